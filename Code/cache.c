@@ -0,0 +1,359 @@
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "data.h"
+#include "hash.h"
+#include "list.h"
+
+// part of every key, bump when the format of an entry or the code made for
+// a function changes so old entries are not reused
+#define CACHE_VERSION 2
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+extern HashTable* ht;
+extern int translateEnabled;
+extern List* IRGenerateExtDef(NodeId node);
+extern void beginSemanticAnalysis();
+extern int semanticAnalysisExtDef(NodeId node);
+extern int declareExtDef(NodeId node);
+extern int isParam(char* name);
+
+// a compiled function, its labels are numbered from 1
+typedef struct {
+  size_t nlabels;
+  char* ir;
+  size_t irsize;
+  char* code;
+  size_t codesize;
+} CacheEntry;
+
+static uint64_t hashBytes(uint64_t h, const void* p, size_t n);
+static uint64_t hashString(uint64_t h, const char* s);
+static uint64_t hashTree(uint64_t h, NodeId node);
+static uint64_t hashType(uint64_t h, Type* t);
+static int isFunction(NodeId extDef);
+static int hasCode(NodeId extDef);
+static void freeEntry(void* e);
+static void compile(NodeId extDef, CacheEntry* e);
+static size_t canonicalLabels(List* codes);
+static char* capture(void (*print)(List*, FILE*), List* ir, size_t* size);
+static int readEntry(const char* path, CacheEntry* e);
+static void writeEntry(const char* path, CacheEntry* e);
+static void writeShifted(const char* text, size_t size, size_t base, int ir,
+                         FILE* fout);
+static int labelAt(const char* text, size_t size, size_t i, int ir);
+
+// check and compile a program one function at a time, a function is looked
+// up in dir by a hash of its tokens and of what the names in it were
+// declared as by the ExtDefs before it. Only a function that is not there
+// is checked in full and compiled, one that is has just its declarations
+// entered, it was checked when it was compiled. Return the compiled
+// functions, or NULL, with nothing checked, if the program has code outside
+// functions
+List* compileCached(NodeId root, const char* dir, const char* salt) {
+  // Program -> ExtDefList
+  NodeId list = getNodeKid(root, 0);
+  for (uint32_t i = 0; i < getNodeKidCount(list); i++) {
+    if (hasCode(getNodeKid(list, i))) return NULL;
+  }
+
+  uint64_t seed = hashBytes(FNV_OFFSET, &(int){CACHE_VERSION}, sizeof(int));
+  seed = hashString(seed, salt);
+
+  beginSemanticAnalysis();
+  List* functions = newList(NULL, freeEntry, NULL);
+  char* path = malloc(strlen(dir) + 32);
+  for (uint32_t i = 0; i < getNodeKidCount(list); i++) {
+    NodeId extDef = getNodeKid(list, i);
+    if (!isFunction(extDef)) {
+      semanticAnalysisExtDef(extDef);
+      continue;
+    }
+
+    sprintf(path, "%s/%016" PRIx64 ".fn", dir, hashTree(seed, extDef));
+    CacheEntry* e = calloc(1, sizeof(CacheEntry));
+    if (readEntry(path, e)) {
+      declareExtDef(extDef);
+    } else {
+      int errors = semanticAnalysisExtDef(extDef);
+      // once the program cannot be translated it is only checked; a
+      // function with errors is translated as usual but not kept
+      if (translateEnabled) {
+        compile(extDef, e);
+        if (errors == 0) writeEntry(path, e);
+      }
+    }
+    listAddNodeTail(functions, e);
+  }
+
+  free(path);
+  return functions;
+}
+
+// write the functions compileCached returned, the labels of each renumbered
+// past those of the functions before it
+void writeCached(List* functions, FILE* fout, FILE* irout) {
+  size_t base = 0;
+  MIPS32Prelude(fout);
+  for (ListNode* node = functions->head; node; node = node->next) {
+    CacheEntry* e = node->value;
+    if (irout) writeShifted(e->ir, e->irsize, base, 1, irout);
+    writeShifted(e->code, e->codesize, base, 0, fout);
+    base += e->nlabels;
+  }
+}
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t h, const void* p, size_t n) {
+  const unsigned char* bytes = p;
+  for (size_t i = 0; i < n; i++) {
+    h ^= bytes[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+static uint64_t hashString(uint64_t h, const char* s) {
+  return hashBytes(h, s, strlen(s) + 1);
+}
+
+// the tokens of a subtree, punctuation aside the tree and the tokens tell
+// each other apart, and what each name in it is declared as so far
+static uint64_t hashTree(uint64_t h, NodeId node) {
+  AstNode* n = &ast.nodes[node];
+  uint32_t shape[3] = {n->type, n->op, n->nkids};
+  h = hashBytes(h, shape, sizeof(shape));
+
+  switch (getNodeType(node)) {
+    case _ID: {
+      char* name = tokenText(node);
+      h = hashString(h, name);
+      HashEntry* he = htFind(ht, name);
+      int declared = he == NULL ? 0 : isParam(name) ? 2 : 1;
+      h = hashBytes(h, &declared, sizeof(int));
+      if (he && htGetEntryVal(he)) h = hashType(h, htGetEntryVal(he));
+      break;
+    }
+    case _TYPE:
+      h = hashString(h, tokenText(node));
+      break;
+    case _INT:
+      h = hashBytes(h, &n->value.val_int, sizeof(int));
+      break;
+    case _FLOAT:
+      h = hashBytes(h, &n->value.val_float, sizeof(float));
+      break;
+    case _Exp:
+      if (getNodeOp(node) == _RELOP) h = hashString(h, tokenText(node));
+      break;
+    default:
+      break;
+  }
+
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    h = hashTree(h, getNodeKid(node, i));
+  }
+  return h;
+}
+
+static uint64_t hashType(uint64_t h, Type* t) {
+  h = hashBytes(h, &t->kind, sizeof(t->kind));
+  switch (t->kind) {
+    case BASIC:
+      return hashBytes(h, &t->basic, sizeof(t->basic));
+    case ARRAY:
+      h = hashBytes(h, &t->array.size, sizeof(int));
+      return hashType(h, t->array.element);
+    case STRUCTURE:
+      h = hashString(h, t->structure.name ? t->structure.name : "");
+      for (FieldList* fl = t->structure.structure; fl; fl = fl->next) {
+        h = hashString(h, fl->name);
+        h = hashType(h, fl->type);
+      }
+      return h;
+    case FUNCTION:
+      h = hashType(h, t->function.returnType);
+      for (FieldList* fl = t->function.params; fl; fl = fl->next) {
+        h = hashType(h, fl->type);
+      }
+      return h;
+  }
+
+  // we should never reach here
+  assert(0);
+  return h;
+}
+
+// ExtDef -> Specifier FunDec CompSt
+static int isFunction(NodeId extDef) {
+  return getNodeKidCount(extDef) == 3;
+}
+
+// return 1 if the ExtDef declares global arrays or structures, the code
+// to declare them is not part of a function
+static int hasCode(NodeId extDef) {
+  if (getNodeKidCount(extDef) != 2) return 0;
+
+  // Specifier -> StructSpecifier
+  NodeId specifier = getNodeKid(extDef, 0);
+  if (getNodeType(getNodeKid(specifier, 0)) == _StructSpecifier) return 1;
+
+  // VarDec -> VarDec LB INT RB
+  NodeId decList = getNodeKid(extDef, 1);
+  for (uint32_t i = 0; i < getNodeKidCount(decList); i++) {
+    if (getNodeKidCount(getNodeKid(decList, i)) == 2) return 1;
+  }
+  return 0;
+}
+
+static void freeEntry(void* e) {
+  free(((CacheEntry*)e)->ir);
+  free(((CacheEntry*)e)->code);
+  free(e);
+}
+
+static void compile(NodeId extDef, CacheEntry* e) {
+  List* ir = IROptimize(IRGenerateExtDef(extDef));
+  e->nlabels = canonicalLabels(ir);
+  e->ir = capture(displayIRCodeList, ir, &e->irsize);
+  e->code = capture(MIPS32GenerateCodes, ir, &e->codesize);
+  freeList(ir);
+  arenaReset(&irArena);
+}
+
+// number the labels of a function from 1 in the order they appear, return
+// how many there are
+static size_t canonicalLabels(List* codes) {
+  size_t max = 0;
+  for (ListNode* node = codes->head; node; node = node->next) {
+    IRCode* ir = node->value;
+    if (ir->kind == IR_LABEL && ir->op->label_no > max) {
+      max = ir->op->label_no;
+    }
+  }
+
+  // the operands are shared between codes, each slot gets a new one
+  size_t* number = calloc(max + 1, sizeof(size_t));
+  size_t count = 0;
+  for (ListNode* node = codes->head; node; node = node->next) {
+    IRCode* ir = node->value;
+    Operand** slot = NULL;
+    if (ir->kind == IR_LABEL || ir->kind == IR_GOTO) {
+      slot = &ir->op;
+    } else if (ir->kind == IR_IF_GOTO) {
+      slot = &ir->label;
+    }
+    if (slot == NULL) continue;
+
+    size_t label_no = (*slot)->label_no;
+    if (number[label_no] == 0) number[label_no] = ++count;
+    *slot = newOperand(OP_LABEL, (void*)number[label_no], NULL);
+  }
+
+  free(number);
+  return count;
+}
+
+// what print writes for ir
+static char* capture(void (*print)(List*, FILE*), List* ir, size_t* size) {
+  FILE* f = tmpfile();
+  if (!f) {
+    perror("tmpfile");
+    exit(1);
+  }
+  print(ir, f);
+
+  *size = ftell(f);
+  rewind(f);
+  char* text = malloc(*size + 1);
+  *size = fread(text, 1, *size, f);
+  text[*size] = '\0';
+  fclose(f);
+  return text;
+}
+
+// an entry is a header line "cmm <version> <labels> <ir bytes> <code bytes>"
+// followed by the IR and the code
+static int readEntry(const char* path, CacheEntry* e) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return 0;
+
+  int version;
+  // the newline is read on its own, "\n" in the format would also skip the
+  // blank line the IR starts with
+  int ok = fscanf(f, "cmm %d %zu %zu %zu", &version, &e->nlabels,
+                  &e->irsize, &e->codesize) == 4 &&
+           fgetc(f) == '\n' && version == CACHE_VERSION;
+  if (ok) {
+    e->ir = malloc(e->irsize + 1);
+    e->code = malloc(e->codesize + 1);
+    ok = fread(e->ir, 1, e->irsize, f) == e->irsize &&
+         fread(e->code, 1, e->codesize, f) == e->codesize;
+    if (!ok) {
+      free(e->ir);
+      free(e->code);
+      e->ir = e->code = NULL;
+    }
+  }
+
+  fclose(f);
+  return ok;
+}
+
+// written next to its place and renamed, a compiler running at the same time
+// reads an entry whole or not at all
+static void writeEntry(const char* path, CacheEntry* e) {
+  char* tmp = malloc(strlen(path) + 5);
+  sprintf(tmp, "%s.tmp", path);
+
+  FILE* f = fopen(tmp, "wb");
+  if (!f) {
+    // the function is simply compiled again next time
+    free(tmp);
+    return;
+  }
+  fprintf(f, "cmm %d %zu %zu %zu\n", CACHE_VERSION, e->nlabels, e->irsize,
+          e->codesize);
+  fwrite(e->ir, 1, e->irsize, f);
+  fwrite(e->code, 1, e->codesize, f);
+  if (fclose(f) != 0 || rename(tmp, path) != 0) remove(tmp);
+  free(tmp);
+}
+
+// copy the IR or the code of a function, adding base to its labels
+static void writeShifted(const char* text, size_t size, size_t base, int ir,
+                         FILE* fout) {
+  size_t start = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (!labelAt(text, size, i, ir)) continue;
+
+    fwrite(text + start, 1, i - start, fout);
+    size_t label_no = 0;
+    for (i++; i < size && isdigit((unsigned char)text[i]); i++) {
+      label_no = label_no * 10 + (text[i] - '0');
+    }
+    fprintf(fout, "l%zu", label_no + base);
+    start = i;
+  }
+  fwrite(text + start, 1, size - start, fout);
+}
+
+// return 1 if a label starts at text[i]: in the IR it follows LABEL or GOTO,
+// as a variable may be named like one, in the code it starts a line or
+// follows a space outside a comment
+static int labelAt(const char* text, size_t size, size_t i, int ir) {
+  if (text[i] != 'l' || i + 1 >= size ||
+      !isdigit((unsigned char)text[i + 1])) {
+    return 0;
+  }
+
+  if (ir) {
+    return (i >= 6 && strncmp(text + i - 6, "LABEL ", 6) == 0) ||
+           (i >= 5 && strncmp(text + i - 5, "GOTO ", 5) == 0);
+  }
+  if (i == 0 || text[i - 1] == '\n') return 1;
+  return text[i - 1] == ' ' && !(i >= 2 && text[i - 2] == '#');
+}
@@ -6,40 +6,195 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "hash.h"
+
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+
 extern char* strdup(const char*);
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+
+// the names belong to the field list of the structure
+static HtType fieldType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                           .keyDup = NULL,
+                           .valDup = NULL,
+                           .keyCompare = keyCompare,
+                           .keyDestructor = NULL,
+                           .valDestructor = NULL};
+
+// the names taken out of the source, see tokenText
+static HtType nameType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                          .keyDup = NULL,
+                          .valDup = NULL,
+                          .keyCompare = keyCompare,
+                          .keyDestructor = NULL,
+                          .valDestructor = NULL};
+static HashTable* names = NULL;
 
 /*-------------------lexical analysis and syntax analysis-------------------*/
-Val val_str(const char* s) { return (Val){.val_str = strdup(s)}; }
+// node 0 stands for no node
+SyntaxTree ast = {.nnodes = 1};
+
+// while parsing, the element following a list element
+static NodeId* links = NULL;
+
+static NodeId allocNode(Node_type type, Node_type op, Val val,
+                        unsigned int lineno) {
+  if (ast.nnodes >= ast.capacity) {
+    ast.capacity = ast.capacity ? ast.capacity * 2 : 1024;
+    ast.nodes = realloc(ast.nodes, sizeof(AstNode) * ast.capacity);
+    links = realloc(links, sizeof(NodeId) * ast.capacity);
+    // the semantic analysis may run while parsing, see streamExtDef
+    if (ast.info) {
+      ast.info = realloc(ast.info, sizeof(NodeInfo) * ast.capacity);
+    }
+  }
+  NodeId n = ast.nnodes++;
+  ast.nodes[n] = (AstNode){.type = type, .op = op, .lineno = lineno,
+                           .value = val};
+  links[n] = 0;
+  if (ast.info) ast.info[n] = (NodeInfo){0};
+  return n;
+}
 
-MBTreeNode* newMBTreeNodeData(Val val, Node_type type, unsigned int lineno) {
-  Data* data = (Data*)malloc(sizeof(Data));
-  *data = (Data){.type = type, .value = val, .lineno = lineno};
-  return newMBTreeNode(data);
+// room for n children next to each other
+static uint32_t allocKids(uint32_t n) {
+  if (ast.nkids + n > ast.kids_capacity) {
+    while (ast.nkids + n > ast.kids_capacity) {
+      ast.kids_capacity = ast.kids_capacity ? ast.kids_capacity * 2 : 1024;
+    }
+    ast.kids = realloc(ast.kids, sizeof(NodeId) * ast.kids_capacity);
+  }
+  uint32_t first = ast.nkids;
+  ast.nkids += n;
+  return first;
 }
 
-void displayMBTreeNode(const MBTreeNode* node, unsigned indent) {
-  if (node == NULL || getMBTreeNodeType(node) == _Empty) return;
-  if (node->firstChild != NULL && getMBTreeNodeType(node->firstChild) == _Empty)
-    return;
+// lay the elements of a list out as its children
+static void closeList(NodeId list) {
+  uint32_t first = allocKids(ast.nodes[list].nkids);
+  NodeId elem = ast.nodes[list].kids;
+  for (uint32_t i = 0; i < ast.nodes[list].nkids; i++, elem = links[elem]) {
+    ast.kids[first + i] = elem;
+  }
+  ast.nodes[list].kids = first;
+  ast.nodes[list].open = 0;
+}
+
+char* tokenText(NodeId node) {
+  Slice slice = getNodeValue(node).val_slice;
+  char* text = malloc(slice.length + 1);
+  memcpy(text, source + slice.offset, slice.length);
+  text[slice.length] = '\0';
+
+  if (names == NULL) names = htCreate(&nameType, NULL);
+  HashEntry* entry = htFind(names, text);
+  if (entry) {
+    free(text);
+    return htGetEntryVal(entry);
+  }
+  htAdd(names, text, text);
+  return text;
+}
+
+int tokenIs(NodeId node, const char* s) {
+  Slice slice = getNodeValue(node).val_slice;
+  return strlen(s) == slice.length &&
+         strncmp(source + slice.offset, s, slice.length) == 0;
+}
+
+NodeId newAstLeaf(Val val, Node_type type, unsigned int lineno) {
+  return allocNode(type, _Empty, val, lineno);
+}
+
+NodeId newAstNode(Node_type type, Node_type op, unsigned int lineno,
+                  int nkids, ...) {
+  NodeId n = allocNode(type, op, VAL_EMPTY, lineno);
+
+  va_list args;
+  va_start(args, nkids);
+  uint32_t first = allocKids(nkids);
+  for (int i = 0; i < nkids; i++) {
+    NodeId kid = va_arg(args, NodeId);
+    ast.kids[first + i] = kid;
+  }
+  va_end(args);
+
+  // a list is complete once the node holding it is made
+  for (int i = 0; i < nkids; i++) {
+    NodeId kid = ast.kids[first + i];
+    if (kid != 0 && ast.nodes[kid].open) closeList(kid);
+  }
+
+  ast.nodes[n].kids = first;
+  ast.nodes[n].nkids = nkids;
+  return n;
+}
+
+NodeId newAstList(Node_type type, unsigned int lineno) {
+  NodeId n = allocNode(type, _Empty, VAL_EMPTY, lineno);
+  ast.nodes[n].open = 1;
+  return n;
+}
+
+NodeId prependAstNode(NodeId list, NodeId elem, unsigned int lineno) {
+  // after a syntax error the list may be any node, the tree is dropped
+  if (list == 0 || !ast.nodes[list].open) {
+    list = newAstList(_Empty, lineno);
+  }
+  if (elem == 0) return list;
+
+  // while open, kids is the first element and the rest follow links
+  links[elem] = ast.nodes[list].nkids ? ast.nodes[list].kids : 0;
+  ast.nodes[list].kids = elem;
+  ast.nodes[list].nkids++;
+  ast.nodes[list].lineno = lineno;
+  return list;
+}
+
+AstMark markAst() { return (AstMark){ast.nnodes, ast.nkids}; }
+
+NodeId releaseAst(AstMark mark, NodeId keep) {
+  AstNode leaf = keep ? ast.nodes[keep] : (AstNode){0};
+  ast.nnodes = mark.nnodes;
+  ast.nkids = mark.nkids;
+  if (keep == 0) return 0;
+
+  // a leaf has no children to move along
+  assert(leaf.nkids == 0);
+  return allocNode(leaf.type, leaf.op, leaf.value, leaf.lineno);
+}
+
+void displayAstNode(NodeId node, unsigned indent) {
+  if (node == 0) return;
 
   for (int i = 0; i < indent; i++) {
     printf(" ");
   }
-  if (is_non_terminal(getMBTreeNodeType(node))) {
-    printf("%s (%u)\n", type_strs[getMBTreeNodeType(node)],
-           getMBTreeNodeLineNo(node));
+  Node_type type = getNodeType(node);
+  if (is_non_terminal(type)) {
+    printf("%s (%u)", type_strs[type], getNodeLineNo(node));
+    if (getNodeOp(node) != _Empty) {
+      printf(" %s", type_strs[getNodeOp(node)]);
+    }
+    if (getNodeOp(node) == _RELOP) {
+      Slice slice = getNodeValue(node).val_slice;
+      printf(": %.*s", (int)slice.length, source + slice.offset);
+    }
+    printf("\n");
   } else {
-    printf("%s", type_strs[getMBTreeNodeType(node)]);
-    switch (getMBTreeNodeType(node)) {
+    printf("%s", type_strs[type]);
+    switch (type) {
       case _ID:
-      case _TYPE:
-        printf(": %s\n", getMBTreeNodeValue(node).val_str);
+      case _TYPE: {
+        Slice slice = getNodeValue(node).val_slice;
+        printf(": %.*s\n", (int)slice.length, source + slice.offset);
         break;
+      }
       case _INT:
-        printf(": %d\n", getMBTreeNodeValue(node).val_int);
+        printf(": %d\n", getNodeValue(node).val_int);
         break;
       case _FLOAT:
-        printf(": %f\n", getMBTreeNodeValue(node).val_float);
+        printf(": %f\n", getNodeValue(node).val_float);
         break;
       default:
         printf("\n");
@@ -47,9 +202,8 @@ void displayMBTreeNode(const MBTreeNode* node, unsigned indent) {
     }
   }
 
-  for (MBTreeNode* child = node->firstChild; child != NULL;
-       child = child->nextSibling) {
-    displayMBTreeNode(child, indent + 2);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    displayAstNode(getNodeKid(node, i), indent + 2);
   }
 }
 
@@ -65,7 +219,8 @@ Type* newTypeStructure(char* name, FieldList* structure) {
   *t = (Type){.kind = STRUCTURE,
               .structure.name = strdup(name),
               .structure.structure = copyFieldList(structure),
-              .structure.memSize = 0};
+              .structure.memSize = 0,
+              .structure.layout = NULL};
   return t;
 }
 
@@ -125,6 +280,11 @@ void freeType(Type* t) {
     } else if (t->kind == STRUCTURE) {
       free(t->structure.name);
       freeFieldList(t->structure.structure);
+      if (t->structure.layout) {
+        htRelease(t->structure.layout->byName);
+        free(t->structure.layout->fields);
+        free(t->structure.layout);
+      }
     } else if (t->kind == FUNCTION) {
       freeType(t->function.returnType);
       freeFieldList(t->function.params);
@@ -188,7 +348,8 @@ Type* copyTypeStructure(Type* t) {
       (Type){.kind = STRUCTURE,
              .structure.name = strdup(t->structure.name),
              .structure.structure = copyFieldList(t->structure.structure),
-             .structure.memSize = t->structure.memSize};
+             .structure.memSize = t->structure.memSize,
+             .structure.layout = NULL};
 
   return newType;
 }
@@ -246,6 +407,41 @@ FieldList* copyFieldList(FieldList* fl) {
   return newFieldList;
 }
 
+StructLayout* getStructLayout(Type* t) {
+  assert(t->kind == STRUCTURE);
+  if (t->structure.layout) {
+    return t->structure.layout;
+  }
+
+  StructLayout* layout = malloc(sizeof(StructLayout));
+  layout->nfields = 0;
+  for (FieldList* fl = t->structure.structure; fl; fl = fl->next) {
+    layout->nfields++;
+  }
+  layout->fields = malloc(sizeof(FieldLayout) * (layout->nfields + 1));
+  layout->byName = htCreate(&fieldType, NULL);
+
+  // the fields follow each other without padding
+  size_t offset = 0;
+  int index = 0;
+  for (FieldList* fl = t->structure.structure; fl; fl = fl->next) {
+    FieldLayout* field = &layout->fields[index];
+    *field = (FieldLayout){.field = fl, .index = index, .offset = offset};
+    htAdd(layout->byName, fl->name, field);
+    offset += getMemSize(fl->type);
+    index++;
+  }
+  t->structure.memSize = offset;
+
+  t->structure.layout = layout;
+  return layout;
+}
+
+FieldLayout* findField(Type* t, char* name) {
+  HashEntry* he = htFind(getStructLayout(t)->byName, name);
+  return he ? htGetEntryVal(he) : NULL;
+}
+
 /*--------------------------------ir generate--------------------------------*/
 size_t getMemSize(Type* t) {
   if (t == NULL || t->kind == FUNCTION) {
@@ -261,12 +457,8 @@ size_t getMemSize(Type* t) {
       }
       return t->array.memSize;
     case STRUCTURE: {
-      if (t->structure.memSize == 0) {
-        FieldList* fl = t->structure.structure;
-        while (fl) {
-          t->structure.memSize += getMemSize(fl->type);
-          fl = fl->next;
-        }
+      if (t->structure.layout == NULL) {
+        getStructLayout(t);
       }
       return t->structure.memSize;
     }
@@ -277,8 +469,10 @@ size_t getMemSize(Type* t) {
   }
 }
 
+Arena irArena;
+
 Operand* newOperand(int kind, void* val, Type* type) {
-  Operand* op = malloc(sizeof(Operand));
+  Operand* op = arenaAlloc(&irArena, sizeof(Operand));
   *op = (Operand){.kind = kind, .type = type};
   switch (kind) {
     case OP_CONSTANT:
@@ -307,41 +501,47 @@ Operand* newOperand(int kind, void* val, Type* type) {
   return op;
 }
 
-char* operand2str(Operand* op) {
-  char* str = malloc(32);
+// print the name of an operand into buf, return its length
+static int formatOperand(char* buf, size_t size, Operand* op) {
   switch (op->kind) {
     case OP_CONSTANT:
-      sprintf(str, "#%" PRIdPTR, op->constant);
-      break;
+      return snprintf(buf, size, "#%" PRIdPTR, op->constant);
     case OP_TEMP:
-      sprintf(str, "t%zu", op->temp_no);
-      break;
+      return snprintf(buf, size, "t%zu", op->temp_no);
     case OP_LABEL:
-      sprintf(str, "l%zu", op->label_no);
-      break;
+      return snprintf(buf, size, "l%zu", op->label_no);
     case OP_FUNCTION:
-      sprintf(str, "%s", op->func_name);
-      break;
+      return snprintf(buf, size, "%s", op->func_name);
     case OP_VARIABLE:
-      sprintf(str, "%s", op->var_name);
-      break;
+      return snprintf(buf, size, "%s", op->var_name);
     case OP_ADDRESS:
-      sprintf(str, "%s", op->base_name);
-      break;
+      return snprintf(buf, size, "%s", op->base_name);
     default:
       // we should never reach here
       assert(0);
-      break;
+      return 0;
   }
+}
+
+char* operand2str(Operand* op) {
+  int n = formatOperand(NULL, 0, op);
+  char* str = malloc(n + 1);
+  formatOperand(str, n + 1, op);
+  return str;
+}
+
+char* operandName(Arena* arena, Operand* op) {
+  int n = formatOperand(NULL, 0, op);
+  char* str = arenaAlloc(arena, n + 1);
+  formatOperand(str, n + 1, op);
   return str;
 }
 
 void operandTmp2Addr(Operand* op) {
   assert(op->kind == OP_TEMP);
 
+  char* name = operandName(&irArena, op);
   op->kind = OP_ADDRESS;
-  char* name = malloc(32);
-  sprintf(name, "t%zu", op->temp_no);
   op->base_name = name;
 }
 
@@ -349,8 +549,9 @@ IRCode* newIRCode(int kind, ...) {
   va_list ap;
   va_start(ap, kind);
 
-  IRCode* ir = malloc(sizeof(IRCode));
+  IRCode* ir = arenaAlloc(&irArena, sizeof(IRCode));
   ir->kind = kind;
+  ir->count = -1;
 
   switch (kind) {
     case IR_LABEL:
@@ -389,6 +590,12 @@ IRCode* newIRCode(int kind, ...) {
       ir->op_r = va_arg(ap, Operand*);
       ir->label = va_arg(ap, Operand*);
       break;
+    case IR_COMPARE:
+      ir->cmp = va_arg(ap, Operand*);
+      ir->cmp_l = va_arg(ap, Operand*);
+      ir->cmp_relop = va_arg(ap, char*);
+      ir->cmp_r = va_arg(ap, Operand*);
+      break;
     default:
       // we should never reach here
       assert(0);
@@ -407,7 +614,7 @@ void printIRCode(FILE* fout, IRCode* ir) {
       "*%s := %s\n",     "GOTO %s\n",         "IF %s %s %s GOTO %s\n",
       "RETURN %s\n",     "DEC %s %d\n",       "ARG %s\n",
       "%s := CALL %s\n", "PARAM %s\n",        "READ %s\n",
-      "WRITE %s\n",
+      "WRITE %s\n",       "%s := %s %s %s\n",
   };
 
   char *s1 = NULL, *s2 = NULL, *s3 = NULL;
@@ -452,6 +659,12 @@ void printIRCode(FILE* fout, IRCode* ir) {
       s3 = operand2str(ir->label);
       fprintf(fout, ir_template[ir->kind], s1, ir->relop, s2, s3);
       break;
+    case IR_COMPARE:
+      s1 = operand2str(ir->cmp);
+      s2 = operand2str(ir->cmp_l);
+      s3 = operand2str(ir->cmp_r);
+      fprintf(fout, ir_template[ir->kind], s1, s2, ir->cmp_relop, s3);
+      break;
     default:
       // we should never reach here
       assert(0);
@@ -483,8 +696,111 @@ void displayIRCodeList(List* ir, FILE* out) {
 
 /*------------------------------mips32 generate------------------------------*/
 
-Variable* newVariable(Operand* op, int offset, int reg) {
-  Variable* var = malloc(sizeof(Variable));
+Variable* newVariable(Arena* arena, Operand* op, int offset, int reg) {
+  Variable* var = arenaAlloc(arena, sizeof(Variable));
   *var = (Variable){.op = op, .offset = offset, .reg = reg};
   return var;
-}
\ No newline at end of file
+}
+
+Instr* newInstr(Arena* arena, int op, int rd, int rs, int rt, intptr_t imm,
+                char* label) {
+  Instr* ins = arenaAlloc(arena, sizeof(Instr));
+  *ins = (Instr){.op = op,
+                 .rd = rd,
+                 .rs = rs,
+                 .rt = rt,
+                 .imm = imm,
+                 .label = label,
+                 .comment = NULL};
+  return ins;
+}
+
+void printInstr(Instr* ins, FILE* fout) {
+  static const char* names[] = {
+      NULL,   "addu",  "subu", "mul",   "slt",  "sltu", "and",  "or",
+      "xor",  "addiu", "slti", "sltiu", "andi", "ori",  "xori", "sll",
+      "srl",  "sra",   "mult", "div",   "mfhi", "mflo", "li",   "la",
+      "move", "lw",    "sw",   "beq",   "bne",  "bltz", "bgez", "blez",
+      "bgtz", "j",     "jal",  "jr",    "nop"};
+  const char* rd = register_names[ins->rd];
+  const char* rs = register_names[ins->rs];
+  const char* rt = register_names[ins->rt];
+  const char* name = names[ins->op];
+
+  switch (ins->op) {
+    case INS_LABEL:
+      fprintf(fout, "%s:\n", ins->label);
+      return;
+    case INS_ADDU:
+    case INS_SUBU:
+    case INS_MUL:
+    case INS_SLT:
+    case INS_SLTU:
+    case INS_AND:
+    case INS_OR:
+    case INS_XOR:
+      fprintf(fout, "\t%s %s, %s, %s", name, rd, rs, rt);
+      break;
+    case INS_ADDIU:
+    case INS_SLTI:
+    case INS_SLTIU:
+    case INS_ANDI:
+    case INS_ORI:
+    case INS_XORI:
+    case INS_SLL:
+    case INS_SRL:
+    case INS_SRA:
+      fprintf(fout, "\t%s %s, %s, %" PRIdPTR, name, rd, rs, ins->imm);
+      break;
+    case INS_MULT:
+    case INS_DIV:
+      fprintf(fout, "\t%s %s, %s", name, rs, rt);
+      break;
+    case INS_MFHI:
+    case INS_MFLO:
+      fprintf(fout, "\t%s %s", name, rd);
+      break;
+    case INS_LI:
+      fprintf(fout, "\t%s %s, %" PRIdPTR, name, rd, ins->imm);
+      break;
+    case INS_LA:
+      fprintf(fout, "\t%s %s, %s", name, rd, ins->label);
+      break;
+    case INS_MOVE:
+      fprintf(fout, "\t%s %s, %s", name, rd, rs);
+      break;
+    case INS_LW:
+      fprintf(fout, "\t%s %s, %" PRIdPTR "(%s)", name, rd, ins->imm, rs);
+      break;
+    case INS_SW:
+      fprintf(fout, "\t%s %s, %" PRIdPTR "(%s)", name, rt, ins->imm, rs);
+      break;
+    case INS_BEQ:
+    case INS_BNE:
+      fprintf(fout, "\t%s %s, %s, %s", name, rs, rt, ins->label);
+      break;
+    case INS_BLTZ:
+    case INS_BGEZ:
+    case INS_BLEZ:
+    case INS_BGTZ:
+      fprintf(fout, "\t%s %s, %s", name, rs, ins->label);
+      break;
+    case INS_J:
+    case INS_JAL:
+      fprintf(fout, "\t%s %s", name, ins->label);
+      break;
+    case INS_JR:
+      fprintf(fout, "\t%s %s", name, rs);
+      break;
+    case INS_NOP:
+      fprintf(fout, "\t%s", name);
+      break;
+    default:
+      // we should never reach here
+      assert(0);
+      break;
+  }
+
+  if (ins->comment) fprintf(fout, " # %s", ins->comment);
+  fprintf(fout, "\n");
+}
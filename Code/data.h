@@ -7,8 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "list.h"
-#include "mbtree.h"
 
 /*-------------------lexical analysis and syntax analysis-------------------*/
 // the type of a node
@@ -83,35 +83,107 @@ const static char* type_strs[] = {
     "Dec",        "Exp",        "Args",
 };
 
+// the text of a token, a slice of the source, see tokenText
+typedef struct {
+  unsigned int offset;
+  unsigned int length;
+} Slice;
+
 // the value of a node
 typedef union {
   int val_int;
   float val_float;
-  char* val_str;
+  Slice val_slice;  // ID, TYPE and RELOP
 } Val;
 
 #define VAL_EMPTY \
-  (Val) { .val_str = NULL }
+  (Val) { .val_int = 0 }
 #define VAL_INT(x) \
   (Val) { .val_int = atoi(x) }
 #define VAL_FLOAT(x) \
   (Val) { .val_float = atof(x) }
-
-// the data structure of a node
+#define VAL_SLICE(o, l) \
+  (Val) { .val_slice = {.offset = (o), .length = (l)} }
+
+// the program being compiled, the lexer scans it in place
+extern char* source;
+
+// a node of the syntax tree, named by its index in ast.nodes, 0 is no node
+typedef uint32_t NodeId;
+
+// punctuation and keywords get no node, a node keeps the children the
+// production it stands for has in a fixed layout, and op tells apart the
+// productions of a Stmt or an Exp:
+//   Stmt   _Exp [Exp], _CompSt [CompSt], _RETURN [Exp], _WHILE [Exp, Stmt],
+//          _IF [Exp, Stmt] or [Exp, Stmt, Stmt] with an else
+//   Exp    _ASSIGNOP, _AND, _OR, _RELOP, _PLUS, _MINUS, _STAR, _DIV [Exp, Exp],
+//          the text of a RELOP is the value of the Exp
+//          _LB [Exp, Exp], _DOT [Exp, ID], _LP [Exp] in parentheses,
+//          _MINUS and _NOT [Exp], _ID [ID], _INT [INT], _FLOAT [FLOAT],
+//          _Args [ID] or [ID, Args] for a call
+// the other nodes have op _Empty and are told apart by their children, and
+// the lists ExtDefList, ExtDecList, VarList, StmtList, DefList, DecList and
+// Args hold their elements as children
 typedef struct {
-  Node_type type;
-  Val value;
+  uint8_t type;  // Node_type
+  uint8_t op;    // Node_type
+  uint8_t open;  // a list still being parsed, see prependAstNode
   unsigned int lineno;
-} Data;
+  Val value;
+  uint32_t kids;  // the children are ast.kids[kids] onwards
+  uint32_t nkids;
+} AstNode;
 
-#define getMBTreeNodeType(node) (((Data*)node->data)->type)
-#define getMBTreeNodeValue(node) (((Data*)node->data)->value)
-#define getMBTreeNodeLineNo(node) (((Data*)node->data)->lineno)
+typedef struct NodeInfo NodeInfo;
 
-Val val_str(const char* s);
-MBTreeNode* newMBTreeNodeData(Val val, Node_type type, unsigned int lineno);
+// the nodes of the tree, and the indices of their children next to each
+// other
+typedef struct {
+  AstNode* nodes;
+  uint32_t nnodes, capacity;
+  NodeId* kids;
+  uint32_t nkids, kids_capacity;
+  NodeInfo* info;  // by node, filled in by the semantic analysis
+} SyntaxTree;
+
+extern SyntaxTree ast;
+
+#define getNodeType(n) ((Node_type)ast.nodes[n].type)
+#define getNodeOp(n) ((Node_type)ast.nodes[n].op)
+#define getNodeValue(n) (ast.nodes[n].value)
+#define getNodeLineNo(n) (ast.nodes[n].lineno)
+#define getNodeKidCount(n) (ast.nodes[n].nkids)
+#define getNodeKid(n, i) (ast.kids[ast.nodes[n].kids + (i)])
+#define getNodeInfo(n) (ast.info[n])
+
+// the text of an ID, TYPE or RELOP node, copied out of the source once for
+// every distinct name
+char* tokenText(NodeId node);
+// return 1 if the text of an ID, TYPE or RELOP node is s
+int tokenIs(NodeId node, const char* s);
+// a token carrying a value: ID, TYPE, INT, FLOAT or RELOP
+NodeId newAstLeaf(Val val, Node_type type, unsigned int lineno);
+// a node with nkids children given in order
+NodeId newAstNode(Node_type type, Node_type op, unsigned int lineno,
+                  int nkids, ...);
+// an empty list, the grammar builds lists from the back so elements are put
+// in front of it until the node holding the list is made
+NodeId newAstList(Node_type type, unsigned int lineno);
+NodeId prependAstNode(NodeId list, NodeId elem, unsigned int lineno);
+// the end of the tree, to drop the nodes made after it
+typedef struct {
+  uint32_t nnodes, nkids;
+} AstMark;
+AstMark markAst();
+// drop the nodes and children made after mark but the leaf keep, if not 0,
+// which moves down to the first free node; return where keep is now
+NodeId releaseAst(AstMark mark, NodeId keep);
 // print the tree
-void displayMBTreeNode(const MBTreeNode* node, unsigned indent);
+void displayAstNode(NodeId node, unsigned indent);
+// compile the program while it is parsed, see stream.c
+void beginStream(FILE* fout, FILE* irout);
+NodeId streamExtDef(NodeId extDef, NodeId* lookahead);
+int endStream();
 
 static inline int is_non_terminal(const Node_type type) {
   return type >= _Program && type < _Empty;
@@ -120,6 +192,7 @@ static inline int is_non_terminal(const Node_type type) {
 /*-----------------------------semantic analysis-----------------------------*/
 typedef struct Type Type;
 typedef struct FieldList FieldList;
+typedef struct StructLayout StructLayout;
 
 // the type of a symbol
 struct Type {
@@ -139,6 +212,8 @@ struct Type {
       FieldList* structure;
       // the size of the structure in memory, in bytes
       size_t memSize;
+      // built on the first member access, see getStructLayout
+      StructLayout* layout;
     } structure;
 
     struct {
@@ -155,9 +230,38 @@ struct FieldList {
   FieldList* next;
 };
 
+// where a field lives in its structure
+typedef struct FieldLayout {
+  FieldList* field;
+  int index;
+  size_t offset;
+} FieldLayout;
+
+// the fields of a structure type by name, never changed once built
+struct StructLayout {
+  struct HashTable* byName;  // field name -> FieldLayout*
+  FieldLayout* fields;
+  int nfields;
+};
+
+// what the semantic analysis resolved a node to, so the IR generation looks
+// nothing up again
+struct NodeInfo {
+  Type* type;  // of an Exp
+  // the symbol table entry a VarDec, a FunDec, an ID Exp or a call names
+  struct HashEntry* symbol;
+  FieldLayout* field;  // of an Exp DOT ID, NULL if there is no such member
+  char* relop;         // of an Exp RELOP Exp
+  int param;           // an ID Exp naming a parameter
+};
+
 void freeType(Type* t);
 void freeFieldList(FieldList* fl);
 
+StructLayout* getStructLayout(Type* t);
+// the layout of a field of a structure type, NULL if there is no such field
+FieldLayout* findField(Type* t, char* name);
+
 int typeEqual(Type* a, Type* b);
 int fieldListEqual(FieldList* a, FieldList* b);
 
@@ -251,9 +355,16 @@ typedef struct Operand {
   Type* type;
 } Operand;
 
+// the IRCodes and the Operands, given back once the code they make up is
+// written, see compile in stream.c
+extern Arena irArena;
+
 Operand* newOperand(int kind, void* val, Type* type);
 void operandTmp2Addr(Operand* op);
+// the name of an operand, malloc'ed for the caller to free
 char* operand2str(Operand* op);
+// the same, allocated from arena
+char* operandName(Arena* arena, Operand* op);
 
 typedef struct IRCode {
   enum {
@@ -275,7 +386,8 @@ typedef struct IRCode {
     IR_CALL,       // x := call f
     IR_PARAM,      // param x
     IR_READ,       // read x
-    IR_WRITE       // write x
+    IR_WRITE,      // write x
+    IR_COMPARE     // x := y [relop] z, only made by the backend
   } kind;
   union {
     struct {
@@ -301,12 +413,216 @@ typedef struct IRCode {
       Operand* op_r;
       Operand* label;
     };  // IR_IF_GOTO
+    struct {
+      Operand* cmp;
+      Operand* cmp_l;
+      char* cmp_relop;
+      Operand* cmp_r;
+    };  // IR_COMPARE, cmp is 1 if the relation holds and 0 if not
   };
+  long count;  // the times it ran in the profile, -1 if not known
 } IRCode;
 
 IRCode* newIRCode(int kind, ...);
 void printIRCode(FILE* fout, IRCode* ir);
 void displayIRCodeList(List* ir, FILE* out);
+// parse the text displayIRCodeList writes, see ir_parse.c
+List* parseIR(char* text, size_t size, const char* path);
+// the first code of IR read from a file the passes cannot take, NULL if
+// there is none; why is set to the reason
+ListNode* findBrokenCode(List* ir, const char** why);
+// the largest label or temp number IR read from a file may use, the passes
+// keep arrays indexed by them
+#define MAX_IR_NUMBER (1 << 20)
+
+// allocate a fresh label / temp number, shared by the generator and the passes
+size_t newLabelNo();
+size_t newTempNo();
+// make the fresh numbers start past those of IR read from a file
+void reserveIRNumbers(size_t label_no, size_t temp_no);
+
+// evaluate a op b with 32-bit wrap-around, return 0 if it would trap
+int foldConstant(int kind, intptr_t a, intptr_t b, intptr_t* value);
+// the x of an arithmetic code x + 0, 0 + x, x - 0, x * 1, 1 * x or x / 1,
+// NULL for any other code
+Operand* identityOperand(IRCode* ir);
+
+/*---------------------------------ir image----------------------------------*/
+// the IR in a binary file, read back by mapping it, see ir_image.c
+#define IR_IMAGE_MAGIC "CMIR"
+#define IR_IMAGE_VERSION 1
+#define IR_IMAGE_NO_NAME UINT32_MAX  // of the codes before the first function
+#define IR_IMAGE_NO_OPERAND UINT8_MAX
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t nsections;
+  uint32_t ncodes;
+  uint32_t nstrings;
+  uint32_t text_size;  // the bytes of the strings
+} IRImageHeader;
+
+// the codes of a function
+typedef struct {
+  uint32_t name;  // string index
+  uint32_t first;
+  uint32_t ncodes;
+} IRImageSection;
+
+typedef struct {
+  uint8_t kind;  // of an Operand, IR_IMAGE_NO_OPERAND for an unused slot
+  uint8_t pad[3];
+  int32_t value;  // the constant, temp or label number or a string index
+} IRImageOperand;
+
+// the operands are in the order newIRCode takes them
+typedef struct {
+  uint8_t kind;   // of an IRCode
+  uint8_t relop;  // of an IR_IF_GOTO, "==", "!=", "<", ">=", ">" or "<="
+  uint16_t pad;
+  int32_t size;  // of an IR_DEC
+  IRImageOperand ops[3];
+} IRImageCode;
+
+typedef struct {
+  uint32_t offset;  // in the text
+  // of the array or structure a variable or address of this name stands
+  // for, names are unique in a program
+  uint32_t size;
+} IRImageString;
+
+// an image mapped into memory
+typedef struct {
+  char* base;
+  size_t size;
+  IRImageHeader* header;
+  IRImageSection* sections;
+  IRImageCode* codes;
+  IRImageString* strings;
+  char* text;
+} IRImage;
+
+int writeIRImage(List* ir, FILE* fout);
+IRImage* mapIRImage(const char* path, int* broken);
+void unmapIRImage(IRImage* image);
+List* loadIRImage(IRImage* image, const char* path);
+
+/*--------------------------------ir optimize--------------------------------*/
+
+// a maximal straight-line run of IR codes, entered only at the top
+typedef struct BasicBlock {
+  List* codes;  // IRCode* of the block, the leading IR_LABELs included
+  int succ[2];  // successor block ids, -1 if absent
+  int nsucc;
+  int* preds;  // predecessor block ids
+  int npred;
+  int rpo;   // position in reverse postorder, -1 if unreachable
+  int idom;  // immediate dominator, -1 for the entry and unreachable blocks
+  int loop;  // innermost loop containing the block, -1 if none
+} BasicBlock;
+
+// a natural loop, identified by its header block
+typedef struct Loop {
+  int header;
+  int parent;  // enclosing loop, -1 for an outermost loop
+  int depth;   // 1 for an outermost loop
+  char* body;  // body[b] != 0 if block b belongs to the loop
+  int nblocks;
+} Loop;
+
+// the control flow graph of one function
+typedef struct CFG {
+  List* prologue;  // IR_FUNCTION and IR_PARAM codes
+  BasicBlock** blocks;  // in layout order, block 0 is the entry
+  int nblocks;
+  int capacity;
+  int* order;  // reachable block ids in reverse postorder
+  int nreach;
+
+  // natural loops, sorted from the innermost outwards
+  Loop* loops;
+  int nloops;
+
+  // dense numbering of the variables, temps and addresses of the function
+  struct HashTable* varIds;
+  Operand** vars;
+  int nvars;
+  int varCapacity;
+
+  // liveness, one bit set of nvars bits per block
+  uint32_t** liveIn;
+  uint32_t** liveOut;
+} CFG;
+
+#define BITSET_WORDS(n) (((n) + 31) / 32)
+#define bitTest(set, i) (((set)[(i) >> 5] >> ((i)&31)) & 1)
+#define bitSet(set, i) ((set)[(i) >> 5] |= 1u << ((i)&31))
+#define bitClear(set, i) ((set)[(i) >> 5] &= ~(1u << ((i)&31)))
+
+// build the CFG of a function, codes starts with its IR_FUNCTION
+CFG* newCFG(List* codes);
+void freeCFG(CFG* cfg);
+// concatenate the prologue and the blocks back into one list
+List* cfgLinearize(CFG* cfg);
+// recompute edges, reverse postorder and dominators after the blocks changed
+void cfgAnalyze(CFG* cfg);
+int cfgDominates(CFG* cfg, int a, int b);
+// insert a new block holding codes at layout position pos
+void cfgInsertBlock(CFG* cfg, int pos, List* codes);
+// insert n new blocks at layout position pos, they may jump to each other
+void cfgInsertBlocks(CFG* cfg, int pos, List** codes, int n);
+// remove block b, the codes it still holds go with it
+void cfgRemoveBlock(CFG* cfg, int b);
+// get the label of a block, adding a fresh one if it has none
+Operand* cfgBlockLabel(CFG* cfg, int b);
+// find the natural loops, requires up-to-date dominators
+void cfgFindLoops(CFG* cfg);
+// number every variable operand and compute live variables per block
+void cfgLiveness(CFG* cfg);
+// dense id of a variable operand, -1 for constants, labels and functions
+int cfgVarId(CFG* cfg, Operand* op);
+
+// the operand written by an IR code, NULL if it writes none
+Operand** irDefOperand(IRCode* ir);
+// the operands read by an IR code, returns how many were stored in uses
+int irUseOperands(IRCode* ir, Operand** uses[3]);
+int isVarOperand(Operand* op);
+int sameOperand(Operand* a, Operand* b);
+
+// optimization entry, rewrites the IR of every function
+List* IROptimize(List* ir);
+
+// passes
+void loopInvariantCodeMotion(CFG* cfg);
+void inductionVariableReduction(CFG* cfg);
+void deadCodeElimination(CFG* cfg);
+void propagateCopies(CFG* cfg);
+void simplifyBranches(CFG* cfg);
+void eliminateTailRecursion(CFG* cfg);
+void globalValueNumbering(CFG* cfg);
+void unrollLoops(CFG* cfg);
+// the relop testing the opposite, used by the passes rewriting branches
+char* invertRelop(char* relop);
+// return 1 if a relop b holds
+int relopHolds(intptr_t a, char* relop, intptr_t b);
+// move the blocks the profile never saw run to the end of the function
+void layoutBlocks(CFG* cfg);
+
+/*----------------------------------profile-----------------------------------*/
+
+// written by an instrumented program before its counts, "PROF"
+#define PROFILE_MAGIC 1347571526
+
+// count the runs of every label and function in the generated program
+extern int instrument;
+// a profile was read, see readProfile
+extern int hasProfile;
+
+int readProfile(const char* path);
+void attachProfile(List* ir);
+long blockCount(CFG* cfg, int b);
+List* orderFunctions(List* ir);
 
 /*------------------------------mips32 generate------------------------------*/
 
@@ -316,7 +632,7 @@ typedef struct Variable {
   int reg;
 } Variable;
 
-Variable* newVariable(Operand* op, int offset, int reg);
+Variable* newVariable(Arena* arena, Operand* op, int offset, int reg);
 
 typedef struct Register {
   enum {
@@ -357,6 +673,66 @@ typedef struct Register {
   Variable* var;
 } Register;
 
+// a MIPS32 instruction, the code of a function is selected into a list of
+// them before it is printed
+typedef struct Instr {
+  enum {
+    INS_LABEL,  // label:
+    INS_ADDU,   // rd, rs, rt
+    INS_SUBU,
+    INS_MUL,
+    INS_SLT,
+    INS_SLTU,
+    INS_AND,
+    INS_OR,
+    INS_XOR,
+    INS_ADDIU,  // rd, rs, imm
+    INS_SLTI,
+    INS_SLTIU,
+    INS_ANDI,
+    INS_ORI,
+    INS_XORI,
+    INS_SLL,
+    INS_SRL,
+    INS_SRA,
+    INS_MULT,  // rs, rt
+    INS_DIV,
+    INS_MFHI,  // rd
+    INS_MFLO,
+    INS_LI,    // rd, imm
+    INS_LA,    // rd, label
+    INS_MOVE,  // rd, rs
+    INS_LW,    // rd, imm(rs)
+    INS_SW,    // rt, imm(rs)
+    INS_BEQ,   // rs, rt, label
+    INS_BNE,
+    INS_BLTZ,  // rs, label
+    INS_BGEZ,
+    INS_BLEZ,
+    INS_BGTZ,
+    INS_J,    // label
+    INS_JAL,
+    INS_JR,   // rs
+    INS_NOP
+  } op;
+  int rd, rs, rt;
+  intptr_t imm;
+  char* label;    // the label defined or jumped to, or the function called
+  char* comment;  // the variable a load or a store accesses
+} Instr;
+
+Instr* newInstr(Arena* arena, int op, int rd, int rs, int rt, intptr_t imm,
+                char* label);
+void printInstr(Instr* ins, FILE* fout);
+
+// MIPS32Generate in two parts, to generate the functions one at a time
+void MIPS32Prelude(FILE* fout);
+void MIPS32GenerateCodes(List* irList, FILE* fout);
+// the counters of an instrumented program, after the last function
+void MIPS32Counters(FILE* fout);
+// reorder the instructions selected for a function, see mips32_schedule.c
+void MIPS32Schedule(List* instrs, Arena* arena);
+
 static const char* register_names[] = {
     "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
     "$t0",   "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
@@ -0,0 +1,428 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+// longest block copied in place of a jump to it
+#define MAX_DUPLICATE 4
+
+static int foldConditions(CFG* cfg);
+static int mergeLabels(CFG* cfg);
+static int threadJumps(CFG* cfg);
+static int fallThrough(CFG* cfg);
+static int duplicateTargets(CFG* cfg);
+static int removeDeadBlocks(CFG* cfg);
+static size_t maxLabelNo(CFG* cfg);
+static int jumpTarget(IRCode* ir);
+static void retarget(IRCode* ir, Operand* label);
+static int blockOfLabel(CFG* cfg, size_t label_no);
+static int startsWith(CFG* cfg, int b, size_t label_no);
+static ListNode* firstCode(List* codes);
+static int endsFlow(CFG* cfg, int b);
+
+// straighten the jumps of a function: decide the conditions on constants,
+// merge labels, thread jumps through blocks that only jump, let one side of
+// every branch fall through and drop the blocks left empty
+void simplifyBranches(CFG* cfg) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    changed |= foldConditions(cfg);
+    changed |= mergeLabels(cfg);
+    changed |= threadJumps(cfg);
+    changed |= fallThrough(cfg);
+    changed |= duplicateTargets(cfg);
+    changed |= removeDeadBlocks(cfg);
+  }
+}
+
+// a condition on two constants always jumps or never does, the guard loop
+// rotation puts before a loop with a constant start and bound is one
+static int foldConditions(CFG* cfg) {
+  int changed = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    IRCode* ir = codes->tail->value;
+    if (ir->kind != IR_IF_GOTO || ir->op_l->kind != OP_CONSTANT ||
+        ir->op_r->kind != OP_CONSTANT) {
+      continue;
+    }
+
+    if (relopHolds(ir->op_l->constant, ir->relop, ir->op_r->constant)) {
+      codes->tail->value = newIRCode(IR_GOTO, ir->label);
+      ((IRCode*)codes->tail->value)->count = ir->count;
+    } else {
+      listDelNode(codes, codes->tail);
+    }
+    changed = 1;
+  }
+
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// keep only the first of the labels starting a block
+static int mergeLabels(CFG* cfg) {
+  size_t max = maxLabelNo(cfg);
+  Operand** alias = calloc(max + 1, sizeof(Operand*));
+  int changed = 0;
+
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->head == NULL) continue;
+    IRCode* first = codes->head->value;
+    if (first->kind != IR_LABEL) continue;
+
+    ListNode* next;
+    for (ListNode* node = codes->head->next; node; node = next) {
+      next = node->next;
+      IRCode* ir = node->value;
+      if (ir->kind != IR_LABEL) break;
+      alias[ir->op->label_no] = first->op;
+      listDelNode(codes, node);
+      changed = 1;
+    }
+  }
+
+  for (int b = 0; b < cfg->nblocks && changed; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    int target = jumpTarget(codes->tail->value);
+    if (target >= 0 && alias[target]) {
+      retarget(codes->tail->value, alias[target]);
+    }
+  }
+
+  free(alias);
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// send jumps to a block that only jumps on, or that is empty, straight to
+// where it leads
+static int threadJumps(CFG* cfg) {
+  int n = cfg->nblocks;
+  int* forward = malloc(sizeof(int) * (n + 1));
+  for (int b = 0; b < n; b++) {
+    forward[b] = -1;
+    ListNode* code = firstCode(cfg->blocks[b]->codes);
+    if (code == NULL) {
+      if (b + 1 < n) forward[b] = b + 1;
+    } else if (code->next == NULL &&
+               ((IRCode*)code->value)->kind == IR_GOTO) {
+      forward[b] = blockOfLabel(cfg, ((IRCode*)code->value)->op->label_no);
+    }
+  }
+
+  int changed = 0;
+  for (int b = 0; b < n; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    IRCode* ir = codes->tail->value;
+    int target = jumpTarget(ir);
+    if (target < 0) continue;
+
+    // follow the chain, a cycle of jumps is cut after n steps
+    int t = blockOfLabel(cfg, target);
+    int dest = t;
+    for (int steps = 0; forward[dest] >= 0 && steps < n; steps++) {
+      dest = forward[dest];
+    }
+    if (dest != t && dest != b) {
+      retarget(ir, cfgBlockLabel(cfg, dest));
+      changed = 1;
+    }
+  }
+
+  free(forward);
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// drop jumps to the next block and invert conditions jumping over a goto
+static int fallThrough(CFG* cfg) {
+  int changed = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    IRCode* ir = codes->tail->value;
+    int target = jumpTarget(ir);
+    if (target < 0) continue;
+
+    if (b + 1 < cfg->nblocks && startsWith(cfg, b + 1, target)) {
+      // both ways lead to the next block
+      listDelNode(codes, codes->tail);
+      changed = 1;
+      continue;
+    }
+
+    // IF c GOTO l1; GOTO l2; LABEL l1 becomes IF !c GOTO l2; LABEL l1
+    if (ir->kind != IR_IF_GOTO || b + 2 >= cfg->nblocks) continue;
+    BasicBlock* next = cfg->blocks[b + 1];
+    if (next->npred != 1 || !startsWith(cfg, b + 2, target)) continue;
+    ListNode* code = firstCode(next->codes);
+    if (code == NULL || code->next || code != next->codes->head ||
+        ((IRCode*)code->value)->kind != IR_GOTO) {
+      continue;
+    }
+
+    IRCode* jump = code->value;
+    codes->tail->value = newIRCode(IR_IF_GOTO, ir->op_l,
+                                   invertRelop(ir->relop), ir->op_r, jump->op);
+    ((IRCode*)codes->tail->value)->count = ir->count;
+    listDelNode(next->codes, code);
+    changed = 1;
+  }
+
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// replace a goto by a copy of a short block ending in a return or in a
+// condition, so a loop tests its condition at the bottom instead of jumping
+// back to the test
+static int duplicateTargets(CFG* cfg) {
+  int changed = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    IRCode* jump = codes->tail->value;
+    if (jump->kind != IR_GOTO) continue;
+    int h = blockOfLabel(cfg, jump->op->label_no);
+    if (h == b) continue;
+
+    ListNode* code = firstCode(cfg->blocks[h]->codes);
+    int n = 0;
+    int pure = 1;
+    for (ListNode* node = code; node; node = node->next) {
+      IRCode* ir = node->value;
+      n++;
+      if (node->next == NULL) break;
+      if (ir->kind != IR_ASSIGN && ir->kind != IR_ADD &&
+          ir->kind != IR_SUB && ir->kind != IR_MUL &&
+          ir->kind != IR_GET_ADDR) {
+        pure = 0;
+      }
+    }
+    if (code == NULL || !pure || n > MAX_DUPLICATE) continue;
+
+    IRCode* last = cfg->blocks[h]->codes->tail->value;
+    IRCode* end = NULL;
+    if (last->kind == IR_RETURN) {
+      end = newIRCode(IR_RETURN, last->op);
+    } else if (last->kind == IR_IF_GOTO && h + 1 < cfg->nblocks) {
+      // the copy falls through to the block after b, not after h
+      int t = blockOfLabel(cfg, last->label->label_no);
+      if (t == b + 1) {
+        end = newIRCode(IR_IF_GOTO, last->op_l, invertRelop(last->relop),
+                        last->op_r, cfgBlockLabel(cfg, h + 1));
+      }
+    }
+    if (end == NULL) continue;
+    end->count = last->count;
+
+    listDelNode(codes, codes->tail);
+    for (ListNode* node = code; node->next; node = node->next) {
+      IRCode* copy = malloc(sizeof(IRCode));
+      *copy = *(IRCode*)node->value;
+      listAddNodeTail(codes, copy);
+    }
+    listAddNodeTail(codes, end);
+    changed = 1;
+  }
+
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// drop labels nobody jumps to, unreachable and empty blocks, and join
+// blocks that now simply follow each other
+static int removeDeadBlocks(CFG* cfg) {
+  // unreachable blocks are emptied all at once, they may jump to each other
+  int changed = 0;
+  for (int b = 1; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (cfg->blocks[b]->rpo >= 0 || codes->head == NULL) continue;
+    while (codes->head) listDelNode(codes, codes->head);
+    changed = 1;
+  }
+
+  size_t max = maxLabelNo(cfg);
+  char* used = calloc(max + 1, 1);
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (codes->tail == NULL) continue;
+    int target = jumpTarget(codes->tail->value);
+    if (target >= 0) used[target] = 1;
+  }
+
+  for (int b = cfg->nblocks - 1; b >= 0; b--) {
+    List* codes = cfg->blocks[b]->codes;
+
+    ListNode* next;
+    for (ListNode* node = codes->head; node; node = next) {
+      next = node->next;
+      IRCode* ir = node->value;
+      if (ir->kind != IR_LABEL) break;
+      if (!used[ir->op->label_no]) {
+        listDelNode(codes, node);
+        changed = 1;
+      }
+    }
+
+    if (codes->head == NULL && cfg->nblocks > 1) {
+      cfgRemoveBlock(cfg, b);
+      changed = 1;
+      continue;
+    }
+
+    // a block entered only by falling through joins the one before
+    if (b > 0 && ((IRCode*)codes->head->value)->kind != IR_LABEL) {
+      List* prev = cfg->blocks[b - 1]->codes;
+      IRCode* last = prev->tail ? prev->tail->value : NULL;
+      if (last == NULL || (jumpTarget(last) < 0 && last->kind != IR_RETURN)) {
+        listJoin(prev, codes);
+        cfgRemoveBlock(cfg, b);
+        changed = 1;
+      }
+    }
+  }
+
+  free(used);
+  if (changed) cfgAnalyze(cfg);
+  return changed;
+}
+
+// move the blocks the profile never saw run to the end of the function, so
+// the code that runs is laid out in one piece; a run of them moves together
+// up to its last block not falling through, the block before it jumps to it
+void layoutBlocks(CFG* cfg) {
+  int n = cfg->nblocks;
+  IRCode* func = cfg->prologue->head->value;
+  if (!hasProfile || n < 3 || func->count <= 0) return;
+  // the moved blocks follow the last one
+  if (!endsFlow(cfg, n - 1)) return;
+
+  // a block without a count is cold if it is entered from cold blocks only
+  char* cold = calloc(n, 1);
+  for (int b = 1; b < n; b++) {
+    long count = blockCount(cfg, b);
+    BasicBlock* bb = cfg->blocks[b];
+    cold[b] = count >= 0 ? count == 0 : bb->npred > 0;
+    for (int p = 0; p < bb->npred && count < 0; p++) {
+      if (bb->preds[p] >= b || !cold[bb->preds[p]]) cold[b] = 0;
+    }
+  }
+
+  List** moved = malloc(sizeof(List*) * n);
+  int nmoved = 0;
+  for (int s = 1; s < n; s++) {
+    if (!cold[s]) continue;
+    int t = s;
+    while (t + 1 < n && cold[t + 1]) t++;
+    int e = t;
+    while (e >= s && !endsFlow(cfg, e)) e--;
+    if (e >= s && e < n - 1) {
+      Operand* label = cfgBlockLabel(cfg, s);
+      for (int b = s; b <= e; b++) {
+        moved[nmoved++] = cfg->blocks[b]->codes;
+        cfg->blocks[b]->codes = newList(NULL, NULL, NULL);
+      }
+      listAddNodeTail(cfg->blocks[s]->codes, newIRCode(IR_GOTO, label));
+    }
+    s = t;
+  }
+  free(cold);
+
+  if (nmoved > 0) cfgInsertBlocks(cfg, n, moved, nmoved);
+  free(moved);
+}
+
+static size_t maxLabelNo(CFG* cfg) {
+  size_t max = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind == IR_LABEL && ir->op->label_no > max) {
+        max = ir->op->label_no;
+      }
+    }
+  }
+  return max;
+}
+
+// the label a goto or conditional goto jumps to, -1 for other codes
+static int jumpTarget(IRCode* ir) {
+  if (ir->kind == IR_GOTO) return ir->op->label_no;
+  if (ir->kind == IR_IF_GOTO) return ir->label->label_no;
+  return -1;
+}
+
+static void retarget(IRCode* ir, Operand* label) {
+  if (ir->kind == IR_GOTO) {
+    ir->op = label;
+  } else {
+    assert(ir->kind == IR_IF_GOTO);
+    ir->label = label;
+  }
+}
+
+static int blockOfLabel(CFG* cfg, size_t label_no) {
+  for (int b = 0; b < cfg->nblocks; b++) {
+    if (startsWith(cfg, b, label_no)) return b;
+  }
+
+  // we should never reach here
+  assert(0);
+  return -1;
+}
+
+// return 1 if block b carries the label
+static int startsWith(CFG* cfg, int b, size_t label_no) {
+  for (ListNode* node = cfg->blocks[b]->codes->head; node;
+       node = node->next) {
+    IRCode* ir = node->value;
+    if (ir->kind != IR_LABEL) return 0;
+    if (ir->op->label_no == label_no) return 1;
+  }
+  return 0;
+}
+
+// the first code of a block that is not a label, NULL if none
+static ListNode* firstCode(List* codes) {
+  ListNode* node = codes->head;
+  while (node && ((IRCode*)node->value)->kind == IR_LABEL) node = node->next;
+  return node;
+}
+
+// the relop testing the opposite
+char* invertRelop(char* relop) {
+  static char* pairs[][2] = {{"==", "!="}, {"!=", "=="}, {"<", ">="},
+                             {">=", "<"},  {">", "<="},  {"<=", ">"}};
+  for (int i = 0; i < 6; i++) {
+    if (strcmp(relop, pairs[i][0]) == 0) return pairs[i][1];
+  }
+
+  // we should never reach here
+  assert(0);
+  return NULL;
+}
+
+int relopHolds(intptr_t a, char* relop, intptr_t b) {
+  if (strcmp(relop, "<") == 0) return a < b;
+  if (strcmp(relop, "<=") == 0) return a <= b;
+  if (strcmp(relop, ">") == 0) return a > b;
+  if (strcmp(relop, ">=") == 0) return a >= b;
+  if (strcmp(relop, "==") == 0) return a == b;
+  return a != b;
+}
+
+// return 1 if block b ends in a jump or a return, it does not fall through
+static int endsFlow(CFG* cfg, int b) {
+  List* codes = cfg->blocks[b]->codes;
+  if (codes->tail == NULL) return 0;
+  IRCode* ir = codes->tail->value;
+  return ir->kind == IR_GOTO || ir->kind == IR_RETURN;
+}
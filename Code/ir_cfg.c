@@ -0,0 +1,638 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "hash.h"
+#include "list.h"
+
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+extern void keyDestructor(void* privDataPtr, void* key);
+
+static HtType varIdType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                           .keyDup = NULL,
+                           .valDup = NULL,
+                           .keyCompare = keyCompare,
+                           .keyDestructor = keyDestructor,
+                           .valDestructor = NULL};
+
+static void addBlock(CFG* cfg, int pos, List* codes);
+static void dropLiveness(CFG* cfg, int n);
+static void computeEdges(CFG* cfg);
+static void computeOrder(CFG* cfg);
+static void computeDominators(CFG* cfg);
+static int labelOf(IRCode* ir);
+
+// build the CFG of a function, codes starts with its IR_FUNCTION
+CFG* newCFG(List* codes) {
+  assert(codes && codes->head);
+  assert(((IRCode*)codes->head->value)->kind == IR_FUNCTION);
+
+  CFG* cfg = calloc(1, sizeof(CFG));
+  cfg->prologue = newList(NULL, NULL, NULL);
+  cfg->varIds = htCreate(&varIdType, NULL);
+
+  ListNode* node = codes->head;
+  for (; node; node = node->next) {
+    IRCode* ir = node->value;
+    if (ir->kind != IR_FUNCTION && ir->kind != IR_PARAM) break;
+    listAddNodeTail(cfg->prologue, ir);
+  }
+
+  // a label starts a new block unless the current one holds only labels, a
+  // jump or a return ends the current block
+  List* cur = NULL;
+  for (; node; node = node->next) {
+    IRCode* ir = node->value;
+    if (cur == NULL || (ir->kind == IR_LABEL &&
+                        ((IRCode*)cur->tail->value)->kind != IR_LABEL)) {
+      cur = newList(NULL, NULL, NULL);
+      addBlock(cfg, cfg->nblocks, cur);
+    }
+    listAddNodeTail(cur, ir);
+    if (ir->kind == IR_GOTO || ir->kind == IR_IF_GOTO ||
+        ir->kind == IR_RETURN) {
+      cur = NULL;
+    }
+  }
+
+  cfgAnalyze(cfg);
+  return cfg;
+}
+
+void freeCFG(CFG* cfg) {
+  if (cfg == NULL) return;
+
+  freeList(cfg->prologue);
+  for (int i = 0; i < cfg->nblocks; i++) {
+    freeList(cfg->blocks[i]->codes);
+    free(cfg->blocks[i]->preds);
+    free(cfg->blocks[i]);
+    if (cfg->liveIn) {
+      free(cfg->liveIn[i]);
+      free(cfg->liveOut[i]);
+    }
+  }
+  for (int i = 0; i < cfg->nloops; i++) {
+    free(cfg->loops[i].body);
+  }
+  free(cfg->liveIn);
+  free(cfg->liveOut);
+  free(cfg->loops);
+  free(cfg->blocks);
+  free(cfg->order);
+  free(cfg->vars);
+  htRelease(cfg->varIds);
+  free(cfg);
+}
+
+// concatenate the prologue and the blocks back into one list
+List* cfgLinearize(CFG* cfg) {
+  List* ir = newList(NULL, NULL, NULL);
+  for (ListNode* node = cfg->prologue->head; node; node = node->next) {
+    listAddNodeTail(ir, node->value);
+  }
+  for (int i = 0; i < cfg->nblocks; i++) {
+    for (ListNode* node = cfg->blocks[i]->codes->head; node;
+         node = node->next) {
+      listAddNodeTail(ir, node->value);
+    }
+  }
+  return ir;
+}
+
+// recompute edges, reverse postorder and dominators after the blocks changed
+void cfgAnalyze(CFG* cfg) {
+  computeEdges(cfg);
+  computeOrder(cfg);
+  computeDominators(cfg);
+}
+
+// return 1 if block a dominates block b
+int cfgDominates(CFG* cfg, int a, int b) {
+  if (cfg->blocks[b]->rpo < 0) return 0;
+  while (b != a && b > -1) {
+    b = cfg->blocks[b]->idom;
+  }
+  return b == a;
+}
+
+// insert a new block holding codes at layout position pos
+void cfgInsertBlock(CFG* cfg, int pos, List* codes) {
+  cfgInsertBlocks(cfg, pos, &codes, 1);
+}
+
+// insert n new blocks at layout position pos, in order; they are analyzed
+// together, so they may jump to each other
+void cfgInsertBlocks(CFG* cfg, int pos, List** codes, int n) {
+  for (int i = 0; i < n; i++) addBlock(cfg, pos + i, codes[i]);
+  cfgAnalyze(cfg);
+}
+
+// remove block b, the codes it still holds go with it
+void cfgRemoveBlock(CFG* cfg, int b) {
+  assert(b >= 0 && b < cfg->nblocks);
+  dropLiveness(cfg, cfg->nblocks);
+
+  BasicBlock* bb = cfg->blocks[b];
+  freeList(bb->codes);
+  free(bb->preds);
+  free(bb);
+  memmove(&cfg->blocks[b], &cfg->blocks[b + 1],
+          sizeof(BasicBlock*) * (cfg->nblocks - b - 1));
+  cfg->nblocks--;
+  cfgAnalyze(cfg);
+}
+
+// get the label of a block, adding a fresh one if it has none
+Operand* cfgBlockLabel(CFG* cfg, int b) {
+  List* codes = cfg->blocks[b]->codes;
+  if (codes->head && ((IRCode*)codes->head->value)->kind == IR_LABEL) {
+    return ((IRCode*)codes->head->value)->op;
+  }
+
+  Operand* label = newOperand(OP_LABEL, (void*)newLabelNo(), NULL);
+  listAddNodeHead(codes, newIRCode(IR_LABEL, label));
+  return label;
+}
+
+static int compareLoopSize(const void* a, const void* b) {
+  return ((Loop*)a)->nblocks - ((Loop*)b)->nblocks;
+}
+
+// find the natural loops, requires up-to-date dominators
+void cfgFindLoops(CFG* cfg) {
+  for (int i = 0; i < cfg->nloops; i++) {
+    free(cfg->loops[i].body);
+  }
+  free(cfg->loops);
+  cfg->loops = NULL;
+  cfg->nloops = 0;
+
+  int n = cfg->nblocks;
+  int* stack = malloc(sizeof(int) * (n + 1));
+
+  // every back edge latch -> header adds the blocks reaching the latch
+  // without passing through the header; back edges sharing a header make
+  // up a single loop
+  for (int h = 0; h < n; h++) {
+    BasicBlock* header = cfg->blocks[h];
+    if (header->rpo < 0) continue;
+
+    char* body = NULL;
+    for (int i = 0; i < header->npred; i++) {
+      int latch = header->preds[i];
+      if (!cfgDominates(cfg, h, latch)) continue;
+
+      if (body == NULL) {
+        body = calloc(n, 1);
+        body[h] = 1;
+      }
+      int top = 0;
+      if (!body[latch]) {
+        body[latch] = 1;
+        stack[top++] = latch;
+      }
+      while (top > 0) {
+        BasicBlock* bb = cfg->blocks[stack[--top]];
+        for (int j = 0; j < bb->npred; j++) {
+          int p = bb->preds[j];
+          if (!body[p] && cfg->blocks[p]->rpo >= 0) {
+            body[p] = 1;
+            stack[top++] = p;
+          }
+        }
+      }
+    }
+    if (body == NULL) continue;
+
+    cfg->loops = realloc(cfg->loops, sizeof(Loop) * (cfg->nloops + 1));
+    Loop* loop = &cfg->loops[cfg->nloops++];
+    *loop = (Loop){.header = h, .parent = -1, .depth = 1, .body = body};
+    for (int b = 0; b < n; b++) {
+      loop->nblocks += body[b];
+    }
+  }
+  free(stack);
+
+  // an enclosing loop is always bigger, so after sorting by size the parent
+  // of a loop is the first later loop containing its header
+  if (cfg->nloops > 1) {
+    qsort(cfg->loops, cfg->nloops, sizeof(Loop), compareLoopSize);
+  }
+  for (int i = 0; i < cfg->nloops; i++) {
+    for (int j = i + 1; j < cfg->nloops; j++) {
+      if (cfg->loops[j].body[cfg->loops[i].header]) {
+        cfg->loops[i].parent = j;
+        break;
+      }
+    }
+  }
+  for (int i = cfg->nloops - 1; i >= 0; i--) {
+    Loop* loop = &cfg->loops[i];
+    if (loop->parent >= 0) loop->depth = cfg->loops[loop->parent].depth + 1;
+  }
+
+  for (int b = 0; b < n; b++) {
+    cfg->blocks[b]->loop = -1;
+    for (int i = 0; i < cfg->nloops; i++) {
+      if (cfg->loops[i].body[b]) {
+        cfg->blocks[b]->loop = i;
+        break;
+      }
+    }
+  }
+}
+
+// dense id of a variable operand, -1 for constants, labels and functions
+int cfgVarId(CFG* cfg, Operand* op) {
+  if (!isVarOperand(op)) return -1;
+
+  char* name = operand2str(op);
+  HashEntry* entry = htFind(cfg->varIds, name);
+  if (entry) {
+    free(name);
+    return (int)(intptr_t)htGetEntryVal(entry);
+  }
+
+  if (cfg->nvars == cfg->varCapacity) {
+    cfg->varCapacity = cfg->varCapacity ? cfg->varCapacity * 2 : 16;
+    cfg->vars = realloc(cfg->vars, sizeof(Operand*) * cfg->varCapacity);
+  }
+  cfg->vars[cfg->nvars] = op;
+  htAdd(cfg->varIds, name, (void*)(intptr_t)cfg->nvars);
+  return cfg->nvars++;
+}
+
+// number every variable operand and compute live variables per block
+void cfgLiveness(CFG* cfg) {
+  for (ListNode* node = cfg->prologue->head; node; node = node->next) {
+    Operand** def = irDefOperand(node->value);
+    if (def) cfgVarId(cfg, *def);
+  }
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      Operand** uses[3];
+      int n = irUseOperands(node->value, uses);
+      for (int i = 0; i < n; i++) cfgVarId(cfg, *uses[i]);
+      Operand** def = irDefOperand(node->value);
+      if (def) cfgVarId(cfg, *def);
+    }
+  }
+
+  if (cfg->liveIn) {
+    for (int b = 0; b < cfg->nblocks; b++) {
+      free(cfg->liveIn[b]);
+      free(cfg->liveOut[b]);
+    }
+    free(cfg->liveIn);
+    free(cfg->liveOut);
+  }
+
+  int words = BITSET_WORDS(cfg->nvars);
+  int n = cfg->nblocks;
+  cfg->liveIn = malloc(sizeof(uint32_t*) * n);
+  cfg->liveOut = malloc(sizeof(uint32_t*) * n);
+  uint32_t** use = malloc(sizeof(uint32_t*) * n);
+  uint32_t** def = malloc(sizeof(uint32_t*) * n);
+
+  // upward exposed uses and definitions of every block
+  for (int b = 0; b < n; b++) {
+    cfg->liveIn[b] = calloc(words + 1, sizeof(uint32_t));
+    cfg->liveOut[b] = calloc(words + 1, sizeof(uint32_t));
+    use[b] = calloc(words + 1, sizeof(uint32_t));
+    def[b] = calloc(words + 1, sizeof(uint32_t));
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      Operand** uses[3];
+      int k = irUseOperands(node->value, uses);
+      for (int i = 0; i < k; i++) {
+        int id = cfgVarId(cfg, *uses[i]);
+        if (id >= 0 && !bitTest(def[b], id)) bitSet(use[b], id);
+      }
+      Operand** d = irDefOperand(node->value);
+      if (d) {
+        int id = cfgVarId(cfg, *d);
+        if (id >= 0) bitSet(def[b], id);
+      }
+    }
+  }
+
+  // iterate to the fixed point, visiting blocks in postorder
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = cfg->nreach - 1; i >= 0; i--) {
+      int b = cfg->order[i];
+      BasicBlock* bb = cfg->blocks[b];
+      uint32_t* out = cfg->liveOut[b];
+      uint32_t* in = cfg->liveIn[b];
+      for (int j = 0; j < bb->nsucc; j++) {
+        uint32_t* sin = cfg->liveIn[bb->succ[j]];
+        for (int w = 0; w < words; w++) out[w] |= sin[w];
+      }
+      for (int w = 0; w < words; w++) {
+        uint32_t v = use[b][w] | (out[w] & ~def[b][w]);
+        if (v != in[w]) {
+          in[w] = v;
+          changed = 1;
+        }
+      }
+    }
+  }
+
+  for (int b = 0; b < n; b++) {
+    free(use[b]);
+    free(def[b]);
+  }
+  free(use);
+  free(def);
+}
+
+// the operand written by an IR code, NULL if it writes none
+Operand** irDefOperand(IRCode* ir) {
+  switch (ir->kind) {
+    case IR_ASSIGN:
+    case IR_GET_ADDR:
+    case IR_GET_VALUE:
+    case IR_CALL:
+      return &ir->left;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+      return &ir->result;
+    case IR_PARAM:
+    case IR_READ:
+      return &ir->op;
+    case IR_COMPARE:
+      return &ir->cmp;
+    default:
+      return NULL;
+  }
+}
+
+// the operands read by an IR code, returns how many were stored in uses
+int irUseOperands(IRCode* ir, Operand** uses[3]) {
+  int n = 0;
+  switch (ir->kind) {
+    case IR_ASSIGN:
+    case IR_GET_VALUE:
+      uses[n++] = &ir->right;
+      break;
+    case IR_SET_VALUE:
+      uses[n++] = &ir->left;
+      uses[n++] = &ir->right;
+      break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+      uses[n++] = &ir->op1;
+      uses[n++] = &ir->op2;
+      break;
+    case IR_IF_GOTO:
+      uses[n++] = &ir->op_l;
+      uses[n++] = &ir->op_r;
+      break;
+    case IR_COMPARE:
+      uses[n++] = &ir->cmp_l;
+      uses[n++] = &ir->cmp_r;
+      break;
+    case IR_RETURN:
+    case IR_ARG:
+    case IR_WRITE:
+      uses[n++] = &ir->op;
+      break;
+    default:
+      break;
+  }
+
+  // constants are not variables, drop them
+  int k = 0;
+  for (int i = 0; i < n; i++) {
+    if (isVarOperand(*uses[i])) uses[k++] = uses[i];
+  }
+  return k;
+}
+
+int isVarOperand(Operand* op) {
+  return op && (op->kind == OP_VARIABLE || op->kind == OP_TEMP ||
+                op->kind == OP_ADDRESS);
+}
+
+// operands are the same storage if they print the same, a temp and the
+// address it was turned into by operandTmp2Addr share the name tN
+int sameOperand(Operand* a, Operand* b) {
+  if (a == b) return 1;
+  if (a == NULL || b == NULL) return 0;
+  if (a->kind == OP_CONSTANT || b->kind == OP_CONSTANT) {
+    return a->kind == b->kind && a->constant == b->constant;
+  }
+  if (a->kind == OP_LABEL || b->kind == OP_LABEL) {
+    return a->kind == b->kind && a->label_no == b->label_no;
+  }
+  if (a->kind == OP_TEMP && b->kind == OP_TEMP) {
+    return a->temp_no == b->temp_no;
+  }
+
+  char* s1 = operand2str(a);
+  char* s2 = operand2str(b);
+  int same = strcmp(s1, s2) == 0;
+  free(s1);
+  free(s2);
+  return same;
+}
+
+static void addBlock(CFG* cfg, int pos, List* codes) {
+  if (cfg->nblocks == cfg->capacity) {
+    cfg->capacity = cfg->capacity ? cfg->capacity * 2 : 16;
+    cfg->blocks = realloc(cfg->blocks, sizeof(BasicBlock*) * cfg->capacity);
+  }
+  memmove(&cfg->blocks[pos + 1], &cfg->blocks[pos],
+          sizeof(BasicBlock*) * (cfg->nblocks - pos));
+
+  BasicBlock* bb = calloc(1, sizeof(BasicBlock));
+  *bb = (BasicBlock){.codes = codes,
+                     .succ = {-1, -1},
+                     .rpo = -1,
+                     .idom = -1,
+                     .loop = -1};
+  cfg->blocks[pos] = bb;
+  cfg->nblocks++;
+
+  // liveness and loops are stale once the layout changed
+  dropLiveness(cfg, cfg->nblocks - 1);
+}
+
+// free the live sets of the n blocks they were computed for
+static void dropLiveness(CFG* cfg, int n) {
+  if (cfg->liveIn == NULL) return;
+  for (int b = 0; b < n; b++) {
+    free(cfg->liveIn[b]);
+    free(cfg->liveOut[b]);
+  }
+  free(cfg->liveIn);
+  free(cfg->liveOut);
+  cfg->liveIn = cfg->liveOut = NULL;
+}
+
+static int labelOf(IRCode* ir) {
+  if (ir->kind == IR_GOTO) return ir->op->label_no;
+  if (ir->kind == IR_IF_GOTO) return ir->label->label_no;
+  return -1;
+}
+
+static void computeEdges(CFG* cfg) {
+  int n = cfg->nblocks;
+
+  // map every label to the block it starts
+  size_t maxLabel = 0;
+  for (int b = 0; b < n; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind != IR_LABEL) break;
+      if (ir->op->label_no > maxLabel) maxLabel = ir->op->label_no;
+    }
+  }
+  int* labelBlock = malloc(sizeof(int) * (maxLabel + 1));
+  for (size_t i = 0; i <= maxLabel; i++) labelBlock[i] = -1;
+  for (int b = 0; b < n; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind != IR_LABEL) break;
+      labelBlock[ir->op->label_no] = b;
+    }
+  }
+
+  for (int b = 0; b < n; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    bb->nsucc = 0;
+    bb->succ[0] = bb->succ[1] = -1;
+    bb->npred = 0;
+  }
+
+  for (int b = 0; b < n; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    IRCode* last = bb->codes->tail ? bb->codes->tail->value : NULL;
+    int target = last ? labelOf(last) : -1;
+    if (target >= 0) {
+      assert((size_t)target <= maxLabel && labelBlock[target] >= 0);
+      bb->succ[bb->nsucc++] = labelBlock[target];
+    }
+    if ((last == NULL ||
+         (last->kind != IR_GOTO && last->kind != IR_RETURN)) &&
+        b + 1 < n && (bb->nsucc == 0 || bb->succ[0] != b + 1)) {
+      bb->succ[bb->nsucc++] = b + 1;
+    }
+    for (int i = 0; i < bb->nsucc; i++) {
+      cfg->blocks[bb->succ[i]]->npred++;
+    }
+  }
+
+  for (int b = 0; b < n; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    free(bb->preds);
+    bb->preds = malloc(sizeof(int) * (bb->npred + 1));
+    bb->npred = 0;
+  }
+  for (int b = 0; b < n; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    for (int i = 0; i < bb->nsucc; i++) {
+      BasicBlock* s = cfg->blocks[bb->succ[i]];
+      s->preds[s->npred++] = b;
+    }
+  }
+
+  free(labelBlock);
+}
+
+static void computeOrder(CFG* cfg) {
+  int n = cfg->nblocks;
+  free(cfg->order);
+  cfg->order = malloc(sizeof(int) * (n + 1));
+  cfg->nreach = 0;
+  for (int b = 0; b < n; b++) cfg->blocks[b]->rpo = -1;
+  if (n == 0) return;
+
+  // iterative depth first search, blocks are appended in postorder
+  int* stack = malloc(sizeof(int) * (n + 1));
+  int* next = calloc(n, sizeof(int));
+  char* seen = calloc(n, 1);
+  int top = 0;
+  int count = 0;
+  stack[top++] = 0;
+  seen[0] = 1;
+  while (top > 0) {
+    BasicBlock* bb = cfg->blocks[stack[top - 1]];
+    int b = stack[top - 1];
+    if (next[b] < bb->nsucc) {
+      int s = bb->succ[next[b]++];
+      if (!seen[s]) {
+        seen[s] = 1;
+        stack[top++] = s;
+      }
+    } else {
+      cfg->order[count++] = b;
+      top--;
+    }
+  }
+  for (int i = 0; i < count / 2; i++) {
+    int t = cfg->order[i];
+    cfg->order[i] = cfg->order[count - 1 - i];
+    cfg->order[count - 1 - i] = t;
+  }
+  for (int i = 0; i < count; i++) cfg->blocks[cfg->order[i]]->rpo = i;
+  cfg->nreach = count;
+
+  free(stack);
+  free(next);
+  free(seen);
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+static void computeDominators(CFG* cfg) {
+  int n = cfg->nblocks;
+  if (n == 0) return;
+
+  int* idom = malloc(sizeof(int) * n);
+  for (int b = 0; b < n; b++) idom[b] = -1;
+  idom[0] = 0;
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 1; i < cfg->nreach; i++) {
+      int b = cfg->order[i];
+      BasicBlock* bb = cfg->blocks[b];
+      int newIdom = -1;
+      for (int j = 0; j < bb->npred; j++) {
+        int p = bb->preds[j];
+        if (idom[p] < 0) continue;
+        if (newIdom < 0) {
+          newIdom = p;
+          continue;
+        }
+        // intersect
+        int f1 = p, f2 = newIdom;
+        while (f1 != f2) {
+          while (cfg->blocks[f1]->rpo > cfg->blocks[f2]->rpo) f1 = idom[f1];
+          while (cfg->blocks[f2]->rpo > cfg->blocks[f1]->rpo) f2 = idom[f2];
+        }
+        newIdom = f1;
+      }
+      if (idom[b] != newIdom) {
+        idom[b] = newIdom;
+        changed = 1;
+      }
+    }
+  }
+
+  for (int b = 0; b < n; b++) {
+    cfg->blocks[b]->idom = b == 0 ? -1 : idom[b];
+  }
+  free(idom);
+}
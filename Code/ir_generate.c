@@ -4,11 +4,14 @@
 #include "hash.h"
 #include "list.h"
 
-extern HashTable* ht;
+extern int translateEnabled;
+extern void beginSemanticAnalysis();
+extern int semanticAnalysisEmit(NodeId node, void (*emit)(NodeId part));
 
 static size_t label_count = 0;
 static size_t temp_count = 0;
-static List* parmList = NULL;
+// what IRGenerateFused translated so far
+static List* fusedIR = NULL;
 
 #define IS_LVAL 1
 #define NOT_LVAL 0
@@ -44,86 +47,147 @@ static List* parmList = NULL;
     freeList(ir2);            \
   } while (0)
 
-static List* translateExtDefList(MBTreeNode* node);
-static List* translateExtDef(MBTreeNode* node);
-static List* translateExtDecList(MBTreeNode* node);
-static List* translateVarDec(MBTreeNode* node, Operand* place);
-static List* translateCompSt(MBTreeNode* node);
-static List* translateDefList(MBTreeNode* node);
-static List* translateDef(MBTreeNode* node);
-static List* translateDecList(MBTreeNode* node);
-static List* translateDec(MBTreeNode* node);
-static List* translateStmtList(MBTreeNode* node);
-
-static List* translateFunDec(MBTreeNode* node);
-static List* translateArgs(MBTreeNode* node, List* argList);
-static List* translateStmt(MBTreeNode* node);
-static List* translateCond(MBTreeNode* node, Operand* label_true,
+static void translatePart(NodeId node);
+static List* translateExtDefList(NodeId node);
+static List* translateExtDef(NodeId node);
+static List* translateExtDecList(NodeId node);
+static List* translateVarDec(NodeId node, Operand* place);
+static List* translateCompSt(NodeId node);
+static List* translateDefList(NodeId node);
+static List* translateDef(NodeId node);
+static List* translateDecList(NodeId node);
+static List* translateDec(NodeId node);
+static List* translateStmtList(NodeId node);
+
+static List* translateFunDec(NodeId node);
+static List* translateArgs(NodeId node, List* argList);
+static List* translateStmt(NodeId node);
+static List* translateCond(NodeId node, Operand* label_true,
                            Operand* label_false);
-static List* translateExp(MBTreeNode* node, Operand* place, int isLVal);
+static List* translateExp(NodeId node, Operand* place, int isLVal);
 
-static char* getID(MBTreeNode* node);
-static int getINT(MBTreeNode* node);
+static void assignTo(List* ir, Operand* target, Operand* value);
+
+static int getINT(NodeId node);
+
+size_t newLabelNo() { return ++label_count; }
+size_t newTempNo() { return ++temp_count; }
+
+void reserveIRNumbers(size_t label_no, size_t temp_no) {
+  if (label_no > label_count) label_count = label_no;
+  if (temp_no > temp_count) temp_count = temp_no;
+}
 
 // entry point for the IR generation
-List* IRGenerate(MBTreeNode* node) {
-  if (node == NULL) {
+List* IRGenerate(NodeId node) {
+  if (node == 0) {
+    return NULL;
+  }
+
+  assert(getNodeType(node) == _Program);
+
+  // Program -> ExtDefList
+  return translateExtDefList(getNodeKid(node, 0));
+}
+
+// check and translate the ExtDefs one after the other, a function a part at
+// a time, see semanticAnalysisEmit; NULL if the program has semantic errors,
+// once one is found the rest is only checked
+List* IRGenerateFused(NodeId node) {
+  beginSemanticAnalysis();
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Program);
+  assert(getNodeType(node) == _Program);
 
   // Program -> ExtDefList
-  return translateExtDefList(getMBTreeNodeFirstChild(node));
+  NodeId list = getNodeKid(node, 0);
+  fusedIR = newList(NULL, NULL, NULL);
+  int errors = 0;
+  for (uint32_t i = 0; i < getNodeKidCount(list); i++) {
+    errors += semanticAnalysisEmit(getNodeKid(list, i), translatePart);
+  }
+
+  List* ir = fusedIR;
+  fusedIR = NULL;
+  if (errors != 0) {
+    freeList(ir);
+    return NULL;
+  }
+  return ir;
+}
+
+// translate a part of an ExtDef that was just checked onto fusedIR
+static void translatePart(NodeId node) {
+  if (!translateEnabled) return;
+
+  List* ir2 = NULL;
+  switch (getNodeType(node)) {
+    case _ExtDef:
+      ir2 = translateExtDef(node);
+      break;
+    case _FunDec:
+      ir2 = translateFunDec(node);
+      break;
+    case _DefList:
+      ir2 = translateDefList(node);
+      break;
+    case _Stmt:
+      ir2 = translateStmt(node);
+      break;
+    default:
+      // we should never reach here
+      assert(0);
+  }
+  joinAndFree(fusedIR, ir2);
 }
 
+// translate one ExtDef on its own
+List* IRGenerateExtDef(NodeId node) { return translateExtDef(node); }
+
 // process ExtDefList node
-static List* translateExtDefList(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateExtDefList(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _ExtDefList);
-  List* ir = NULL;
+  assert(getNodeType(node) == _ExtDefList);
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  if (getMBTreeNodeType(child) == _Empty) {
-    // ExtDefList -> Empty
-    ir = newList(NULL, NULL, NULL);
-  } else {
-    // ExtDefList -> ExtDef ExtDefList
-    ir = translateExtDef(child);
-    List* ir2 = translateExtDefList(getMBTreeNodeNextSibling(child));
+  // ExtDefList -> ExtDef ExtDefList | Empty
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    List* ir2 = translateExtDef(getNodeKid(node, i));
     joinAndFree(ir, ir2);
   }
   return ir;
 }
 
 // process ExtDef node
-static List* translateExtDef(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateExtDef(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _ExtDef);
+  assert(getNodeType(node) == _ExtDef);
   List* ir = NULL;
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // Specifier
-  assert(getMBTreeNodeType(child) == _Specifier);
+  assert(getNodeType(getNodeKid(node, 0)) == _Specifier);
+
+  if (getNodeKidCount(node) == 1) {
+    // ExtDef -> Specifier SEMI
+    return newList(NULL, NULL, NULL);
+  }
 
-  child = getMBTreeNodeNextSibling(child);
-  if (getMBTreeNodeType(child) == _ExtDecList) {
+  NodeId child = getNodeKid(node, 1);
+  if (getNodeType(child) == _ExtDecList) {
     // ExtDef -> Specifier ExtDecList SEMI
     ir = translateExtDecList(child);
-  } else if (getMBTreeNodeType(child) == _SEMI) {
-    // ExtDef -> Specifier SEMI
-    ir = newList(NULL, NULL, NULL);
-  } else if (getMBTreeNodeType(child) == _FunDec) {
+  } else if (getNodeType(child) == _FunDec) {
     // ExtDef -> Specifier FunDec CompSt
     ir = translateFunDec(child);
-    List* ir2 = translateCompSt(getMBTreeNodeNextSibling(child));
+    List* ir2 = translateCompSt(getNodeKid(node, 2));
     joinAndFree(ir, ir2);
-    parmList = NULL;
   } else {
     // error
     assert(0);
@@ -133,25 +197,18 @@ static List* translateExtDef(MBTreeNode* node) {
 }
 
 // process ExtDecList node
-static List* translateExtDecList(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateExtDecList(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _ExtDecList);
-  List* ir = NULL;
-
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // VarDec
-  Operand* place = newOperand(OP_TEMP, getTempNo, NULL);
-  ir = translateVarDec(child, place);
+  assert(getNodeType(node) == _ExtDecList);
 
-  child = getMBTreeNodeNextSibling(child);
-  if (child == NULL) {
-    // ExtDecList -> VarDec
-    // do nothing
-  } else {
-    // ExtDecList -> VarDec COMMA ExtDecList
-    List* ir2 = translateExtDecList(getMBTreeNodeNextSibling(child));
+  // ExtDecList -> VarDec | VarDec COMMA ExtDecList
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    Operand* place = newOperand(OP_TEMP, getTempNo, NULL);
+    List* ir2 = translateVarDec(getNodeKid(node, i), place);
     joinAndFree(ir, ir2);
   }
 
@@ -159,180 +216,188 @@ static List* translateExtDecList(MBTreeNode* node) {
 }
 
 // process VarDec node
-static List* translateVarDec(MBTreeNode* node, Operand* place) {
-  if (node == NULL) {
+static List* translateVarDec(NodeId node, Operand* place) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _VarDec);
+  assert(getNodeType(node) == _VarDec);
   List* ir = newList(NULL, NULL, NULL);
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  if (getMBTreeNodeType(child) == _ID) {
-    // VarDec -> ID
-    char* id = getID(child);
-    Type* t = htFind(ht, id)->val;
-    assert(t != NULL);
-
-    place->kind = OP_VARIABLE;
-    place->var_name = id;
-    place->type = t;
-
-    if (t->kind == ARRAY) {
-      listAddNodeTail(ir, newIRCode(IR_DEC, place, getMemSize(t)));
-    } else if (t->kind == STRUCTURE) {
-      listAddNodeTail(ir, newIRCode(IR_DEC, place, getMemSize(t)));
-    }
-  } else if (getMBTreeNodeType(child) == _VarDec) {
-    // VarDec -> VarDec LB INT RB
-    freeList(ir);
-    ir = translateVarDec(child, place);
-  } else {
-    // error
-    assert(0);
+  // VarDec -> ID
+  // VarDec -> VarDec LB INT RB
+  HashEntry* symbol = getNodeInfo(node).symbol;
+  char* id = htGetEntryKey(symbol);
+  Type* t = htGetEntryVal(symbol);
+  assert(t != NULL);
+
+  place->kind = OP_VARIABLE;
+  place->var_name = id;
+  place->type = t;
+
+  if (t->kind == ARRAY) {
+    listAddNodeTail(ir, newIRCode(IR_DEC, place, getMemSize(t)));
+  } else if (t->kind == STRUCTURE) {
+    listAddNodeTail(ir, newIRCode(IR_DEC, place, getMemSize(t)));
   }
 
   return ir;
 }
 
-// process ID node
-static char* getID(MBTreeNode* node) {
-  if (node == NULL) {
-    return NULL;
+// make target hold value, the fresh temp ir computes, by writing it straight
+// into target when the last code of ir computes it
+static void assignTo(List* ir, Operand* target, Operand* value) {
+  if (ir->tail) {
+    IRCode* last = ir->tail->value;
+    Operand** def = irDefOperand(last);
+    if (def && *def == value && last->kind != IR_PARAM) {
+      *def = target;
+      return;
+    }
   }
+  listAddNodeTail(ir, newIRCode(IR_ASSIGN, target, value));
+}
 
-  assert(getMBTreeNodeType(node) == _ID);
+int foldConstant(int kind, intptr_t a, intptr_t b, intptr_t* value) {
+  uint32_t x = (uint32_t)a, y = (uint32_t)b;
+  switch (kind) {
+    case IR_ADD:
+      *value = (int32_t)(x + y);
+      return 1;
+    case IR_SUB:
+      *value = (int32_t)(x - y);
+      return 1;
+    case IR_MUL:
+      *value = (int32_t)(x * y);
+      return 1;
+    case IR_DIV:
+      if (b == 0 || ((int32_t)a == INT32_MIN && (int32_t)b == -1)) return 0;
+      *value = (int32_t)a / (int32_t)b;
+      return 1;
+    default:
+      // we should never reach here
+      assert(0);
+      return 0;
+  }
+}
 
-  return getMBTreeNodeValue(node).val_str;
+Operand* identityOperand(IRCode* ir) {
+  if (ir->kind != IR_ADD && ir->kind != IR_SUB && ir->kind != IR_MUL &&
+      ir->kind != IR_DIV) {
+    return NULL;
+  }
+  intptr_t unit = ir->kind == IR_ADD || ir->kind == IR_SUB ? 0 : 1;
+  if (ir->op2->kind == OP_CONSTANT && ir->op2->constant == unit) {
+    return ir->op1;
+  }
+  // only addition and multiplication commute
+  if ((ir->kind == IR_ADD || ir->kind == IR_MUL) &&
+      ir->op1->kind == OP_CONSTANT && ir->op1->constant == unit) {
+    return ir->op2;
+  }
+  return NULL;
 }
 
 // process INT node
-static int getINT(MBTreeNode* node) {
-  if (node == NULL) {
+static int getINT(NodeId node) {
+  if (node == 0) {
     return 0;
   }
 
-  assert(getMBTreeNodeType(node) == _INT);
+  assert(getNodeType(node) == _INT);
 
-  return getMBTreeNodeValue(node).val_int;
+  return getNodeValue(node).val_int;
 }
 
 // process FunDec node
-static List* translateFunDec(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateFunDec(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _FunDec);
+  assert(getNodeType(node) == _FunDec);
   List* ir = newList(NULL, NULL, NULL);
 
   // FunDec -> ID LP VarList RP
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // ID
-  char* id = getID(child);
-
-  Type* t = htFind(ht, id)->val;
+  HashEntry* symbol = getNodeInfo(node).symbol;
+  char* id = htGetEntryKey(symbol);
+  Type* t = htGetEntryVal(symbol);
   assert(t != NULL);
 
   Operand* op = newOperand(OP_FUNCTION, id, t);
   listAddNodeTail(ir, newIRCode(IR_FUNCTION, op));
 
-  parmList = newList(NULL, NULL, NULL);
   for (FieldList* fl = t->function.params; fl; fl = fl->next) {
     Operand* op = newOperand(OP_VARIABLE, fl->name, fl->type);
     if (fl->type->kind == ARRAY || fl->type->kind == STRUCTURE) {
       op->kind = OP_ADDRESS;
     }
     listAddNodeTail(ir, newIRCode(IR_PARAM, op));
-    listAddNodeTail(parmList, op);
   }
 
   return ir;
 }
 
 // process CompSt node
-static List* translateCompSt(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateCompSt(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _CompSt);
+  assert(getNodeType(node) == _CompSt);
   List* ir = NULL;
 
   // CompSt -> LC DefList StmtList RC
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // LC
-  assert(getMBTreeNodeType(child) == _LC);
+  ir = translateDefList(getNodeKid(node, 0));
 
-  child = getMBTreeNodeNextSibling(child);  // DefList
-  ir = translateDefList(child);
-
-  child = getMBTreeNodeNextSibling(child);  // StmtList
-  List* ir2 = translateStmtList(child);
+  List* ir2 = translateStmtList(getNodeKid(node, 1));
   joinAndFree(ir, ir2);
 
   return ir;
 }
 
 // process DefList node
-static List* translateDefList(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateDefList(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _DefList);
-  List* ir = NULL;
+  assert(getNodeType(node) == _DefList);
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  if (getMBTreeNodeType(child) == _Def) {
-    // DefList -> Def DefList
-    ir = translateDef(child);
-    List* ir2 = translateDefList(getMBTreeNodeNextSibling(child));
+  // DefList -> Def DefList | Empty
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    List* ir2 = translateDef(getNodeKid(node, i));
     joinAndFree(ir, ir2);
-  } else if (getMBTreeNodeType(child) == _Empty) {
-    // DefList -> Empty
-    ir = newList(NULL, NULL, NULL);
-  } else {
-    // error
-    assert(0);
   }
 
   return ir;
 }
 
 // process Def node
-static List* translateDef(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateDef(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Def);
-  List* ir = NULL;
+  assert(getNodeType(node) == _Def);
 
   // Def -> Specifier DecList SEMI
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // Specifier
-  child = getMBTreeNodeNextSibling(child);            // DecList
-  ir = translateDecList(child);
-
-  return ir;
+  return translateDecList(getNodeKid(node, 1));
 }
 
 // process DecList node
-static List* translateDecList(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateDecList(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _DecList);
-  List* ir = NULL;
-
-  // DecList -> Dec
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // Dec
-  ir = translateDec(child);
+  assert(getNodeType(node) == _DecList);
 
-  child = getMBTreeNodeNextSibling(child);
-  if (child != NULL) {
-    // DecList -> Dec COMMA DecList
-    assert(getMBTreeNodeType(child) == _COMMA);
-    List* ir2 = translateDecList(getMBTreeNodeNextSibling(child));
+  // DecList -> Dec | Dec COMMA DecList
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    List* ir2 = translateDec(getNodeKid(node, i));
     joinAndFree(ir, ir2);
   }
 
@@ -340,195 +405,66 @@ static List* translateDecList(MBTreeNode* node) {
 }
 
 // process Dec node
-static List* translateDec(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateDec(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Dec);
+  assert(getNodeType(node) == _Dec);
   List* ir = NULL;
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // VarDec
   Operand* place = newOperand(OP_TEMP, getTempNo, NULL);
-  ir = translateVarDec(child, place);
+  ir = translateVarDec(getNodeKid(node, 0), place);  // VarDec
 
-  child = getMBTreeNodeNextSibling(child);
-  if (child == NULL) {
-    // Dec -> VarDec
-    // do nothing
-  } else {
+  if (getNodeKidCount(node) == 2) {
     // Dec -> VarDec ASSIGNOP Exp
-    assert(getMBTreeNodeType(child) == _ASSIGNOP);
     Operand* tmp = newOperand(OP_TEMP, getTempNo, NULL);
-    List* ir2 = translateExp(getMBTreeNodeNextSibling(child), tmp, NOT_LVAL);
+    List* ir2 = translateExp(getNodeKid(node, 1), tmp, NOT_LVAL);
+    assignTo(ir2, place, tmp);
     joinAndFree(ir, ir2);
-
-    listAddNodeTail(ir, newIRCode(IR_ASSIGN, place, tmp));
   }
 
   return ir;
 }
 
 // process Exp node
-static List* translateExp(MBTreeNode* node, Operand* place, int isLVal) {
-  if (node == NULL) {
+static List* translateExp(NodeId node, Operand* place, int isLVal) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Exp);
+  assert(getNodeType(node) == _Exp);
   List* ir = NULL;
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  switch (getMBTreeNodeType(child)) {
-    case _Exp: {
-      MBTreeNode* child2 = getMBTreeNodeNextSibling(child);
-      switch
-        getMBTreeNodeType(child2) {
-          case _ASSIGNOP: {
-            // Exp -> Exp1 ASSIGNOP Exp2
-            Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-            ir = translateExp(getMBTreeNodeNextSibling(child2), t1, NOT_LVAL);
-            List* ir2 = translateExp(child, place, IS_LVAL);
-            joinAndFree(ir, ir2);
-
-            if (place->kind == OP_ADDRESS) {
-              listAddNodeTail(ir, newIRCode(IR_SET_VALUE, place, t1));
-
-              Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
-              listAddNodeTail(ir, newIRCode(IR_GET_VALUE, t2, place));
-              place->kind = OP_TEMP;
-              place->temp_no = t2->temp_no;
-            } else {
-              listAddNodeTail(ir, newIRCode(IR_ASSIGN, place, t1));
-            }
-            break;
-          }
-          case _AND:
-          case _OR:
-          case _RELOP: {
-            // Exp -> Exp AND Exp
-            // Exp -> Exp OR Exp
-            // Exp -> Exp RELOP Exp
-            Operand* label_true = newOperand(OP_LABEL, getLabelNo, NULL);
-            Operand* label_false = newOperand(OP_LABEL, getLabelNo, NULL);
-            ir = newList(NULL, NULL, NULL);
-            listAddNodeTail(ir, newIRCode(IR_ASSIGN, place,
-                                          newOperand(OP_CONSTANT, 0, NULL)));
-            List* ir2 = translateCond(node, label_true, label_false);
-            joinAndFree(ir, ir2);
-            listAddNodeTail(ir, newIRCode(IR_LABEL, label_true));
-            listAddNodeTail(ir,
-                            newIRCode(IR_ASSIGN, place,
-                                      newOperand(OP_CONSTANT, (void*)1, NULL)));
-            listAddNodeTail(ir, newIRCode(IR_LABEL, label_false));
-            break;
-          }
-          case _PLUS:
-          case _MINUS:
-          case _STAR:
-          case _DIV: {
-            // Exp -> Exp PLUS Exp
-            // Exp -> Exp MINUS Exp
-            // Exp -> Exp STAR Exp
-            // Exp -> Exp DIV Exp
-            int kinds[] = {IR_ADD, IR_SUB, IR_MUL, IR_DIV};
-            int ir_kind = kinds[getMBTreeNodeType(child2) - _PLUS];
-
-            Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-            Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
-            ir = translateExp(child, t1, NOT_LVAL);
-            List* ir2 =
-                translateExp(getMBTreeNodeNextSibling(child2), t2, NOT_LVAL);
-            joinAndFree(ir, ir2);
-
-            listAddNodeTail(ir, newIRCode(ir_kind, place, t1, t2));
-            break;
-          }
-          case _DOT: {
-            // Exp -> Exp DOT ID
-            Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-            ir = translateExp(child, t1, IS_LVAL);
-            if (t1->kind == OP_VARIABLE) {
-              getAdressAndSwap(t1, ir);
-            }
-
-            char* id = getID(getMBTreeNodeNextSibling(child2));
-            intptr_t offset = 0;
-            Type* t = NULL;
-            for (FieldList* fl = t1->type->structure.structure; fl;
-                 fl = fl->next) {
-              if (strcmp(fl->name, id) == 0) {
-                t = fl->type;
-                break;
-              }
-              offset += getMemSize(fl->type);
-            }
-
-            if (isLVal) {
-              operandTmp2Addr(place);
-              place->type = t;
-              listAddNodeTail(
-                  ir, newIRCode(IR_ADD, place, t1,
-                                newOperand(OP_CONSTANT, (void*)offset, NULL)));
-            } else {
-              Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
-              listAddNodeTail(
-                  ir, newIRCode(IR_ADD, t2, t1,
-                                newOperand(OP_CONSTANT, (void*)offset, NULL)));
-              listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, t2));
-            }
-            break;
-          }
-          case _LB: {
-            // Exp -> Exp LB Exp RB
-            Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-            Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
-            ir = translateExp(child, t1, IS_LVAL);
-            List* ir2 =
-                translateExp(getMBTreeNodeNextSibling(child2), t2, NOT_LVAL);
-            joinAndFree(ir, ir2);
-
-            if (t1->kind == OP_VARIABLE) {
-              getAdressAndSwap(t1, ir);
-            }
-
-            Type* t = t1->type->array.element;
-            Operand* t3 = newOperand(OP_TEMP, getTempNo, NULL);
-            listAddNodeTail(
-                ir,
-                newIRCode(IR_MUL, t3, t2,
-                          newOperand(OP_CONSTANT, (void*)getMemSize(t), NULL)));
-            if (isLVal) {
-              operandTmp2Addr(place);
-              place->type = t;
-              listAddNodeTail(ir, newIRCode(IR_ADD, place, t1, t3));
-            } else {
-              listAddNodeTail(ir, newIRCode(IR_ADD, t3, t1, t3));
-              listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, t3));
-            }
-            break;
-          }
-          default:
-            // error
-            assert(0);
-            break;
-        }
-      break;
-    }
-    case _LP: {
-      // Exp -> LP Exp RP
-      ir = translateExp(getMBTreeNodeNextSibling(child), place, isLVal);
-      break;
-    }
-    case _MINUS: {
-      // Exp -> MINUS Exp
+  switch (getNodeOp(node)) {
+    case _ASSIGNOP: {
+      // Exp -> Exp1 ASSIGNOP Exp2
+      // the value of the assignment is the value stored
       Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-      ir = translateExp(getMBTreeNodeNextSibling(child), t1, NOT_LVAL);
-      Operand* t2 = newOperand(OP_CONSTANT, 0, NULL);
-      listAddNodeTail(ir, newIRCode(IR_SUB, place, t2, t1));
+      Operand* target = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(getNodeKid(node, 1), t1, NOT_LVAL);
+      List* ir2 = translateExp(getNodeKid(node, 0), target, IS_LVAL);
+
+      if (target->kind == OP_ADDRESS) {
+        joinAndFree(ir, ir2);
+        listAddNodeTail(ir, newIRCode(IR_SET_VALUE, target, t1));
+        *place = *t1;
+      } else {
+        // a variable is assigned by the code computing the value
+        assignTo(ir, target, t1);
+        joinAndFree(ir, ir2);
+        *place = *target;
+      }
       break;
     }
+    case _AND:
+    case _OR:
+    case _RELOP:
     case _NOT: {
+      // Exp -> Exp AND Exp
+      // Exp -> Exp OR Exp
+      // Exp -> Exp RELOP Exp
+      // Exp -> NOT Exp
       Operand* label_true = newOperand(OP_LABEL, getLabelNo, NULL);
       Operand* label_false = newOperand(OP_LABEL, getLabelNo, NULL);
       ir = newList(NULL, NULL, NULL);
@@ -542,94 +478,203 @@ static List* translateExp(MBTreeNode* node, Operand* place, int isLVal) {
       listAddNodeTail(ir, newIRCode(IR_LABEL, label_false));
       break;
     }
+    case _MINUS:
+      if (getNodeKidCount(node) == 1) {
+        // Exp -> MINUS Exp
+        Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
+        ir = translateExp(getNodeKid(node, 0), t1, NOT_LVAL);
+        intptr_t value;
+        if (t1->kind == OP_CONSTANT &&
+            foldConstant(IR_SUB, 0, t1->constant, &value)) {
+          place->kind = OP_CONSTANT;
+          place->constant = value;
+        } else {
+          Operand* t2 = newOperand(OP_CONSTANT, 0, NULL);
+          listAddNodeTail(ir, newIRCode(IR_SUB, place, t2, t1));
+        }
+        break;
+      }
+      // fall through
+    case _PLUS:
+    case _STAR:
+    case _DIV: {
+      // Exp -> Exp PLUS Exp
+      // Exp -> Exp MINUS Exp
+      // Exp -> Exp STAR Exp
+      // Exp -> Exp DIV Exp
+      int kinds[] = {IR_ADD, IR_SUB, IR_MUL, IR_DIV};
+      int ir_kind = kinds[getNodeOp(node) - _PLUS];
+
+      Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
+      Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(getNodeKid(node, 0), t1, NOT_LVAL);
+      List* ir2 = translateExp(getNodeKid(node, 1), t2, NOT_LVAL);
+      joinAndFree(ir, ir2);
+
+      intptr_t value;
+      if (t1->kind == OP_CONSTANT && t2->kind == OP_CONSTANT &&
+          foldConstant(ir_kind, t1->constant, t2->constant, &value)) {
+        place->kind = OP_CONSTANT;
+        place->constant = value;
+      } else {
+        listAddNodeTail(ir, newIRCode(ir_kind, place, t1, t2));
+      }
+      break;
+    }
+    case _DOT: {
+      // Exp -> Exp DOT ID
+      Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(getNodeKid(node, 0), t1, IS_LVAL);
+      if (t1->kind == OP_VARIABLE) {
+        getAdressAndSwap(t1, ir);
+      }
+
+      // an undefined member was reported, it is placed past the end
+      FieldLayout* field = getNodeInfo(node).field;
+      intptr_t offset = field ? field->offset : getMemSize(t1->type);
+      Type* t = field ? field->field->type : NULL;
+
+      // the first field lives at the address of the structure
+      Operand* t2 = t1;
+      if (offset != 0) {
+        t2 = newOperand(OP_TEMP, getTempNo, NULL);
+        operandTmp2Addr(t2);
+        listAddNodeTail(
+            ir, newIRCode(IR_ADD, t2, t1,
+                          newOperand(OP_CONSTANT, (void*)offset, NULL)));
+      }
+      if (isLVal) {
+        *place = *t2;
+        place->type = t;
+      } else {
+        listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, t2));
+      }
+      break;
+    }
+    case _LB: {
+      // Exp -> Exp LB Exp RB
+      Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
+      Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(getNodeKid(node, 0), t1, IS_LVAL);
+      List* ir2 = translateExp(getNodeKid(node, 1), t2, NOT_LVAL);
+      joinAndFree(ir, ir2);
+
+      if (t1->kind == OP_VARIABLE) {
+        getAdressAndSwap(t1, ir);
+      }
+
+      // a constant index is a constant offset
+      Type* t = t1->type->array.element;
+      Operand* size = newOperand(OP_CONSTANT, (void*)getMemSize(t), NULL);
+      Operand* t4 = t1;
+      if (t2->kind == OP_CONSTANT) {
+        size->constant *= t2->constant;
+        if (size->constant != 0) {
+          t4 = newOperand(OP_TEMP, getTempNo, NULL);
+          operandTmp2Addr(t4);
+          listAddNodeTail(ir, newIRCode(IR_ADD, t4, t1, size));
+        }
+      } else {
+        Operand* t3 = newOperand(OP_TEMP, getTempNo, NULL);
+        t4 = newOperand(OP_TEMP, getTempNo, NULL);
+        operandTmp2Addr(t4);
+        listAddNodeTail(ir, newIRCode(IR_MUL, t3, t2, size));
+        listAddNodeTail(ir, newIRCode(IR_ADD, t4, t1, t3));
+      }
+      if (isLVal) {
+        *place = *t4;
+        place->type = t;
+      } else {
+        listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, t4));
+      }
+      break;
+    }
+    case _LP: {
+      // Exp -> LP Exp RP
+      ir = translateExp(getNodeKid(node, 0), place, isLVal);
+      break;
+    }
     case _ID: {
-      char* id = getID(child);
-      Type* t = htFind(ht, id)->val;
+      // Exp -> ID
+      HashEntry* symbol = getNodeInfo(node).symbol;
+      char* id = htGetEntryKey(symbol);
+      Type* t = htGetEntryVal(symbol);
       assert(t != NULL);
 
-      child = getMBTreeNodeNextSibling(child);
-      if (child == NULL) {
-        // Exp -> ID
-        ir = newList(NULL, NULL, NULL);
+      ir = newList(NULL, NULL, NULL);
+
+      // a variable is its own place, no copy is needed
+      Operand* op1 = newOperand(OP_VARIABLE, id, t);
+      place->type = t;
+      place->var_name = id;
+      place->kind = OP_VARIABLE;
 
-        Operand* op1 = newOperand(OP_VARIABLE, id, t);
+      // a structure or an array parameter holds its address
+      if (getNodeInfo(node).param &&
+          (t->kind == ARRAY || t->kind == STRUCTURE)) {
+        op1->kind = OP_ADDRESS;
+      }
+
+      if (op1->kind == OP_ADDRESS) {
         if (isLVal) {
-          place->type = t;
-          place->var_name = id;
-          place->kind = OP_VARIABLE;
+          place->kind = OP_ADDRESS;
+        } else {
+          place->kind = OP_TEMP;
+          place->temp_no = (size_t)getTempNo;
+          listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, op1));
         }
+      }
+      break;
+    }
+    case _Args: {
+      HashEntry* symbol = getNodeInfo(node).symbol;
+      char* id = htGetEntryKey(symbol);
+      Type* t = htGetEntryVal(symbol);
+      assert(t != NULL);
 
-        if (parmList) {
-          ListIter* iter = listGetIterator(parmList, ITER_HEAD);
-          for (ListNode* node = listNext(iter); node; node = listNext(iter)) {
-            Operand* op = node->value;
-            if (op->kind == OP_ADDRESS && strcmp(op->var_name, id) == 0) {
-              op1 = op;
-              break;
-            }
-          }
-        }
+      if (getNodeKidCount(node) == 1) {
+        // Exp -> ID LP RP
+        Operand* op = newOperand(OP_FUNCTION, id, t);
+        ir = newList(NULL, NULL, NULL);
 
-        if (op1->kind == OP_ADDRESS) {
-          if (isLVal) {
-            place->kind = OP_ADDRESS;
-          } else {
-            listAddNodeTail(ir, newIRCode(IR_GET_VALUE, place, op1));
-          }
+        if (strcmp(id, "read") == 0) {
+          listAddNodeTail(ir, newIRCode(IR_READ, place));
         } else {
-          if (!isLVal) {
-            listAddNodeTail(ir, newIRCode(IR_ASSIGN, place, op1));
-          }
+          listAddNodeTail(ir, newIRCode(IR_CALL, place, op));
         }
-      } else if (getMBTreeNodeType(child) == _LP) {
-        child = getMBTreeNodeNextSibling(child);
-        if (getMBTreeNodeType(child) == _RP) {
-          // Exp -> ID LP RP
-          Operand* op = newOperand(OP_FUNCTION, id, t);
-          ir = newList(NULL, NULL, NULL);
-
-          if (strcmp(id, "read") == 0) {
-            listAddNodeTail(ir, newIRCode(IR_READ, place));
-          } else {
-            listAddNodeTail(ir, newIRCode(IR_CALL, place, op));
-          }
-        } else if (getMBTreeNodeType(child) == _Args) {
-          // Exp -> ID LP Args RP
-          List* argList = newList(NULL, NULL, NULL);
-          ir = translateArgs(child, argList);
-          ListIter* iter = listGetIterator(argList, ITER_HEAD);
-
-          if (strcmp(id, "write") == 0) {
-            Operand* arg = listNext(iter)->value;
-            if (arg->kind == OP_ADDRESS) {
-              getValAndSwap(arg, ir);
-            }
-            listAddNodeTail(ir, newIRCode(IR_WRITE, arg));
-            place->kind = OP_CONSTANT;
-            place->constant = 0;
-          } else {
-            ListNode* arg;
-            while ((arg = listNext(iter)) != NULL) {
-              listAddNodeTail(ir, newIRCode(IR_ARG, arg->value));
-            }
-            listAddNodeTail(
-                ir, newIRCode(IR_CALL, place, newOperand(OP_FUNCTION, id, t)));
-          }
-        } else {
-          // error
-          assert(0);
+        break;
+      }
+
+      // Exp -> ID LP Args RP
+      List* argList = newList(NULL, NULL, NULL);
+      ir = translateArgs(getNodeKid(node, 1), argList);
+      ListIter* iter = listGetIterator(argList, ITER_HEAD);
+
+      if (strcmp(id, "write") == 0) {
+        Operand* arg = listNext(iter)->value;
+        if (arg->kind == OP_ADDRESS) {
+          getValAndSwap(arg, ir);
         }
+        listAddNodeTail(ir, newIRCode(IR_WRITE, arg));
+        place->kind = OP_CONSTANT;
+        place->constant = 0;
       } else {
-        // error
-        assert(0);
+        ListNode* arg;
+        while ((arg = listNext(iter)) != NULL) {
+          listAddNodeTail(ir, newIRCode(IR_ARG, arg->value));
+        }
+        listAddNodeTail(
+            ir, newIRCode(IR_CALL, place, newOperand(OP_FUNCTION, id, t)));
       }
+      freeListIterator(iter);
+      freeList(argList);
       break;
     }
     case _INT: {
       // Exp -> INT
       ir = newList(NULL, NULL, NULL);
       place->kind = OP_CONSTANT;
-      place->constant = getINT(child);
+      place->constant = getINT(getNodeKid(node, 0));
       break;
     }
     case _FLOAT: {
@@ -648,124 +693,105 @@ static List* translateExp(MBTreeNode* node, Operand* place, int isLVal) {
 }
 
 // process Args node
-static List* translateArgs(MBTreeNode* node, List* argList) {
-  if (node == NULL) {
+static List* translateArgs(NodeId node, List* argList) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Args);
-
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);  // Exp
-  Operand* tmp = newOperand(OP_TEMP, getTempNo, NULL);
-  List* ir = translateExp(child, tmp, IS_LVAL);
+  assert(getNodeType(node) == _Args);
 
-  if (tmp->kind == OP_VARIABLE && tmp->type->kind == STRUCTURE) {
-    getAdressAndSwap(tmp, ir);
-  } else if (tmp->kind == OP_ADDRESS && tmp->type->kind == BASIC) {
-    getValAndSwap(tmp, ir);
-  }
-  listAddNodeHead(argList, tmp);
+  // Args -> Exp | Exp COMMA Args, the last argument ends up first in argList
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    Operand* tmp = newOperand(OP_TEMP, getTempNo, NULL);
+    List* ir2 = translateExp(getNodeKid(node, i), tmp, IS_LVAL);
 
-  child = getMBTreeNodeNextSibling(child);
-  if (child != NULL) {
-    // Args -> Exp COMMA Args
-    assert(getMBTreeNodeType(child) == _COMMA);
-    List* ir2 = translateArgs(getMBTreeNodeNextSibling(child), argList);
+    if (tmp->kind == OP_VARIABLE && tmp->type->kind == STRUCTURE) {
+      getAdressAndSwap(tmp, ir2);
+    } else if (tmp->kind == OP_ADDRESS && tmp->type->kind == BASIC) {
+      getValAndSwap(tmp, ir2);
+    }
+    listAddNodeHead(argList, tmp);
     joinAndFree(ir, ir2);
   }
 
   return ir;
 }
 
-static List* translateCond(MBTreeNode* node, Operand* label_true,
+static List* translateCond(NodeId node, Operand* label_true,
                            Operand* label_false) {
-  if (node == NULL) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Exp);
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
+  assert(getNodeType(node) == _Exp);
 
   List* ir = NULL;
   Operand* t1 = NULL;
 
-  if (getMBTreeNodeType(child) == _Exp) {
-    MBTreeNode* child2 = getMBTreeNodeNextSibling(child);
-    switch (getMBTreeNodeType(child2)) {
-      case _RELOP: {
-        // Exp -> Exp RELOP Exp
-        Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-        Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
-        ir = translateExp(child, t1, NOT_LVAL);
-        List* ir2 =
-            translateExp(getMBTreeNodeNextSibling(child2), t2, NOT_LVAL);
-        joinAndFree(ir, ir2);
+  switch (getNodeOp(node)) {
+    case _RELOP: {
+      // Exp -> Exp RELOP Exp
+      Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
+      Operand* t2 = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(getNodeKid(node, 0), t1, NOT_LVAL);
+      List* ir2 = translateExp(getNodeKid(node, 1), t2, NOT_LVAL);
+      joinAndFree(ir, ir2);
 
-        listAddNodeTail(
-            ir, newIRCode(IR_IF_GOTO, t1, getMBTreeNodeValue(child2).val_str,
-                          t2, label_true));
-        listAddNodeTail(ir, newIRCode(IR_GOTO, label_false));
-        break;
-      }
-      case _AND: {
-        // Exp -> Exp AND Exp
-        Operand* label1 = newOperand(OP_LABEL, getLabelNo, NULL);
-        ir = translateCond(child, label1, label_false);
-        listAddNodeTail(ir, newIRCode(IR_LABEL, label1));
-        List* ir2 = translateCond(getMBTreeNodeNextSibling(child2), label_true,
-                                  label_false);
-        joinAndFree(ir, ir2);
-        break;
-      }
-      case _OR: {
-        // Exp -> Exp OR Exp
-        Operand* label1 = newOperand(OP_LABEL, getLabelNo, NULL);
-        ir = translateCond(child, label_true, label1);
-        listAddNodeTail(ir, newIRCode(IR_LABEL, label1));
-        List* ir2 = translateCond(getMBTreeNodeNextSibling(child2), label_true,
-                                  label_false);
-        joinAndFree(ir, ir2);
-        break;
-      }
-      default: {
-        goto other;
-      }
+      listAddNodeTail(ir, newIRCode(IR_IF_GOTO, t1, getNodeInfo(node).relop, t2,
+                                    label_true));
+      listAddNodeTail(ir, newIRCode(IR_GOTO, label_false));
+      break;
+    }
+    case _AND: {
+      // Exp -> Exp AND Exp
+      Operand* label1 = newOperand(OP_LABEL, getLabelNo, NULL);
+      ir = translateCond(getNodeKid(node, 0), label1, label_false);
+      listAddNodeTail(ir, newIRCode(IR_LABEL, label1));
+      List* ir2 = translateCond(getNodeKid(node, 1), label_true, label_false);
+      joinAndFree(ir, ir2);
+      break;
+    }
+    case _OR: {
+      // Exp -> Exp OR Exp
+      Operand* label1 = newOperand(OP_LABEL, getLabelNo, NULL);
+      ir = translateCond(getNodeKid(node, 0), label_true, label1);
+      listAddNodeTail(ir, newIRCode(IR_LABEL, label1));
+      List* ir2 = translateCond(getNodeKid(node, 1), label_true, label_false);
+      joinAndFree(ir, ir2);
+      break;
+    }
+    case _NOT: {
+      // Exp -> NOT Exp
+      ir = translateCond(getNodeKid(node, 0), label_false, label_true);
+      break;
+    }
+    default: {
+      t1 = newOperand(OP_TEMP, getTempNo, NULL);
+      ir = translateExp(node, t1, NOT_LVAL);
+      listAddNodeTail(ir,
+                      newIRCode(IR_IF_GOTO, t1, "!=",
+                                newOperand(OP_CONSTANT, 0, NULL), label_true));
+      listAddNodeTail(ir, newIRCode(IR_GOTO, label_false));
+      break;
     }
-  } else if (getMBTreeNodeType(child) == _NOT) {
-    ir =
-        translateCond(getMBTreeNodeNextSibling(child), label_false, label_true);
-  } else {
-    goto other;
   }
 
   return ir;
-
-other:
-  t1 = newOperand(OP_TEMP, getTempNo, NULL);
-  ir = translateExp(node, t1, NOT_LVAL);
-  listAddNodeTail(ir, newIRCode(IR_IF_GOTO, t1, "!=",
-                                newOperand(OP_CONSTANT, 0, NULL), label_true));
-  listAddNodeTail(ir, newIRCode(IR_GOTO, label_false));
-  return ir;
 }
 
 // process StmtList node
-static List* translateStmtList(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateStmtList(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _StmtList);
-  List* ir = NULL;
+  assert(getNodeType(node) == _StmtList);
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  if (getMBTreeNodeType(child) == _Empty) {
-    // StmtList -> Empty
-    ir = newList(NULL, NULL, NULL);
-  } else {
-    // StmtList -> Stmt StmtList
-    ir = translateStmt(child);
-    List* ir2 = translateStmtList(getMBTreeNodeNextSibling(child));
+  // StmtList -> Stmt StmtList | Empty
+  List* ir = newList(NULL, NULL, NULL);
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    List* ir2 = translateStmt(getNodeKid(node, i));
     joinAndFree(ir, ir2);
   }
 
@@ -773,31 +799,30 @@ static List* translateStmtList(MBTreeNode* node) {
 }
 
 // process Stmt node
-static List* translateStmt(MBTreeNode* node) {
-  if (node == NULL) {
+static List* translateStmt(NodeId node) {
+  if (node == 0) {
     return NULL;
   }
 
-  assert(getMBTreeNodeType(node) == _Stmt);
+  assert(getNodeType(node) == _Stmt);
   List* ir = NULL;
 
-  MBTreeNode* child = getMBTreeNodeFirstChild(node);
-  switch (getMBTreeNodeType(child)) {
+  switch (getNodeOp(node)) {
     case _Exp: {
       // Stmt -> Exp SEMI
       Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-      ir = translateExp(child, t1, NOT_LVAL);
+      ir = translateExp(getNodeKid(node, 0), t1, NOT_LVAL);
       break;
     }
     case _CompSt: {
       // Stmt -> CompSt
-      ir = translateCompSt(child);
+      ir = translateCompSt(getNodeKid(node, 0));
       break;
     }
     case _RETURN: {
       // Stmt -> RETURN Exp SEMI
       Operand* t1 = newOperand(OP_TEMP, getTempNo, NULL);
-      ir = translateExp(getMBTreeNodeNextSibling(child), t1, IS_LVAL);
+      ir = translateExp(getNodeKid(node, 0), t1, IS_LVAL);
 
       if (t1->kind == OP_ADDRESS) {
         getValAndSwap(t1, ir);
@@ -812,28 +837,20 @@ static List* translateStmt(MBTreeNode* node) {
       Operand* label1 = newOperand(OP_LABEL, getLabelNo, NULL);
       Operand* label2 = newOperand(OP_LABEL, getLabelNo, NULL);
 
-      child = getMBTreeNodeNextSibling(child);  // LP
-      child = getMBTreeNodeNextSibling(child);  // Exp
-
-      ir = translateCond(child, label1, label2);
+      ir = translateCond(getNodeKid(node, 0), label1, label2);
       listAddNodeTail(ir, newIRCode(IR_LABEL, label1));
 
-      child = getMBTreeNodeNextSibling(child);  // RP
-      child = getMBTreeNodeNextSibling(child);  // Stmt
-
-      List* ir2 = translateStmt(child);
+      List* ir2 = translateStmt(getNodeKid(node, 1));
       joinAndFree(ir, ir2);
 
-      child = getMBTreeNodeNextSibling(child);
-      if (child != NULL) {  // ELSE
+      if (getNodeKidCount(node) == 3) {
         // Stmt -> IF LP Exp RP Stmt ELSE Stmt
         Operand* label3 = newOperand(OP_LABEL, getLabelNo, NULL);
 
         listAddNodeTail(ir, newIRCode(IR_GOTO, label3));
         listAddNodeTail(ir, newIRCode(IR_LABEL, label2));
 
-        child = getMBTreeNodeNextSibling(child);  // Stmt
-        ir2 = translateStmt(child);
+        ir2 = translateStmt(getNodeKid(node, 2));
         joinAndFree(ir, ir2);
 
         listAddNodeTail(ir, newIRCode(IR_LABEL, label3));
@@ -848,17 +865,11 @@ static List* translateStmt(MBTreeNode* node) {
       Operand* label2 = newOperand(OP_LABEL, getLabelNo, NULL);
       Operand* label3 = newOperand(OP_LABEL, getLabelNo, NULL);
 
-      child = getMBTreeNodeNextSibling(child);  // LP
-      child = getMBTreeNodeNextSibling(child);  // Exp
-
-      ir = translateCond(child, label2, label3);
+      ir = translateCond(getNodeKid(node, 0), label2, label3);
       listAddNodeHead(ir, newIRCode(IR_LABEL, label1));
       listAddNodeTail(ir, newIRCode(IR_LABEL, label2));
 
-      child = getMBTreeNodeNextSibling(child);  // RP
-      child = getMBTreeNodeNextSibling(child);  // Stmt
-
-      List* ir2 = translateStmt(child);
+      List* ir2 = translateStmt(getNodeKid(node, 1));
       joinAndFree(ir, ir2);
 
       listAddNodeTail(ir, newIRCode(IR_GOTO, label1));
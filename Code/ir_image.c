@@ -0,0 +1,494 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "data.h"
+#include "hash.h"
+#include "list.h"
+
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+
+static char* relops[] = {"==", "!=", "<", ">=", ">", "<="};
+
+// the operands each kind of code takes, in the order of its slots: a label,
+// a function, a value, a destination, which is no constant, or a declared
+// variable
+static const char* operandsOf[] = {
+    [IR_LABEL] = "l",     [IR_FUNCTION] = "f",  [IR_ASSIGN] = "dv",
+    [IR_ADD] = "dvv",     [IR_SUB] = "dvv",     [IR_MUL] = "dvv",
+    [IR_DIV] = "dvv",     [IR_GET_ADDR] = "dd", [IR_GET_VALUE] = "dv",
+    [IR_SET_VALUE] = "vv", [IR_GOTO] = "l",     [IR_IF_GOTO] = "vvl",
+    [IR_RETURN] = "v",    [IR_DEC] = "x",       [IR_ARG] = "v",
+    [IR_CALL] = "df",     [IR_PARAM] = "d",     [IR_READ] = "d",
+    [IR_WRITE] = "v"};
+
+// the strings of an image being written, by their text
+static HtType stringType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                            .keyDup = NULL,
+                            .valDup = NULL,
+                            .keyCompare = keyCompare,
+                            .keyDestructor = NULL,
+                            .valDestructor = NULL};
+
+typedef struct {
+  HashTable* index;  // text -> its index + 1
+  char** texts;
+  uint32_t* sizes;
+  uint32_t n, capacity;
+  uint32_t bytes;
+} StringTable;
+
+// where the parts of an image start
+typedef struct {
+  size_t sections, codes, strings, text, end;
+} ImageLayout;
+
+static ImageLayout layoutOf(IRImageHeader* header);
+static const char* checkImage(IRImage* image);
+static int operandFits(IRImage* image, IRImageOperand* op, char want);
+static uint32_t internString(StringTable* st, char* s);
+static void encodeOperand(StringTable* st, Operand* op, IRImageOperand* out);
+static Operand* decodeOperand(IRImage* image, IRImageOperand* in,
+                              size_t* max_label, size_t* max_temp);
+static int relopIndex(char* relop);
+
+/*
+ * layout of an image, every part starts 8-byte aligned
+ *
+ * +--------------------+
+ * | IRImageHeader      |
+ * +--------------------+
+ * | IRImageSection     | <- one per function, the codes before the first
+ * | ...                |    function form a section without a name
+ * +--------------------+
+ * | IRImageCode        | <- the codes of all the sections in order
+ * | ...                |
+ * +--------------------+
+ * | IRImageString      | <- where every string is in the text below
+ * | ...                |
+ * +--------------------+
+ * | text               | <- the strings, each ending with '\0'
+ * +--------------------+
+ *
+ */
+
+// write ir as an image with one write, return 0 if it failed
+int writeIRImage(List* ir, FILE* fout) {
+  StringTable st = {.index = htCreate(&stringType, NULL)};
+
+  IRImageHeader header = {.magic = IR_IMAGE_MAGIC,
+                          .version = IR_IMAGE_VERSION};
+  for (ListNode* node = ir->head; node; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION || node == ir->head) header.nsections++;
+    header.ncodes++;
+  }
+  IRImageSection* sections =
+      calloc(header.nsections + 1, sizeof(IRImageSection));
+  IRImageCode* codes = calloc(header.ncodes + 1, sizeof(IRImageCode));
+
+  int s = -1;
+  uint32_t i = 0;
+  for (ListNode* node = ir->head; node; node = node->next, i++) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION || node == ir->head) {
+      s++;
+      sections[s].name = code->kind == IR_FUNCTION
+                             ? internString(&st, code->op->func_name)
+                             : IR_IMAGE_NO_NAME;
+      sections[s].first = i;
+    }
+    sections[s].ncodes++;
+
+    IRImageCode* out = &codes[i];
+    out->kind = code->kind;
+    for (int k = 0; k < 3; k++) out->ops[k].kind = IR_IMAGE_NO_OPERAND;
+    switch (code->kind) {
+      case IR_LABEL:
+      case IR_FUNCTION:
+      case IR_GOTO:
+      case IR_RETURN:
+      case IR_ARG:
+      case IR_PARAM:
+      case IR_READ:
+      case IR_WRITE:
+        encodeOperand(&st, code->op, &out->ops[0]);
+        break;
+      case IR_ASSIGN:
+      case IR_GET_ADDR:
+      case IR_GET_VALUE:
+      case IR_SET_VALUE:
+      case IR_CALL:
+        encodeOperand(&st, code->left, &out->ops[0]);
+        encodeOperand(&st, code->right, &out->ops[1]);
+        break;
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+      case IR_DIV:
+        encodeOperand(&st, code->result, &out->ops[0]);
+        encodeOperand(&st, code->op1, &out->ops[1]);
+        encodeOperand(&st, code->op2, &out->ops[2]);
+        break;
+      case IR_DEC:
+        encodeOperand(&st, code->operand, &out->ops[0]);
+        out->size = code->size;
+        break;
+      case IR_IF_GOTO:
+        encodeOperand(&st, code->op_l, &out->ops[0]);
+        encodeOperand(&st, code->op_r, &out->ops[1]);
+        encodeOperand(&st, code->label, &out->ops[2]);
+        out->relop = relopIndex(code->relop);
+        break;
+      default:
+        // we should never reach here
+        assert(0);
+        break;
+    }
+  }
+  header.nstrings = st.n;
+  header.text_size = st.bytes;
+
+  ImageLayout at = layoutOf(&header);
+  char* buf = calloc(at.end + 1, 1);
+  memcpy(buf, &header, sizeof(header));
+  memcpy(buf + at.sections, sections,
+         header.nsections * sizeof(IRImageSection));
+  memcpy(buf + at.codes, codes, header.ncodes * sizeof(IRImageCode));
+
+  IRImageString* strings = (IRImageString*)(buf + at.strings);
+  uint32_t offset = 0;
+  for (uint32_t k = 0; k < st.n; k++) {
+    size_t len = strlen(st.texts[k]) + 1;
+    memcpy(buf + at.text + offset, st.texts[k], len);
+    strings[k] = (IRImageString){.offset = offset, .size = st.sizes[k]};
+    offset += len;
+  }
+
+  int ok = fwrite(buf, 1, at.end, fout) == at.end;
+
+  free(buf);
+  free(codes);
+  free(sections);
+  free(st.texts);
+  free(st.sizes);
+  htRelease(st.index);
+  return ok;
+}
+
+// map the image in path, NULL if it cannot be read or does not start with
+// the magic number; nothing is parsed, the parts are found from the header.
+// An image that is broken, of another version or cut short, is reported and
+// NULL too, with *broken set
+IRImage* mapIRImage(const char* path, int* broken) {
+  *broken = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IRImageHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = st.st_size;
+  char* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+
+  IRImageHeader* header = (IRImageHeader*)base;
+  if (memcmp(header->magic, IR_IMAGE_MAGIC, 4) != 0) {
+    munmap(base, size);
+    return NULL;
+  }
+
+  IRImage* image = malloc(sizeof(IRImage));
+  *image = (IRImage){.base = base, .size = size, .header = header};
+  const char* error = checkImage(image);
+  if (error) {
+    fprintf(stderr, "%s: %s\n", path, error);
+    unmapIRImage(image);
+    *broken = 1;
+    return NULL;
+  }
+  return image;
+}
+
+void unmapIRImage(IRImage* image) {
+  munmap(image->base, image->size);
+  free(image);
+}
+
+// build the IR codes of an image; the names stay in the image, it must stay
+// mapped while they are used. NULL after reporting the first code the
+// passes cannot take, see findBrokenCode
+List* loadIRImage(IRImage* image, const char* path) {
+  List* ir = newList(NULL, NULL, NULL);
+  size_t max_label = 0, max_temp = 0;
+
+  for (uint32_t i = 0; i < image->header->ncodes; i++) {
+    IRImageCode* in = &image->codes[i];
+    Operand* ops[3] = {NULL, NULL, NULL};
+    for (int k = 0; k < 3; k++) {
+      if (in->ops[k].kind != IR_IMAGE_NO_OPERAND) {
+        ops[k] = decodeOperand(image, &in->ops[k], &max_label, &max_temp);
+      }
+    }
+
+    IRCode* code;
+    switch (in->kind) {
+      case IR_LABEL:
+      case IR_FUNCTION:
+      case IR_GOTO:
+      case IR_RETURN:
+      case IR_ARG:
+      case IR_PARAM:
+      case IR_READ:
+      case IR_WRITE:
+      case IR_ASSIGN:
+      case IR_GET_ADDR:
+      case IR_GET_VALUE:
+      case IR_SET_VALUE:
+      case IR_CALL:
+      case IR_ADD:
+      case IR_SUB:
+      case IR_MUL:
+      case IR_DIV:
+        code = newIRCode(in->kind, ops[0], ops[1], ops[2]);
+        break;
+      case IR_DEC:
+        code = newIRCode(IR_DEC, ops[0], (int)in->size);
+        break;
+      case IR_IF_GOTO:
+        code = newIRCode(IR_IF_GOTO, ops[0], relops[in->relop], ops[1],
+                         ops[2]);
+        break;
+      default:
+        // we should never reach here
+        assert(0);
+        code = NULL;
+        break;
+    }
+    listAddNodeTail(ir, code);
+  }
+
+  const char* why;
+  ListNode* broken = findBrokenCode(ir, &why);
+  if (broken) {
+    uint32_t i = 0;
+    for (ListNode* node = ir->head; node != broken; node = node->next) i++;
+    fprintf(stderr, "%s: code %u: %s\n", path, i, why);
+    freeList(ir);
+    return NULL;
+  }
+
+  reserveIRNumbers(max_label, max_temp);
+  return ir;
+}
+
+// find the parts of image and check every count, index and offset in it,
+// so loading it cannot go astray; return what is wrong, NULL if nothing is
+static const char* checkImage(IRImage* image) {
+  IRImageHeader* header = image->header;
+  size_t size = image->size;
+  if (header->version != IR_IMAGE_VERSION) {
+    return "an IR image of another version";
+  }
+  // each part fits in the file on its own, so their sum cannot wrap around
+  if (header->nsections > size / sizeof(IRImageSection) ||
+      header->ncodes > size / sizeof(IRImageCode) ||
+      header->nstrings > size / sizeof(IRImageString) ||
+      header->text_size > size) {
+    return "a broken IR image, its parts do not fit in it";
+  }
+  ImageLayout at = layoutOf(header);
+  if (at.end != size) return "a broken IR image, its size is wrong";
+  image->sections = (IRImageSection*)(image->base + at.sections);
+  image->codes = (IRImageCode*)(image->base + at.codes);
+  image->strings = (IRImageString*)(image->base + at.strings);
+  image->text = image->base + at.text;
+
+  // every string ends before the text does
+  if (header->text_size > 0 && image->text[header->text_size - 1] != '\0') {
+    return "a broken IR image, its text is cut short";
+  }
+  for (uint32_t i = 0; i < header->nstrings; i++) {
+    IRImageString* string = &image->strings[i];
+    if (string->offset >= header->text_size ||
+        string->size % BASIC_MEM_SIZE != 0) {
+      return "a broken IR image, a string is out of place";
+    }
+  }
+
+  for (uint32_t i = 0; i < header->nsections; i++) {
+    IRImageSection* section = &image->sections[i];
+    if ((section->name != IR_IMAGE_NO_NAME &&
+         section->name >= header->nstrings) ||
+        section->first > header->ncodes ||
+        section->ncodes > header->ncodes - section->first) {
+      return "a broken IR image, a section is out of place";
+    }
+  }
+
+  int nkinds = sizeof(operandsOf) / sizeof(operandsOf[0]);
+  for (uint32_t i = 0; i < header->ncodes; i++) {
+    IRImageCode* in = &image->codes[i];
+    if (in->kind >= nkinds) return "a broken IR image, a code is unknown";
+    const char* want = operandsOf[in->kind];
+    for (int k = 0; k < 3; k++) {
+      char w = *want ? *want++ : '\0';
+      if (!operandFits(image, &in->ops[k], w)) {
+        return "a broken IR image, an operand does not fit its code";
+      }
+    }
+    if ((in->kind == IR_IF_GOTO && in->relop >= 6) ||
+        (in->kind == IR_DEC &&
+         (in->size <= 0 || in->size % BASIC_MEM_SIZE != 0))) {
+      return "a broken IR image, a code does not fit its kind";
+    }
+  }
+  return NULL;
+}
+
+// return 1 if op is what a slot taking want, see operandsOf, may hold
+static int operandFits(IRImage* image, IRImageOperand* op, char want) {
+  if (want == '\0') return op->kind == IR_IMAGE_NO_OPERAND;
+  switch (op->kind) {
+    case OP_CONSTANT:
+      return want == 'v';
+    case OP_TEMP:
+      return (want == 'v' || want == 'd') && op->value >= 0 &&
+             op->value <= MAX_IR_NUMBER;
+    case OP_LABEL:
+      return want == 'l' && op->value >= 0 && op->value <= MAX_IR_NUMBER;
+    case OP_FUNCTION:
+      return want == 'f' && (uint32_t)op->value < image->header->nstrings;
+    case OP_VARIABLE:
+    case OP_ADDRESS: {
+      if ((want != 'v' && want != 'd' &&
+           (want != 'x' || op->kind != OP_VARIABLE)) ||
+          (uint32_t)op->value >= image->header->nstrings) {
+        return 0;
+      }
+      // an address held in a temp is named after it
+      char* name = image->text + image->strings[op->value].offset;
+      if (op->kind == OP_ADDRESS && name[0] == 't') {
+        return strtoul(name + 1, NULL, 10) <= MAX_IR_NUMBER;
+      }
+      return 1;
+    }
+    default:
+      return 0;
+  }
+}
+
+static ImageLayout layoutOf(IRImageHeader* header) {
+  ImageLayout at;
+  at.sections = ALIGN8(sizeof(IRImageHeader));
+  at.codes = ALIGN8(at.sections + header->nsections * sizeof(IRImageSection));
+  at.strings = ALIGN8(at.codes + header->ncodes * sizeof(IRImageCode));
+  at.text = ALIGN8(at.strings + header->nstrings * sizeof(IRImageString));
+  at.end = at.text + header->text_size;
+  return at;
+}
+
+static uint32_t internString(StringTable* st, char* s) {
+  HashEntry* he = htFind(st->index, s);
+  if (he) return (uint32_t)(uintptr_t)htGetEntryVal(he) - 1;
+
+  if (st->n == st->capacity) {
+    st->capacity = st->capacity ? st->capacity * 2 : 64;
+    st->texts = realloc(st->texts, sizeof(char*) * st->capacity);
+    st->sizes = realloc(st->sizes, sizeof(uint32_t) * st->capacity);
+  }
+  st->texts[st->n] = s;
+  st->sizes[st->n] = 0;
+  st->bytes += strlen(s) + 1;
+  htAdd(st->index, s, (void*)(uintptr_t)(st->n + 1));
+  return st->n++;
+}
+
+static void encodeOperand(StringTable* st, Operand* op, IRImageOperand* out) {
+  out->kind = op->kind;
+  switch (op->kind) {
+    case OP_CONSTANT:
+      out->value = op->constant;
+      return;
+    case OP_TEMP:
+      out->value = op->temp_no;
+      return;
+    case OP_LABEL:
+      out->value = op->label_no;
+      return;
+    case OP_FUNCTION:
+      out->value = internString(st, op->func_name);
+      return;
+    case OP_VARIABLE:
+      out->value = internString(st, op->var_name);
+      break;
+    case OP_ADDRESS:
+      out->value = internString(st, op->base_name);
+      break;
+    default:
+      // we should never reach here
+      assert(0);
+      break;
+  }
+
+  // past the IR generation only the size of an object is asked for
+  Type* t = op->type;
+  if (t && (t->kind == ARRAY || t->kind == STRUCTURE)) {
+    st->sizes[out->value] = getMemSize(t);
+  }
+}
+
+static Operand* decodeOperand(IRImage* image, IRImageOperand* in,
+                              size_t* max_label, size_t* max_temp) {
+  switch (in->kind) {
+    case OP_CONSTANT:
+      return newOperand(OP_CONSTANT, (void*)(intptr_t)in->value, NULL);
+    case OP_TEMP:
+      if ((size_t)in->value > *max_temp) *max_temp = in->value;
+      return newOperand(OP_TEMP, (void*)(size_t)in->value, NULL);
+    case OP_LABEL:
+      if ((size_t)in->value > *max_label) *max_label = in->value;
+      return newOperand(OP_LABEL, (void*)(size_t)in->value, NULL);
+    case OP_FUNCTION:
+    case OP_VARIABLE:
+    case OP_ADDRESS: {
+      IRImageString* string = &image->strings[in->value];
+      char* name = image->text + string->offset;
+      if (in->kind == OP_ADDRESS && name[0] == 't') {
+        // an address held in a temp is named after it
+        size_t temp_no = strtoul(name + 1, NULL, 10);
+        if (temp_no > *max_temp) *max_temp = temp_no;
+      }
+
+      // an object of the same size stands for the type of an array or a
+      // structure
+      Type* type = NULL;
+      if (in->kind != OP_FUNCTION && string->size) {
+        type = newTypeArray(newTypeBasic(INT_), string->size / BASIC_MEM_SIZE);
+      }
+      return newOperand(in->kind, name, type);
+    }
+    default:
+      // we should never reach here
+      assert(0);
+      return NULL;
+  }
+}
+
+static int relopIndex(char* relop) {
+  for (int i = 0; i < 6; i++) {
+    if (strcmp(relop, relops[i]) == 0) return i;
+  }
+
+  // we should never reach here
+  assert(0);
+  return -1;
+}
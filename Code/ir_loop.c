@@ -0,0 +1,1291 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+// lattice of the object an address operand points into
+#define BASE_UNDEF -3  // no definition seen yet
+#define BASE_NONE -2   // not an address
+#define BASE_ANY -1    // may point anywhere
+// the objects every parameter passed by address points into, one class
+// past the variables
+#define BASE_PARAM(cfg) ((cfg)->nvars)
+
+// copies a counted loop is unrolled into, see unrollFactor
+#define UNROLL_FACTOR 4
+// the most codes the copies of an unrolled loop may take, a few hundred
+// instructions, well within the instruction cache
+#define MAX_UNROLLED_SIZE 96
+
+// per-function facts used to decide what may leave a loop
+typedef struct LoopInfo {
+  int* base;         // object each variable points into, see BASE_*
+  IRCode** onlyDef;  // the single definition of a variable, NULL otherwise
+  int* defCount;     // definitions of each variable in the whole function
+} LoopInfo;
+
+// a variable stepped by a constant exactly once per iteration
+typedef struct BasicIV {
+  int id;
+  ListNode* def;  // the code stepping it
+  List* block;    // the code list holding def
+  intptr_t step;
+} BasicIV;
+
+// base + scale * the basic variable, stepped right after it
+typedef struct DerivedIV {
+  int biv;
+  intptr_t scale;
+  Operand* base;  // loop-invariant, NULL if none
+  Operand* var;
+} DerivedIV;
+
+// which variables of a block hold a basic variable plus a constant
+typedef struct IVTrack {
+  int nvars;  // variables numbered before the pass started
+  int* bivOf;  // basic variable each variable is, -1 if none
+  BasicIV* bivs;
+  int* rel;  // basic variable each variable is offset from, -1 if none
+  intptr_t* off;
+} IVTrack;
+
+// a counted loop laid out as the blocks first to last, the latch, whose
+// final test keeps the loop going while iv relop bound after the step
+typedef struct CountedLoop {
+  int first, last;
+  Operand* iv;
+  intptr_t step;
+  char* relop;
+  Operand* bound;  // a constant or a variable the loop does not write
+  int size;        // codes in the loop, labels aside
+} CountedLoop;
+
+// the headers forEachLoop ran the pass on, by their code list, which
+// survives the block insertions that renumber the blocks; a pass adds the
+// headers of the loops it makes to leave them alone
+static List* done = NULL;
+// unroll by this many copies, 1 for no unrolling
+int unrollFactor = UNROLL_FACTOR;
+
+static void forEachLoop(CFG* cfg, int (*pass)(CFG* cfg, int l));
+static int hoistLoop(CFG* cfg, int l);
+static int ensurePreheader(CFG* cfg, int l);
+static int reduceLoop(CFG* cfg, int l);
+static int stepOf(CFG* cfg, IVTrack* t, List* codes, ListNode* def, int id,
+                  intptr_t* step);
+static int ivOf(CFG* cfg, IVTrack* t, Operand* op, intptr_t* k);
+static int ivValue(CFG* cfg, IVTrack* t, IRCode* ir, intptr_t* value);
+static void trackIV(CFG* cfg, IVTrack* t, IRCode* ir);
+static int findDerivedIV(DerivedIV** ivs, int* niv, int biv, intptr_t scale,
+                         Operand* base);
+static int entryConstant(CFG* cfg, int l, int id, intptr_t* value);
+static IRCode* replaceExitTest(CFG* cfg, int l, LoopInfo* info, IVTrack* t,
+                               int m, DerivedIV* iv);
+static IRCode* newAddConstant(Operand* dest, Operand* src, intptr_t c);
+static LoopInfo* newLoopInfo(CFG* cfg);
+static void freeLoopInfo(LoopInfo* info);
+static int meetBase(int a, int b);
+static int unrollLoop(CFG* cfg, int l);
+static int countedLoop(CFG* cfg, int l, CountedLoop* c);
+static int tripCount(intptr_t start, CountedLoop* c, int max);
+static char* swapRelop(char* relop);
+static List** copyLoop(CFG* cfg, CountedLoop* c, IRCode* test);
+static void divideCounts(List** blocks, int n, int factor);
+static IRCode* copyCode(CFG* cfg, IRCode* ir, size_t* from, Operand** to,
+                        int n, Operand** names);
+static int isStaticAddress(CFG* cfg, LoopInfo* info, Operand* op,
+                           intptr_t* offset, size_t* size);
+
+// hoist loop-invariant computations of every loop into its preheader
+void loopInvariantCodeMotion(CFG* cfg) { forEachLoop(cfg, hoistLoop); }
+
+// replace multiplies of loop counters by variables stepping along with them
+void inductionVariableReduction(CFG* cfg) { forEachLoop(cfg, reduceLoop); }
+
+// unroll the innermost counted loops, requires the loops laid out by
+// simplifyBranches, each testing its condition at the bottom
+void unrollLoops(CFG* cfg) {
+  if (unrollFactor > 1) forEachLoop(cfg, unrollLoop);
+}
+
+// run pass on every loop once, innermost first, so what an inner loop moves
+// into its preheader can be handled again by the enclosing loop. The pass
+// returns 1 when it changed the blocks, the loops are then found again.
+static void forEachLoop(CFG* cfg, int (*pass)(CFG* cfg, int l)) {
+  done = newList(NULL, NULL, NULL);
+
+  int progress = 1;
+  while (progress) {
+    progress = 0;
+    cfgFindLoops(cfg);
+    for (int l = 0; l < cfg->nloops && !progress; l++) {
+      List* key = cfg->blocks[cfg->loops[l].header]->codes;
+      int seen = 0;
+      for (ListNode* node = done->head; node; node = node->next) {
+        if (node->value == key) seen = 1;
+      }
+      if (seen) continue;
+
+      listAddNodeTail(done, key);
+      progress = pass(cfg, l);
+    }
+  }
+
+  freeList(done);
+  done = NULL;
+}
+
+// move the invariant codes of loop l to its preheader, return 1 if the
+// function changed
+static int hoistLoop(CFG* cfg, int l) {
+  cfgLiveness(cfg);
+  LoopInfo* info = newLoopInfo(cfg);
+
+  Loop* loop = &cfg->loops[l];
+  int nv = cfg->nvars;
+  int* defs = calloc(nv + 1, sizeof(int));
+  char* invariant = calloc(nv + 1, 1);
+  int hasCall = 0;
+
+  // stores are summarized by the objects they may write
+  char* stored = calloc(nv + 1, 1);
+  int storesAnywhere = 0;
+
+  for (int b = 0; b < cfg->nblocks; b++) {
+    if (!loop->body[b]) continue;
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      Operand** def = irDefOperand(ir);
+      if (def && cfgVarId(cfg, *def) >= 0) defs[cfgVarId(cfg, *def)]++;
+      if (ir->kind == IR_CALL) hasCall = 1;
+      if (ir->kind == IR_SET_VALUE) {
+        int id = cfgVarId(cfg, ir->left);
+        int base = id >= 0 ? info->base[id] : BASE_ANY;
+        if (base >= 0) {
+          stored[base] = 1;
+        } else {
+          storesAnywhere = 1;
+        }
+      }
+    }
+  }
+
+  // the blocks leaving the loop and the blocks they leave to
+  int* exiting = malloc(sizeof(int) * (cfg->nblocks * 2 + 1));
+  int* exits = exiting + cfg->nblocks;
+  int nexiting = 0, nexits = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    if (!loop->body[b]) continue;
+    BasicBlock* bb = cfg->blocks[b];
+    int leaves = 0;
+    for (int i = 0; i < bb->nsucc; i++) {
+      if (!loop->body[bb->succ[i]]) {
+        exits[nexits++] = bb->succ[i];
+        leaves = 1;
+      }
+    }
+    if (leaves) exiting[nexiting++] = b;
+  }
+
+  // mark invariant codes until nothing changes, hoisted codes keep the
+  // order they were found in, so each one follows the codes it reads
+  ListNode** marked = NULL;
+  List** markedBlock = NULL;
+  int nmarked = 0;
+  uint32_t* headerIn = cfg->liveIn[loop->header];
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 0; i < cfg->nreach; i++) {
+      int b = cfg->order[i];
+      if (!loop->body[b]) continue;
+
+      int dominatesExits = 1;
+      for (int j = 0; j < nexiting; j++) {
+        if (!cfgDominates(cfg, b, exiting[j])) dominatesExits = 0;
+      }
+
+      for (ListNode* node = cfg->blocks[b]->codes->head; node;
+           node = node->next) {
+        IRCode* ir = node->value;
+        switch (ir->kind) {
+          case IR_ASSIGN:
+          case IR_ADD:
+          case IR_SUB:
+          case IR_MUL:
+          case IR_GET_ADDR:
+            break;
+          case IR_DIV:
+            // a division by zero must not be executed speculatively
+            if (ir->op2->kind != OP_CONSTANT || ir->op2->constant == 0) {
+              continue;
+            }
+            break;
+          case IR_GET_VALUE:
+            if (hasCall) continue;
+            break;
+          default:
+            continue;
+        }
+
+        int d = cfgVarId(cfg, *irDefOperand(ir));
+        if (d < 0 || invariant[d] || defs[d] != 1 || bitTest(headerIn, d)) {
+          continue;
+        }
+
+        Operand** uses[3];
+        int n = irUseOperands(ir, uses);
+        int ok = 1;
+        for (int j = 0; j < n; j++) {
+          int u = cfgVarId(cfg, *uses[j]);
+          if (defs[u] != 0 && !invariant[u]) ok = 0;
+        }
+        if (!ok) continue;
+
+        // a value still needed after the loop must be the one the loop
+        // computes, which a zero-trip path would not
+        if (!dominatesExits) {
+          for (int j = 0; j < nexits; j++) {
+            if (bitTest(cfg->liveIn[exits[j]], d)) ok = 0;
+          }
+        }
+
+        if (ok && ir->kind == IR_GET_VALUE) {
+          // the loop must not write the object and the load must not fault
+          // if the loop body never runs
+          int id = cfgVarId(cfg, ir->right);
+          int base = id >= 0 ? info->base[id] : BASE_ANY;
+          intptr_t off;
+          size_t size;
+          if (base < 0 || storesAnywhere || stored[base]) {
+            ok = 0;
+          } else if (!dominatesExits &&
+                     !isStaticAddress(cfg, info, ir->right, &off, &size)) {
+            ok = 0;
+          }
+        }
+        if (!ok) continue;
+
+        invariant[d] = 1;
+        marked = realloc(marked, sizeof(ListNode*) * (nmarked + 1));
+        markedBlock = realloc(markedBlock, sizeof(List*) * (nmarked + 1));
+        marked[nmarked] = node;
+        markedBlock[nmarked] = cfg->blocks[b]->codes;
+        nmarked++;
+        changed = 1;
+      }
+    }
+  }
+
+  if (nmarked > 0) {
+    int ph = ensurePreheader(cfg, l);
+    List* codes = cfg->blocks[ph]->codes;
+    ListNode* jump = NULL;
+    if (codes->tail && ((IRCode*)codes->tail->value)->kind == IR_GOTO) {
+      jump = codes->tail;
+    }
+    for (int i = 0; i < nmarked; i++) {
+      IRCode* ir = marked[i]->value;
+      listDelNode(markedBlock[i], marked[i]);
+      // it runs as often as the preheader now, not as the loop
+      ir->count = blockCount(cfg, ph);
+      if (jump) {
+        listInsertNode(codes, jump, ir, 0);
+      } else {
+        listAddNodeTail(codes, ir);
+      }
+    }
+  }
+
+  free(marked);
+  free(markedBlock);
+  free(exiting);
+  free(defs);
+  free(invariant);
+  free(stored);
+  freeLoopInfo(info);
+  return nmarked > 0;
+}
+
+// return the block every entry into loop l passes through last, creating
+// one right before the header when there is none
+static int ensurePreheader(CFG* cfg, int l) {
+  Loop* loop = &cfg->loops[l];
+  int h = loop->header;
+  BasicBlock* header = cfg->blocks[h];
+
+  int outside = -1, noutside = 0;
+  for (int i = 0; i < header->npred; i++) {
+    if (!loop->body[header->preds[i]]) {
+      outside = header->preds[i];
+      noutside++;
+    }
+  }
+  if (noutside == 1 && h != 0 && cfg->blocks[outside]->nsucc == 1) {
+    List* codes = cfg->blocks[outside]->codes;
+    if (codes->tail == NULL ||
+        ((IRCode*)codes->tail->value)->kind != IR_IF_GOTO) {
+      return outside;
+    }
+  }
+
+  Operand* headerLabel = cfgBlockLabel(cfg, h);
+  Operand* label = newOperand(OP_LABEL, (void*)newLabelNo(), NULL);
+
+  // jumps from outside the loop now enter through the preheader
+  for (int i = 0; i < header->npred; i++) {
+    int p = header->preds[i];
+    if (loop->body[p]) continue;
+    IRCode* last = cfg->blocks[p]->codes->tail->value;
+    if (last->kind == IR_GOTO && last->op->label_no == headerLabel->label_no) {
+      last->op = label;
+    } else if (last->kind == IR_IF_GOTO &&
+               last->label->label_no == headerLabel->label_no) {
+      last->label = label;
+    }
+  }
+
+  // a block of the loop falling through into the header has to jump over
+  // the preheader now
+  int pos = h;
+  if (h > 0 && loop->body[h - 1]) {
+    BasicBlock* prev = cfg->blocks[h - 1];
+    IRCode* last = prev->codes->tail ? prev->codes->tail->value : NULL;
+    if (last == NULL || last->kind == IR_IF_GOTO) {
+      List* jump = newList(NULL, NULL, NULL);
+      listAddNodeTail(jump, newIRCode(IR_GOTO, headerLabel));
+      cfgInsertBlock(cfg, pos++, jump);
+    } else if (last->kind != IR_GOTO && last->kind != IR_RETURN) {
+      listAddNodeTail(prev->codes, newIRCode(IR_GOTO, headerLabel));
+    }
+  }
+
+  List* codes = newList(NULL, NULL, NULL);
+  listAddNodeTail(codes, newIRCode(IR_LABEL, label));
+  cfgInsertBlock(cfg, pos, codes);
+  return pos;
+}
+
+// strength-reduce the multiplies of the basic induction variables of loop l,
+// then test the new variable instead of a basic one that is used for
+// nothing else, return 1 if the function changed
+static int reduceLoop(CFG* cfg, int l) {
+  cfgLiveness(cfg);
+  LoopInfo* info = newLoopInfo(cfg);
+
+  Loop* loop = &cfg->loops[l];
+  BasicBlock* header = cfg->blocks[loop->header];
+  int nv = cfg->nvars;
+  int* defs = calloc(nv + 1, sizeof(int));
+  int* uses = calloc(nv + 1, sizeof(int));
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      Operand** u[3];
+      int n = irUseOperands(node->value, u);
+      for (int i = 0; i < n; i++) uses[cfgVarId(cfg, *u[i])]++;
+      Operand** def = irDefOperand(node->value);
+      if (loop->body[b] && def) defs[cfgVarId(cfg, *def)]++;
+    }
+  }
+
+  IVTrack t;
+  t.nvars = nv;
+  t.bivOf = malloc(sizeof(int) * (nv + 1));
+  t.rel = malloc(sizeof(int) * (nv + 1));
+  t.off = malloc(sizeof(intptr_t) * (nv + 1));
+  t.bivs = NULL;
+
+  // a basic variable is stepped in a block of no inner loop that runs on
+  // every iteration
+  int nbiv = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    if (!loop->body[b] || cfg->blocks[b]->loop != l) continue;
+    int everyIteration = 1;
+    for (int i = 0; i < header->npred; i++) {
+      int p = header->preds[i];
+      if (loop->body[p] && !cfgDominates(cfg, b, p)) everyIteration = 0;
+    }
+    if (!everyIteration) continue;
+
+    List* codes = cfg->blocks[b]->codes;
+    for (ListNode* node = codes->head; node; node = node->next) {
+      Operand** def = irDefOperand(node->value);
+      if (def == NULL) continue;
+      int id = cfgVarId(cfg, *def);
+      intptr_t step;
+      if (defs[id] != 1 || !stepOf(cfg, &t, codes, node, id, &step)) continue;
+      t.bivs = realloc(t.bivs, sizeof(BasicIV) * (nbiv + 1));
+      t.bivs[nbiv++] = (BasicIV){id, node, codes, step};
+    }
+  }
+
+  for (int i = 0; i < nv; i++) t.bivOf[i] = -1;
+  for (int i = 0; i < nbiv; i++) t.bivOf[t.bivs[i].id] = i;
+
+  DerivedIV* ivs = NULL;
+  int niv = 0;
+  for (int b = 0; b < cfg->nblocks && nbiv > 0; b++) {
+    if (!loop->body[b]) continue;
+    List* codes = cfg->blocks[b]->codes;
+    for (int i = 0; i < nv; i++) t.rel[i] = -1;
+
+    ListNode* next;
+    for (ListNode* node = codes->head; node; node = next) {
+      next = node->next;
+      IRCode* ir = node->value;
+      if (ir->kind != IR_MUL) {
+        trackIV(cfg, &t, ir);
+        continue;
+      }
+
+      Operand* x = ir->op1;
+      Operand* c = ir->op2;
+      if (x->kind == OP_CONSTANT) {
+        x = ir->op2;
+        c = ir->op1;
+      }
+      intptr_t k;
+      int m = ivOf(cfg, &t, x, &k);
+      if (m < 0 || c->kind != OP_CONSTANT || c->constant == 0) {
+        trackIV(cfg, &t, ir);
+        continue;
+      }
+
+      // a product only added to an invariant base is folded with the base
+      // into one variable, as array indexing does, copies on the way are
+      // dropped
+      int pid = cfgVarId(cfg, ir->result);
+      Operand* value = ir->result;
+      ListNode* copies[4];
+      int ncopies = 0;
+      ListNode* use = NULL;
+      for (ListNode* after = next; after; after = after->next) {
+        IRCode* code = after->value;
+        Operand** u[3];
+        int n = irUseOperands(code, u);
+        int reads = 0;
+        for (int i = 0; i < n; i++) reads |= sameOperand(*u[i], value);
+        Operand** def = irDefOperand(code);
+        if (!reads) {
+          if (def && sameOperand(*def, value)) break;
+          continue;
+        }
+
+        // the value has to die where it is read
+        int id = cfgVarId(cfg, value);
+        if (uses[id] != 1 && !(def && sameOperand(*def, value))) break;
+        if (code->kind == IR_ASSIGN && ncopies < 4) {
+          copies[ncopies++] = after;
+          value = code->left;
+          continue;
+        }
+        if (code->kind == IR_ADD) use = after;
+        break;
+      }
+
+      Operand* base = NULL;
+      if (use) {
+        IRCode* add = use->value;
+        base = sameOperand(add->op1, value) ? add->op2 : add->op1;
+        int id = cfgVarId(cfg, base);
+        if (id < 0 || id >= nv || sameOperand(base, value) || defs[id] != 0) {
+          base = NULL;
+        }
+      }
+
+      int v = findDerivedIV(&ivs, &niv, m, c->constant, base);
+      if (base) {
+        IRCode* add = use->value;
+        use->value = newAddConstant(add->result, ivs[v].var, k * c->constant);
+        for (int i = 0; i < ncopies; i++) {
+          if (next == copies[i]) next = copies[i]->next;
+          listDelNode(codes, copies[i]);
+        }
+        listDelNode(codes, node);
+        t.rel[pid] = -1;
+      } else {
+        node->value = newAddConstant(ir->result, ivs[v].var, k * c->constant);
+        trackIV(cfg, &t, node->value);
+      }
+    }
+  }
+
+  // the derived variables step right after their basic variable
+  for (int v = 0; v < niv; v++) {
+    BasicIV* biv = &t.bivs[ivs[v].biv];
+    IRCode* step = newAddConstant(ivs[v].var, ivs[v].var,
+                                  biv->step * ivs[v].scale);
+    listInsertNode(biv->block, biv->def, step, 1);
+  }
+
+  IRCode** limits = calloc(niv + 1, sizeof(IRCode*));
+  for (int v = 0; v < niv; v++) {
+    BasicIV* biv = &t.bivs[ivs[v].biv];
+    if (biv->def == NULL || ivs[v].base == NULL) continue;
+    limits[v] = replaceExitTest(cfg, l, info, &t, ivs[v].biv, &ivs[v]);
+    if (limits[v]) {
+      listDelNode(biv->block, biv->def);
+      biv->def = NULL;
+    }
+  }
+
+  if (niv > 0) {
+    int ph = ensurePreheader(cfg, l);
+    List* codes = cfg->blocks[ph]->codes;
+    ListNode* jump = NULL;
+    if (codes->tail && ((IRCode*)codes->tail->value)->kind == IR_GOTO) {
+      jump = codes->tail;
+    }
+
+    List* init = newList(NULL, NULL, NULL);
+    for (int v = 0; v < niv; v++) {
+      Operand* var = ivs[v].var;
+      Operand* biv = cfg->vars[t.bivs[ivs[v].biv].id];
+      if (ivs[v].scale == 1) {
+        listAddNodeTail(init, newIRCode(IR_ASSIGN, var, biv));
+      } else {
+        Operand* scale = newOperand(OP_CONSTANT, (void*)ivs[v].scale, NULL);
+        listAddNodeTail(init, newIRCode(IR_MUL, var, biv, scale));
+      }
+      if (ivs[v].base) {
+        listAddNodeTail(init, newIRCode(IR_ADD, var, ivs[v].base, var));
+      }
+      if (limits[v]) listAddNodeTail(init, limits[v]);
+    }
+    for (ListNode* node = init->head; node; node = node->next) {
+      if (jump) {
+        listInsertNode(codes, jump, node->value, 0);
+      } else {
+        listAddNodeTail(codes, node->value);
+      }
+    }
+    freeList(init);
+  }
+
+  int changed = niv > 0;
+  free(limits);
+  free(ivs);
+  free(t.bivs);
+  free(t.bivOf);
+  free(t.rel);
+  free(t.off);
+  free(defs);
+  free(uses);
+  freeLoopInfo(info);
+  return changed;
+}
+
+// return 1 if the code def makes variable id its value at the top of codes
+// plus a constant, stored in step
+static int stepOf(CFG* cfg, IVTrack* t, List* codes, ListNode* def, int id,
+                  intptr_t* step) {
+  for (int i = 0; i < t->nvars; i++) {
+    t->bivOf[i] = -1;
+    t->rel[i] = -1;
+  }
+  t->bivOf[id] = 0;
+
+  for (ListNode* node = codes->head; node != def; node = node->next) {
+    trackIV(cfg, t, node->value);
+  }
+  return ivValue(cfg, t, def->value, step) == 0 && *step != 0;
+}
+
+// the basic variable op holds plus *k, -1 if none
+static int ivOf(CFG* cfg, IVTrack* t, Operand* op, intptr_t* k) {
+  int id = cfgVarId(cfg, op);
+  if (id < 0 || id >= t->nvars) return -1;
+  if (t->bivOf[id] >= 0) {
+    *k = 0;
+    return t->bivOf[id];
+  }
+  *k = t->off[id];
+  return t->rel[id];
+}
+
+// the basic variable the value computed by ir is offset from, -1 if none
+static int ivValue(CFG* cfg, IVTrack* t, IRCode* ir, intptr_t* value) {
+  switch (ir->kind) {
+    case IR_ASSIGN:
+      return ivOf(cfg, t, ir->right, value);
+    case IR_ADD:
+    case IR_SUB: {
+      Operand* x = ir->op1;
+      Operand* c = ir->op2;
+      if (ir->kind == IR_ADD && x->kind == OP_CONSTANT) {
+        x = ir->op2;
+        c = ir->op1;
+      }
+      if (c->kind != OP_CONSTANT) return -1;
+      int m = ivOf(cfg, t, x, value);
+      if (m >= 0) *value += ir->kind == IR_ADD ? c->constant : -c->constant;
+      return m;
+    }
+    default:
+      return -1;
+  }
+}
+
+// update the offsets after ir has run
+static void trackIV(CFG* cfg, IVTrack* t, IRCode* ir) {
+  Operand** def = irDefOperand(ir);
+  int d = def ? cfgVarId(cfg, *def) : -1;
+  if (d < 0 || d >= t->nvars) return;
+
+  if (t->bivOf[d] >= 0) {
+    // the basic variable stepped, what was offset from it moves back
+    int m = t->bivOf[d];
+    for (int i = 0; i < t->nvars; i++) {
+      if (t->rel[i] == m) t->off[i] -= t->bivs[m].step;
+    }
+    return;
+  }
+
+  intptr_t value;
+  int m = ivValue(cfg, t, ir, &value);
+  t->rel[d] = m;
+  t->off[d] = value;
+}
+
+static int findDerivedIV(DerivedIV** ivs, int* niv, int biv, intptr_t scale,
+                         Operand* base) {
+  for (int i = 0; i < *niv; i++) {
+    DerivedIV* iv = &(*ivs)[i];
+    if (iv->biv == biv && iv->scale == scale && sameOperand(iv->base, base)) {
+      return i;
+    }
+  }
+
+  *ivs = realloc(*ivs, sizeof(DerivedIV) * (*niv + 1));
+  Operand* var = newOperand(OP_TEMP, (void*)newTempNo(), NULL);
+  (*ivs)[*niv] = (DerivedIV){biv, scale, base, var};
+  return (*niv)++;
+}
+
+// return 1 if variable id is set to a constant on every entry into loop l
+static int entryConstant(CFG* cfg, int l, int id, intptr_t* value) {
+  Loop* loop = &cfg->loops[l];
+  BasicBlock* header = cfg->blocks[loop->header];
+  int p = -1;
+  for (int i = 0; i < header->npred; i++) {
+    if (loop->body[header->preds[i]]) continue;
+    if (p >= 0) return 0;
+    p = header->preds[i];
+  }
+
+  // walk up through blocks with a single way in
+  for (int hops = 0; p >= 0 && hops < cfg->nblocks; hops++) {
+    List* codes = cfg->blocks[p]->codes;
+    for (ListNode* node = codes->tail; node; node = node->prev) {
+      IRCode* ir = node->value;
+      Operand** def = irDefOperand(ir);
+      if (def == NULL || cfgVarId(cfg, *def) != id) continue;
+      if (ir->kind != IR_ASSIGN || ir->right->kind != OP_CONSTANT) return 0;
+      *value = ir->right->constant;
+      return 1;
+    }
+    p = cfg->blocks[p]->npred == 1 ? cfg->blocks[p]->preds[0] : -1;
+  }
+  return 0;
+}
+
+// rewrite the exit test of loop l on basic variable m into one on iv, if m
+// is used for nothing else, and return the code computing the new bound in
+// the preheader, NULL if the test was left alone
+static IRCode* replaceExitTest(CFG* cfg, int l, LoopInfo* info, IVTrack* t,
+                               int m, DerivedIV* iv) {
+  Loop* loop = &cfg->loops[l];
+  BasicIV* biv = &t->bivs[m];
+  intptr_t offset, start;
+  size_t size;
+  if (iv->scale <= 0 || !entryConstant(cfg, l, biv->id, &start) ||
+      !isStaticAddress(cfg, info, iv->base, &offset, &size)) {
+    return NULL;
+  }
+
+  // find a test of the variable against a constant leaving the loop
+  ListNode* test = NULL;
+  int left = 0;
+  intptr_t bound = 0;
+  for (int b = 0; b < cfg->nblocks && test == NULL; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    if (!loop->body[b] || bb->codes->tail == NULL) continue;
+    IRCode* last = bb->codes->tail->value;
+    int leaves = 0;
+    for (int i = 0; i < bb->nsucc; i++) leaves |= !loop->body[bb->succ[i]];
+    if (last->kind != IR_IF_GOTO || !leaves) continue;
+
+    for (int i = 0; i < t->nvars; i++) t->rel[i] = -1;
+    for (ListNode* node = bb->codes->head; node != bb->codes->tail;
+         node = node->next) {
+      trackIV(cfg, t, node->value);
+    }
+    intptr_t k;
+    if (last->op_r->kind == OP_CONSTANT && ivOf(cfg, t, last->op_l, &k) == m) {
+      left = 1;
+      bound = last->op_r->constant - k;
+      test = bb->codes->tail;
+    } else if (last->op_l->kind == OP_CONSTANT &&
+               ivOf(cfg, t, last->op_r, &k) == m) {
+      bound = last->op_l->constant - k;
+      test = bb->codes->tail;
+    }
+  }
+  if (test == NULL) return NULL;
+
+  // the pointer has to stay within the object, so that comparing it is
+  // comparing the index
+  IRCode* ir = test->value;
+  char* relop = ir->relop;
+  if (!left) {
+    if (strcmp(relop, "<") == 0) {
+      relop = ">";
+    } else if (strcmp(relop, "<=") == 0) {
+      relop = ">=";
+    } else if (strcmp(relop, ">") == 0) {
+      relop = "<";
+    } else if (strcmp(relop, ">=") == 0) {
+      relop = "<=";
+    }
+  }
+  int ok;
+  if (strcmp(relop, "!=") == 0) {
+    ok = (bound - start) % biv->step == 0 &&
+         (biv->step > 0 ? bound >= start : bound <= start);
+  } else if (biv->step > 0) {
+    ok = strcmp(relop, "<") == 0 || strcmp(relop, "<=") == 0;
+  } else {
+    ok = strcmp(relop, ">") == 0 || strcmp(relop, ">=") == 0;
+  }
+  intptr_t hi = start > bound ? start : bound;
+  if (!ok || start < 0 || bound < 0 ||
+      offset + iv->scale * hi > (intptr_t)size) {
+    return NULL;
+  }
+
+  // everything computed from the variable in the loop must die with it
+  int nv = t->nvars;
+  char* derived = calloc(nv + 1, 1);
+  derived[biv->id] = 1;
+  int changed = 1;
+  while (changed && ok) {
+    changed = 0;
+    for (int b = 0; b < cfg->nblocks && ok; b++) {
+      if (!loop->body[b]) continue;
+      for (ListNode* node = cfg->blocks[b]->codes->head; node && ok;
+           node = node->next) {
+        if (node == biv->def || node == test) continue;
+        IRCode* code = node->value;
+        Operand** u[3];
+        int n = irUseOperands(code, u);
+        int reads = 0;
+        for (int i = 0; i < n; i++) {
+          int id = cfgVarId(cfg, *u[i]);
+          if (id < nv && derived[id]) reads = 1;
+        }
+        if (!reads) continue;
+
+        // copies and constant offsets die along with what they read
+        Operand** def = irDefOperand(code);
+        int d = def ? cfgVarId(cfg, *def) : -1;
+        int offsets = code->kind == IR_ASSIGN ||
+                      ((code->kind == IR_ADD || code->kind == IR_SUB) &&
+                       (code->op1->kind == OP_CONSTANT ||
+                        code->op2->kind == OP_CONSTANT));
+        if (d < 0 || d >= nv || !offsets) {
+          ok = 0;
+        } else if (!derived[d]) {
+          derived[d] = 1;
+          changed = 1;
+        }
+      }
+    }
+  }
+  for (int b = 0; b < cfg->nblocks && ok; b++) {
+    if (!loop->body[b]) continue;
+    BasicBlock* bb = cfg->blocks[b];
+    for (int i = 0; i < bb->nsucc; i++) {
+      if (loop->body[bb->succ[i]]) continue;
+      for (int id = 0; id < nv; id++) {
+        if (derived[id] && bitTest(cfg->liveIn[bb->succ[i]], id)) ok = 0;
+      }
+    }
+  }
+  free(derived);
+  if (!ok) return NULL;
+
+  Operand* limit = newOperand(OP_TEMP, (void*)newTempNo(), NULL);
+  Operand* op_l = left ? iv->var : limit;
+  Operand* op_r = left ? limit : iv->var;
+  test->value = newIRCode(IR_IF_GOTO, op_l, ir->relop, op_r, ir->label);
+  ((IRCode*)test->value)->count = ir->count;
+  return newAddConstant(limit, iv->base, bound * iv->scale);
+}
+
+// dest := src + c, a copy if c is 0
+static IRCode* newAddConstant(Operand* dest, Operand* src, intptr_t c) {
+  if (c == 0) return newIRCode(IR_ASSIGN, dest, src);
+  return newIRCode(IR_ADD, dest, src, newOperand(OP_CONSTANT, (void*)c, NULL));
+}
+
+static int meetBase(int a, int b) {
+  if (a == BASE_UNDEF) return b;
+  if (b == BASE_UNDEF || a == b) return a;
+  return BASE_ANY;
+}
+
+// find out which object every address points into and which variables
+// have a single definition
+static LoopInfo* newLoopInfo(CFG* cfg) {
+  int nv = cfg->nvars;
+  LoopInfo* info = malloc(sizeof(LoopInfo));
+  info->base = malloc(sizeof(int) * (nv + 1));
+  info->onlyDef = calloc(nv + 1, sizeof(IRCode*));
+  info->defCount = calloc(nv + 1, sizeof(int));
+  for (int i = 0; i < nv; i++) info->base[i] = BASE_UNDEF;
+
+  List* all = cfgLinearize(cfg);
+  for (ListNode* node = all->head; node; node = node->next) {
+    IRCode* ir = node->value;
+    Operand** def = irDefOperand(ir);
+    if (def == NULL) continue;
+    int d = cfgVarId(cfg, *def);
+    info->defCount[d]++;
+    info->onlyDef[d] = info->defCount[d] == 1 ? ir : NULL;
+  }
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (ListNode* node = all->head; node; node = node->next) {
+      IRCode* ir = node->value;
+      Operand** def = irDefOperand(ir);
+      if (def == NULL) continue;
+
+      int base = BASE_NONE;
+      switch (ir->kind) {
+        case IR_GET_ADDR:
+          base = cfgVarId(cfg, ir->right);
+          break;
+        case IR_PARAM:
+          // structures and arrays are passed by address, and the caller may
+          // pass one object for several of them
+          if (ir->op->kind == OP_ADDRESS) base = BASE_PARAM(cfg);
+          break;
+        case IR_ASSIGN: {
+          int id = cfgVarId(cfg, ir->right);
+          base = id >= 0 ? info->base[id] : BASE_NONE;
+          break;
+        }
+        case IR_ADD:
+        case IR_SUB: {
+          int id1 = cfgVarId(cfg, ir->op1);
+          int id2 = cfgVarId(cfg, ir->op2);
+          int b1 = id1 >= 0 ? info->base[id1] : BASE_NONE;
+          int b2 = id2 >= 0 ? info->base[id2] : BASE_NONE;
+          if (b1 == BASE_NONE || b1 == BASE_UNDEF) {
+            base = ir->kind == IR_ADD ? b2 : BASE_NONE;
+          } else if (b2 == BASE_NONE || b2 == BASE_UNDEF) {
+            base = b1;
+          } else {
+            base = BASE_ANY;
+          }
+          if (base == BASE_UNDEF) base = BASE_NONE;
+          break;
+        }
+        default:
+          break;
+      }
+
+      int d = cfgVarId(cfg, *def);
+      int meet = meetBase(info->base[d], base);
+      if (meet != info->base[d]) {
+        info->base[d] = meet;
+        changed = 1;
+      }
+    }
+  }
+
+  freeList(all);
+  return info;
+}
+
+static void freeLoopInfo(LoopInfo* info) {
+  free(info->base);
+  free(info->onlyDef);
+  free(info->defCount);
+  free(info);
+}
+
+// return 1 if op is an address inside a local object, at a constant offset
+// within the object
+static int isStaticAddress(CFG* cfg, LoopInfo* info, Operand* op,
+                           intptr_t* offset, size_t* size) {
+  int id = cfgVarId(cfg, op);
+  if (id < 0 || info->defCount[id] != 1) return 0;
+
+  IRCode* def = info->onlyDef[id];
+  switch (def->kind) {
+    case IR_GET_ADDR:
+      *offset = 0;
+      *size = getMemSize(def->right->type);
+      return *size > 0;
+    case IR_ADD: {
+      Operand* base = def->op1;
+      Operand* c = def->op2;
+      if (base->kind == OP_CONSTANT) {
+        base = def->op2;
+        c = def->op1;
+      }
+      if (c->kind != OP_CONSTANT) return 0;
+      if (!isStaticAddress(cfg, info, base, offset, size)) return 0;
+      *offset += c->constant;
+      return *offset >= 0 && (size_t)*offset + BASIC_MEM_SIZE <= *size;
+    }
+    default:
+      return 0;
+  }
+}
+
+// unroll counted loop l: fully when it runs a known, small number of times,
+// otherwise into a loop running unrollFactor iterations per test, followed
+// by the original loop for the iterations left. Return 1 if the function
+// changed
+static int unrollLoop(CFG* cfg, int l) {
+  CountedLoop c;
+  if (!countedLoop(cfg, l, &c)) return 0;
+  // the rounds the profile saw, a loop that never ran is left as it is
+  long rounds = blockCount(cfg, cfg->loops[l].header);
+  if (rounds == 0) return 0;
+  cfgLiveness(cfg);
+  int nb = c.last - c.first + 1;
+  int max = MAX_UNROLLED_SIZE / c.size;
+  intptr_t start;
+
+  if (c.bound->kind == OP_CONSTANT &&
+      entryConstant(cfg, l, cfgVarId(cfg, c.iv), &start)) {
+    int trips = tripCount(start, &c, max);
+    if (trips > 0) {
+      // the copies replace the loop, the entries into it enter the first one
+      List** blocks = malloc(sizeof(List*) * (trips * nb + 1));
+      for (int i = 0; i < trips; i++) {
+        List** copy = copyLoop(cfg, &c, NULL);
+        memcpy(blocks + i * nb, copy, sizeof(List*) * nb);
+        free(copy);
+      }
+      for (int b = c.first; b <= c.last; b++) {
+        List* codes = cfg->blocks[b]->codes;
+        while (codes->head && b == c.first &&
+               ((IRCode*)codes->head->value)->kind == IR_LABEL) {
+          listAddNodeHead(blocks[0], codes->head->value);
+          listDelNode(codes, codes->head);
+        }
+        while (codes->head) listDelNode(codes, codes->head);
+      }
+      divideCounts(blocks, trips * nb, trips);
+      cfgInsertBlocks(cfg, c.first, blocks, trips * nb);
+      for (int b = c.last; b >= c.first; b--) {
+        cfgRemoveBlock(cfg, b + trips * nb);
+      }
+      free(blocks);
+      return 1;
+    }
+  }
+
+  // the copies only pay off if the unrolled loop goes round a few times
+  if (rounds >= 0 && rounds < 2 * unrollFactor) return 0;
+  int factor = unrollFactor < max ? unrollFactor : max;
+  if (factor < 2) return 0;
+
+  // the unrolled loop runs while the next factor tests would all pass, that
+  // is while iv relop bound - (factor - 1) * step, which must not wrap
+  intptr_t span = (factor - 1) * c.step;
+  if (span > INT32_MAX / 2 || span < -(INT32_MAX / 2)) return 0;
+  Operand* limit;
+  if (c.bound->kind == OP_CONSTANT) {
+    intptr_t value = c.bound->constant - span;
+    if (value < INT32_MIN || value > INT32_MAX) return 0;
+    limit = newOperand(OP_CONSTANT, (void*)value, NULL);
+  } else {
+    limit = newOperand(OP_TEMP, (void*)newTempNo(), NULL);
+  }
+
+  // the original loop stays for the remaining iterations, its header gets a
+  // label of its own as the entries into the loop now enter the test
+  List* header = cfg->blocks[c.first]->codes;
+  List* entry = newList(NULL, NULL, NULL);
+  while (header->head && ((IRCode*)header->head->value)->kind == IR_LABEL) {
+    listAddNodeTail(entry, header->head->value);
+    listDelNode(header, header->head);
+  }
+  Operand* rest = newOperand(OP_LABEL, (void*)newLabelNo(), NULL);
+  listAddNodeHead(header, newIRCode(IR_LABEL, rest));
+  List* latch = cfg->blocks[c.last]->codes;
+  IRCode* test = latch->tail->value;
+  latch->tail->value = newIRCode(IR_IF_GOTO, test->op_l, test->relop,
+                                 test->op_r, rest);
+  ((IRCode*)latch->tail->value)->count = test->count;
+  Operand* exit = cfgBlockLabel(cfg, c.last + 1);
+
+  // a bound that would wrap leaves all the iterations to the original loop,
+  // that test ends a block of its own
+  List* guard = NULL;
+  if (c.bound->kind != OP_CONSTANT) {
+    intptr_t edge = span > 0 ? INT32_MIN + span : INT32_MAX + span;
+    listAddNodeTail(entry, newAddConstant(limit, c.bound, -span));
+    listAddNodeTail(entry, newIRCode(IR_IF_GOTO, c.bound, span > 0 ? "<" : ">",
+                                     newOperand(OP_CONSTANT, (void*)edge, NULL),
+                                     rest));
+    guard = newList(NULL, NULL, NULL);
+  }
+  listAddNodeTail(guard ? guard : entry,
+                  newIRCode(IR_IF_GOTO, c.iv, invertRelop(c.relop), limit,
+                            rest));
+
+  int n = 0;
+  List** blocks = malloc(sizeof(List*) * (factor * nb + 3));
+  blocks[n++] = entry;
+  if (guard) blocks[n++] = guard;
+  Operand* top = NULL;
+  for (int i = 0; i < factor; i++) {
+    IRCode* end = NULL;
+    if (i == factor - 1) end = newIRCode(IR_IF_GOTO, c.iv, c.relop, limit, top);
+    List** copy = copyLoop(cfg, &c, end);
+    if (i == 0) top = ((IRCode*)copy[0]->head->value)->op;
+    memcpy(blocks + n, copy, sizeof(List*) * nb);
+    n += nb;
+    free(copy);
+  }
+
+  // the iterations left, if any, run in the original loop
+  List* check = newList(NULL, NULL, NULL);
+  listAddNodeTail(check, newIRCode(IR_IF_GOTO, c.iv, invertRelop(c.relop),
+                                   c.bound, exit));
+  blocks[n++] = check;
+
+  // each copy runs a factor-th of the rounds, the loop left for the last
+  // iterations runs fewer
+  divideCounts(blocks, n, factor);
+  for (int b = c.first; b <= c.last; b++) {
+    divideCounts(&cfg->blocks[b]->codes, 1, factor);
+  }
+
+  listAddNodeTail(done, blocks[guard ? 2 : 1]);
+  cfgInsertBlocks(cfg, c.first, blocks, n);
+  free(blocks);
+  return 1;
+}
+
+// return 1 if loop l is an innermost loop laid out in one piece, whose
+// only back edge is the test ending its latch, on a variable stepped once
+// per iteration by a constant towards a bound the loop does not change
+static int countedLoop(CFG* cfg, int l, CountedLoop* c) {
+  Loop* loop = &cfg->loops[l];
+  c->first = loop->header;
+  c->last = loop->header + loop->nblocks - 1;
+  if (c->last + 1 >= cfg->nblocks) return 0;
+
+  c->size = 0;
+  for (int b = c->first; b <= c->last; b++) {
+    if (!loop->body[b] || cfg->blocks[b]->loop != l) return 0;
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      // a call costs more than the test, and the copies of its arguments
+      // would crowd the registers
+      if (ir->kind == IR_DEC || ir->kind == IR_CALL) return 0;
+      if (ir->kind != IR_LABEL) c->size++;
+    }
+  }
+  // one way in and, but for returns, one way out: a jump out of the middle
+  // of the loop would skip the tests the copies leave out
+  BasicBlock* header = cfg->blocks[c->first];
+  int outside = 0;
+  for (int i = 0; i < header->npred; i++) {
+    int p = header->preds[i];
+    if (loop->body[p] && p != c->last) return 0;
+    if (!loop->body[p]) outside++;
+  }
+  if (outside != 1) return 0;
+  for (int b = c->first; b < c->last; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    for (int i = 0; i < bb->nsucc; i++) {
+      if (!loop->body[bb->succ[i]]) return 0;
+    }
+  }
+  List* latch = cfg->blocks[c->last]->codes;
+  if (latch->tail == NULL) return 0;
+  IRCode* test = latch->tail->value;
+  if (test->kind != IR_IF_GOTO || strcmp(test->relop, "==") == 0 ||
+      strcmp(test->relop, "!=") == 0) {
+    return 0;
+  }
+
+  // the variable may be on either side of the test
+  for (int side = 0; side < 2; side++) {
+    c->iv = side ? test->op_r : test->op_l;
+    c->bound = side ? test->op_l : test->op_r;
+    c->relop = side ? swapRelop(test->relop) : test->relop;
+    int iv = cfgVarId(cfg, c->iv);
+    int bound = cfgVarId(cfg, c->bound);
+    if (iv < 0 || iv == bound) continue;
+
+    IRCode* step = NULL;
+    int ndefs = 0, boundDefs = 0;
+    for (int b = c->first; b <= c->last; b++) {
+      for (ListNode* node = cfg->blocks[b]->codes->head; node;
+           node = node->next) {
+        Operand** def = irDefOperand(node->value);
+        int d = def ? cfgVarId(cfg, *def) : -1;
+        if (d == bound) boundDefs++;
+        if (d != iv) continue;
+        ndefs++;
+        if (cfgDominates(cfg, b, c->last)) step = node->value;
+      }
+    }
+    if (ndefs != 1 || boundDefs != 0 || step == NULL) continue;
+
+    if (step->kind == IR_ADD && sameOperand(step->op1, c->iv) &&
+        step->op2->kind == OP_CONSTANT) {
+      c->step = step->op2->constant;
+    } else if (step->kind == IR_ADD && sameOperand(step->op2, c->iv) &&
+               step->op1->kind == OP_CONSTANT) {
+      c->step = step->op1->constant;
+    } else if (step->kind == IR_SUB && sameOperand(step->op1, c->iv) &&
+               step->op2->kind == OP_CONSTANT) {
+      c->step = -step->op2->constant;
+    } else {
+      continue;
+    }
+
+    // the variable must head for the bound
+    int up = strcmp(c->relop, "<") == 0 || strcmp(c->relop, "<=") == 0;
+    if (c->step != 0 && up == (c->step > 0)) return 1;
+  }
+  return 0;
+}
+
+// the iterations counted loop c runs from iv = start, 0 if more than max
+static int tripCount(intptr_t start, CountedLoop* c, int max) {
+  intptr_t v = start;
+  int trips = 0;
+  do {
+    trips++;
+    v += c->step;
+    if (trips > max || v < INT32_MIN || v > INT32_MAX) return 0;
+  } while (relopHolds(v, c->relop, c->bound->constant));
+  return trips;
+}
+
+// the relop testing the same with the operands swapped
+static char* swapRelop(char* relop) {
+  if (strcmp(relop, "<") == 0) return ">";
+  if (strcmp(relop, "<=") == 0) return ">=";
+  if (strcmp(relop, ">") == 0) return "<";
+  if (strcmp(relop, ">=") == 0) return "<=";
+  return relop;
+}
+
+// a copy of the blocks of counted loop c with labels of their own, the
+// test ending the latch replaced by test, or dropped if NULL, so the copy
+// falls through to what follows. The temps living within one iteration get
+// names of their own too, each copy then reads as straight-line code to the
+// back end; requires up-to-date liveness
+static List** copyLoop(CFG* cfg, CountedLoop* c, IRCode* test) {
+  int nb = c->last - c->first + 1;
+  Operand** names = calloc(cfg->nvars + 1, sizeof(Operand*));
+  for (int b = c->first; b <= c->last; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      Operand** def = irDefOperand(node->value);
+      if (def == NULL || ((*def)->kind != OP_TEMP &&
+                          (*def)->kind != OP_ADDRESS)) {
+        continue;
+      }
+      int id = cfgVarId(cfg, *def);
+      if (names[id] || bitTest(cfg->liveIn[c->first], id) ||
+          bitTest(cfg->liveIn[c->last + 1], id)) {
+        continue;
+      }
+      names[id] = newOperand(OP_TEMP, (void*)newTempNo(), (*def)->type);
+      if ((*def)->kind == OP_ADDRESS) operandTmp2Addr(names[id]);
+    }
+  }
+
+  size_t* from = NULL;
+  Operand** to = NULL;
+  int n = 0;
+  for (int b = c->first; b <= c->last; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind != IR_LABEL) break;
+      from = realloc(from, sizeof(size_t) * (n + 1));
+      to = realloc(to, sizeof(Operand*) * (n + 1));
+      from[n] = ir->op->label_no;
+      to[n++] = newOperand(OP_LABEL, (void*)newLabelNo(), NULL);
+    }
+  }
+
+  List** blocks = malloc(sizeof(List*) * nb);
+  for (int b = c->first; b <= c->last; b++) {
+    List* codes = newList(NULL, NULL, NULL);
+    // the header gets a label, the loop above jumps back to it
+    if (b == c->first) {
+      IRCode* first = cfg->blocks[b]->codes->head->value;
+      if (first->kind != IR_LABEL) {
+        listAddNodeTail(codes, newIRCode(IR_LABEL, newOperand(
+                                   OP_LABEL, (void*)newLabelNo(), NULL)));
+      }
+    }
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      if (b == c->last && node->next == NULL) break;
+      listAddNodeTail(codes, copyCode(cfg, node->value, from, to, n, names));
+    }
+    if (b == c->last && test) listAddNodeTail(codes, test);
+    blocks[b - c->first] = codes;
+  }
+
+  free(from);
+  free(to);
+  free(names);
+  return blocks;
+}
+
+// the counts of the profile of codes run a factor-th as often, rounded up
+static void divideCounts(List** blocks, int n, int factor) {
+  for (int b = 0; b < n; b++) {
+    for (ListNode* node = blocks[b]->head; node; node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->count > 0) ir->count = (ir->count + factor - 1) / factor;
+    }
+  }
+}
+
+// a copy of ir jumping to the labels to[i] instead of from[i], with the
+// variables that have one renamed to names[id]
+static IRCode* copyCode(CFG* cfg, IRCode* ir, size_t* from, Operand** to,
+                        int n, Operand** names) {
+  IRCode* copy = arenaAlloc(&irArena, sizeof(IRCode));
+  *copy = *ir;
+  Operand** slots[4];
+  int k = irUseOperands(copy, slots);
+  Operand** def = irDefOperand(copy);
+  if (def) slots[k++] = def;
+  for (int i = 0; i < k; i++) {
+    int id = cfgVarId(cfg, *slots[i]);
+    if (id < cfg->nvars && names[id]) *slots[i] = names[id];
+  }
+
+  Operand** label = NULL;
+  if (ir->kind == IR_LABEL || ir->kind == IR_GOTO) label = &copy->op;
+  if (ir->kind == IR_IF_GOTO) label = &copy->label;
+  for (int i = 0; label && i < n; i++) {
+    if ((*label)->label_no == from[i]) *label = to[i];
+  }
+  return copy;
+}
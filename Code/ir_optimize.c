@@ -0,0 +1,452 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+static List* optimizeFunction(List* codes);
+static int propagateOnce(CFG* cfg);
+static int coalesceCopies(CFG* cfg);
+static int isCopy(IRCode* ir);
+static int copyIndex(IRCode** copies, int ncopies, IRCode* ir);
+static void renumberTemps(List* codes);
+static int operandSlots(IRCode* ir, Operand** slots[3]);
+static int tempNo(Operand* op, size_t* temp_no);
+
+// optimization entry, rewrites the IR of every function
+List* IROptimize(List* ir) {
+  if (ir == NULL) {
+    return NULL;
+  }
+  // the counters of an instrumented program stand for the labels as
+  // IRGenerate made them
+  if (instrument) return ir;
+
+  List* out = newList(NULL, NULL, NULL);
+  List* func = NULL;
+
+  // codes before the first function are kept as they are
+  for (ListNode* node = ir->head; node; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION) {
+      if (func) {
+        List* opt = optimizeFunction(func);
+        listJoin(out, opt);
+        freeList(opt);
+        freeList(func);
+      }
+      func = newList(NULL, NULL, NULL);
+    }
+    listAddNodeTail(func ? func : out, code);
+  }
+  if (func) {
+    List* opt = optimizeFunction(func);
+    listJoin(out, opt);
+    freeList(opt);
+    freeList(func);
+  }
+
+  freeList(ir);
+  return out;
+}
+
+// run the passes over one function
+static List* optimizeFunction(List* codes) {
+  CFG* cfg = newCFG(codes);
+
+  propagateCopies(cfg);
+  deadCodeElimination(cfg);
+  eliminateTailRecursion(cfg);
+  globalValueNumbering(cfg);
+  propagateCopies(cfg);
+  deadCodeElimination(cfg);
+  loopInvariantCodeMotion(cfg);
+  inductionVariableReduction(cfg);
+  propagateCopies(cfg);
+  deadCodeElimination(cfg);
+  simplifyBranches(cfg);
+  unrollLoops(cfg);
+  propagateCopies(cfg);
+  deadCodeElimination(cfg);
+  layoutBlocks(cfg);
+  simplifyBranches(cfg);
+
+  List* ir = cfgLinearize(cfg);
+  freeCFG(cfg);
+  renumberTemps(ir);
+  return ir;
+}
+
+// remove the codes computing values nobody reads
+void deadCodeElimination(CFG* cfg) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    cfgLiveness(cfg);
+    int words = BITSET_WORDS(cfg->nvars);
+    uint32_t* live = malloc(sizeof(uint32_t) * (words + 1));
+
+    for (int b = 0; b < cfg->nblocks; b++) {
+      List* codes = cfg->blocks[b]->codes;
+      memcpy(live, cfg->liveOut[b], sizeof(uint32_t) * words);
+
+      ListNode* prev;
+      for (ListNode* node = codes->tail; node; node = prev) {
+        prev = node->prev;
+        IRCode* ir = node->value;
+        Operand** def = irDefOperand(ir);
+        int d = def ? cfgVarId(cfg, *def) : -1;
+
+        int pure = 0;
+        switch (ir->kind) {
+          case IR_ASSIGN:
+          case IR_ADD:
+          case IR_SUB:
+          case IR_MUL:
+          case IR_DIV:
+          case IR_GET_ADDR:
+          case IR_GET_VALUE:
+            pure = 1;
+            break;
+          default:
+            break;
+        }
+        if (pure && d >= 0 && !bitTest(live, d)) {
+          listDelNode(codes, node);
+          changed = 1;
+          continue;
+        }
+
+        if (d >= 0) bitClear(live, d);
+        Operand** uses[3];
+        int n = irUseOperands(ir, uses);
+        for (int i = 0; i < n; i++) bitSet(live, cfgVarId(cfg, *uses[i]));
+      }
+    }
+
+    free(live);
+  }
+}
+
+// replace variables by the variables or constants copied into them, fold
+// the constants this exposes, then let computations write straight into
+// the variable they are copied to
+void propagateCopies(CFG* cfg) {
+  while (propagateOnce(cfg) | coalesceCopies(cfg)) {
+  }
+}
+
+// one round of global copy propagation over the copies available at each
+// code, return 1 if an operand was replaced
+static int propagateOnce(CFG* cfg) {
+  cfgLiveness(cfg);
+
+  // number the copies, what their source is at this point is remembered,
+  // the availability below holds for it
+  IRCode** copies = NULL;
+  Operand** source = NULL;
+  int ncopies = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (!isCopy(ir)) continue;
+      copies = realloc(copies, sizeof(IRCode*) * (ncopies + 1));
+      source = realloc(source, sizeof(Operand*) * (ncopies + 1));
+      copies[ncopies] = ir;
+      source[ncopies] = ir->right;
+      ncopies++;
+    }
+  }
+  if (ncopies == 0) return 0;
+
+  // a definition kills the copies into and out of its variable
+  int nv = cfg->nvars;
+  int words = BITSET_WORDS(ncopies);
+  uint32_t** kill = malloc(sizeof(uint32_t*) * (nv + 1));
+  for (int i = 0; i < nv; i++) kill[i] = calloc(words + 1, sizeof(uint32_t));
+  int* target = malloc(sizeof(int) * ncopies);
+  for (int c = 0; c < ncopies; c++) {
+    target[c] = cfgVarId(cfg, copies[c]->left);
+    bitSet(kill[target[c]], c);
+    int id = cfgVarId(cfg, source[c]);
+    if (id >= 0) bitSet(kill[id], c);
+  }
+
+  // available copies, the intersection over all predecessors
+  int n = cfg->nblocks;
+  uint32_t** in = malloc(sizeof(uint32_t*) * n);
+  uint32_t** out = malloc(sizeof(uint32_t*) * n);
+  for (int b = 0; b < n; b++) {
+    in[b] = calloc(words + 1, sizeof(uint32_t));
+    out[b] = malloc(sizeof(uint32_t) * (words + 1));
+    memset(out[b], 0xff, sizeof(uint32_t) * (words + 1));
+  }
+
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 0; i < cfg->nreach; i++) {
+      int b = cfg->order[i];
+      BasicBlock* bb = cfg->blocks[b];
+      uint32_t* set = in[b];
+      for (int w = 0; w < words; w++) set[w] = bb->npred && b ? ~0u : 0;
+      for (int j = 0; j < bb->npred; j++) {
+        if (cfg->blocks[bb->preds[j]]->rpo < 0) continue;
+        for (int w = 0; w < words; w++) set[w] &= out[bb->preds[j]][w];
+      }
+      if (b == 0) memset(set, 0, sizeof(uint32_t) * words);
+
+      uint32_t* cur = malloc(sizeof(uint32_t) * (words + 1));
+      memcpy(cur, set, sizeof(uint32_t) * words);
+      for (ListNode* node = bb->codes->head; node; node = node->next) {
+        IRCode* ir = node->value;
+        Operand** def = irDefOperand(ir);
+        if (def) {
+          int d = cfgVarId(cfg, *def);
+          for (int w = 0; w < words; w++) cur[w] &= ~kill[d][w];
+        }
+        int c = copyIndex(copies, ncopies, ir);
+        if (c >= 0) bitSet(cur, c);
+      }
+      if (memcmp(cur, out[b], sizeof(uint32_t) * words) != 0) {
+        memcpy(out[b], cur, sizeof(uint32_t) * words);
+        changed = 1;
+      }
+      free(cur);
+    }
+  }
+
+  // replace the uses, a constant is not put where an address is read
+  int replaced = 0;
+  uint32_t* cur = malloc(sizeof(uint32_t) * (words + 1));
+  for (int i = 0; i < cfg->nreach; i++) {
+    int b = cfg->order[i];
+    memcpy(cur, in[b], sizeof(uint32_t) * words);
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      Operand** uses[3];
+      int k = irUseOperands(ir, uses);
+      for (int j = 0; j < k; j++) {
+        int id = cfgVarId(cfg, *uses[j]);
+        int pointer = (ir->kind == IR_GET_VALUE && uses[j] == &ir->right) ||
+                      (ir->kind == IR_SET_VALUE && uses[j] == &ir->left);
+        for (int x = 0; x < ncopies; x++) {
+          if (target[x] != id || !bitTest(cur, x)) continue;
+          if (pointer && source[x]->kind == OP_CONSTANT) continue;
+          *uses[j] = source[x];
+          replaced = 1;
+          break;
+        }
+      }
+
+      // constants met in an arithmetic code are folded into a copy
+      if ((ir->kind == IR_ADD || ir->kind == IR_SUB || ir->kind == IR_MUL ||
+           ir->kind == IR_DIV) &&
+          ir->op1->kind == OP_CONSTANT && ir->op2->kind == OP_CONSTANT) {
+        intptr_t value;
+        if (foldConstant(ir->kind, ir->op1->constant, ir->op2->constant,
+                         &value)) {
+          node->value = newIRCode(IR_ASSIGN, ir->result,
+                                  newOperand(OP_CONSTANT, (void*)value, NULL));
+          ir = node->value;
+          replaced = 1;
+        }
+      }
+      // and so are x + 0, x * 1 and the like, what is left of a sum once a
+      // constant replaced one of its terms
+      Operand* x = identityOperand(ir);
+      if (x) {
+        node->value = newIRCode(IR_ASSIGN, ir->result, x);
+        ((IRCode*)node->value)->count = ir->count;
+        ir = node->value;
+        replaced = 1;
+      }
+
+      Operand** def = irDefOperand(ir);
+      if (def) {
+        int d = cfgVarId(cfg, *def);
+        for (int w = 0; w < words; w++) cur[w] &= ~kill[d][w];
+      }
+      // a copy made by this round is left for the next one
+      int c = copyIndex(copies, ncopies, ir);
+      if (c >= 0) bitSet(cur, c);
+    }
+  }
+  free(cur);
+
+  for (int b = 0; b < n; b++) {
+    free(in[b]);
+    free(out[b]);
+  }
+  for (int i = 0; i < nv; i++) free(kill[i]);
+  free(in);
+  free(out);
+  free(kill);
+  free(target);
+  free(copies);
+  free(source);
+  return replaced;
+}
+
+// turn t := expr; x := t into x := expr when t dies at the copy, return 1
+// if a copy was removed
+static int coalesceCopies(CFG* cfg) {
+  cfgLiveness(cfg);
+  int words = BITSET_WORDS(cfg->nvars);
+  uint32_t* live = malloc(sizeof(uint32_t) * (words + 1));
+  int changed = 0;
+
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    memcpy(live, cfg->liveOut[b], sizeof(uint32_t) * words);
+
+    ListNode* prev;
+    for (ListNode* node = codes->tail; node; node = prev) {
+      prev = node->prev;
+      IRCode* ir = node->value;
+
+      int t = ir->kind == IR_ASSIGN ? cfgVarId(cfg, ir->right) : -1;
+      int x = ir->kind == IR_ASSIGN ? cfgVarId(cfg, ir->left) : -1;
+      ListNode* def = NULL;
+      if (t >= 0 && t != x && !bitTest(live, t)) {
+        // find the code computing t, x must not be touched in between
+        for (ListNode* p = prev; p; p = p->prev) {
+          IRCode* code = p->value;
+          Operand** d = irDefOperand(code);
+          if (d && cfgVarId(cfg, *d) == t) {
+            if (code->kind != IR_PARAM) def = p;
+            break;
+          }
+          if (d && cfgVarId(cfg, *d) == x) break;
+          Operand** uses[3];
+          int k = irUseOperands(code, uses);
+          int touched = 0;
+          for (int i = 0; i < k; i++) {
+            int id = cfgVarId(cfg, *uses[i]);
+            if (id == t || id == x) touched = 1;
+          }
+          if (touched) break;
+        }
+      }
+
+      if (def) {
+        *irDefOperand(def->value) = ir->left;
+        listDelNode(codes, node);
+        changed = 1;
+        // x is now defined by the earlier code, t no longer
+        continue;
+      }
+
+      Operand** d = irDefOperand(ir);
+      if (d) bitClear(live, cfgVarId(cfg, *d));
+      Operand** uses[3];
+      int k = irUseOperands(ir, uses);
+      for (int i = 0; i < k; i++) bitSet(live, cfgVarId(cfg, *uses[i]));
+    }
+  }
+
+  free(live);
+  return changed;
+}
+
+// a copy of a variable or a constant into another variable
+static int isCopy(IRCode* ir) {
+  return ir->kind == IR_ASSIGN && isVarOperand(ir->left) &&
+         (isVarOperand(ir->right) || ir->right->kind == OP_CONSTANT) &&
+         !sameOperand(ir->left, ir->right);
+}
+
+static int copyIndex(IRCode** copies, int ncopies, IRCode* ir) {
+  for (int c = 0; c < ncopies; c++) {
+    if (copies[c] == ir) return c;
+  }
+  return -1;
+}
+
+// number the temps of a function densely from t1, in order of appearance
+static void renumberTemps(List* codes) {
+  size_t max = 0;
+  for (ListNode* node = codes->head; node; node = node->next) {
+    Operand** slots[3];
+    int n = operandSlots(node->value, slots);
+    for (int i = 0; i < n; i++) {
+      size_t temp_no;
+      if (tempNo(*slots[i], &temp_no) && temp_no > max) max = temp_no;
+    }
+  }
+
+  // the operands are shared between codes, each slot gets a new one
+  size_t* number = calloc(max + 1, sizeof(size_t));
+  size_t count = 0;
+  for (ListNode* node = codes->head; node; node = node->next) {
+    Operand** slots[3];
+    int n = operandSlots(node->value, slots);
+    for (int i = 0; i < n; i++) {
+      size_t temp_no;
+      if (!tempNo(*slots[i], &temp_no)) continue;
+      if (number[temp_no] == 0) number[temp_no] = ++count;
+
+      Operand* op =
+          newOperand(OP_TEMP, (void*)number[temp_no], (*slots[i])->type);
+      if ((*slots[i])->kind == OP_ADDRESS) operandTmp2Addr(op);
+      *slots[i] = op;
+    }
+  }
+
+  free(number);
+}
+
+// every operand an IR code holds, labels and functions aside
+static int operandSlots(IRCode* ir, Operand** slots[3]) {
+  switch (ir->kind) {
+    case IR_RETURN:
+    case IR_ARG:
+    case IR_PARAM:
+    case IR_READ:
+    case IR_WRITE:
+      slots[0] = &ir->op;
+      return 1;
+    case IR_ASSIGN:
+    case IR_GET_ADDR:
+    case IR_GET_VALUE:
+    case IR_SET_VALUE:
+      slots[0] = &ir->left;
+      slots[1] = &ir->right;
+      return 2;
+    case IR_CALL:
+      slots[0] = &ir->left;
+      return 1;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+      slots[0] = &ir->result;
+      slots[1] = &ir->op1;
+      slots[2] = &ir->op2;
+      return 3;
+    case IR_DEC:
+      slots[0] = &ir->operand;
+      return 1;
+    case IR_IF_GOTO:
+      slots[0] = &ir->op_l;
+      slots[1] = &ir->op_r;
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+// the number of a temp, or of an address held in a temp, return 0 for the
+// other operands
+static int tempNo(Operand* op, size_t* temp_no) {
+  if (op->kind == OP_TEMP) {
+    *temp_no = op->temp_no;
+    return 1;
+  }
+  if (op->kind != OP_ADDRESS || op->base_name[0] != 't') return 0;
+
+  char* end;
+  *temp_no = strtoul(op->base_name + 1, &end, 10);
+  return end != op->base_name + 1 && *end == '\0';
+}
@@ -0,0 +1,318 @@
+#include <ctype.h>
+#include <stdio.h>
+
+#include "data.h"
+#include "hash.h"
+#include "list.h"
+
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+// the most tokens on a line, IF x relop y GOTO l
+#define MAX_TOKENS 6
+
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+
+static char* relops[] = {"==", "!=", "<", ">=", ">", "<="};
+
+// the objects a DEC gives a size, by name
+static HtType decType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                         .keyDup = NULL,
+                         .valDup = NULL,
+                         .keyCompare = keyCompare,
+                         .keyDestructor = NULL,
+                         .valDestructor = NULL};
+
+typedef struct {
+  HashTable* decs;
+  size_t max_label, max_temp;
+} Parser;
+
+static int splitLine(char** p, char* end, char** tokens);
+static IRCode* parseLine(Parser* ps, char** t, int n);
+static IRCode* parseAssign(Parser* ps, char** t, int n);
+static Operand* value(Parser* ps, char* s);
+static Operand* label(Parser* ps, char* s);
+static char* relop(char* s);
+static int number(char* s, intptr_t* n);
+
+// parse the IR text printIRCode writes into codes, the names stay in text,
+// which is cut into them; NULL after reporting the first line that is not IR
+// or that the passes cannot take, see findBrokenCode
+List* parseIR(char* text, size_t size, const char* path) {
+  Parser ps = {.decs = htCreate(&decType, NULL)};
+  List* ir = newList(NULL, NULL, NULL);
+  // the line of each code
+  int* lines = NULL;
+  int ncodes = 0;
+
+  char* p = text;
+  char* end = text + size;
+  for (int lineno = 1; p < end; lineno++) {
+    char* t[MAX_TOKENS + 1];
+    int n = splitLine(&p, end, t);
+    if (n == 0) continue;
+
+    IRCode* code = n <= MAX_TOKENS ? parseLine(&ps, t, n) : NULL;
+    if (code == NULL) {
+      fprintf(stderr, "%s:%d: not an IR code\n", path, lineno);
+      htRelease(ps.decs);
+      free(lines);
+      return NULL;
+    }
+    listAddNodeTail(ir, code);
+    lines = realloc(lines, sizeof(int) * (ncodes + 1));
+    lines[ncodes++] = lineno;
+  }
+  htRelease(ps.decs);
+
+  const char* why;
+  ListNode* broken = findBrokenCode(ir, &why);
+  if (broken) {
+    int i = 0;
+    for (ListNode* node = ir->head; node != broken; node = node->next) i++;
+    fprintf(stderr, "%s:%d: %s\n", path, lines[i], why);
+    free(lines);
+    freeList(ir);
+    return NULL;
+  }
+  free(lines);
+
+  reserveIRNumbers(ps.max_label, ps.max_temp);
+  return ir;
+}
+
+// every code must be in a function, a jump must land in its own function
+// and the ARGs of a call come right before it, the passes take them for
+// granted
+ListNode* findBrokenCode(List* ir, const char** why) {
+  // the function each label is in plus 1, by number, 0 if none is
+  int* owner = calloc(MAX_IR_NUMBER + 1, sizeof(int));
+  ListNode* broken = NULL;
+  int f = 0;
+  for (ListNode* node = ir->head; node && !broken; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION) f++;
+    if (code->kind != IR_LABEL) continue;
+    if (owner[code->op->label_no]) {
+      broken = node;
+      *why = "a label defined twice";
+    }
+    owner[code->op->label_no] = f + 1;
+  }
+
+  f = 0;
+  for (ListNode* node = ir->head; node && !broken; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION) f++;
+    if (f == 0) {
+      broken = node;
+      *why = "a code outside a function";
+    }
+    Operand* target = code->kind == IR_GOTO      ? code->op
+                      : code->kind == IR_IF_GOTO ? code->label
+                                                 : NULL;
+    if (target && owner[target->label_no] != f + 1) {
+      broken = node;
+      *why = "a jump to a label its function does not have";
+    }
+    IRCode* next = node->next ? node->next->value : NULL;
+    if (code->kind == IR_ARG &&
+        (next == NULL || (next->kind != IR_ARG && next->kind != IR_CALL))) {
+      broken = node;
+      *why = "an ARG not followed by a CALL";
+    }
+  }
+
+  free(owner);
+  return broken;
+}
+
+// cut the line at *p into tokens ending with '\0', move *p to the next line
+// and return how many tokens there are, MAX_TOKENS + 1 if too many
+static int splitLine(char** p, char* end, char** tokens) {
+  char* s = *p;
+  int n = 0;
+  while (s < end && *s != '\n') {
+    if (*s == ' ' || *s == '\t' || *s == '\r') {
+      *s++ = '\0';
+      continue;
+    }
+    if (n <= MAX_TOKENS) tokens[n] = s;
+    n++;
+    while (s < end && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') {
+      s++;
+    }
+  }
+  if (s < end) *s++ = '\0';
+  *p = s;
+  return n > MAX_TOKENS ? MAX_TOKENS + 1 : n;
+}
+
+static IRCode* parseLine(Parser* ps, char** t, int n) {
+  // x := ..., a variable may be named like a keyword
+  if (n >= 3 && strcmp(t[1], ":=") == 0) return parseAssign(ps, t, n);
+
+  if (n == 3 && strcmp(t[2], ":") == 0) {
+    if (strcmp(t[0], "LABEL") == 0) {
+      Operand* l = label(ps, t[1]);
+      return l ? newIRCode(IR_LABEL, l) : NULL;
+    }
+    if (strcmp(t[0], "FUNCTION") == 0) {
+      return newIRCode(IR_FUNCTION, newOperand(OP_FUNCTION, t[1], NULL));
+    }
+    return NULL;
+  }
+
+  if (n == 2) {
+    static const struct {
+      const char* keyword;
+      int kind;
+    } unary[] = {{"GOTO", IR_GOTO}, {"RETURN", IR_RETURN}, {"ARG", IR_ARG},
+                 {"PARAM", IR_PARAM}, {"READ", IR_READ},   {"WRITE", IR_WRITE}};
+    for (int i = 0; i < 6; i++) {
+      if (strcmp(t[0], unary[i].keyword) != 0) continue;
+      Operand* op =
+          unary[i].kind == IR_GOTO ? label(ps, t[1]) : value(ps, t[1]);
+      // a parameter or what is read is stored to
+      if (op && op->kind == OP_CONSTANT &&
+          (unary[i].kind == IR_PARAM || unary[i].kind == IR_READ)) {
+        return NULL;
+      }
+      return op ? newIRCode(unary[i].kind, op) : NULL;
+    }
+    return NULL;
+  }
+
+  if (n == 3 && strcmp(t[0], "DEC") == 0) {
+    intptr_t size;
+    Operand* x = value(ps, t[1]);
+    if (x == NULL || x->kind != OP_VARIABLE || !number(t[2], &size) ||
+        size <= 0 || size % BASIC_MEM_SIZE != 0) {
+      return NULL;
+    }
+    // an int array of the same size stands for the type of the object
+    x->type = newTypeArray(newTypeBasic(INT_), size / BASIC_MEM_SIZE);
+    htReplace(ps->decs, x->var_name, x->type);
+    return newIRCode(IR_DEC, x, (int)size);
+  }
+
+  if (n == 6 && strcmp(t[0], "IF") == 0 && strcmp(t[4], "GOTO") == 0) {
+    Operand* x = value(ps, t[1]);
+    char* r = relop(t[2]);
+    Operand* y = value(ps, t[3]);
+    Operand* l = label(ps, t[5]);
+    if (x == NULL || r == NULL || y == NULL || l == NULL) return NULL;
+    return newIRCode(IR_IF_GOTO, x, r, y, l);
+  }
+
+  return NULL;
+}
+
+// x := y, x := y op z, x := &y, x := *y, *x := y and x := CALL f
+static IRCode* parseAssign(Parser* ps, char** t, int n) {
+  if (t[0][0] == '*') {
+    Operand* x = value(ps, t[0] + 1);
+    Operand* y = value(ps, t[2]);
+    if (n != 3 || x == NULL || y == NULL) return NULL;
+    return newIRCode(IR_SET_VALUE, x, y);
+  }
+
+  Operand* x = value(ps, t[0]);
+  if (x == NULL || x->kind == OP_CONSTANT) return NULL;
+
+  if (n == 4 && strcmp(t[2], "CALL") == 0) {
+    return newIRCode(IR_CALL, x, newOperand(OP_FUNCTION, t[3], NULL));
+  }
+
+  if (n == 3) {
+    int kind = IR_ASSIGN;
+    char* s = t[2];
+    if (s[0] == '&') {
+      kind = IR_GET_ADDR;
+      s++;
+    } else if (s[0] == '*') {
+      kind = IR_GET_VALUE;
+      s++;
+    }
+    Operand* y = value(ps, s);
+    if (y == NULL || (kind == IR_GET_ADDR && y->kind == OP_CONSTANT)) {
+      return NULL;
+    }
+    return newIRCode(kind, x, y);
+  }
+
+  if (n == 5 && t[3][1] == '\0') {
+    int kind;
+    switch (t[3][0]) {
+      case '+':
+        kind = IR_ADD;
+        break;
+      case '-':
+        kind = IR_SUB;
+        break;
+      case '*':
+        kind = IR_MUL;
+        break;
+      case '/':
+        kind = IR_DIV;
+        break;
+      default:
+        return NULL;
+    }
+    Operand* y = value(ps, t[2]);
+    Operand* z = value(ps, t[4]);
+    if (y == NULL || z == NULL) return NULL;
+    return newIRCode(kind, x, y, z);
+  }
+
+  return NULL;
+}
+
+// #c, tN or a variable; a variable named like a temp is taken for one, they
+// are the same storage to the passes anyway
+static Operand* value(Parser* ps, char* s) {
+  intptr_t n;
+  if (s[0] == '#') {
+    return number(s + 1, &n) ? newOperand(OP_CONSTANT, (void*)n, NULL) : NULL;
+  }
+  if (s[0] == 't' && s[1] != '-' && number(s + 1, &n)) {
+    if (n > MAX_IR_NUMBER) return NULL;
+    if ((size_t)n > ps->max_temp) ps->max_temp = n;
+    return newOperand(OP_TEMP, (void*)n, NULL);
+  }
+  if (!isalpha((unsigned char)s[0]) && s[0] != '_') return NULL;
+
+  HashEntry* he = htFind(ps->decs, s);
+  return newOperand(OP_VARIABLE, s, he ? htGetEntryVal(he) : NULL);
+}
+
+static Operand* label(Parser* ps, char* s) {
+  intptr_t n;
+  if (s[0] != 'l' || s[1] == '-' || !number(s + 1, &n) ||
+      n > MAX_IR_NUMBER) {
+    return NULL;
+  }
+  if ((size_t)n > ps->max_label) ps->max_label = n;
+  return newOperand(OP_LABEL, (void*)n, NULL);
+}
+
+static char* relop(char* s) {
+  for (int i = 0; i < 6; i++) {
+    if (strcmp(s, relops[i]) == 0) return relops[i];
+  }
+  return NULL;
+}
+
+// a decimal number, with a sign
+static int number(char* s, intptr_t* n) {
+  int negative = *s == '-';
+  if (negative) s++;
+  if (*s < '0' || *s > '9') return 0;
+
+  intptr_t v = 0;
+  for (; *s; s++) {
+    if (*s < '0' || *s > '9' || v > (INTPTR_MAX - 9) / 10) return 0;
+    v = v * 10 + (*s - '0');
+  }
+  *n = negative ? -v : v;
+  return 1;
+}
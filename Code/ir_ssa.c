@@ -0,0 +1,779 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "hash.h"
+#include "list.h"
+
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+
+// the expressions available along the dominator tree by their text, the
+// keys belong to the block adding them
+static HtType exprType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                          .keyDup = NULL,
+                          .valDup = NULL,
+                          .keyCompare = keyCompare,
+                          .keyDestructor = NULL,
+                          .valDestructor = NULL};
+
+// dest := phi(args), one argument for every predecessor of the block, in
+// the order of its preds
+typedef struct Phi {
+  int var;  // the variable it merges, its id before renaming
+  Operand* dest;
+  Operand** args;
+  int dead;  // its value is found elsewhere by the value numbering
+  struct Phi* next;
+} Phi;
+
+// a function in SSA form; the variables put in SSA form get a new temp for
+// every definition, a use before any definition keeps the original name
+typedef struct SSA {
+  CFG* cfg;
+  Phi** phis;  // by block
+  int** kids;  // the dominator tree
+  int* nkids;
+
+  // the variables before renaming have the ids below norig, those whose
+  // address is taken stay as they are
+  int norig;
+  char* renamed;
+
+  // the temps of the new names are above tempBase, origin tells the
+  // variable each one renames
+  size_t tempBase;
+  int* origin;
+  int norigin;
+
+  // while renaming, the current name of every variable, NULL for its
+  // original one, and the names they had before
+  Operand** top;
+  struct {
+    int var;
+    Operand* name;
+  }* undo;
+  int nundo;
+
+  // the value of every name, NULL for itself
+  Operand** leader;
+  HashTable* exprs;
+} SSA;
+
+// a pair of names a copy between them is removed by sharing
+typedef struct {
+  Operand* a;
+  Operand* b;
+} CopyPair;
+
+static SSA* buildSSA(CFG* cfg);
+static void freeSSA(SSA* ssa);
+static void placePhis(SSA* ssa);
+static void renameBlock(SSA* ssa, int b);
+static Operand* define(SSA* ssa, int var, Operand* op);
+static Operand* newName(SSA* ssa, int var, Operand* op);
+static int originOf(SSA* ssa, int id);
+static int predIndex(CFG* cfg, int s, int b);
+static void numberValues(SSA* ssa, int b);
+static void numberPhis(SSA* ssa, int b, List* added);
+static void numberCode(SSA* ssa, ListNode* node, List* added);
+static Operand* valueOf(SSA* ssa, Operand* op);
+static int isStable(SSA* ssa, Operand* op);
+static Operand* available(SSA* ssa, char* key, Operand* value, List* added);
+static void leaveSSA(SSA* ssa);
+static void insertAtEnd(List* codes, IRCode* ir);
+static void insertAtHead(List* codes, IRCode* ir);
+static void coalesceNames(SSA* ssa, CopyPair* pairs, int npairs);
+
+// put the function in SSA form, number the values along the dominator tree
+// to turn the computations of a value already at hand into copies of it,
+// then go back to copies, the names the phis join share one where they can
+void globalValueNumbering(CFG* cfg) {
+  // a function without a body has no entry
+  if (cfg->nblocks == 0) return;
+  SSA* ssa = buildSSA(cfg);
+  numberValues(ssa, 0);
+  leaveSSA(ssa);
+  freeSSA(ssa);
+}
+
+static SSA* buildSSA(CFG* cfg) {
+  // the entry takes no phis, a jump back to it enters a block of its own
+  if (cfg->blocks[0]->npred > 0) {
+    cfgInsertBlock(cfg, 0, newList(NULL, NULL, NULL));
+  }
+  // unreachable code defines names no phi hears of; emptied first, as the
+  // blocks may jump to each other
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    while (cfg->blocks[b]->rpo < 0 && codes->head) {
+      listDelNode(codes, codes->head);
+    }
+  }
+  for (int b = cfg->nblocks - 1; b > 0; b--) {
+    if (cfg->blocks[b]->rpo < 0) cfgRemoveBlock(cfg, b);
+  }
+
+  // the objects whose address is taken are memory, they keep their names
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind == IR_GET_ADDR) cfgVarId(cfg, ir->right);
+      if (ir->kind == IR_DEC) cfgVarId(cfg, ir->operand);
+    }
+  }
+  cfgLiveness(cfg);
+
+  SSA* ssa = calloc(1, sizeof(SSA));
+  ssa->cfg = cfg;
+  ssa->norig = cfg->nvars;
+  ssa->renamed = malloc(ssa->norig + 1);
+  memset(ssa->renamed, 1, ssa->norig);
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      IRCode* ir = node->value;
+      if (ir->kind == IR_GET_ADDR) ssa->renamed[cfgVarId(cfg, ir->right)] = 0;
+      if (ir->kind == IR_DEC) ssa->renamed[cfgVarId(cfg, ir->operand)] = 0;
+    }
+  }
+  ssa->tempBase = newTempNo();
+
+  int n = cfg->nblocks;
+  ssa->phis = calloc(n, sizeof(Phi*));
+  ssa->kids = calloc(n, sizeof(int*));
+  ssa->nkids = calloc(n, sizeof(int));
+  for (int i = 1; i < cfg->nreach; i++) {
+    int b = cfg->order[i];
+    int d = cfg->blocks[b]->idom;
+    ssa->kids[d] = realloc(ssa->kids[d], sizeof(int) * (ssa->nkids[d] + 1));
+    ssa->kids[d][ssa->nkids[d]++] = b;
+  }
+
+  placePhis(ssa);
+  ssa->top = calloc(ssa->norig + 1, sizeof(Operand*));
+  renameBlock(ssa, 0);
+  return ssa;
+}
+
+static void freeSSA(SSA* ssa) {
+  for (int b = 0; b < ssa->cfg->nblocks; b++) {
+    Phi* next;
+    for (Phi* phi = ssa->phis[b]; phi; phi = next) {
+      next = phi->next;
+      free(phi->args);
+      free(phi);
+    }
+    free(ssa->kids[b]);
+  }
+  free(ssa->phis);
+  free(ssa->kids);
+  free(ssa->nkids);
+  free(ssa->renamed);
+  free(ssa->origin);
+  free(ssa->top);
+  free(ssa->undo);
+  free(ssa->leader);
+  free(ssa);
+}
+
+// a phi for a variable goes to the iterated dominance frontier of the
+// blocks defining it, where the variable is live
+static void placePhis(SSA* ssa) {
+  CFG* cfg = ssa->cfg;
+  int n = cfg->nblocks;
+
+  // Cooper, Harvey and Kennedy: a join is in the frontier of the blocks
+  // from its predecessors up to its immediate dominator
+  int** df = calloc(n, sizeof(int*));
+  int* ndf = calloc(n, sizeof(int));
+  for (int b = 0; b < n; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    if (bb->npred < 2) continue;
+    for (int i = 0; i < bb->npred; i++) {
+      for (int r = bb->preds[i]; r != bb->idom; r = cfg->blocks[r]->idom) {
+        if (ndf[r] > 0 && df[r][ndf[r] - 1] == b) break;
+        df[r] = realloc(df[r], sizeof(int) * (ndf[r] + 1));
+        df[r][ndf[r]++] = b;
+      }
+    }
+  }
+
+  // the blocks defining every variable
+  int** defs = calloc(ssa->norig + 1, sizeof(int*));
+  int* ndefs = calloc(ssa->norig + 1, sizeof(int));
+  for (int b = 0; b < n; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      Operand** def = irDefOperand(node->value);
+      int v = def ? cfgVarId(cfg, *def) : -1;
+      if (v < 0 || !ssa->renamed[v]) continue;
+      if (ndefs[v] > 0 && defs[v][ndefs[v] - 1] == b) continue;
+      defs[v] = realloc(defs[v], sizeof(int) * (ndefs[v] + 1));
+      defs[v][ndefs[v]++] = b;
+    }
+  }
+
+  int* hasPhi = malloc(sizeof(int) * n);
+  int* queued = malloc(sizeof(int) * n);
+  int* work = malloc(sizeof(int) * (n + 1));
+  for (int b = 0; b < n; b++) hasPhi[b] = queued[b] = -1;
+  for (int v = 0; v < ssa->norig; v++) {
+    int top = 0;
+    for (int i = 0; i < ndefs[v]; i++) {
+      queued[defs[v][i]] = v;
+      work[top++] = defs[v][i];
+    }
+    while (top > 0) {
+      int x = work[--top];
+      for (int i = 0; i < ndf[x]; i++) {
+        int y = df[x][i];
+        if (hasPhi[y] == v) continue;
+        hasPhi[y] = v;
+        if (!bitTest(cfg->liveIn[y], v)) continue;
+
+        Phi* phi = calloc(1, sizeof(Phi));
+        phi->var = v;
+        phi->dest = cfg->vars[v];
+        phi->args = malloc(sizeof(Operand*) * (cfg->blocks[y]->npred + 1));
+        phi->next = ssa->phis[y];
+        ssa->phis[y] = phi;
+        if (queued[y] != v) {
+          queued[y] = v;
+          work[top++] = y;
+        }
+      }
+    }
+  }
+
+  for (int b = 0; b < n; b++) free(df[b]);
+  for (int v = 0; v < ssa->norig; v++) free(defs[v]);
+  free(df);
+  free(ndf);
+  free(defs);
+  free(ndefs);
+  free(hasPhi);
+  free(queued);
+  free(work);
+}
+
+// give every definition in the dominator subtree of b a new name and every
+// use the name reaching it
+static void renameBlock(SSA* ssa, int b) {
+  CFG* cfg = ssa->cfg;
+  int mark = ssa->nundo;
+
+  for (Phi* phi = ssa->phis[b]; phi; phi = phi->next) {
+    phi->dest = define(ssa, phi->var, phi->dest);
+  }
+
+  for (ListNode* node = cfg->blocks[b]->codes->head; node;
+       node = node->next) {
+    IRCode* ir = node->value;
+    Operand** uses[3];
+    int k = irUseOperands(ir, uses);
+    for (int i = 0; i < k; i++) {
+      int v = cfgVarId(cfg, *uses[i]);
+      if (ssa->top[v]) *uses[i] = ssa->top[v];
+    }
+    Operand** def = irDefOperand(ir);
+    int v = def ? cfgVarId(cfg, *def) : -1;
+    if (v >= 0 && ssa->renamed[v]) *def = define(ssa, v, *def);
+  }
+
+  BasicBlock* bb = cfg->blocks[b];
+  for (int i = 0; i < bb->nsucc; i++) {
+    int s = bb->succ[i];
+    int j = predIndex(cfg, s, b);
+    for (Phi* phi = ssa->phis[s]; phi; phi = phi->next) {
+      Operand* name = ssa->top[phi->var];
+      phi->args[j] = name ? name : cfg->vars[phi->var];
+    }
+  }
+
+  for (int i = 0; i < ssa->nkids[b]; i++) renameBlock(ssa, ssa->kids[b][i]);
+
+  while (ssa->nundo > mark) {
+    ssa->nundo--;
+    ssa->top[ssa->undo[ssa->nundo].var] = ssa->undo[ssa->nundo].name;
+  }
+}
+
+// a new name for a definition of var, current until the dominator subtree
+// is left
+static Operand* define(SSA* ssa, int var, Operand* op) {
+  Operand* name = newName(ssa, var, op);
+  ssa->undo = realloc(ssa->undo, sizeof(*ssa->undo) * (ssa->nundo + 1));
+  ssa->undo[ssa->nundo].var = var;
+  ssa->undo[ssa->nundo].name = ssa->top[var];
+  ssa->nundo++;
+  ssa->top[var] = name;
+  return name;
+}
+
+// a new temp standing for var, of the kind and type of op
+static Operand* newName(SSA* ssa, int var, Operand* op) {
+  size_t temp_no = newTempNo();
+  int i = temp_no - ssa->tempBase - 1;
+  ssa->origin = realloc(ssa->origin, sizeof(int) * (i + 1));
+  for (; ssa->norigin <= i; ssa->norigin++) ssa->origin[ssa->norigin] = -1;
+  ssa->origin[i] = var;
+
+  Operand* name = newOperand(OP_TEMP, (void*)temp_no, op->type);
+  if (op->kind == OP_ADDRESS) operandTmp2Addr(name);
+  return name;
+}
+
+// the variable a new name stands for, -1 for the original names
+static int originOf(SSA* ssa, int id) {
+  Operand* op = ssa->cfg->vars[id];
+  size_t temp_no;
+  if (op->kind == OP_TEMP) {
+    temp_no = op->temp_no;
+  } else if (op->kind == OP_ADDRESS && op->base_name[0] == 't') {
+    char* end;
+    temp_no = strtoul(op->base_name + 1, &end, 10);
+    if (end == op->base_name + 1 || *end != '\0') return -1;
+  } else {
+    return -1;
+  }
+
+  if (temp_no <= ssa->tempBase) return -1;
+  size_t i = temp_no - ssa->tempBase - 1;
+  return i < (size_t)ssa->norigin ? ssa->origin[i] : -1;
+}
+
+// the position of b among the predecessors of s
+static int predIndex(CFG* cfg, int s, int b) {
+  BasicBlock* bb = cfg->blocks[s];
+  for (int i = 0; i < bb->npred; i++) {
+    if (bb->preds[i] == b) return i;
+  }
+  // we should never reach here
+  assert(0);
+  return -1;
+}
+
+// number the values in the dominator subtree of b: an expression met again
+// on the way down is the value of its first name, and a copy is the value
+// of its source; the uses are replaced by the names of their values
+static void numberValues(SSA* ssa, int b) {
+  CFG* cfg = ssa->cfg;
+  if (b == 0) {
+    // number the new names, the table does not grow from here
+    for (int x = 0; x < cfg->nblocks; x++) {
+      for (Phi* phi = ssa->phis[x]; phi; phi = phi->next) {
+        cfgVarId(cfg, phi->dest);
+        for (int i = 0; i < cfg->blocks[x]->npred; i++) {
+          cfgVarId(cfg, phi->args[i]);
+        }
+      }
+    }
+    cfgLiveness(cfg);
+    ssa->leader = calloc(cfg->nvars + 1, sizeof(Operand*));
+    ssa->exprs = htCreate(&exprType, NULL);
+  }
+
+  List* added = newList(NULL, NULL, NULL);
+  numberPhis(ssa, b, added);
+  for (ListNode* node = cfg->blocks[b]->codes->head; node;
+       node = node->next) {
+    numberCode(ssa, node, added);
+  }
+
+  BasicBlock* bb = cfg->blocks[b];
+  for (int i = 0; i < bb->nsucc; i++) {
+    int s = bb->succ[i];
+    int j = predIndex(cfg, s, b);
+    for (Phi* phi = ssa->phis[s]; phi; phi = phi->next) {
+      phi->args[j] = valueOf(ssa, phi->args[j]);
+    }
+  }
+
+  for (int i = 0; i < ssa->nkids[b]; i++) numberValues(ssa, ssa->kids[b][i]);
+
+  // the expressions of the block are not available beside its subtree
+  for (ListNode* node = added->head; node; node = node->next) {
+    htDelete(ssa->exprs, node->value);
+    free(node->value);
+  }
+  freeList(added);
+
+  if (b == 0) htRelease(ssa->exprs);
+}
+
+// a phi whose arguments all have one value, itself aside, has that value,
+// and so does a phi of the block with the same arguments
+static void numberPhis(SSA* ssa, int b, List* added) {
+  CFG* cfg = ssa->cfg;
+  int npred = cfg->blocks[b]->npred;
+
+  for (Phi* phi = ssa->phis[b]; phi; phi = phi->next) {
+    Operand* same = NULL;
+    int unique = 1;
+    for (int i = 0; i < npred; i++) {
+      Operand* arg = valueOf(ssa, phi->args[i]);
+      if (sameOperand(arg, phi->dest)) continue;
+      if (same == NULL) {
+        same = arg;
+      } else if (!sameOperand(arg, same)) {
+        unique = 0;
+      }
+    }
+    if (same && unique) {
+      ssa->leader[cfgVarId(cfg, phi->dest)] = same;
+      phi->dead = 1;
+      continue;
+    }
+
+    char* key = malloc(32);
+    int len = sprintf(key, "phi %d", b);
+    for (int i = 0; i < npred; i++) {
+      char* name = operand2str(valueOf(ssa, phi->args[i]));
+      key = realloc(key, len + strlen(name) + 2);
+      len += sprintf(key + len, " %s", name);
+      free(name);
+    }
+    Operand* value = available(ssa, key, phi->dest, added);
+    if (value) {
+      ssa->leader[cfgVarId(cfg, phi->dest)] = value;
+      phi->dead = 1;
+    }
+  }
+}
+
+static void numberCode(SSA* ssa, ListNode* node, List* added) {
+  CFG* cfg = ssa->cfg;
+  IRCode* ir = node->value;
+
+  // a constant is not put where an address is read
+  Operand** uses[3];
+  int k = irUseOperands(ir, uses);
+  for (int i = 0; i < k; i++) {
+    Operand* value = valueOf(ssa, *uses[i]);
+    int pointer = (ir->kind == IR_GET_VALUE && uses[i] == &ir->right) ||
+                  (ir->kind == IR_SET_VALUE && uses[i] == &ir->left);
+    if (pointer && value->kind == OP_CONSTANT) continue;
+    *uses[i] = value;
+  }
+
+  Operand** def = irDefOperand(ir);
+  if (def == NULL) return;
+  int d = cfgVarId(cfg, *def);
+  if (d < ssa->norig) return;
+
+  Operand* value = NULL;
+  char* key = NULL;
+  switch (ir->kind) {
+    case IR_ASSIGN:
+      if (isStable(ssa, ir->right)) value = ir->right;
+      break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV: {
+      Operand* a = ir->op1;
+      Operand* c = ir->op2;
+      intptr_t folded;
+      if (a->kind == OP_CONSTANT && c->kind == OP_CONSTANT &&
+          foldConstant(ir->kind, a->constant, c->constant, &folded)) {
+        value = newOperand(OP_CONSTANT, (void*)folded, NULL);
+        break;
+      }
+      // x + 0, x - 0, x * 1 and x / 1 are x; an x in memory is copied,
+      // the copy is left to copy propagation
+      Operand* x = identityOperand(ir);
+      if (x && isStable(ssa, x)) {
+        value = x;
+        break;
+      }
+      if (x) {
+        node->value = newIRCode(IR_ASSIGN, *def, x);
+        ((IRCode*)node->value)->count = ir->count;
+        return;
+      }
+      if (!isStable(ssa, a) || !isStable(ssa, c)) break;
+
+      char* s1 = operand2str(a);
+      char* s2 = operand2str(c);
+      // the operands of a commutative operation in one order
+      if ((ir->kind == IR_ADD || ir->kind == IR_MUL) && strcmp(s1, s2) > 0) {
+        char* t = s1;
+        s1 = s2;
+        s2 = t;
+      }
+      key = malloc(strlen(s1) + strlen(s2) + 16);
+      sprintf(key, "%d %s %s", ir->kind, s1, s2);
+      free(s1);
+      free(s2);
+      break;
+    }
+    case IR_GET_ADDR: {
+      char* s = operand2str(ir->right);
+      key = malloc(strlen(s) + 16);
+      sprintf(key, "%d %s", ir->kind, s);
+      free(s);
+      break;
+    }
+    default:
+      break;
+  }
+
+  if (key) value = available(ssa, key, *def, added);
+  if (value == NULL) return;
+
+  ssa->leader[d] = value;
+  if (ir->kind != IR_ASSIGN) node->value = newIRCode(IR_ASSIGN, *def, value);
+}
+
+// the name of the value of op
+static Operand* valueOf(SSA* ssa, Operand* op) {
+  int id = cfgVarId(ssa->cfg, op);
+  if (id < 0 || ssa->leader[id] == NULL) return op;
+  return ssa->leader[id];
+}
+
+// return 1 if op holds one value all along: a constant or a name in SSA form
+static int isStable(SSA* ssa, Operand* op) {
+  int id = cfgVarId(ssa->cfg, op);
+  return id < 0 || id >= ssa->norig || ssa->renamed[id];
+}
+
+// the name of the expression key if it is available, otherwise make value
+// its name for the rest of the subtree and return NULL; key is taken over
+static Operand* available(SSA* ssa, char* key, Operand* value, List* added) {
+  HashEntry* entry = htFind(ssa->exprs, key);
+  if (entry) {
+    free(key);
+    return htGetEntryVal(entry);
+  }
+  htAdd(ssa->exprs, key, value);
+  listAddNodeTail(added, key);
+  return NULL;
+}
+
+// replace every phi by a copy of its arguments into a new name at the end
+// of the predecessors and a copy of that name at the start of the block,
+// then coalesce the names the copies join
+static void leaveSSA(SSA* ssa) {
+  CFG* cfg = ssa->cfg;
+  CopyPair* pairs = NULL;
+  int npairs = 0;
+
+  for (int b = 0; b < cfg->nblocks; b++) {
+    BasicBlock* bb = cfg->blocks[b];
+    for (Phi* phi = ssa->phis[b]; phi; phi = phi->next) {
+      if (phi->dead) continue;
+
+      Operand* copy = newName(ssa, phi->var, phi->dest);
+      pairs = realloc(pairs, sizeof(CopyPair) * (npairs + bb->npred + 1));
+      for (int i = 0; i < bb->npred; i++) {
+        List* codes = cfg->blocks[bb->preds[i]]->codes;
+        insertAtEnd(codes, newIRCode(IR_ASSIGN, copy, phi->args[i]));
+        if (isVarOperand(phi->args[i])) {
+          pairs[npairs++] = (CopyPair){copy, phi->args[i]};
+        }
+      }
+      insertAtHead(bb->codes, newIRCode(IR_ASSIGN, phi->dest, copy));
+      pairs[npairs++] = (CopyPair){phi->dest, copy};
+    }
+  }
+
+  coalesceNames(ssa, pairs, npairs);
+  free(pairs);
+}
+
+// before the jump ending the block, if there is one
+static void insertAtEnd(List* codes, IRCode* ir) {
+  ListNode* tail = codes->tail;
+  if (tail) {
+    int kind = ((IRCode*)tail->value)->kind;
+    if (kind == IR_GOTO || kind == IR_IF_GOTO) {
+      listInsertNode(codes, tail, ir, 0);
+      return;
+    }
+  }
+  listAddNodeTail(codes, ir);
+}
+
+// after the labels starting the block
+static void insertAtHead(List* codes, IRCode* ir) {
+  for (ListNode* node = codes->head; node; node = node->next) {
+    if (((IRCode*)node->value)->kind != IR_LABEL) {
+      listInsertNode(codes, node, ir, 0);
+      return;
+    }
+  }
+  listAddNodeTail(codes, ir);
+}
+
+static int findClass(int* parent, int x) {
+  while (parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+// names that do not interfere share one: first those the phi copies join,
+// then those of the other copies, then the new names of a variable with
+// the original one, so a variable keeps its name wherever it can. A class
+// holds at most one original variable and is named after it
+static void coalesceNames(SSA* ssa, CopyPair* pairs, int npairs) {
+  CFG* cfg = ssa->cfg;
+  cfgLiveness(cfg);
+  int n = cfg->nvars;
+  int words = BITSET_WORDS(n);
+
+  // the names that may be coalesced, and the original variable of each
+  int* orig = malloc(sizeof(int) * (n + 1));
+  char* candidate = calloc(n + 1, 1);
+  for (int id = 0; id < n; id++) {
+    orig[id] = -1;
+    if (id < ssa->norig) {
+      candidate[id] = ssa->renamed[id];
+      orig[id] = id;
+    } else {
+      candidate[id] = originOf(ssa, id) >= 0;
+    }
+  }
+
+  // a definition interferes with the names live past it, but the source of
+  // a copy; the names live on entry are all defined there
+  uint32_t** row = malloc(sizeof(uint32_t*) * (n + 1));
+  for (int id = 0; id < n; id++) row[id] = calloc(words + 1, sizeof(uint32_t));
+  uint32_t* live = malloc(sizeof(uint32_t) * (words + 1));
+  for (int b = 0; b < cfg->nblocks; b++) {
+    memcpy(live, cfg->liveOut[b], sizeof(uint32_t) * words);
+    for (ListNode* node = cfg->blocks[b]->codes->tail; node;
+         node = node->prev) {
+      IRCode* ir = node->value;
+      Operand** def = irDefOperand(ir);
+      int d = def ? cfgVarId(cfg, *def) : -1;
+      if (d >= 0) {
+        int src = ir->kind == IR_ASSIGN ? cfgVarId(cfg, ir->right) : -1;
+        for (int w = 0; w < words; w++) {
+          uint32_t bits = live[w];
+          while (bits) {
+            int l = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (l == d || l == src) continue;
+            bitSet(row[d], l);
+            bitSet(row[l], d);
+          }
+        }
+        bitClear(live, d);
+      }
+      Operand** uses[3];
+      int k = irUseOperands(ir, uses);
+      for (int i = 0; i < k; i++) bitSet(live, cfgVarId(cfg, *uses[i]));
+    }
+  }
+  if (cfg->nblocks > 0) {
+    uint32_t* entry = cfg->liveIn[0];
+    for (int id = 0; id < n; id++) {
+      if (!bitTest(entry, id)) continue;
+      for (int w = 0; w < words; w++) row[id][w] |= entry[w];
+      bitClear(row[id], id);
+    }
+  }
+  free(live);
+
+  // union-find over the names, a class keeps the interferences and the
+  // members of all of them
+  int* parent = malloc(sizeof(int) * (n + 1));
+  int* next = malloc(sizeof(int) * (n + 1));
+  int* last = malloc(sizeof(int) * (n + 1));
+  for (int id = 0; id < n; id++) {
+    parent[id] = last[id] = id;
+    next[id] = -1;
+  }
+
+  for (int pass = 0; pass < 3; pass++) {
+    int count = 0;
+    int* as = NULL;
+    int* bs = NULL;
+    if (pass == 0) {
+      as = malloc(sizeof(int) * (npairs + 1));
+      bs = malloc(sizeof(int) * (npairs + 1));
+      for (int i = 0; i < npairs; i++) {
+        as[count] = cfgVarId(cfg, pairs[i].a);
+        bs[count++] = cfgVarId(cfg, pairs[i].b);
+      }
+    } else if (pass == 1) {
+      for (int b = 0; b < cfg->nblocks; b++) {
+        for (ListNode* node = cfg->blocks[b]->codes->head; node;
+             node = node->next) {
+          IRCode* ir = node->value;
+          if (ir->kind != IR_ASSIGN || !isVarOperand(ir->right)) continue;
+          as = realloc(as, sizeof(int) * (count + 1));
+          bs = realloc(bs, sizeof(int) * (count + 1));
+          as[count] = cfgVarId(cfg, ir->left);
+          bs[count++] = cfgVarId(cfg, ir->right);
+        }
+      }
+    } else {
+      as = malloc(sizeof(int) * (n + 1));
+      bs = malloc(sizeof(int) * (n + 1));
+      for (int id = ssa->norig; id < n; id++) {
+        int v = originOf(ssa, id);
+        if (v < 0) continue;
+        as[count] = v;
+        bs[count++] = id;
+      }
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (!candidate[as[i]] || !candidate[bs[i]]) continue;
+      int ra = findClass(parent, as[i]);
+      int rb = findClass(parent, bs[i]);
+      if (ra == rb || (orig[ra] >= 0 && orig[rb] >= 0)) continue;
+
+      int interferes = 0;
+      for (int m = rb; m >= 0 && !interferes; m = next[m]) {
+        interferes = bitTest(row[ra], m);
+      }
+      if (interferes) continue;
+
+      for (int w = 0; w < words; w++) row[ra][w] |= row[rb][w];
+      next[last[ra]] = rb;
+      last[ra] = last[rb];
+      parent[rb] = ra;
+      if (orig[ra] < 0) orig[ra] = orig[rb];
+    }
+    free(as);
+    free(bs);
+  }
+
+  // a class is named after its original variable, if it has one
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    ListNode* after;
+    for (ListNode* node = codes->head; node; node = after) {
+      after = node->next;
+      IRCode* ir = node->value;
+      Operand** slots[4];
+      int k = irUseOperands(ir, slots);
+      Operand** def = irDefOperand(ir);
+      if (def) slots[k++] = def;
+      for (int i = 0; i < k; i++) {
+        int id = cfgVarId(cfg, *slots[i]);
+        if (!candidate[id]) continue;
+        int r = findClass(parent, id);
+        *slots[i] = cfg->vars[orig[r] >= 0 ? orig[r] : r];
+      }
+      if (ir->kind == IR_ASSIGN && sameOperand(ir->left, ir->right)) {
+        listDelNode(codes, node);
+      }
+    }
+  }
+
+  for (int id = 0; id < n; id++) free(row[id]);
+  free(row);
+  free(orig);
+  free(candidate);
+  free(parent);
+  free(next);
+  free(last);
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+static int isSelfTailCall(CFG* cfg, List* codes, int nparams);
+
+// turn a function returning the value of a call to itself into a loop: the
+// arguments are copied into the parameters and the call jumps back to the
+// entry, copy propagation removes the copies left over
+void eliminateTailRecursion(CFG* cfg) {
+  // an argument may point into the frame of the caller, which the callee
+  // would have had apart
+  for (int b = 0; b < cfg->nblocks; b++) {
+    for (ListNode* node = cfg->blocks[b]->codes->head; node;
+         node = node->next) {
+      if (((IRCode*)node->value)->kind == IR_DEC) return;
+    }
+  }
+
+  int nparams = 0;
+  for (ListNode* node = cfg->prologue->head; node; node = node->next) {
+    if (((IRCode*)node->value)->kind == IR_PARAM) nparams++;
+  }
+  Operand** params = malloc(sizeof(Operand*) * (nparams + 1));
+  int i = 0;
+  for (ListNode* node = cfg->prologue->head; node; node = node->next) {
+    IRCode* ir = node->value;
+    if (ir->kind == IR_PARAM) params[i++] = ir->op;
+  }
+
+  int changed = 0;
+  for (int b = 0; b < cfg->nblocks; b++) {
+    List* codes = cfg->blocks[b]->codes;
+    if (!isSelfTailCall(cfg, codes, nparams)) continue;
+
+    // RETURN t, t := CALL f and the ARGs, the last argument first, become
+    // copies of the arguments into temps and of the temps into the parameters
+    listDelNode(codes, codes->tail);
+    listDelNode(codes, codes->tail);
+    Operand** temps = malloc(sizeof(Operand*) * (nparams + 1));
+    ListNode* node = codes->tail;
+    ListNode* prev;
+    for (i = 0; i < nparams; i++, node = prev) {
+      IRCode* arg = node->value;
+      prev = node->prev;
+      if (sameOperand(arg->op, params[i])) {
+        // a parameter passed on as it is
+        temps[i] = NULL;
+        listDelNode(codes, node);
+        continue;
+      }
+      temps[i] = newOperand(OP_TEMP, (void*)newTempNo(), NULL);
+      node->value = newIRCode(IR_ASSIGN, temps[i], arg->op);
+    }
+    for (i = 0; i < nparams; i++) {
+      if (temps[i] == NULL) continue;
+      listAddNodeTail(codes, newIRCode(IR_ASSIGN, params[i], temps[i]));
+    }
+    listAddNodeTail(codes, newIRCode(IR_GOTO, cfgBlockLabel(cfg, 0)));
+    free(temps);
+    changed = 1;
+  }
+
+  free(params);
+  if (changed) cfgAnalyze(cfg);
+}
+
+// return 1 if the block ends by returning what a call to the function
+// itself, with all of its arguments, returns
+static int isSelfTailCall(CFG* cfg, List* codes, int nparams) {
+  if (codes->tail == NULL || codes->tail->prev == NULL) return 0;
+  IRCode* ret = codes->tail->value;
+  IRCode* call = codes->tail->prev->value;
+  if (ret->kind != IR_RETURN || call->kind != IR_CALL ||
+      !sameOperand(ret->op, call->left)) {
+    return 0;
+  }
+
+  IRCode* func = cfg->prologue->head->value;
+  if (strcmp(call->right->func_name, func->op->func_name) != 0) return 0;
+
+  int nargs = 0;
+  for (ListNode* node = codes->tail->prev->prev;
+       node && ((IRCode*)node->value)->kind == IR_ARG; node = node->prev) {
+    nargs++;
+  }
+  return nargs == nparams;
+}
@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *allocBlock(Arena *arena, size_t size) {
+  size_t next = arena->blocks ? arena->blocks->size * 2 : ARENA_BLOCK_SIZE;
+  if (next < size) next = size;
+
+  ArenaBlock *block = malloc(sizeof(ArenaBlock) + next);
+  if (block == NULL) return NULL;
+  block->next = arena->blocks;
+  block->size = next;
+  arena->blocks = block;
+  arena->ptr = (char *)(block + 1) + size;
+  arena->end = (char *)(block + 1) + next;
+  return block + 1;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+  assert(arena != NULL);
+
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if ((size_t)(arena->end - arena->ptr) < size) return allocBlock(arena, size);
+  void *p = arena->ptr;
+  arena->ptr += size;
+  return p;
+}
+
+char *arenaStrdup(Arena *arena, const char *s) {
+  size_t size = strlen(s) + 1;
+  char *p = arenaAlloc(arena, size);
+  if (p) memcpy(p, s, size);
+  return p;
+}
+
+void arenaReset(Arena *arena) {
+  assert(arena != NULL);
+
+  ArenaBlock *block = arena->blocks;
+  if (block == NULL) return;
+  while (block->next) {
+    ArenaBlock *next = block->next->next;
+    free(block->next);
+    block->next = next;
+  }
+  arena->ptr = (char *)(block + 1);
+  arena->end = arena->ptr + block->size;
+}
+
+void arenaRelease(Arena *arena) {
+  assert(arena != NULL);
+
+  while (arena->blocks) {
+    ArenaBlock *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+  arena->ptr = arena->end = NULL;
+}
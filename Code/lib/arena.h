@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Memory handed out by bumping a pointer and given back all at once */
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t size; /* the bytes following the block */
+} ArenaBlock;
+
+typedef struct Arena {
+  ArenaBlock *blocks; /* the newest, and largest, first */
+  char *ptr;
+  char *end;
+} Arena;
+
+/* the size of the first block, each next block is twice the size */
+#define ARENA_BLOCK_SIZE 4096
+/* every allocation is aligned to this */
+#define ARENA_ALIGN 16
+
+void *arenaAlloc(Arena *arena, size_t size);
+char *arenaStrdup(Arena *arena, const char *s);
+/* give back everything allocated, keeping the largest block for reuse */
+void arenaReset(Arena *arena);
+void arenaRelease(Arena *arena);
+
+#endif  // ARENA_H
@@ -76,6 +76,44 @@ void listJoin(List *l, List *o) {
   o->len = 0;
 }
 
+void listDelNode(List *list, ListNode *node) {
+  assert(list != NULL && node != NULL);
+
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    list->head = node->next;
+  }
+  if (node->next) {
+    node->next->prev = node->prev;
+  } else {
+    list->tail = node->prev;
+  }
+  freeListNode(list, node);
+  free(node);
+  list->len--;
+}
+
+void listInsertNode(List *list, ListNode *old_node, void *value, int after) {
+  assert(list != NULL && old_node != NULL);
+
+  ListNode *node = malloc(sizeof(ListNode));
+  if (node == NULL) return;
+  node->value = dupListNode(list, value);
+  if (after) {
+    node->prev = old_node;
+    node->next = old_node->next;
+    if (list->tail == old_node) list->tail = node;
+  } else {
+    node->next = old_node;
+    node->prev = old_node->prev;
+    if (list->head == old_node) list->head = node;
+  }
+  if (node->prev != NULL) node->prev->next = node;
+  if (node->next != NULL) node->next->prev = node;
+  list->len++;
+}
+
 ListIter *listGetIterator(List *list, int direction) {
   ListIter *iter = malloc(sizeof(ListIter));
   if (iter == NULL) return NULL;
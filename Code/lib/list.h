@@ -38,6 +38,8 @@ void freeList(List *list);
 void listAddNodeHead(List *list, void *value);
 void listAddNodeTail(List *list, void *value);
 void listJoin(List *l, List *o);
+void listDelNode(List *list, ListNode *node);
+void listInsertNode(List *list, ListNode *old_node, void *value, int after);
 
 ListIter *listGetIterator(List *list, int direction);
 ListNode *listNext(ListIter *iter);
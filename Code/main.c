@@ -8,18 +8,37 @@
 
 #define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
 
-MBTreeNode* root = NULL;
+NodeId root = 0;
 HashTable* ht = NULL;
+char* source = NULL;
 int has_error = 0;
 int translateEnabled = 1;
+// translate each statement of a function as soon as it is checked, see
+// IRGenerateFused
+static int fused = 0;
+// keep compiled functions in this directory, see compileCached
+static char* cacheDir = NULL;
+// write the IR file as an image, see writeIRImage
+static int binaryIR = 0;
+// the input is IR, as an image or as text, the front end is skipped
+static int fromIR = 0;
+// compile each ExtDef as soon as it is parsed, see streamExtDef
+static int stream = 0;
+// the output of an instrumented run of the program, see readProfile
+static char* profile = NULL;
 
 extern int yyparse();
-extern int yyrestart(FILE*);
-extern void semanticAnalysis(MBTreeNode* node);
-extern List* IRGenerate(MBTreeNode* node);
+extern void* yy_scan_buffer(char* base, size_t size);
+extern int semanticAnalysis(NodeId node);
+extern List* IRGenerate(NodeId node);
+extern List* IRGenerateFused(NodeId node);
 extern void MIPS32Generate(List* irList, FILE* fout);
+extern List* compileCached(NodeId root, const char* dir, const char* salt);
+extern void writeCached(List* functions, FILE* fout, FILE* irout);
 extern char* strdup(const char*);
 extern int yydebug;
+extern int unrollFactor;
+extern int delaySlots;
 
 int keyCompare(void* privDataPtr, const void* a, const void* b) {
   return !strcmp(a, b);
@@ -48,56 +67,228 @@ static void init() {
   // yydebug = 1;
 }
 
+static List* readIR(char* path);
+static int openOutputs(char** files, int nfiles, FILE** fout, FILE** irout);
+static void closeOutputs(FILE* fout, FILE* irout);
+static void writeCode(List* ir, FILE* fout, FILE* irout);
+static void cannotTranslate();
+
+// read the whole file, followed by the two NULs yy_scan_buffer expects
+static char* readSource(FILE* f, size_t* size) {
+  if (fseek(f, 0, SEEK_END) != 0) return NULL;
+  long n = ftell(f);
+  if (n < 0 || fseek(f, 0, SEEK_SET) != 0) return NULL;
+
+  char* buf = malloc(n + 2);
+  if (!buf) return NULL;
+  *size = fread(buf, 1, n, f);
+  buf[*size] = buf[*size + 1] = '\0';
+  return buf;
+}
+
 int main(int argc, char** argv) {
-  if (argc <= 1) return 1;
+  // options start with --, the other arguments are the source, the assembly
+  // and the IR files
+  char* files[3] = {NULL, NULL, NULL};
+  int nfiles = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--fused") == 0) {
+      fused = 1;
+    } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+      cacheDir = argv[i] + 8;
+    } else if (strcmp(argv[i], "--binary-ir") == 0) {
+      binaryIR = 1;
+    } else if (strcmp(argv[i], "--from-ir") == 0) {
+      fromIR = 1;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      stream = 1;
+    } else if (strncmp(argv[i], "--unroll=", 9) == 0) {
+      // the copies a counted loop is unrolled into, 1 for none
+      unrollFactor = atoi(argv[i] + 9);
+    } else if (strcmp(argv[i], "--delay-slots") == 0) {
+      // the target runs the instruction after a jump before taking it
+      delaySlots = 1;
+    } else if (strcmp(argv[i], "--instrument") == 0) {
+      // the program writes how often each label and function ran
+      instrument = 1;
+    } else if (strncmp(argv[i], "--profile-use=", 14) == 0) {
+      // what such a program wrote, to optimize for it
+      profile = argv[i] + 14;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    } else if (nfiles < 3) {
+      files[nfiles++] = argv[i];
+    }
+  }
+  if (nfiles == 0) return 1;
+  // both decide how each function is checked
+  if (fused && cacheDir) {
+    fprintf(stderr, "--fused does not go with --cache\n");
+    return 1;
+  }
+  // both need the whole program
+  if (stream && (cacheDir || binaryIR)) {
+    fprintf(stderr, "--stream does not go with --cache or --binary-ir\n");
+    return 1;
+  }
+  // the labels of the profile are numbered across the whole program
+  if (stream && profile) {
+    fprintf(stderr, "--stream does not go with --profile-use\n");
+    return 1;
+  }
+  if (profile && !readProfile(profile)) return 1;
 
   init();
 
-  FILE* f = fopen(argv[1], "r");
+  FILE* fout = NULL;
+  FILE* irout = NULL;
+
+  if (fromIR) {
+    List* ir = readIR(files[0]);
+    if (!ir) return 1;
+    if (!openOutputs(files, nfiles, &fout, &irout)) return 1;
+    writeCode(ir, fout, irout);
+    closeOutputs(fout, irout);
+    return 0;
+  }
+
+  FILE* f = fopen(files[0], "r");
   if (!f) {
-    perror(argv[1]);
+    perror(files[0]);
     return 1;
   }
 
-  FILE* fout = NULL;
+  // the tokens are slices of the source, it is scanned in place
+  size_t size;
+  source = readSource(f, &size);
+  fclose(f);
+  if (!source) {
+    perror(files[0]);
+    return 1;
+  }
+
+  if (stream) {
+    if (!openOutputs(files, nfiles, &fout, &irout)) return 1;
+    beginStream(fout, irout);
+  }
 
-  yyrestart(f);
+  yy_scan_buffer(source, size + 2);
   yyparse();
 
-  fclose(f);
+  if (stream) {
+    int whole = endStream();
+    closeOutputs(fout, irout);
+    if (!whole) {
+      // there is no output for such a program, not even a part of it
+      for (int i = 1; i < nfiles; i++) remove(files[i]);
+      if (!has_error) cannotTranslate();
+    }
+  } else if (!has_error) {
+    // displayAstNode(root, 0);
+    List* ir = NULL;
+    // what compileCached checked and compiled, the cache keeps the IR as
+    // text; the counters of a profile are for labels numbered across the
+    // whole program, which the cache renumbers
+    List* functions = NULL;
+    // the options changing the code are part of the cache key
+    char salt[32];
+    sprintf(salt, "unroll=%d delay=%d", unrollFactor, delaySlots);
+    if (fused) {
+      ir = IRGenerateFused(root);
+      // a fused run stops at semantic errors
+      if (ir == NULL && translateEnabled) return 0;
+    } else if (cacheDir == NULL || binaryIR || instrument || profile ||
+               (functions = compileCached(root, cacheDir, salt)) == NULL) {
+      // a program with semantic errors is translated as usual
+      semanticAnalysis(root);
+    }
 
-  if (!has_error) {
-    // displayMBTreeNode(root, 0);
-    semanticAnalysis(root);
     if (translateEnabled) {
-      if (argc <= 2) {
-        fout = stdout;
+      if (!openOutputs(files, nfiles, &fout, &irout)) return 1;
+      if (functions) {
+        writeCached(functions, fout, irout);
       } else {
-        fout = fopen(argv[2], "w");
-        if (!fout) {
-          perror(argv[2]);
-          return 1;
-        }
+        if (ir == NULL) ir = IRGenerate(root);
+        writeCode(ir, fout, irout);
       }
+      closeOutputs(fout, irout);
+    } else {
+      cannotTranslate();
+    }
+    if (functions) freeList(functions);
+  }
 
-      List* ir = IRGenerate(root);
+  return 0;
+}
 
-      if (argc > 3) {
-        FILE* irout = fopen(argv[3], "w");
-        displayIRCodeList(ir, irout);
-        fclose(irout);
-      }
-      // displayIRCodeList(ir, fout);
+// read an IR image or the IR as text, NULL after reporting an error
+static List* readIR(char* path) {
+  int broken;
+  IRImage* image = mapIRImage(path, &broken);
+  if (broken) return NULL;
+  if (image) return loadIRImage(image, path);
 
-      MIPS32Generate(ir, fout);
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  size_t size;
+  char* text = readSource(f, &size);
+  fclose(f);
+  if (!text) {
+    perror(path);
+    return NULL;
+  }
+  return parseIR(text, size, path);
+}
 
-      if (argc > 2) fclose(fout);
-    } else {
-      fprintf(stderr,
-              "Cannot translate: Code contains variables of multi-dimensional"
-              "array type or parameters of array type.\n");
+// the assembly goes to the second file or stdout, the IR to the third file
+// if there is one
+static int openOutputs(char** files, int nfiles, FILE** fout, FILE** irout) {
+  *fout = stdout;
+  *irout = NULL;
+  if (nfiles > 1) {
+    *fout = fopen(files[1], "w");
+    if (!*fout) {
+      perror(files[1]);
+      return 0;
+    }
+  }
+  if (nfiles > 2) {
+    *irout = fopen(files[2], binaryIR ? "wb" : "w");
+    if (!*irout) {
+      perror(files[2]);
+      return 0;
     }
   }
+  return 1;
+}
 
-  return 0;
+static void closeOutputs(FILE* fout, FILE* irout) {
+  if (irout) fclose(irout);
+  if (fout != stdout) fclose(fout);
+}
+
+// optimize the IR, then write it and the assembly
+static void writeCode(List* ir, FILE* fout, FILE* irout) {
+  attachProfile(ir);
+  ir = IROptimize(ir);
+  ir = orderFunctions(ir);
+
+  if (irout && binaryIR) {
+    if (!writeIRImage(ir, irout)) perror("writeIRImage");
+  } else if (irout) {
+    displayIRCodeList(ir, irout);
+  }
+  // displayIRCodeList(ir, fout);
+
+  MIPS32Generate(ir, fout);
+}
+
+static void cannotTranslate() {
+  fprintf(stderr,
+          "Cannot translate: Code contains variables of multi-dimensional"
+          "array type or parameters of array type.\n");
 }
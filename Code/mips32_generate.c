@@ -1,19 +1,87 @@
+#include <inttypes.h>
+
 #include "data.h"
 #include "hash.h"
 #include "list.h"
 
 #define MIPS32_REG_NUM 32
 #define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
-#define SAVE_FP_RA()                      \
-  fprintf(fout, "\taddi $sp, $sp, -8\n"); \
-  fprintf(fout, "\tsw $ra, 0($sp)\n");    \
-  fprintf(fout, "\tsw $fp, 4($sp)\n")
-#define RESTORE_FP_RA()                \
-  fprintf(fout, "\tlw $ra, 0($sp)\n"); \
-  fprintf(fout, "\tlw $fp, 4($sp)\n"); \
-  fprintf(fout, "\taddi $sp, $sp, 8\n")
+// a loop multiplies the weight of the variables used in it
+#define LOOP_WEIGHT 8
+#define MAX_LOOP_DEPTH 4
+// the most a code weighs with a profile, as much as in MAX_LOOP_DEPTH loops
+#define MAX_PROFILE_WEIGHT 4096
+// the first arguments are passed in $a0-$a3
+#define ARG_REG_NUM 4
+// the cost of a cover that does not exist
+#define NO_COVER 0x3fffffff
+// the cycles a multiplication and a division take
+#define MUL_COST 3
+#define DIV_COST 36
 
 extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+extern int delaySlots;
+
+// what setupStackFrame learns about a variable of the function
+typedef struct VarInfo {
+  Variable* var;
+  int size;    // bytes of memory, 0 for a parameter passed on the stack
+  int param;   // index of a parameter, -1 for the others
+  int weight;  // uses and definitions, weighted by loop depth
+  int pinned;  // its address is taken, it must stay in memory
+  int start;   // the codes it is live in, see extendIntervals
+  int end;
+  int ndefs;
+  int nuses;
+  // the code computing a temp used once later in its block, the code is
+  // folded into the tree of its use, see findTrees
+  IRCode* tree;
+  int need;  // scratch registers the tree needs
+} VarInfo;
+
+// the nonterminals a tree is covered as
+enum {
+  NT_REG,  // a value in a register
+  NT_IMM,  // a constant fitting in 16 bits
+  NT_MEM,  // an address, off(base)
+  NT_NUM
+};
+
+// the rules covering a node
+enum {
+  R_VAR,     // a variable, in its register or loaded
+  R_ZERO,    // $zero
+  R_LI,      // li rd, c
+  R_IMM,     // c, as the immediate of its parent
+  R_ADDU,    // addu rd, a, b
+  R_ADDIU,   // addiu rd, a, c
+  R_SUBU,    // subu rd, a, b
+  R_SUBI,    // addiu rd, a, -c
+  R_MUL,     // mul rd, a, b
+  R_MULC,    // shifts and adds multiplying by c
+  R_DIV,     // div a, b; mflo rd
+  R_DIVC,    // shifts, or a multiplication by a magic number, dividing by c
+  R_LW,      // lw rd, off(base)
+  R_LEA,     // addiu rd, base, off
+  R_CMP,     // slt, sltu, xor and friends, 1 if a relation holds
+  M_REG,     // 0(reg)
+  M_FRAME,   // off($sp), a variable of the frame
+  M_OFFSET,  // the address of the left kid moved by a constant
+};
+
+// a node of an expression tree
+typedef struct Node {
+  int kind;     // IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_GET_VALUE, IR_GET_ADDR,
+                // IR_COMPARE or IR_ASSIGN for a leaf
+  Operand* op;  // the operand of a leaf, the variable of IR_GET_ADDR
+  char* relop;  // of IR_COMPARE
+  struct Node* kids[2];
+  // the cheapest cover of the node as each nonterminal
+  int cost[NT_NUM];
+  int rule[NT_NUM];
+  intptr_t off;  // the offset of the NT_MEM cover
+  int need;      // scratch registers its evaluation needs
+} Node;
 
 static Register reg[MIPS32_REG_NUM];
 static HashTable* varTable;
@@ -22,58 +90,150 @@ static int param_num = 0;
 static int arg_num = 0;
 static HtType* type;
 
-static void init(FILE* fout);
+// the frame of the current function, addressed from $sp
+static VarInfo** vars;
+static int nvars;
+static int frame_size;
+static int leaf;
+static int ra_offset;
+static int saved_offset;
+static int saved[MIPS32_REG_NUM];
+static int nsaved;
+// the outgoing arguments not passed in registers, at the bottom of the frame
+static int out_size;
+
+// the instructions selected for the current function
+static List* instrs;
+// what the code of the current function is selected with, the instructions
+// and the variables and trees they come from; given back once it is printed
+static Arena arena;
+
+// the key of every counter of an instrumented program, see genCounter
+static intptr_t* counter_keys;
+static int ncounters;
+static int counter_capacity;
+static int nfunctions;
+// main of an instrumented program writes the counters before it returns
+static int dump_counts;
+
+// registers holding variables
+static const int callee_saved[] = {REG_S0, REG_S1, REG_S2, REG_S3, REG_S4,
+                                   REG_S5, REG_S6, REG_S7, REG_FP};
+static const int caller_saved[] = {REG_T4, REG_T5, REG_T6,
+                                   REG_T7, REG_T8, REG_T9};
+// registers holding the values of trees, a leaf keeps variables in $t4-$t9
+static const int scratch[] = {REG_T0, REG_T1, REG_T2, REG_T3, REG_T4,
+                              REG_T5, REG_T6, REG_T7, REG_T8, REG_T9};
+static int nscratch;
+
+static void init();
+static void flushFunction(FILE* fout);
+static void selectCompares(List* irList, ListNode* node);
+static int boolConstant(IRCode* ir, IRCode* test);
 static void setupStackFrame(ListNode* node);
-static void insertVariable(Operand* op);
-static int getRegister(Variable* var, FILE* fout);
+static VarInfo* insertVariable(Operand* op);
+static VarInfo* lookupVariable(Operand* op);
+static void touchVariable(VarInfo* info, int position, int weight);
+static void extendIntervals(int* head, int* tail, int nloops);
+static void findTrees(ListNode* node, int n);
+static int foldable(IRCode* def, ListNode* from, ListNode* use);
+static void treeLeaves(IRCode* ir, Operand** leaves, int* nleaves, int* load);
+static int treeNeed(IRCode* ir);
+static int operandNeed(Operand* op);
+static void allocateRegisters();
+static int registerFree(VarInfo** order, int n, int r, VarInfo* info);
+static void layoutFrame();
+static int compareWeight(const void* a, const void* b);
+static int compareStart(const void* a, const void* b);
+static Variable* findVariable(Operand* op);
+static IRCode* foldedCode(Operand* op);
+
+static Node* treeOf(Operand* op);
+static Node* codeTree(IRCode* ir);
+static Node* newNode(int kind, Operand* op, Node* left, Node* right);
+static void labelNode(Node* n);
+static void cover(Node* n, int nt, int cost, int rule);
+static int reduceReg(Node* n, int target);
+static int reduceMem(Node* n, intptr_t* off);
+static void reducePair(Node* a, Node* b, int* ra, int* rb);
+static int isConstant(Node* n);
+static int fitsImm(intptr_t c);
+static int log2Of(intptr_t c);
+static int reduceMulConst(Node* n, int target);
+static int reduceDivConst(Node* n, int target);
+static int nextDest(int* left, int* acc, int src, int target);
+static int nafDigits(intptr_t c, int* pos, int* sign);
+static int mulOps(intptr_t c);
+static int divOps(intptr_t c);
+static void magicNumber(int32_t d, int32_t* magic, int* shift);
+static int reduceCompare(Node* n, int target);
+static int compareImm(char* relop, Node* b);
+static char* mirrorRelop(char* relop);
+
+static Instr* emit(int op, int rd, int rs, int rt, intptr_t imm, char* label);
+static void emitLoad(int reg_num, Variable* var);
+static void storeVariable(Variable* var, int reg_num);
+static int getScratch(int target);
 static void freeRegister(int reg_num);
-
-static void genLabel(IRCode* ir, FILE* fout);
-static void genFunction(IRCode* ir, FILE* fout);
-static void genAssign(IRCode* ir, FILE* fout);
-static void genAdd(IRCode* ir, FILE* fout);
-static void genSub(IRCode* ir, FILE* fout);
-static void genMul(IRCode* ir, FILE* fout);
-static void genDiv(IRCode* ir, FILE* fout);
-static void genGetAddr(IRCode* ir, FILE* fout);
-static void genGetValue(IRCode* ir, FILE* fout);
-static void genSetValue(IRCode* ir, FILE* fout);
-static void genGoto(IRCode* ir, FILE* fout);
-static void genIfGoto(IRCode* ir, FILE* fout);
-static void genReturn(IRCode* ir, FILE* fout);
-static void genDec(IRCode* ir, FILE* fout);
-static void genArg(IRCode* ir, FILE* fout);
-static void genCall(IRCode* ir, FILE* fout);
-static void genParam(IRCode* ir, FILE* fout);
-static void genRead(IRCode* ir, FILE* fout);
-static void genWrite(IRCode* ir, FILE* fout);
-
-static void (*mips32GenFunctions[])(IRCode*, FILE*) = {
+static void genValue(IRCode* ir);
+static void genPrologue();
+static void genEpilogue();
+static void genRestore();
+static int isTailCall(ListNode* node);
+static void genTailCall(IRCode* ir);
+static char* functionLabel(Operand* op);
+static int argIndex(ListNode* node);
+static int isDead(VarInfo* info);
+static void genCounter(intptr_t key);
+
+static void genLabel(IRCode* ir);
+static void genFunction(IRCode* ir);
+static void genAssign(IRCode* ir);
+static void genAdd(IRCode* ir);
+static void genSub(IRCode* ir);
+static void genMul(IRCode* ir);
+static void genDiv(IRCode* ir);
+static void genGetAddr(IRCode* ir);
+static void genGetValue(IRCode* ir);
+static void genSetValue(IRCode* ir);
+static void genGoto(IRCode* ir);
+static void genIfGoto(IRCode* ir);
+static void genReturn(IRCode* ir);
+static void genDec(IRCode* ir);
+static void genArg(IRCode* ir);
+static void genCall(IRCode* ir);
+static void genParam(IRCode* ir);
+static void genRead(IRCode* ir);
+static void genWrite(IRCode* ir);
+static void genCompare(IRCode* ir);
+
+static void (*mips32GenFunctions[])(IRCode*) = {
     genLabel,   genFunction, genAssign,   genAdd,  genSub,    genMul,    genDiv,
     genGetAddr, genGetValue, genSetValue, genGoto, genIfGoto, genReturn, genDec,
-    genArg,     genCall,     genParam,    genRead, genWrite};
+    genArg,     genCall,     genParam,    genRead, genWrite,  genCompare};
 
 /*
- * stack frame layout
+ * stack frame layout, $sp does not move inside a function, the first four
+ * arguments are passed in $a0-$a3 and the others on the stack
  *
  * high address
  * +--------+
- * |  arg2  | <- $fp + 12
+ * |  arg6  | <- $sp + frame + 4
  * +--------+
- * |  arg1  | <- $fp + 8
+ * |  arg5  | <- $sp + frame ($sp on entry)
  * +--------+
- * |  ret   | <- $fp + 4 (return address)
+ * |  ret   | <- return address, only if the function calls
  * +--------+
- * | old $fp| <-$fp (old frame pointer)
+ * | saved  | <- the callee-saved registers the function uses
+ * |  ...   |
  * +--------+
- * |  var1  | <- $fp - 4
+ * |  var2  |
  * +--------+
- * |  var2  | <- $fp - 8
+ * |  var1  |
  * +--------+
- * |  ...   |
- * |  ...   |
+ * |  ...   | <- outgoing arg6
  * +--------+
- * |  ...   | <- $sp (stack pointer)
+ * |  ...   | <- $sp, outgoing arg5
  * +--------+
  * low address
  *
@@ -83,22 +243,13 @@ static void (*mips32GenFunctions[])(IRCode*, FILE*) = {
 void MIPS32Generate(List* irList, FILE* fout) {
   if (irList == NULL) return;
 
-  init(fout);
-
-  ListIter* iter = listGetIterator(irList, ITER_HEAD);
-  for (ListNode* node = listNext(iter); node != NULL; node = listNext(iter)) {
-    IRCode* ir = (IRCode*)node->value;
-    if (ir->kind == IR_FUNCTION) {
-      setupStackFrame(node);
-    }
-
-    mips32GenFunctions[ir->kind](ir, fout);
-  }
-  freeListIterator(iter);
+  MIPS32Prelude(fout);
+  MIPS32GenerateCodes(irList, fout);
+  MIPS32Counters(fout);
 }
 
-// add read and write functions, initialize registers and variables list
-static void init(FILE* fout) {
+// print the data and the read and write functions every program starts with
+void MIPS32Prelude(FILE* fout) {
   const char* init_code =
       ".data\n"
       "_prompt: .asciiz \"Enter an integer:\"\n"
@@ -113,6 +264,7 @@ static void init(FILE* fout) {
       "\tli $v0, 5\n"
       "\tsyscall\n"
       "\tjr $ra\n"
+      "%s"
       "\n"
       "write:\n"
       "\tli $v0, 1\n"
@@ -120,10 +272,105 @@ static void init(FILE* fout) {
       "\tli $v0, 4\n"
       "\tla $a0, _ret\n"
       "\tsyscall\n"
-      "\tmove $v0, $0\n"
-      "\tjr $ra\n";
+      "%s";
+
+  // the instruction after jr is run before it returns
+  if (delaySlots) {
+    fprintf(fout, init_code, "\tnop\n", "\tjr $ra\n\tmove $v0, $0\n");
+  } else {
+    fprintf(fout, init_code, "", "\tmove $v0, $0\n\tjr $ra\n");
+  }
+}
+
+// print the counters of an instrumented program, after its functions, and
+// _prof_dump, which main calls as it returns to write the magic number, the
+// number of counters, then the key and the count of each
+void MIPS32Counters(FILE* fout) {
+  if (!instrument) return;
+
+  fprintf(fout, "\n.data\n.align 2\n_prof: .space %d\n_prof_keys:",
+          BASIC_MEM_SIZE * ncounters);
+  for (int i = 0; i < ncounters; i++) {
+    fprintf(fout, "%s%" PRIdPTR, i % 8 ? ", " : "\n.word ", counter_keys[i]);
+  }
+
+  // the registers of main are restored after it, $v0 is kept for it
+  const char* dump_code =
+      "\n.text\n"
+      "\n"
+      "_prof_dump:\n"
+      "\tmove $t3, $ra\n"
+      "\tmove $t2, $v0\n"
+      "\tli $a0, %d\n"
+      "\tjal write\n"
+      "%s"
+      "\tli $a0, %d\n"
+      "\tjal write\n"
+      "%s"
+      "\tla $t0, _prof_keys\n"
+      "\tla $t1, _prof\n"
+      "\tli $t4, %d\n"
+      "_prof_next:\n"
+      "\tbeq $t4, $zero, _prof_done\n"
+      "%s"
+      "\tlw $a0, 0($t0)\n"
+      "\tjal write\n"
+      "%s"
+      "\tlw $a0, 0($t1)\n"
+      "\tjal write\n"
+      "%s"
+      "\taddiu $t0, $t0, 4\n"
+      "\taddiu $t1, $t1, 4\n"
+      "\taddiu $t4, $t4, -1\n"
+      "\tj _prof_next\n"
+      "%s"
+      "_prof_done:\n"
+      "\tmove $v0, $t2\n"
+      "\tjr $t3\n"
+      "%s";
+
+  // the instruction after a jump is run before it is taken
+  const char* slot = delaySlots ? "\tnop\n" : "";
+  fprintf(fout, dump_code, PROFILE_MAGIC, slot, ncounters, slot, ncounters,
+          slot, slot, slot, slot, slot);
+}
 
-  fprintf(fout, "%s", init_code);
+// generate the code of the functions in irList, without the prelude
+void MIPS32GenerateCodes(List* irList, FILE* fout) {
+  if (irList == NULL) return;
+
+  init();
+
+  ListIter* iter = listGetIterator(irList, ITER_HEAD);
+  for (ListNode* node = listNext(iter); node != NULL; node = listNext(iter)) {
+    IRCode* ir = (IRCode*)node->value;
+    if (ir->kind == IR_FUNCTION) {
+      flushFunction(fout);
+      // the counters are for the labels as they are
+      if (!instrument) selectCompares(irList, node);
+      setupStackFrame(node);
+    } else if (ir->kind == IR_ARG) {
+      arg_num = argIndex(node);
+    } else if (ir->kind == IR_CALL && isTailCall(node)) {
+      // the callee returns for the function
+      genTailCall(ir);
+      listNext(iter);
+      continue;
+    }
+
+    // a code folded into a tree is selected where its value is used
+    Operand** def = irDefOperand(ir);
+    if (def && foldedCode(*def) == ir) continue;
+
+    mips32GenFunctions[ir->kind](ir);
+  }
+  freeListIterator(iter);
+  flushFunction(fout);
+}
+
+// initialize registers and variables list, once
+static void init() {
+  if (instrs) return;
 
   for (int i = 0; i < MIPS32_REG_NUM; i++) {
     reg[i].kind = i;
@@ -139,9 +386,125 @@ static void init(FILE* fout) {
                    .keyDestructor = NULL,
                    .valDestructor = NULL};
   varTable = htCreate(type, NULL);
+  instrs = newList(NULL, NULL, NULL);
+}
+
+// schedule and print the instructions selected for the function
+static void flushFunction(FILE* fout) {
+  if (instrs->head) {
+    MIPS32Schedule(instrs, &arena);
+    fprintf(fout, "\n");
+  }
+  while (instrs->head) {
+    printInstr(instrs->head->value, fout);
+    listDelNode(instrs, instrs->head);
+  }
+  arenaReset(&arena);
 }
 
-// setup stack frame for function
+// turn the branches computing a relation into x := y [relop] z, what
+// translateExp makes of a value like a < b or !a after the branches are
+// simplified:
+//   IF a < b GOTO l1; x := #0; GOTO l2; LABEL l1 : x := #1; LABEL l2 :
+//   x := #1; IF a != #0 GOTO l1; x := #0; LABEL l1 :
+// the first code is rewritten in place as the caller iterates over the list;
+// a label no jump is left to goes too, the relation may then be folded into
+// the code using it
+static void selectCompares(List* irList, ListNode* node) {
+  size_t max_label = 0;
+  for (ListNode* p = node->next;
+       p && ((IRCode*)p->value)->kind != IR_FUNCTION; p = p->next) {
+    IRCode* ir = (IRCode*)p->value;
+    if (ir->kind == IR_LABEL && ir->op->label_no > max_label) {
+      max_label = ir->op->label_no;
+    }
+  }
+  // the jumps to every label
+  int* jumps = calloc(max_label + 1, sizeof(int));
+  for (ListNode* p = node->next;
+       p && ((IRCode*)p->value)->kind != IR_FUNCTION; p = p->next) {
+    IRCode* ir = (IRCode*)p->value;
+    if (ir->kind == IR_GOTO && ir->op->label_no <= max_label) {
+      jumps[ir->op->label_no]++;
+    }
+    if (ir->kind == IR_IF_GOTO && ir->label->label_no <= max_label) {
+      jumps[ir->label->label_no]++;
+    }
+  }
+
+  for (ListNode* p = node->next;
+       p && ((IRCode*)p->value)->kind != IR_FUNCTION; p = p->next) {
+    IRCode* c[6];
+    ListNode* q = p;
+    int n = 0;
+    for (; q && n < 6; q = q->next) c[n++] = (IRCode*)q->value;
+    while (n < 6) c[n++] = NULL;
+
+    IRCode* test = NULL;
+    Operand* x = NULL;
+    int holds = -1;
+    int ncodes = 0;
+    if (c[0]->kind == IR_IF_GOTO && c[1] && c[1]->kind == IR_ASSIGN &&
+        c[2] && c[2]->kind == IR_GOTO && c[3] && c[3]->kind == IR_LABEL &&
+        c[4] && c[4]->kind == IR_ASSIGN && c[5] && c[5]->kind == IR_LABEL &&
+        c[3]->op->label_no == c[0]->label->label_no &&
+        c[5]->op->label_no == c[2]->op->label_no &&
+        c[2]->op->label_no != c[0]->label->label_no &&
+        jumps[c[3]->op->label_no] == 1 &&
+        sameOperand(c[1]->left, c[4]->left) &&
+        boolConstant(c[1], NULL) >= 0 && boolConstant(c[4], NULL) >= 0 &&
+        boolConstant(c[1], NULL) != boolConstant(c[4], NULL)) {
+      // the diamond, x is only written once the test is done
+      test = c[0];
+      x = c[1]->left;
+      holds = boolConstant(c[4], NULL);
+      ncodes = 6;
+    } else if (c[0]->kind == IR_ASSIGN && c[1] && c[1]->kind == IR_IF_GOTO &&
+               c[2] && c[2]->kind == IR_ASSIGN && c[3] &&
+               c[3]->kind == IR_LABEL &&
+               c[3]->op->label_no == c[1]->label->label_no &&
+               sameOperand(c[0]->left, c[2]->left) &&
+               boolConstant(c[0], c[1]) >= 0 && boolConstant(c[2], NULL) >= 0 &&
+               boolConstant(c[0], c[1]) != boolConstant(c[2], NULL)) {
+      // the triangle, x is written before the test, which must not read it
+      test = c[1];
+      x = c[0]->left;
+      holds = boolConstant(c[0], c[1]);
+      ncodes = 4;
+    }
+    if (test == NULL) continue;
+
+    char* relop = holds ? test->relop : invertRelop(test->relop);
+    p->value = newIRCode(IR_COMPARE, x, test->op_l, relop, test->op_r);
+
+    // the jumps of the pattern go, its last code is the label they met at
+    IRCode* last = c[ncodes - 1];
+    for (int i = 1; i < ncodes - 1; i++) {
+      if (c[i]->kind == IR_GOTO) jumps[c[i]->op->label_no]--;
+      if (c[i]->kind == IR_IF_GOTO) jumps[c[i]->label->label_no]--;
+      listDelNode(irList, p->next);
+    }
+    if (jumps[last->op->label_no] == 0) listDelNode(irList, p->next);
+  }
+
+  free(jumps);
+}
+
+// the value 0 or 1 an assignment of a constant gives, -1 for the others;
+// -1 too if the test reads what it assigns
+static int boolConstant(IRCode* ir, IRCode* test) {
+  if (ir->right->kind != OP_CONSTANT) return -1;
+  if (ir->right->constant != 0 && ir->right->constant != 1) return -1;
+  if (test && (sameOperand(test->op_l, ir->left) ||
+               sameOperand(test->op_r, ir->left))) {
+    return -1;
+  }
+  return ir->right->constant;
+}
+
+// setup stack frame for function: collect its variables, fold the temps
+// used once into trees, keep the most used variables in registers and lay
+// out the rest of them in the frame
 static void setupStackFrame(ListNode* node) {
   assert(node);
 
@@ -150,430 +513,1462 @@ static void setupStackFrame(ListNode* node) {
 
   htRelease(varTable);
   varTable = htCreate(type, NULL);
+  free(vars);
+  vars = NULL;
+  nvars = 0;
   param_num = 0;
-  offset = 0;
+  arg_num = 0;
+  out_size = 0;
+  leaf = 1;
+
+  // the loop depth of every code, a jump back to a label closes a loop
+  int n = 0;
+  for (ListNode* p = node->next; p && ((IRCode*)p->value)->kind != IR_FUNCTION;
+       p = p->next) {
+    n++;
+  }
+  int* depth = calloc(n + 1, sizeof(int));
+  int* head = malloc(sizeof(int) * (n + 1));
+  int* tail = malloc(sizeof(int) * (n + 1));
+  int nloops = 0;
+  int i = 0;
+  for (ListNode* p = node->next; i < n; p = p->next, i++) {
+    IRCode* ir = (IRCode*)p->value;
+    Operand* label = NULL;
+    if (ir->kind == IR_GOTO) label = ir->op;
+    if (ir->kind == IR_IF_GOTO) label = ir->label;
+    if (label == NULL) continue;
+
+    int j = i;
+    for (ListNode* q = p; q != node; q = q->prev, j--) {
+      IRCode* code = (IRCode*)q->value;
+      if (code->kind == IR_LABEL && code->op->label_no == label->label_no) {
+        for (int k = j; k <= i; k++) depth[k]++;
+        head[nloops] = j;
+        tail[nloops++] = i;
+        break;
+      }
+    }
+  }
 
-  for (ListNode* p = node->next; p != NULL; p = p->next) {
+  // with a profile a code weighs the times it ran per call, a code the
+  // passes made without a count as much as the one before it
+  long entry = ir->count;
+  long count = entry;
+  i = 0;
+  for (ListNode* p = node->next; i < n; p = p->next, i++) {
     IRCode* ir = (IRCode*)p->value;
+    if (ir->count >= 0) count = ir->count;
+    int weight = 1;
+    if (entry > 0) {
+      long runs = (count + entry - 1) / entry;
+      weight = runs < MAX_PROFILE_WEIGHT ? runs : MAX_PROFILE_WEIGHT;
+    } else {
+      for (int d = 0; d < depth[i] && d < MAX_LOOP_DEPTH; d++) {
+        weight *= LOOP_WEIGHT;
+      }
+    }
+
     switch (ir->kind) {
-      case IR_LABEL:
-      case IR_FUNCTION:
-      case IR_GOTO:
-        break;
       case IR_PARAM: {
-        Variable* var = newVariable(ir->op, BASIC_MEM_SIZE * param_num + 8, -1);
-        htAdd(varTable, operand2str(ir->op), var);
-        param_num++;
+        VarInfo* info = insertVariable(ir->op);
+        info->param = param_num++;
+        if (info->param >= ARG_REG_NUM) info->size = 0;
         break;
       }
-      case IR_ARG:
-      case IR_RETURN:
+      case IR_ARG: {
+        int size = BASIC_MEM_SIZE * (argIndex(p) + 1 - ARG_REG_NUM);
+        if (size > out_size) out_size = size;
+        break;
+      }
+      case IR_CALL:
       case IR_READ:
       case IR_WRITE:
-        insertVariable(ir->op);
+        leaf = 0;
         break;
-      case IR_ASSIGN:
+      case IR_DEC: {
+        VarInfo* info = insertVariable(ir->operand);
+        info->size = ir->size;
+        info->pinned = 1;
+        break;
+      }
       case IR_GET_ADDR:
-      case IR_GET_VALUE:
-      case IR_SET_VALUE:
-        insertVariable(ir->left);
-        insertVariable(ir->right);
+        insertVariable(ir->right)->pinned = 1;
         break;
-      case IR_CALL:
-        insertVariable(ir->left);
+      default:
         break;
+    }
+
+    Operand** def = irDefOperand(ir);
+    if (def) {
+      VarInfo* info = insertVariable(*def);
+      touchVariable(info, i, weight);
+      info->ndefs++;
+    }
+    Operand** uses[3];
+    int k = irUseOperands(ir, uses);
+    for (int u = 0; u < k; u++) {
+      VarInfo* info = insertVariable(*uses[u]);
+      touchVariable(info, i, weight);
+      info->nuses++;
+    }
+  }
+  free(depth);
+
+  dump_counts = instrument && strcmp(ir->op->func_name, "main") == 0;
+  if (dump_counts) leaf = 0;
+  nscratch = leaf ? 4 : sizeof(scratch) / sizeof(int);
+  findTrees(node, n);
+
+  extendIntervals(head, tail, nloops);
+  free(head);
+  free(tail);
+
+  allocateRegisters();
+  layoutFrame();
+}
+
+// insert variable into variable table
+static VarInfo* insertVariable(Operand* op) {
+  assert(op && op->kind != OP_CONSTANT);
+
+  VarInfo* info = lookupVariable(op);
+  if (info != NULL) return info;
+
+  info = arenaAlloc(&arena, sizeof(VarInfo));
+  *info = (VarInfo){.var = newVariable(&arena, op, 0, -1),
+                    .size = BASIC_MEM_SIZE,
+                    .param = -1,
+                    .weight = 0,
+                    .pinned = 0,
+                    .start = -1,
+                    .end = -1,
+                    .ndefs = 0,
+                    .nuses = 0,
+                    .tree = NULL,
+                    .need = 0};
+  assert(htAdd(varTable, operandName(&arena, op), info) == HT_OK);
+
+  vars = realloc(vars, sizeof(VarInfo*) * (nvars + 1));
+  vars[nvars++] = info;
+  return info;
+}
+
+static VarInfo* lookupVariable(Operand* op) {
+  HashEntry* entry = htFind(varTable, operandName(&arena, op));
+  return entry ? entry->val : NULL;
+}
+
+// a variable is used or defined by the code at position
+static void touchVariable(VarInfo* info, int position, int weight) {
+  if (info->start < 0) info->start = position;
+  info->end = position;
+  info->weight += weight;
+}
+
+// without jumps back a variable is only live between its first and last
+// code, a loop the interval reaches into is covered whole
+static void extendIntervals(int* head, int* tail, int nloops) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 0; i < nvars; i++) {
+      VarInfo* info = vars[i];
+      if (info->start < 0) continue;
+      for (int l = 0; l < nloops; l++) {
+        if (info->start > tail[l] || info->end < head[l]) continue;
+        if (info->start > head[l]) {
+          info->start = head[l];
+          changed = 1;
+        }
+        if (info->end < tail[l]) {
+          info->end = tail[l];
+          changed = 1;
+        }
+      }
+    }
+  }
+}
+
+// fold a code computing a temp into the code using it when the temp is
+// defined and used once, in the same block, and nothing between changes
+// what the code reads; the expressions of a block become trees whose
+// shared nodes are the variables and the temps used more than once
+static void findTrees(ListNode* node, int n) {
+  int i = 0;
+  for (ListNode* p = node->next; i < n; p = p->next, i++) {
+    IRCode* ir = (IRCode*)p->value;
+    switch (ir->kind) {
+      case IR_ASSIGN:
       case IR_ADD:
       case IR_SUB:
       case IR_MUL:
       case IR_DIV:
-        insertVariable(ir->result);
-        insertVariable(ir->op1);
-        insertVariable(ir->op2);
-        break;
-      case IR_DEC:
-        offset -= (ir->size - BASIC_MEM_SIZE);
-        insertVariable(ir->operand);
-        break;
-      case IR_IF_GOTO:
-        insertVariable(ir->op_l);
-        insertVariable(ir->op_r);
+      case IR_GET_ADDR:
+      case IR_GET_VALUE:
+      case IR_COMPARE:
         break;
       default:
-        // we should never reach here
-        assert(0);
+        continue;
+    }
+
+    Operand* t = *irDefOperand(ir);
+    VarInfo* info = lookupVariable(t);
+    if (t->kind == OP_VARIABLE || info->ndefs != 1 || info->nuses != 1 ||
+        info->pinned || info->param >= 0) {
+      continue;
+    }
+    int need = treeNeed(ir);
+    if (need >= nscratch) continue;
+
+    // the use, in the same block
+    int j = i + 1;
+    ListNode* use = NULL;
+    for (ListNode* q = p->next; j < n; q = q->next, j++) {
+      IRCode* code = (IRCode*)q->value;
+      if (code->kind == IR_LABEL) break;
+      Operand** uses[3];
+      int k = irUseOperands(code, uses);
+      for (int u = 0; u < k; u++) {
+        if (sameOperand(*uses[u], t)) use = q;
+      }
+      if (use || code->kind == IR_GOTO || code->kind == IR_IF_GOTO ||
+          code->kind == IR_RETURN) {
         break;
+      }
+    }
+    if (use == NULL || !foldable(ir, p, use)) continue;
+
+    // the variables the tree reads are now read at the use
+    Operand* leaves[64];
+    int nleaves = 0;
+    int load = 0;
+    treeLeaves(ir, leaves, &nleaves, &load);
+    for (int l = 0; l < nleaves; l++) {
+      VarInfo* leaf_info = lookupVariable(leaves[l]);
+      if (leaf_info->end < j) leaf_info->end = j;
     }
+    info->tree = ir;
+    info->need = need;
+    info->start = info->end = -1;
   }
 }
 
-// insert variable into variable table
-static void insertVariable(Operand* op) {
-  assert(op);
+// return 1 if the code may be evaluated at use instead of where it is
+static int foldable(IRCode* def, ListNode* from, ListNode* use) {
+  Operand* leaves[64];
+  int nleaves = 0;
+  int load = 0;
+  treeLeaves(def, leaves, &nleaves, &load);
+  if (nleaves < 0) return 0;
+
+  for (ListNode* q = from->next; q != use; q = q->next) {
+    IRCode* code = (IRCode*)q->value;
+    if (load && (code->kind == IR_SET_VALUE || code->kind == IR_CALL)) {
+      return 0;
+    }
+    Operand** d = irDefOperand(code);
+    if (d == NULL) continue;
+    for (int l = 0; l < nleaves; l++) {
+      if (sameOperand(*d, leaves[l])) return 0;
+    }
+  }
+  return 1;
+}
+
+// the variables a tree reads, nleaves is -1 if there are too many of them;
+// load is set if it reads memory
+static void treeLeaves(IRCode* ir, Operand** leaves, int* nleaves, int* load) {
+  if (ir->kind == IR_GET_VALUE) *load = 1;
+
+  Operand** uses[3];
+  int k = irUseOperands(ir, uses);
+  for (int u = 0; u < k && *nleaves >= 0; u++) {
+    IRCode* code = foldedCode(*uses[u]);
+    if (code) {
+      treeLeaves(code, leaves, nleaves, load);
+    } else if (*nleaves == 64) {
+      *nleaves = -1;
+    } else {
+      leaves[(*nleaves)++] = *uses[u];
+    }
+  }
+}
+
+// scratch registers the tree of a code needs, evaluating the needier kid
+// first; a leaf is counted as a load as its register is not known yet
+static int treeNeed(IRCode* ir) {
+  switch (ir->kind) {
+    case IR_ASSIGN:
+    case IR_GET_VALUE:
+      return operandNeed(ir->right);
+    case IR_GET_ADDR:
+      return 1;
+    case IR_COMPARE: {
+      int a = operandNeed(ir->cmp_l);
+      int b = operandNeed(ir->cmp_r);
+      return a == b ? a + 1 : (a > b ? a : b);
+    }
+    default: {
+      int a = operandNeed(ir->op1);
+      int b = operandNeed(ir->op2);
+      // a constant factor or divisor takes a sequence of two registers
+      if ((ir->kind == IR_MUL || ir->kind == IR_DIV) &&
+          ir->op2->kind == OP_CONSTANT) {
+        return a > 2 ? a : 2;
+      }
+      return a == b ? a + 1 : (a > b ? a : b);
+    }
+  }
+}
+
+static int operandNeed(Operand* op) {
+  IRCode* code = foldedCode(op);
+  return code ? lookupVariable(op)->need : 1;
+}
+
+// keep the most used variables in registers, a leaf may use the caller-saved
+// ones freely, a callee-saved register costs a save and a restore; variables
+// whose intervals do not overlap share a register
+static void allocateRegisters() {
+  VarInfo** order = malloc(sizeof(VarInfo*) * (nvars + 1));
+  if (nvars > 0) {
+    memcpy(order, vars, sizeof(VarInfo*) * nvars);
+    qsort(order, nvars, sizeof(VarInfo*), compareWeight);
+  }
+
+  int ncaller = leaf ? sizeof(caller_saved) / sizeof(int) : 0;
+  int ncallee = sizeof(callee_saved) / sizeof(int);
+  nsaved = 0;
+  for (int i = 0; i < nvars; i++) {
+    VarInfo* info = order[i];
+    if (info->pinned || info->tree || isDead(info)) continue;
+
+    // a leaf leaves its parameters where they arrive
+    if (leaf && info->param >= 0 && info->param < ARG_REG_NUM) {
+      info->var->reg = REG_A0 + info->param;
+      continue;
+    }
+
+    int r = -1;
+    for (int j = 0; j < ncaller && r < 0 && info->weight >= 2; j++) {
+      if (registerFree(order, i, caller_saved[j], info)) r = caller_saved[j];
+    }
+    for (int j = 0; j < ncallee && r < 0 && info->weight > 2; j++) {
+      if (registerFree(order, i, callee_saved[j], info)) r = callee_saved[j];
+    }
+    if (r < 0) continue;
+
+    // a callee-saved register is saved once however many variables share it
+    info->var->reg = r;
+    int s = 0;
+    while (s < nsaved && saved[s] != r) s++;
+    for (int j = 0; j < ncallee && s == nsaved; j++) {
+      if (callee_saved[j] == r) saved[nsaved++] = r;
+    }
+  }
+
+  free(order);
+}
+
+// return 1 if register r holds none of the first n variables of order
+// where info is live; a parameter keeps its register from the entry
+static int registerFree(VarInfo** order, int n, int r, VarInfo* info) {
+  for (int i = 0; i < n; i++) {
+    VarInfo* other = order[i];
+    if (other->var->reg != r) continue;
+    if (info->param >= 0 || other->param >= 0 || info->start < 0 ||
+        other->start < 0) {
+      return 0;
+    }
+    if (info->start < other->end && other->start < info->end) return 0;
+  }
+  return 1;
+}
 
-  if (op->kind == OP_CONSTANT) return;
+// variables whose intervals do not overlap share a slot, the parameters
+// and the variables whose address is taken get their own
+static void layoutFrame() {
+  offset = out_size;
+  VarInfo** order = malloc(sizeof(VarInfo*) * (nvars + 1));
+  int n = 0;
+  for (int i = 0; i < nvars; i++) {
+    VarInfo* info = vars[i];
+    if (info->var->reg >= 0 || info->size == 0 || info->tree ||
+        isDead(info)) {
+      continue;
+    }
+    if (info->pinned || info->param >= 0 || info->start < 0) {
+      info->var->offset = offset;
+      offset += info->size;
+    } else {
+      order[n++] = info;
+    }
+  }
 
-  if (htFind(varTable, operand2str(op)) != NULL) return;
+  // a code reads its operands before it writes, an interval may start
+  // where another one ends
+  qsort(order, n, sizeof(VarInfo*), compareStart);
+  int* slot_end = malloc(sizeof(int) * (n + 1));
+  int* slot_offset = malloc(sizeof(int) * (n + 1));
+  int nslots = 0;
+  for (int i = 0; i < n; i++) {
+    int s = 0;
+    while (s < nslots && slot_end[s] > order[i]->start) s++;
+    if (s == nslots) {
+      slot_offset[nslots++] = offset;
+      offset += BASIC_MEM_SIZE;
+    }
+    slot_end[s] = order[i]->end;
+    order[i]->var->offset = slot_offset[s];
+  }
+  free(slot_end);
+  free(slot_offset);
+  free(order);
+
+  saved_offset = offset;
+  offset += nsaved * BASIC_MEM_SIZE;
+  if (!leaf) {
+    ra_offset = offset;
+    offset += BASIC_MEM_SIZE;
+  }
+  frame_size = offset;
+
+  for (int i = 0; i < nvars; i++) {
+    if (vars[i]->param < ARG_REG_NUM) continue;
+    vars[i]->var->offset =
+        frame_size + BASIC_MEM_SIZE * (vars[i]->param - ARG_REG_NUM);
+  }
+}
 
-  offset -= BASIC_MEM_SIZE;
+// heavier first, the earlier of equal ones first
+static int compareWeight(const void* a, const void* b) {
+  VarInfo* x = *(VarInfo**)a;
+  VarInfo* y = *(VarInfo**)b;
+  if (x->weight != y->weight) return y->weight - x->weight;
+  return x->start - y->start;
+}
 
-  Variable* var = newVariable(op, offset, -1);
-  assert(htAdd(varTable, operand2str(op), var) == HT_OK);
+static int compareStart(const void* a, const void* b) {
+  VarInfo* x = *(VarInfo**)a;
+  VarInfo* y = *(VarInfo**)b;
+  if (x->start != y->start) return x->start - y->start;
+  return x < y ? -1 : x > y;
 }
 
 static Variable* findVariable(Operand* op) {
   assert(op);
 
-  HashEntry* entry = htFind(varTable, operand2str(op));
-  if (entry == NULL) {
+  VarInfo* info = lookupVariable(op);
+  if (info == NULL) {
     if (op->kind == OP_CONSTANT) {
-      return newVariable(op, -1, op->constant);
+      return newVariable(&arena, op, -1, -1);
     }
     assert(0);
     return NULL;
   }
 
-  Variable* var = entry->val;
-  assert(var);
+  return info->var;
+}
 
-  return var;
+// the code folded into the tree of the operand, NULL if none
+static IRCode* foldedCode(Operand* op) {
+  if (op->kind == OP_CONSTANT) return NULL;
+  VarInfo* info = lookupVariable(op);
+  return info ? info->tree : NULL;
 }
 
-// get register, load variable into register
-static int getRegister(Variable* var, FILE* fout) {
-  assert(var);
+/*
+ * instruction selection
+ *
+ * the tree of an operand is labelled bottom up with the cheapest cover of
+ * every node as a value in a register, as an immediate and as an address
+ * off(base), then reduced top down emitting the instructions of the rules
+ * chosen
+ */
 
-  int i;
+// the tree computing the operand
+static Node* treeOf(Operand* op) {
+  IRCode* code = foldedCode(op);
+  if (code) return codeTree(code);
+  return newNode(IR_ASSIGN, op, NULL, NULL);
+}
 
-  for (i = REG_T0; i <= REG_T9; i++) {
-    if (!reg[i].used) {
-      reg[i].var = var;
-      reg[i].used = 1;
+// the tree of the value a code computes
+static Node* codeTree(IRCode* ir) {
+  switch (ir->kind) {
+    case IR_ASSIGN:
+      return treeOf(ir->right);
+    case IR_GET_VALUE:
+      return newNode(IR_GET_VALUE, NULL, treeOf(ir->right), NULL);
+    case IR_GET_ADDR:
+      return newNode(IR_GET_ADDR, ir->right, NULL, NULL);
+    case IR_ADD:
+    case IR_MUL: {
+      // the constant of a commutative operation goes right
+      Node* a = treeOf(ir->op1);
+      Node* b = treeOf(ir->op2);
+      if (isConstant(a) && !isConstant(b)) return newNode(ir->kind, NULL, b, a);
+      return newNode(ir->kind, NULL, a, b);
+    }
+    case IR_SUB:
+    case IR_DIV:
+      return newNode(ir->kind, NULL, treeOf(ir->op1), treeOf(ir->op2));
+    case IR_COMPARE: {
+      // the constant goes right, mirroring the relation
+      Node* a = treeOf(ir->cmp_l);
+      Node* b = treeOf(ir->cmp_r);
+      char* relop = ir->cmp_relop;
+      if (isConstant(a) && !isConstant(b)) {
+        Node* t = a;
+        a = b;
+        b = t;
+        relop = mirrorRelop(relop);
+      }
+      Node* n = arenaAlloc(&arena, sizeof(Node));
+      *n = (Node){.kind = IR_COMPARE, .relop = relop, .kids = {a, b}};
+      labelNode(n);
+      return n;
+    }
+    default:
+      // we should never reach here
+      assert(0);
+      return NULL;
+  }
+}
+
+static Node* newNode(int kind, Operand* op, Node* left, Node* right) {
+  Node* n = arenaAlloc(&arena, sizeof(Node));
+  *n = (Node){.kind = kind, .op = op, .kids = {left, right}, .off = 0};
+  labelNode(n);
+  return n;
+}
+
+// find the cheapest cover of the node, its kids are labelled
+static void labelNode(Node* n) {
+  for (int nt = 0; nt < NT_NUM; nt++) {
+    n->cost[nt] = NO_COVER;
+    n->rule[nt] = -1;
+  }
+  Node* a = n->kids[0];
+  Node* b = n->kids[1];
+
+  switch (n->kind) {
+    case IR_ASSIGN:
+      if (n->op->kind == OP_CONSTANT) {
+        intptr_t c = n->op->constant;
+        if (fitsImm(c)) cover(n, NT_IMM, 0, R_IMM);
+        if (c == 0) {
+          cover(n, NT_REG, 0, R_ZERO);
+        } else {
+          cover(n, NT_REG, fitsImm(c) ? 1 : 2, R_LI);
+        }
+      } else {
+        cover(n, NT_REG, findVariable(n->op)->reg >= 0 ? 0 : 1, R_VAR);
+      }
+      break;
+    case IR_GET_ADDR:
+      n->off = findVariable(n->op)->offset;
+      if (fitsImm(n->off)) cover(n, NT_MEM, 0, M_FRAME);
+      break;
+    case IR_ADD:
+      cover(n, NT_REG, a->cost[NT_REG] + b->cost[NT_REG] + 1, R_ADDU);
+      cover(n, NT_REG, a->cost[NT_REG] + b->cost[NT_IMM] + 1, R_ADDIU);
+      if (b->cost[NT_IMM] == 0 && a->cost[NT_MEM] < NO_COVER &&
+          fitsImm(a->off + b->op->constant)) {
+        n->off = a->off + b->op->constant;
+        cover(n, NT_MEM, a->cost[NT_MEM], M_OFFSET);
+      }
+      break;
+    case IR_SUB:
+      cover(n, NT_REG, a->cost[NT_REG] + b->cost[NT_REG] + 1, R_SUBU);
+      if (b->cost[NT_IMM] == 0 && fitsImm(-b->op->constant)) {
+        cover(n, NT_REG, a->cost[NT_REG] + 1, R_SUBI);
+        if (a->cost[NT_MEM] < NO_COVER && fitsImm(a->off - b->op->constant)) {
+          n->off = a->off - b->op->constant;
+          cover(n, NT_MEM, a->cost[NT_MEM], M_OFFSET);
+        }
+      }
+      break;
+    case IR_MUL:
+      cover(n, NT_REG, a->cost[NT_REG] + b->cost[NT_REG] + MUL_COST, R_MUL);
+      if (isConstant(b)) {
+        cover(n, NT_REG, a->cost[NT_REG] + mulOps(b->op->constant), R_MULC);
+      }
+      break;
+    case IR_DIV:
+      cover(n, NT_REG, a->cost[NT_REG] + b->cost[NT_REG] + DIV_COST, R_DIV);
+      if (isConstant(b) && divOps(b->op->constant) < NO_COVER) {
+        cover(n, NT_REG, a->cost[NT_REG] + divOps(b->op->constant), R_DIVC);
+      }
+      break;
+    case IR_GET_VALUE:
+      cover(n, NT_REG, a->cost[NT_MEM] + 1, R_LW);
       break;
+    case IR_COMPARE:
+      // a relation takes one instruction or two, a constant the instructions
+      // take as their immediate needs no register
+      cover(n, NT_REG,
+            a->cost[NT_REG] + (compareImm(n->relop, b) ? 0 : b->cost[NT_REG]) +
+                2,
+            R_CMP);
+      break;
+    default:
+      // we should never reach here
+      assert(0);
+      break;
+  }
+
+  // an address that is not a register is computed with addiu, a value in a
+  // register is the address 0(reg)
+  if (n->cost[NT_MEM] < NO_COVER) {
+    cover(n, NT_REG, n->cost[NT_MEM] + 1, R_LEA);
+  }
+  if (n->cost[NT_REG] < n->cost[NT_MEM]) {
+    n->off = 0;
+    cover(n, NT_MEM, n->cost[NT_REG], M_REG);
+  }
+
+  // scratch registers, the needier kid is evaluated first
+  if (n->kind == IR_ASSIGN) {
+    n->need = n->rule[NT_REG] == R_ZERO ||
+              (n->rule[NT_REG] == R_VAR && findVariable(n->op)->reg >= 0)
+                  ? 0
+                  : 1;
+  } else if (n->rule[NT_REG] == R_MULC || n->rule[NT_REG] == R_DIVC) {
+    // a sequence holds two registers at most
+    n->need = a->need > 2 ? a->need : 2;
+  } else if (b == NULL || (n->kind == IR_COMPARE
+                                ? compareImm(n->relop, b)
+                                : b->rule[NT_IMM] == R_IMM)) {
+    n->need = a && a->need > 1 ? a->need : 1;
+  } else {
+    n->need = a->need == b->need ? a->need + 1
+                                 : (a->need > b->need ? a->need : b->need);
+    if (n->need == 0) n->need = 1;
+  }
+}
+
+static void cover(Node* n, int nt, int cost, int rule) {
+  if (cost < n->cost[nt]) {
+    n->cost[nt] = cost;
+    n->rule[nt] = rule;
+  }
+}
+
+// emit the cover of the node as a value, in target unless it is -1, return
+// the register holding the value
+static int reduceReg(Node* n, int target) {
+  Node* a = n->kids[0];
+  Node* b = n->kids[1];
+  int ra, rb, d;
+  intptr_t off;
+
+  switch (n->rule[NT_REG]) {
+    case R_VAR: {
+      Variable* var = findVariable(n->op);
+      if (var->reg >= 0) {
+        if (target < 0 || target == var->reg) return var->reg;
+        emit(INS_MOVE, target, var->reg, 0, 0, NULL);
+        return target;
+      }
+      d = getScratch(target);
+      emitLoad(d, var);
+      return d;
     }
+    case R_ZERO:
+      if (target < 0) return REG_ZERO;
+      emit(INS_MOVE, target, REG_ZERO, 0, 0, NULL);
+      return target;
+    case R_LI:
+      d = getScratch(target);
+      emit(INS_LI, d, 0, 0, n->op->constant, NULL);
+      return d;
+    case R_ADDU:
+    case R_SUBU:
+    case R_MUL:
+      reducePair(a, b, &ra, &rb);
+      freeRegister(ra);
+      freeRegister(rb);
+      d = getScratch(target);
+      emit(n->rule[NT_REG] == R_ADDU   ? INS_ADDU
+           : n->rule[NT_REG] == R_SUBU ? INS_SUBU
+                                       : INS_MUL,
+           d, ra, rb, 0, NULL);
+      return d;
+    case R_ADDIU:
+    case R_SUBI:
+      ra = reduceReg(a, -1);
+      freeRegister(ra);
+      d = getScratch(target);
+      emit(INS_ADDIU, d, ra, 0,
+           n->rule[NT_REG] == R_ADDIU ? b->op->constant : -b->op->constant,
+           NULL);
+      return d;
+    case R_MULC:
+      return reduceMulConst(n, target);
+    case R_DIV:
+      reducePair(a, b, &ra, &rb);
+      freeRegister(ra);
+      freeRegister(rb);
+      emit(INS_DIV, 0, ra, rb, 0, NULL);
+      d = getScratch(target);
+      emit(INS_MFLO, d, 0, 0, 0, NULL);
+      return d;
+    case R_DIVC:
+      return reduceDivConst(n, target);
+    case R_LW:
+      ra = reduceMem(a, &off);
+      freeRegister(ra);
+      d = getScratch(target);
+      emit(INS_LW, d, ra, 0, off, NULL);
+      return d;
+    case R_LEA:
+      ra = reduceMem(n, &off);
+      freeRegister(ra);
+      d = getScratch(target);
+      emit(INS_ADDIU, d, ra, 0, off, NULL);
+      return d;
+    case R_CMP:
+      return reduceCompare(n, target);
+    default:
+      // we should never reach here
+      assert(0);
+      return -1;
   }
+}
 
-  assert(i <= REG_T9);
+// emit the cover of the node as an address, return its base register and
+// store its offset
+static int reduceMem(Node* n, intptr_t* off) {
+  switch (n->rule[NT_MEM]) {
+    case M_REG:
+      *off = 0;
+      return reduceReg(n, -1);
+    case M_FRAME:
+      *off = n->off;
+      return REG_SP;
+    case M_OFFSET: {
+      intptr_t base_off;
+      int base = reduceMem(n->kids[0], &base_off);
+      *off = n->off;
+      return base;
+    }
+    default:
+      // we should never reach here
+      assert(0);
+      return -1;
+  }
+}
 
-  if (var->op->kind == OP_CONSTANT) {
-    fprintf(fout, "\tli %s, %ld\n", register_names[i], var->op->constant);
+// evaluate two kids into registers, the needier one first
+static void reducePair(Node* a, Node* b, int* ra, int* rb) {
+  if (b->need > a->need) {
+    *rb = reduceReg(b, -1);
+    *ra = reduceReg(a, -1);
   } else {
-    fprintf(fout, "\tlw %s, %d($fp) # %s\n", register_names[i], var->offset,
-            operand2str(var->op));
+    *ra = reduceReg(a, -1);
+    *rb = reduceReg(b, -1);
   }
+}
 
-  return i;
+static int isConstant(Node* n) {
+  return n->kind == IR_ASSIGN && n->op->kind == OP_CONSTANT;
 }
 
-// free register
-static void freeRegister(int reg_num) {
-  assert(reg_num >= REG_T0 && reg_num <= REG_T9);
+static int fitsImm(intptr_t c) { return c >= -32768 && c <= 32767; }
 
-  reg[reg_num].var = NULL;
-  reg[reg_num].used = 0;
+// the shift multiplying by c, -1 if c is not a power of two
+static int log2Of(intptr_t c) {
+  if (c <= 0 || (c & (c - 1)) != 0) return -1;
+  int shift = 0;
+  while (((intptr_t)1 << shift) != c) shift++;
+  return shift;
 }
 
-// generate MIPS32 code for Label, e.g. l1:
-static void genLabel(IRCode* ir, FILE* fout) {
-  assert(ir && ir->kind == IR_LABEL);
+// multiply by a constant with shifts and adds, a digit of the signed binary
+// form of c, from the top one down, shifts the product and adds or subtracts
+// the kid
+static int reduceMulConst(Node* n, int target) {
+  intptr_t c = n->kids[1]->op->constant;
+  if (c == 0) {
+    if (target < 0) return REG_ZERO;
+    emit(INS_MOVE, target, REG_ZERO, 0, 0, NULL);
+    return target;
+  }
+  if (c == 1) return reduceReg(n->kids[0], target);
+
+  int pos[66], sign[66];
+  int m = nafDigits(c < 0 ? -c : c, pos, sign);
+  int left = mulOps(c);
+  int x = reduceReg(n->kids[0], -1);
+  int acc = -1;
+  int value = x;
+  for (int i = m - 2; i >= 0; i--) {
+    int d = nextDest(&left, &acc, x, target);
+    emit(INS_SLL, d, value, 0, pos[i + 1] - pos[i], NULL);
+    value = d;
+    d = nextDest(&left, &acc, x, target);
+    emit(sign[i] > 0 ? INS_ADDU : INS_SUBU, d, value, x, 0, NULL);
+    value = d;
+  }
+  if (pos[0] > 0) {
+    int d = nextDest(&left, &acc, x, target);
+    emit(INS_SLL, d, value, 0, pos[0], NULL);
+    value = d;
+  }
+  if (c < 0) {
+    int d = nextDest(&left, &acc, x, target);
+    emit(INS_SUBU, d, REG_ZERO, value, 0, NULL);
+    value = d;
+  }
+  return value;
+}
 
-  fprintf(fout, "%s:\n", operand2str(ir->op));
+// divide by a constant rounding toward zero, a power of two is a shift of
+// the dividend biased by 2^k - 1 when it is negative, the others take the
+// high word of a multiplication by a magic number
+static int reduceDivConst(Node* n, int target) {
+  intptr_t c = n->kids[1]->op->constant;
+  if (c == 1) return reduceReg(n->kids[0], target);
+
+  int x = reduceReg(n->kids[0], -1);
+  int acc = -1;
+  int d;
+  int k = log2Of(c < 0 ? -c : c);
+  if (k >= 0) {
+    int left = (k == 0 ? 0 : (k == 1 ? 3 : 4)) + (c < 0);
+    int value = x;
+    if (k > 0) {
+      if (k > 1) {
+        d = nextDest(&left, &acc, x, target);
+        emit(INS_SRA, d, x, 0, 31, NULL);
+        value = d;
+      }
+      d = nextDest(&left, &acc, x, target);
+      emit(INS_SRL, d, value, 0, 32 - k, NULL);
+      d = nextDest(&left, &acc, x, target);
+      emit(INS_ADDU, d, x, acc, 0, NULL);
+      d = nextDest(&left, &acc, x, target);
+      emit(INS_SRA, d, acc, 0, k, NULL);
+      value = d;
+    }
+    if (c < 0) {
+      d = nextDest(&left, &acc, x, target);
+      emit(INS_SUBU, d, REG_ZERO, value, 0, NULL);
+      value = d;
+    }
+    return value;
+  }
+
+  int32_t magic;
+  int shift;
+  magicNumber(c, &magic, &shift);
+  acc = getScratch(-1);
+  emit(INS_LI, acc, 0, 0, magic, NULL);
+  emit(INS_MULT, 0, x, acc, 0, NULL);
+  emit(INS_MFHI, acc, 0, 0, 0, NULL);
+  if (c > 0 && magic < 0) emit(INS_ADDU, acc, acc, x, 0, NULL);
+  if (c < 0 && magic > 0) emit(INS_SUBU, acc, acc, x, 0, NULL);
+  if (shift > 0) emit(INS_SRA, acc, acc, 0, shift, NULL);
+  freeRegister(x);
+
+  // add one to a negative quotient
+  int sign = getScratch(-1);
+  emit(INS_SRL, sign, acc, 0, 31, NULL);
+  freeRegister(sign);
+  freeRegister(acc);
+  d = getScratch(target);
+  emit(INS_ADDU, d, acc, sign, 0, NULL);
+  return d;
 }
 
-// generate MIPS32 code for Function, e.g. main:
-static void genFunction(IRCode* ir, FILE* fout) {
-  assert(ir && ir->kind == IR_FUNCTION);
+// the register the next instruction of a sequence of left ones writes, the
+// last one writes the target and may reuse the registers it reads
+static int nextDest(int* left, int* acc, int src, int target) {
+  if (--*left > 0) {
+    if (*acc < 0) *acc = getScratch(-1);
+    return *acc;
+  }
+  freeRegister(src);
+  if (*acc >= 0) freeRegister(*acc);
+  return getScratch(target);
+}
+
+// the nonzero digits of the non-adjacent form of c > 0, each 1 or -1,
+// lowest first, return their number
+static int nafDigits(intptr_t c, int* pos, int* sign) {
+  int m = 0;
+  for (int p = 0; c != 0; p++, c >>= 1) {
+    if (c & 1) {
+      int digit = 2 - (int)(c & 3);
+      pos[m] = p;
+      sign[m++] = digit;
+      c -= digit;
+    }
+  }
+  return m;
+}
 
-  if (strcmp(operand2str(ir->op), "main") == 0) {
-    fprintf(fout, "\n%s:\n", operand2str(ir->op));
+// the instructions multiplying by c
+static int mulOps(intptr_t c) {
+  if (c == 0 || c == 1) return 0;
+
+  int pos[66], sign[66];
+  int m = nafDigits(c < 0 ? -c : c, pos, sign);
+  return 2 * (m - 1) + (pos[0] > 0) + (c < 0);
+}
+
+// the cycles dividing by c take, NO_COVER if the division is kept
+static int divOps(intptr_t c) {
+  if (c == 0 || c < INT32_MIN + 1 || c > INT32_MAX) return NO_COVER;
+  if (c == 1) return 0;
+
+  int k = log2Of(c < 0 ? -c : c);
+  if (k >= 0) return (k == 1 ? 3 : 4) + (c < 0);
+
+  int32_t magic;
+  int shift;
+  magicNumber(c, &magic, &shift);
+  return (fitsImm(magic) ? 1 : 2) + 2 + 1 + ((c > 0) != (magic > 0)) +
+         (shift > 0) + 2;
+}
+
+// the magic number and the shift dividing by d, 2 <= |d| < 2^31, see
+// Hacker's Delight, 10-1
+static void magicNumber(int32_t d, int32_t* magic, int* shift) {
+  const uint32_t two31 = 0x80000000u;
+  uint32_t ad = d < 0 ? -(uint32_t)d : (uint32_t)d;
+  uint32_t t = two31 + ((uint32_t)d >> 31);
+  uint32_t anc = t - 1 - t % ad;
+  uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+  uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+  uint32_t delta;
+  int p = 31;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  *magic = (int32_t)(q2 + 1);
+  if (d < 0) *magic = -*magic;
+  *shift = p - 32;
+}
+
+// set a register to 1 if the relation of the kids holds and to 0 if not,
+// without a branch
+static int reduceCompare(Node* n, int target) {
+  Node* a = n->kids[0];
+  Node* b = n->kids[1];
+  char* relop = n->relop;
+  int imm = compareImm(relop, b);
+  intptr_t c = imm ? b->op->constant : 0;
+  int ra, rb, t, d;
+
+  if (relop[0] == '=' || relop[0] == '!') {
+    // x == y is (x ^ y) < 1 and x != y is 0 < (x ^ y), unsigned
+    if (imm) {
+      ra = reduceReg(a, -1);
+      if (c != 0) {
+        freeRegister(ra);
+        t = getScratch(-1);
+        if (c > 0 && c <= 0xffff) {
+          emit(INS_XORI, t, ra, 0, c, NULL);
+        } else {
+          emit(INS_ADDIU, t, ra, 0, -c, NULL);
+        }
+        ra = t;
+      }
+    } else {
+      reducePair(a, b, &ra, &rb);
+      freeRegister(ra);
+      freeRegister(rb);
+      t = getScratch(-1);
+      emit(INS_XOR, t, ra, rb, 0, NULL);
+      ra = t;
+    }
+    freeRegister(ra);
+    d = getScratch(target);
+    if (relop[0] == '=') {
+      emit(INS_SLTIU, d, ra, 0, 1, NULL);
+    } else {
+      emit(INS_SLTU, d, REG_ZERO, ra, 0, NULL);
+    }
+    return d;
+  }
+
+  // the tests of genIfGoto, the relations it branches on when the test
+  // fails are the test flipped with xori
+  int lt = relop[0] == '<';
+  int eq = relop[1] == '=';
+  int flip;
+  if (imm) {
+    ra = reduceReg(a, -1);
+    freeRegister(ra);
+    flip = !lt;
+    t = getScratch(flip ? -1 : target);
+    emit(INS_SLTI, t, ra, 0, c + (lt == eq), NULL);
   } else {
-    fprintf(fout, "\nfunc_%s:\n", operand2str(ir->op));
+    reducePair(a, b, &ra, &rb);
+    freeRegister(ra);
+    freeRegister(rb);
+    flip = eq;
+    t = getScratch(flip ? -1 : target);
+    if (lt != eq) {
+      emit(INS_SLT, t, ra, rb, 0, NULL);
+    } else {
+      emit(INS_SLT, t, rb, ra, 0, NULL);
+    }
   }
-  fprintf(fout, "\tmove $fp, $sp\n");
-  fprintf(fout, "\taddi $sp, $sp, %d\n", offset);
+  if (!flip) return t;
+
+  freeRegister(t);
+  d = getScratch(target);
+  emit(INS_XORI, d, t, 0, 1, NULL);
+  return d;
 }
 
-// generate MIPS32 code for Assign, e.g. x = y
-static void genAssign(IRCode* ir, FILE* fout) {
-  assert(ir && ir->kind == IR_ASSIGN);
+// return 1 if the constant b is the immediate of the instructions testing
+// the relation, it then needs no register
+static int compareImm(char* relop, Node* b) {
+  if (!isConstant(b)) return 0;
 
-  Variable* left = findVariable(ir->left);
-  Variable* right = findVariable(ir->right);
+  intptr_t c = b->op->constant;
+  if (relop[0] == '=' || relop[0] == '!') {
+    // xori zero-extends its immediate, addiu subtracts the others
+    return (c > 0 && c <= 0xffff) || fitsImm(-c);
+  }
+  int lt = relop[0] == '<';
+  int eq = relop[1] == '=';
+  return fitsImm(c + (lt == eq));
+}
 
-  int reg_num = getRegister(right, fout);
+// the relop testing the same with the operands swapped
+static char* mirrorRelop(char* relop) {
+  if (relop[0] == '<') return relop[1] == '=' ? ">=" : ">";
+  if (relop[0] == '>') return relop[1] == '=' ? "<=" : "<";
+  return relop;
+}
 
-  fprintf(fout, "\tsw %s, %d($fp) # %s\n", register_names[reg_num],
-          left->offset, operand2str(ir->left));
+static Instr* emit(int op, int rd, int rs, int rt, intptr_t imm, char* label) {
+  Instr* ins = newInstr(&arena, op, rd, rs, rt, imm, label);
+  listAddNodeTail(instrs, ins);
+  return ins;
+}
 
+// load a variable living in the frame
+static void emitLoad(int reg_num, Variable* var) {
+  Instr* ins = emit(INS_LW, reg_num, REG_SP, 0, var->offset, NULL);
+  ins->comment = operandName(&arena, var->op);
+}
+
+// write the value in the register back to the variable
+static void storeVariable(Variable* var, int reg_num) {
+  if (var->reg >= 0) {
+    if (var->reg != reg_num) emit(INS_MOVE, var->reg, reg_num, 0, 0, NULL);
+  } else {
+    Instr* ins = emit(INS_SW, 0, REG_SP, reg_num, var->offset, NULL);
+    ins->comment = operandName(&arena, var->op);
+  }
+}
+
+// the register a value is computed in, target unless it is -1
+static int getScratch(int target) {
+  if (target >= 0) return target;
+
+  for (int i = 0; i < nscratch; i++) {
+    if (!reg[scratch[i]].used) {
+      reg[scratch[i]].used = 1;
+      return scratch[i];
+    }
+  }
+
+  // we should never reach here
+  assert(0);
+  return -1;
+}
+
+// free register, the registers holding variables are never freed
+static void freeRegister(int reg_num) {
+  for (int i = 0; i < nscratch; i++) {
+    if (scratch[i] == reg_num) {
+      reg[reg_num].var = NULL;
+      reg[reg_num].used = 0;
+    }
+  }
+}
+
+// compute the value of a code into the variable it defines
+static void genValue(IRCode* ir) {
+  VarInfo* info = lookupVariable(*irDefOperand(ir));
+  if (info && isDead(info)) return;
+  Variable* var = findVariable(*irDefOperand(ir));
+  Node* n = codeTree(ir);
+
+  int reg_num = reduceReg(n, var->reg);
+  storeVariable(var, reg_num);
   freeRegister(reg_num);
 }
 
-// generate MIPS32 code for Arithmetic, e.g. x = y op z
-static void genArithmetic(IRCode* ir, FILE* fout, int type) {
-  assert(ir && (ir->kind == IR_ADD || ir->kind == IR_SUB ||
-                ir->kind == IR_MUL || ir->kind == IR_DIV));
+// allocate the frame, save $ra and the callee-saved registers in use and
+// move the parameters to where the function keeps them
+static void genPrologue() {
+  if (frame_size) emit(INS_ADDIU, REG_SP, REG_SP, 0, -frame_size, NULL);
+  if (!leaf) emit(INS_SW, 0, REG_SP, REG_RA, ra_offset, NULL);
+  for (int i = 0; i < nsaved; i++) {
+    emit(INS_SW, 0, REG_SP, saved[i], saved_offset + BASIC_MEM_SIZE * i, NULL);
+  }
 
-  Variable* result = findVariable(ir->result);
-  Variable* op1 = findVariable(ir->op1);
-  Variable* op2 = findVariable(ir->op2);
+  for (int i = 0; i < nvars; i++) {
+    Variable* var = vars[i]->var;
+    int param = vars[i]->param;
+    if (param < 0 || isDead(vars[i])) continue;
+    if (param < ARG_REG_NUM) {
+      storeVariable(var, REG_A0 + param);
+    } else if (var->reg >= 0) {
+      emitLoad(var->reg, var);
+    }
+  }
+}
 
-  int reg_num1 = getRegister(op1, fout);
-  int reg_num2 = getRegister(op2, fout);
+static void genEpilogue() {
+  genRestore();
+  emit(INS_JR, 0, REG_RA, 0, 0, NULL);
+}
 
-  switch (type) {
-    case IR_ADD:
-      fprintf(fout, "\tadd %s, %s, %s\n", register_names[reg_num1],
-              register_names[reg_num1], register_names[reg_num2]);
-      break;
-    case IR_SUB:
-      fprintf(fout, "\tsub %s, %s, %s\n", register_names[reg_num1],
-              register_names[reg_num1], register_names[reg_num2]);
-      break;
-    case IR_MUL:
-      fprintf(fout, "\tmul %s, %s, %s\n", register_names[reg_num1],
-              register_names[reg_num1], register_names[reg_num2]);
-      break;
-    case IR_DIV:
-      fprintf(fout, "\tdiv %s, %s\n", register_names[reg_num1],
-              register_names[reg_num2]);
-      fprintf(fout, "\tmflo %s\n", register_names[reg_num1]);
-      break;
-    default:
-      // we should never reach here
-      assert(0);
-      break;
+// restore the registers saved by genPrologue and pop the frame
+static void genRestore() {
+  for (int i = 0; i < nsaved; i++) {
+    emit(INS_LW, saved[i], REG_SP, 0, saved_offset + BASIC_MEM_SIZE * i, NULL);
   }
+  if (!leaf) emit(INS_LW, REG_RA, REG_SP, 0, ra_offset, NULL);
+  if (frame_size) emit(INS_ADDIU, REG_SP, REG_SP, 0, frame_size, NULL);
+}
 
-  fprintf(fout, "\tsw %s, %d($fp) # %s\n", register_names[reg_num1],
-          result->offset, operand2str(ir->result));
+// return 1 if the function returns what the call returns and the callee may
+// take over its frame: all the arguments are in registers and none of them
+// can point into the frame
+static int isTailCall(ListNode* node) {
+  if (dump_counts) return 0;
+  if (node->next == NULL) return 0;
+  IRCode* call = (IRCode*)node->value;
+  IRCode* ret = (IRCode*)node->next->value;
+  if (ret->kind != IR_RETURN || !sameOperand(ret->op, call->left)) return 0;
+
+  int nargs = 0;
+  for (ListNode* p = node->prev; ((IRCode*)p->value)->kind == IR_ARG;
+       p = p->prev) {
+    nargs++;
+  }
+  if (nargs > ARG_REG_NUM) return 0;
 
-  freeRegister(reg_num1);
-  freeRegister(reg_num2);
+  for (int i = 0; i < nvars; i++) {
+    if (vars[i]->pinned) return 0;
+  }
+  return 1;
+}
+
+// pop the frame and jump to the callee, which returns to our caller
+static void genTailCall(IRCode* ir) {
+  genRestore();
+  emit(INS_J, 0, 0, 0, 0, functionLabel(ir->right));
+}
+
+// return 1 if the variable is never read, from its name or through its
+// address; it gets neither a register nor a slot and is never stored
+static int isDead(VarInfo* info) {
+  return info->nuses == 0 && !info->pinned;
+}
+
+// the label of a function, main keeps its name
+static char* functionLabel(Operand* op) {
+  char* name = operandName(&arena, op);
+  if (strcmp(name, "main") == 0) return name;
+
+  char* label = arenaAlloc(&arena, strlen(name) + 6);
+  sprintf(label, "func_%s", name);
+  return label;
+}
+
+// the position of the argument among those of its call, the ARGs come last
+// argument first right before the CALL
+static int argIndex(ListNode* node) {
+  int index = 0;
+  for (node = node->next; ((IRCode*)node->value)->kind == IR_ARG;
+       node = node->next) {
+    index++;
+  }
+  assert(((IRCode*)node->value)->kind == IR_CALL);
+  return index;
 }
 
-// generate MIPS32 code for GetAddr, e.g. x = y + z
-static void genAdd(IRCode* ir, FILE* fout) {
+// add one to a new counter of the code that follows, key is the label or
+// -(n + 1) for the n-th function; $t0 and $t1 hold no value between codes
+static void genCounter(intptr_t key) {
+  if (ncounters == counter_capacity) {
+    counter_capacity = counter_capacity ? counter_capacity * 2 : 64;
+    counter_keys = realloc(counter_keys, sizeof(intptr_t) * counter_capacity);
+  }
+  int off = BASIC_MEM_SIZE * ncounters;
+  counter_keys[ncounters++] = key;
+
+  emit(INS_LA, REG_T0, 0, 0, 0, "_prof");
+  if (!fitsImm(off)) {
+    emit(INS_LI, REG_T1, 0, 0, off, NULL);
+    emit(INS_ADDU, REG_T0, REG_T0, REG_T1, 0, NULL);
+    off = 0;
+  }
+  emit(INS_LW, REG_T1, REG_T0, 0, off, NULL);
+  emit(INS_ADDIU, REG_T1, REG_T1, 0, 1, NULL);
+  emit(INS_SW, 0, REG_T0, REG_T1, off, NULL);
+}
+
+// generate MIPS32 code for Label, e.g. l1:
+static void genLabel(IRCode* ir) {
+  assert(ir && ir->kind == IR_LABEL);
+
+  emit(INS_LABEL, 0, 0, 0, 0, operandName(&arena, ir->op));
+  if (instrument) genCounter(ir->op->label_no);
+}
+
+// generate MIPS32 code for Function, e.g. main:
+static void genFunction(IRCode* ir) {
+  assert(ir && ir->kind == IR_FUNCTION);
+
+  emit(INS_LABEL, 0, 0, 0, 0, functionLabel(ir->op));
+  genPrologue();
+  if (instrument) genCounter(-++nfunctions);
+}
+
+// generate MIPS32 code for Assign, e.g. x = y
+static void genAssign(IRCode* ir) {
+  assert(ir && ir->kind == IR_ASSIGN);
+
+  genValue(ir);
+}
+
+// generate MIPS32 code for Add, e.g. x = y + z
+static void genAdd(IRCode* ir) {
   assert(ir && ir->kind == IR_ADD);
 
-  genArithmetic(ir, fout, IR_ADD);
+  genValue(ir);
 }
 
 // generate MIPS32 code for Sub, e.g. x = y - z
-static void genSub(IRCode* ir, FILE* fout) {
+static void genSub(IRCode* ir) {
   assert(ir && ir->kind == IR_SUB);
 
-  genArithmetic(ir, fout, IR_SUB);
+  genValue(ir);
 }
 
 // generate MIPS32 code for Mul, e.g. x = y * z
-static void genMul(IRCode* ir, FILE* fout) {
+static void genMul(IRCode* ir) {
   assert(ir && ir->kind == IR_MUL);
 
-  genArithmetic(ir, fout, IR_MUL);
+  genValue(ir);
 }
 
 // generate MIPS32 code for Div, e.g. x = y / z
-static void genDiv(IRCode* ir, FILE* fout) {
+static void genDiv(IRCode* ir) {
   assert(ir && ir->kind == IR_DIV);
 
-  genArithmetic(ir, fout, IR_DIV);
+  genValue(ir);
 }
 
 // generate MIPS32 code for GetAddr, e.g. x = &y
-static void genGetAddr(IRCode* ir, FILE* fout) {
+static void genGetAddr(IRCode* ir) {
   assert(ir && ir->kind == IR_GET_ADDR);
 
-  Variable* left = findVariable(ir->left);
-  Variable* right = findVariable(ir->right);
-
-  int reg_num = getRegister(left, fout);
-
-  fprintf(fout, "\taddi %s, $fp, %d\n", register_names[reg_num], right->offset);
-  fprintf(fout, "\tsw %s, %d($fp) # %s\n", register_names[reg_num],
-          left->offset, operand2str(ir->left));
-
-  freeRegister(reg_num);
+  genValue(ir);
 }
 
 // generate MIPS32 code for GetValue, e.g. x = *y
-static void genGetValue(IRCode* ir, FILE* fout) {
+static void genGetValue(IRCode* ir) {
   assert(ir && ir->kind == IR_GET_VALUE);
 
-  Variable* left = findVariable(ir->left);
-  Variable* right = findVariable(ir->right);
-
-  int reg_num = getRegister(right, fout);
-
-  fprintf(fout, "\tlw %s, 0(%s)\n", register_names[reg_num],
-          register_names[reg_num]);
-  fprintf(fout, "\tsw %s, %d($fp) # %s\n", register_names[reg_num],
-          left->offset, operand2str(ir->left));
-
-  freeRegister(reg_num);
+  genValue(ir);
 }
 
 // generate MIPS32 code for SetValue, e.g. *x = y
-static void genSetValue(IRCode* ir, FILE* fout) {
+static void genSetValue(IRCode* ir) {
   assert(ir && ir->kind == IR_SET_VALUE);
 
-  Variable* left = findVariable(ir->left);
-  Variable* right = findVariable(ir->right);
+  Node* addr = treeOf(ir->left);
+  Node* value = treeOf(ir->right);
 
-  int left_reg_num = getRegister(left, fout);
-  int right_reg_num = getRegister(right, fout);
-
-  fprintf(fout, "\tsw %s, 0(%s)\n", register_names[right_reg_num],
-          register_names[left_reg_num]);
+  intptr_t off;
+  int base, reg_num;
+  if (value->need > addr->need) {
+    reg_num = reduceReg(value, -1);
+    base = reduceMem(addr, &off);
+  } else {
+    base = reduceMem(addr, &off);
+    reg_num = reduceReg(value, -1);
+  }
+  emit(INS_SW, 0, base, reg_num, off, NULL);
 
-  freeRegister(left_reg_num);
-  freeRegister(right_reg_num);
+  freeRegister(base);
+  freeRegister(reg_num);
 }
 
 // generate MIPS32 code for Goto, e.g. goto l
-static void genGoto(IRCode* ir, FILE* fout) {
+static void genGoto(IRCode* ir) {
   assert(ir && ir->kind == IR_GOTO);
 
-  fprintf(fout, "\tj %s\n", operand2str(ir->op));
+  emit(INS_J, 0, 0, 0, 0, operandName(&arena, ir->op));
 }
 
 // generate MIPS32 code for IfGoto, e.g. if x [relop] y goto l
-static void genIfGoto(IRCode* ir, FILE* fout) {
+static void genIfGoto(IRCode* ir) {
   assert(ir && ir->kind == IR_IF_GOTO);
 
-  Variable* op_l = findVariable(ir->op_l);
-  Variable* op_r = findVariable(ir->op_r);
-
-  int reg_num1 = getRegister(op_l, fout);
-  int reg_num2 = getRegister(op_r, fout);
-
-  char* relop;
-  switch (ir->relop[0]) {
-    case '<':
-      if (ir->relop[1] == '=') {
-        relop = "ble";
-      } else {
-        relop = "blt";
-      }
-      break;
-    case '>':
-      if (ir->relop[1] == '=') {
-        relop = "bge";
-      } else {
-        relop = "bgt";
-      }
-      break;
-    case '=':
-      relop = "beq";
-      break;
-    case '!':
-      relop = "bne";
-      break;
-    default:
-      assert(0);
-      break;
+  // a relation folded into the test is branched on itself
+  IRCode* cmp = foldedCode(ir->op_l);
+  if (cmp && cmp->kind == IR_COMPARE && ir->op_r->kind == OP_CONSTANT &&
+      ir->op_r->constant == 0 && (ir->relop[0] == '=' || ir->relop[0] == '!')) {
+    IRCode fused = *ir;
+    fused.op_l = cmp->cmp_l;
+    fused.op_r = cmp->cmp_r;
+    fused.relop =
+        ir->relop[0] == '!' ? cmp->cmp_relop : invertRelop(cmp->cmp_relop);
+    genIfGoto(&fused);
+    return;
   }
 
-  fprintf(fout, "\t%s %s, %s, %s\n", relop, register_names[reg_num1],
-          register_names[reg_num2], operand2str(ir->label));
+  Node* l = treeOf(ir->op_l);
+  Node* r = treeOf(ir->op_r);
+  char* label = operandName(&arena, ir->label);
+
+  // keep the constant on the right, mirroring the comparison
+  char* relop = ir->relop;
+  if (isConstant(l) && !isConstant(r)) {
+    Node* t = l;
+    l = r;
+    r = t;
+    relop = mirrorRelop(relop);
+  }
+  int lt = relop[0] == '<';
+  int eq = relop[1] == '=';
+
+  int ra, rb;
+  if (relop[0] == '=' || relop[0] == '!') {
+    // $zero is compared for free
+    reducePair(l, r, &ra, &rb);
+    emit(relop[0] == '=' ? INS_BEQ : INS_BNE, 0, ra, rb, 0, label);
+  } else if (isConstant(r) && r->op->constant == 0) {
+    ra = reduceReg(l, -1);
+    rb = REG_ZERO;
+    int op = lt ? (eq ? INS_BLEZ : INS_BLTZ) : (eq ? INS_BGEZ : INS_BGTZ);
+    emit(op, 0, ra, 0, 0, label);
+  } else if (isConstant(r) && fitsImm(r->op->constant + (lt == eq))) {
+    // x < c, x >= c, x <= c as x < c + 1, x > c as !(x < c + 1)
+    ra = reduceReg(l, -1);
+    freeRegister(ra);
+    rb = getScratch(-1);
+    emit(INS_SLTI, rb, ra, 0, r->op->constant + (lt == eq), NULL);
+    emit(lt ? INS_BNE : INS_BEQ, 0, rb, REG_ZERO, 0, label);
+  } else {
+    // x < y and x >= y test x < y, x > y and x <= y test y < x
+    reducePair(l, r, &ra, &rb);
+    freeRegister(ra);
+    freeRegister(rb);
+    int t = getScratch(-1);
+    if (lt != eq) {
+      emit(INS_SLT, t, ra, rb, 0, NULL);
+    } else {
+      emit(INS_SLT, t, rb, ra, 0, NULL);
+    }
+    emit(eq ? INS_BEQ : INS_BNE, 0, t, REG_ZERO, 0, label);
+    ra = t;
+    rb = REG_ZERO;
+  }
 
-  freeRegister(reg_num1);
-  freeRegister(reg_num2);
+  freeRegister(ra);
+  freeRegister(rb);
 }
 
 // generate MIPS32 code for Return, e.g. return x
-static void genReturn(IRCode* ir, FILE* fout) {
+static void genReturn(IRCode* ir) {
   assert(ir && ir->kind == IR_RETURN);
 
-  Variable* op = findVariable(ir->op);
-
-  int reg_num = getRegister(op, fout);
-
-  fprintf(fout, "\tmove $v0, %s\n", register_names[reg_num]);
-  fprintf(fout, "\tmove $sp, $fp\n");
-  fprintf(fout, "\tjr $ra\n");
+  Node* n = treeOf(ir->op);
+  reduceReg(n, REG_V0);
 
-  freeRegister(reg_num);
+  if (dump_counts) emit(INS_JAL, 0, 0, 0, 0, "_prof_dump");
+  genEpilogue();
 }
 
 // generate MIPS32 code for Dec, e.g. dec x [size]
-static void genDec(IRCode* ir, FILE* fout) { assert(ir && ir->kind == IR_DEC); }
+static void genDec(IRCode* ir) { assert(ir && ir->kind == IR_DEC); }
 
 // generate MIPS32 code for Arg, e.g. arg x
-static void genArg(IRCode* ir, FILE* fout) {
+static void genArg(IRCode* ir) {
   assert(ir && ir->kind == IR_ARG);
 
-  Variable* op = findVariable(ir->op);
-
-  int reg_num = getRegister(op, fout);
-
-  fprintf(fout, "\taddi $sp, $sp, -4\n");
-  fprintf(fout, "\tsw %s, 0($sp)\n", register_names[reg_num]);
+  Node* n = treeOf(ir->op);
 
-  freeRegister(reg_num);
-
-  arg_num++;
+  // arg_num is the position of the argument, see argIndex
+  if (arg_num < ARG_REG_NUM) {
+    reduceReg(n, REG_A0 + arg_num);
+  } else {
+    int reg_num = reduceReg(n, -1);
+    emit(INS_SW, 0, REG_SP, reg_num, BASIC_MEM_SIZE * (arg_num - ARG_REG_NUM),
+         NULL);
+    freeRegister(reg_num);
+  }
 }
 
 // generate MIPS32 code for Call, e.g. x = call f
-static void genCall(IRCode* ir, FILE* fout) {
+static void genCall(IRCode* ir) {
   assert(ir && ir->kind == IR_CALL);
 
-  // save $ra and $fp
-  SAVE_FP_RA();
+  emit(INS_JAL, 0, 0, 0, 0, functionLabel(ir->right));
 
-  if (strcmp(operand2str(ir->right), "main") == 0) {
-    fprintf(fout, "\tjal %s\n", operand2str(ir->right));
-  } else {
-    fprintf(fout, "\tjal func_%s\n", operand2str(ir->right));
+  // save return value, unless nobody reads it
+  if (!isDead(lookupVariable(ir->left))) {
+    storeVariable(findVariable(ir->left), REG_V0);
   }
-
-  // restore $ra and $fp
-  RESTORE_FP_RA();
-
-  // save return value
-  Variable* left = findVariable(ir->left);
-
-  fprintf(fout, "\tsw $v0, %d($fp) # %s\n", left->offset,
-          operand2str(ir->left));
-
-  fprintf(fout, "\taddi $sp, $sp, %d\n", arg_num * BASIC_MEM_SIZE);
-  arg_num = 0;
 }
 
 // generate MIPS32 code for Param, e.g. param x
-static void genParam(IRCode* ir, FILE* fout) {
-  assert(ir && ir->kind == IR_PARAM);
-}
+static void genParam(IRCode* ir) { assert(ir && ir->kind == IR_PARAM); }
 
 // generate MIPS32 code for Read, e.g. read x
-static void genRead(IRCode* ir, FILE* fout) {
+static void genRead(IRCode* ir) {
   assert(ir && ir->kind == IR_READ);
 
-  Variable* op = findVariable(ir->op);
-
-  SAVE_FP_RA();
+  emit(INS_JAL, 0, 0, 0, 0, "read");
 
-  fprintf(fout, "\tjal read\n");
-
-  RESTORE_FP_RA();
-
-  fprintf(fout, "\tsw $v0, %d($fp) # %s\n", op->offset, operand2str(ir->op));
+  if (!isDead(lookupVariable(ir->op))) {
+    storeVariable(findVariable(ir->op), REG_V0);
+  }
 }
 
 // generate MIPS32 code for Write, e.g. write x
-static void genWrite(IRCode* ir, FILE* fout) {
+static void genWrite(IRCode* ir) {
   assert(ir && ir->kind == IR_WRITE);
 
-  Variable* op = findVariable(ir->op);
+  Node* n = treeOf(ir->op);
+  reduceReg(n, REG_A0);
 
-  int reg_num = getRegister(op, fout);
-
-  fprintf(fout, "\tmove $a0, %s\n", register_names[reg_num]);
-
-  SAVE_FP_RA();
-
-  fprintf(fout, "\tjal write\n");
+  emit(INS_JAL, 0, 0, 0, 0, "write");
+}
 
-  RESTORE_FP_RA();
+// generate MIPS32 code for Compare, e.g. x = y [relop] z
+static void genCompare(IRCode* ir) {
+  assert(ir && ir->kind == IR_COMPARE);
 
-  freeRegister(reg_num);
-}
\ No newline at end of file
+  genValue(ir);
+}
@@ -0,0 +1,354 @@
+#include "data.h"
+#include "list.h"
+
+// HI and LO, written by mult and div, are one more register to the scheduler
+#define REG_HILO 32
+#define SCHED_REG_NUM 33
+// the most instructions scheduled together, a longer block is cut
+#define MAX_WINDOW 256
+// the cycles before the result of an instruction may be used
+#define LOAD_LATENCY 2
+#define MUL_LATENCY 3
+#define DIV_LATENCY 36
+
+// the instruction after a jump or a branch is run before it is taken, see
+// delaySlot
+int delaySlots = 0;
+
+// an instruction of the window being scheduled
+typedef struct {
+  Instr* ins;
+  int uses[3];
+  int nuses;
+  int defs[2];
+  int ndefs;
+  int load, store;
+  int version;   // the writes to the base register before it in the window
+  int latency;   // the cycles its result takes
+  int priority;  // the longest latency from it to the end of the window
+  int npreds;    // the predecessors not scheduled yet
+  int ready;     // the first cycle its operands are available
+  int done;
+} SchedNode;
+
+static int scheduleWindow(Instr** code, int n, Instr** out, Arena* arena);
+static void describe(Instr* ins, SchedNode* node);
+static int dependence(SchedNode* a, SchedNode* b);
+static int isControl(Instr* ins);
+static int reads(SchedNode* node, int r);
+static int writes(SchedNode* node, int r);
+static int delaySlot(Instr** code, int n);
+static int movable(Instr** code, int k, int branch);
+
+// reorder the instructions of every block of a function so a result is not
+// used right after the instruction computing it, the jumps and the calls
+// stay at the end of their blocks; with delaySlots the slot after every jump
+// is filled with an instruction from before it, or with a nop
+void MIPS32Schedule(List* instrs, Arena* arena) {
+  int n = 0;
+  for (ListNode* node = instrs->head; node; node = node->next) n++;
+  Instr** code = malloc(sizeof(Instr*) * (n + 1));
+  n = 0;
+  for (ListNode* node = instrs->head; node; node = node->next) {
+    code[n++] = node->value;
+  }
+
+  // a window ends before a label, after a jump and after a call
+  Instr** out = malloc(sizeof(Instr*) * (2 * n + 1));
+  int m = 0;
+  int start = 0;
+  for (int i = 0; i <= n; i++) {
+    if (i < n && code[i]->op != INS_LABEL && !isControl(code[i]) &&
+        i + 1 - start < MAX_WINDOW) {
+      continue;
+    }
+    int stop = i < n && code[i]->op != INS_LABEL ? i + 1 : i;
+    m += scheduleWindow(code + start, stop - start, out + m, arena);
+    if (stop == i && i < n) out[m++] = code[i];
+    start = i + 1;
+  }
+
+  ListNode* node = instrs->head;
+  for (int i = 0; i < m; i++) {
+    if (node) {
+      node->value = out[i];
+      node = node->next;
+    } else {
+      listAddNodeTail(instrs, out[i]);
+    }
+  }
+
+  free(out);
+  free(code);
+}
+
+// list scheduling: every cycle the ready instruction with the longest path
+// to the end of the window goes next, a jump or a call stays last and the
+// instruction for its slot is taken out first; return the instructions
+// written to out
+static int scheduleWindow(Instr** code, int n, Instr** out, Arena* arena) {
+  Instr* slot = NULL;
+  if (delaySlots && n > 0 && isControl(code[n - 1])) {
+    int k = delaySlot(code, n);
+    if (k >= 0) {
+      slot = code[k];
+      memmove(code + k, code + k + 1, sizeof(Instr*) * (n - 1 - k));
+      n--;
+    } else {
+      slot = newInstr(arena, INS_NOP, 0, 0, 0, 0, NULL);
+    }
+  }
+  if (n < 2) {
+    memcpy(out, code, sizeof(Instr*) * n);
+    if (slot) out[n++] = slot;
+    return n;
+  }
+
+  SchedNode* nodes = calloc(n, sizeof(SchedNode));
+  int* version = calloc(SCHED_REG_NUM, sizeof(int));
+  for (int i = 0; i < n; i++) {
+    describe(code[i], &nodes[i]);
+    if (nodes[i].load || nodes[i].store) {
+      nodes[i].version = version[nodes[i].ins->rs];
+    }
+    for (int d = 0; d < nodes[i].ndefs; d++) version[nodes[i].defs[d]]++;
+  }
+  free(version);
+
+  // the latency of the edge from i to j, -1 if j does not depend on i
+  int* edge = malloc(sizeof(int) * n * n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      edge[i * n + j] = j > i ? dependence(&nodes[i], &nodes[j]) : -1;
+      if (j == n - 1 && j > i && isControl(code[j]) && edge[i * n + j] < 0) {
+        edge[i * n + j] = 0;
+      }
+      if (edge[i * n + j] >= 0) nodes[j].npreds++;
+    }
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    nodes[i].priority = nodes[i].latency;
+    for (int j = i + 1; j < n; j++) {
+      int e = edge[i * n + j];
+      if (e >= 0 && e + nodes[j].priority > nodes[i].priority) {
+        nodes[i].priority = e + nodes[j].priority;
+      }
+    }
+  }
+
+  int cycle = 0;
+  for (int k = 0; k < n; k++) {
+    // the ready one with the highest priority, the earliest if none is
+    // ready yet; ties keep the original order
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+      SchedNode* node = &nodes[i];
+      if (node->done || node->npreds > 0) continue;
+      if (best < 0) {
+        best = i;
+        continue;
+      }
+      int ready = node->ready <= cycle;
+      int best_ready = nodes[best].ready <= cycle;
+      if (ready != best_ready) {
+        if (ready) best = i;
+      } else if (ready ? node->priority > nodes[best].priority
+                       : node->ready < nodes[best].ready) {
+        best = i;
+      }
+    }
+    assert(best >= 0);
+
+    SchedNode* node = &nodes[best];
+    if (node->ready > cycle) cycle = node->ready;
+    node->done = 1;
+    out[k] = node->ins;
+    for (int j = best + 1; j < n; j++) {
+      int e = edge[best * n + j];
+      if (e < 0) continue;
+      nodes[j].npreds--;
+      if (cycle + e > nodes[j].ready) nodes[j].ready = cycle + e;
+    }
+    cycle++;
+  }
+
+  free(edge);
+  free(nodes);
+  if (slot) out[n++] = slot;
+  return n;
+}
+
+// the registers an instruction reads and writes, whether it touches memory
+// and how long its result takes
+static void describe(Instr* ins, SchedNode* node) {
+  *node = (SchedNode){.ins = ins, .latency = 1};
+  switch (ins->op) {
+    case INS_ADDU:
+    case INS_SUBU:
+    case INS_MUL:
+    case INS_SLT:
+    case INS_SLTU:
+    case INS_AND:
+    case INS_OR:
+    case INS_XOR:
+      node->uses[node->nuses++] = ins->rs;
+      node->uses[node->nuses++] = ins->rt;
+      node->defs[node->ndefs++] = ins->rd;
+      if (ins->op == INS_MUL) node->latency = MUL_LATENCY;
+      break;
+    case INS_ADDIU:
+    case INS_SLTI:
+    case INS_SLTIU:
+    case INS_ANDI:
+    case INS_ORI:
+    case INS_XORI:
+    case INS_SLL:
+    case INS_SRL:
+    case INS_SRA:
+    case INS_MOVE:
+      node->uses[node->nuses++] = ins->rs;
+      node->defs[node->ndefs++] = ins->rd;
+      break;
+    case INS_MULT:
+    case INS_DIV:
+      node->uses[node->nuses++] = ins->rs;
+      node->uses[node->nuses++] = ins->rt;
+      node->defs[node->ndefs++] = REG_HILO;
+      node->latency = ins->op == INS_MULT ? MUL_LATENCY : DIV_LATENCY;
+      break;
+    case INS_MFHI:
+    case INS_MFLO:
+      node->uses[node->nuses++] = REG_HILO;
+      node->defs[node->ndefs++] = ins->rd;
+      break;
+    case INS_LI:
+    case INS_LA:
+      node->defs[node->ndefs++] = ins->rd;
+      break;
+    case INS_LW:
+      node->uses[node->nuses++] = ins->rs;
+      node->defs[node->ndefs++] = ins->rd;
+      node->load = 1;
+      node->latency = LOAD_LATENCY;
+      break;
+    case INS_SW:
+      node->uses[node->nuses++] = ins->rs;
+      node->uses[node->nuses++] = ins->rt;
+      node->store = 1;
+      break;
+    case INS_BEQ:
+    case INS_BNE:
+      node->uses[node->nuses++] = ins->rs;
+      node->uses[node->nuses++] = ins->rt;
+      break;
+    case INS_BLTZ:
+    case INS_BGEZ:
+    case INS_BLEZ:
+    case INS_BGTZ:
+    case INS_JR:
+      node->uses[node->nuses++] = ins->rs;
+      break;
+    case INS_JAL:
+      // the callee reads the arguments and the memory, and clobbers them
+      node->load = node->store = 1;
+      node->defs[node->ndefs++] = REG_RA;
+      break;
+    case INS_J:
+    case INS_NOP:
+      break;
+    default:
+      // we should never reach here
+      assert(0);
+      break;
+  }
+}
+
+// the latency after a before b may start, -1 if they may be swapped; two
+// words at different offsets from the same value of a base register are
+// apart
+static int dependence(SchedNode* a, SchedNode* b) {
+  int latency = -1;
+  for (int d = 0; d < a->ndefs; d++) {
+    if (a->defs[d] == REG_ZERO) continue;
+    if (reads(b, a->defs[d])) return a->latency;
+    if (writes(b, a->defs[d])) latency = 1;
+  }
+  for (int u = 0; u < a->nuses; u++) {
+    if (a->uses[u] != REG_ZERO && writes(b, a->uses[u]) && latency < 0) {
+      latency = 0;
+    }
+  }
+
+  if ((a->store && (b->load || b->store)) || (a->load && b->store)) {
+    int apart = !(a->ins->op == INS_JAL || b->ins->op == INS_JAL) &&
+                a->ins->rs == b->ins->rs && a->version == b->version &&
+                a->ins->imm != b->ins->imm;
+    if (!apart && latency < 1) latency = a->store && b->load ? 1 : 0;
+  }
+  return latency;
+}
+
+static int isControl(Instr* ins) {
+  switch (ins->op) {
+    case INS_BEQ:
+    case INS_BNE:
+    case INS_BLTZ:
+    case INS_BGEZ:
+    case INS_BLEZ:
+    case INS_BGTZ:
+    case INS_J:
+    case INS_JAL:
+    case INS_JR:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int reads(SchedNode* node, int r) {
+  for (int u = 0; u < node->nuses; u++) {
+    if (node->uses[u] == r) return 1;
+  }
+  return 0;
+}
+
+static int writes(SchedNode* node, int r) {
+  for (int d = 0; d < node->ndefs; d++) {
+    if (node->defs[d] == r) return 1;
+  }
+  return 0;
+}
+
+// the instruction of the window the jump ending it takes into its slot, -1
+// if none may run after the jump; a load there would delay what the jump
+// leads to, any other is taken first
+static int delaySlot(Instr** code, int n) {
+  int load = -1;
+  for (int k = n - 2; k >= 0; k--) {
+    if (!movable(code, k, n - 1)) continue;
+    if (code[k]->op != INS_LW) return k;
+    if (load < 0) load = k;
+  }
+  return load;
+}
+
+// return 1 if code[k] may be moved after the jump code[branch], nothing
+// between depends on it and the jump does not read what it writes
+static int movable(Instr** code, int k, int branch) {
+  SchedNode node, other;
+  describe(code[k], &node);
+  if (isControl(code[k]) || code[k]->op == INS_LABEL) return 0;
+  // jal writes $ra before the slot is run
+  if (reads(&node, REG_RA) || writes(&node, REG_RA)) return 0;
+
+  for (int j = k + 1; j <= branch; j++) {
+    describe(code[j], &other);
+    if (j < branch && dependence(&node, &other) >= 0) return 0;
+    if (j == branch) {
+      for (int d = 0; d < node.ndefs; d++) {
+        if (reads(&other, node.defs[d])) return 0;
+      }
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+// the counts of a program built with instrument, read back to guide the
+// passes, see readProfile
+int instrument = 0;
+int hasProfile = 0;
+
+// the records of the profile, a label number or -(n + 1) for the n-th
+// function, with the times it was reached
+static long* keys = NULL;
+static long* counts = NULL;
+static int nrecords = 0;
+
+static long* scanNumbers(char* text, int* n);
+static int functionIndex(char* name, List** funcs, int n);
+
+// read the output of a program built with instrument, it ends with the
+// magic number, the number of records and a key and a count for each; the
+// lines the program itself wrote before are skipped. Return 0 after
+// reporting a file without them
+int readProfile(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 0;
+  }
+  size_t size = 0, capacity = 4096;
+  char* text = malloc(capacity);
+  size_t got;
+  while ((got = fread(text + size, 1, capacity - size - 1, f)) > 0) {
+    size += got;
+    if (size + 1 == capacity) {
+      capacity *= 2;
+      text = realloc(text, capacity);
+    }
+  }
+  text[size] = '\0';
+  fclose(f);
+
+  int n;
+  long* numbers = scanNumbers(text, &n);
+  free(text);
+
+  // the last magic number followed by exactly the records it announces
+  int start = -1;
+  for (int i = n - 2; i >= 0 && start < 0; i--) {
+    if (numbers[i] == PROFILE_MAGIC && numbers[i + 1] >= 0 &&
+        numbers[i + 1] <= (n - i - 2) / 2 &&
+        i + 2 + 2 * numbers[i + 1] == n) {
+      start = i;
+    }
+  }
+  if (start < 0) {
+    fprintf(stderr, "%s: not the output of an instrumented program\n", path);
+    free(numbers);
+    return 0;
+  }
+
+  nrecords = numbers[start + 1];
+  keys = malloc(sizeof(long) * (nrecords + 1));
+  counts = malloc(sizeof(long) * (nrecords + 1));
+  for (int r = 0; r < nrecords; r++) {
+    keys[r] = numbers[start + 2 + 2 * r];
+    counts[r] = numbers[start + 3 + 2 * r];
+    // a counter wraps around after 2^31 runs
+    if (counts[r] < 0) counts[r] = 0x7fffffff;
+  }
+  free(numbers);
+  hasProfile = 1;
+  return 1;
+}
+
+// give every code of ir, the whole program as IRGenerate made it, the
+// count of the label or the function it follows; a profile of another
+// program is reported and dropped
+void attachProfile(List* ir) {
+  if (!hasProfile) return;
+
+  size_t nlabels = 1;
+  int nfuncs = 0;
+  for (ListNode* node = ir->head; node; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_LABEL && code->op->label_no >= nlabels) {
+      nlabels = code->op->label_no + 1;
+    }
+    if (code->kind == IR_FUNCTION) nfuncs++;
+  }
+
+  long* labels = malloc(sizeof(long) * nlabels);
+  long* funcs = malloc(sizeof(long) * (nfuncs + 1));
+  for (size_t l = 0; l < nlabels; l++) labels[l] = -1;
+  for (int f = 0; f < nfuncs; f++) funcs[f] = -1;
+  int matches = 1;
+  for (int r = 0; r < nrecords; r++) {
+    if (keys[r] < 0 && -keys[r] - 1 < nfuncs) {
+      funcs[-keys[r] - 1] = counts[r];
+    } else if (keys[r] >= 0 && (size_t)keys[r] < nlabels) {
+      labels[keys[r]] = counts[r];
+    } else {
+      matches = 0;
+    }
+  }
+
+  long count = -1;
+  int f = 0;
+  for (ListNode* node = ir->head; node && matches; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION) count = funcs[f++];
+    if (code->kind == IR_LABEL) count = labels[code->op->label_no];
+    if (f > 0 && count < 0) matches = 0;
+    code->count = count;
+  }
+  free(funcs);
+  free(labels);
+
+  if (!matches) {
+    fprintf(stderr, "the profile is of another program, it is ignored\n");
+    for (ListNode* node = ir->head; node; node = node->next) {
+      ((IRCode*)node->value)->count = -1;
+    }
+    hasProfile = 0;
+  }
+}
+
+// the times block b was entered, the most any of its codes ran, -1 if none
+// of them has a count
+long blockCount(CFG* cfg, int b) {
+  long count = -1;
+  for (ListNode* node = cfg->blocks[b]->codes->head; node;
+       node = node->next) {
+    IRCode* ir = node->value;
+    if (ir->count > count) count = ir->count;
+  }
+  return count;
+}
+
+// lay out the functions of ir so a function follows its hottest caller:
+// starting from main, the callee called the most from those placed goes
+// next; the functions never reached from them follow, the most run first
+List* orderFunctions(List* ir) {
+  if (!hasProfile) return ir;
+
+  int n = 0;
+  for (ListNode* node = ir->head; node; node = node->next) {
+    if (((IRCode*)node->value)->kind == IR_FUNCTION) n++;
+  }
+  if (n < 2) return ir;
+
+  // the codes of each function, the codes before the first stay first
+  List* head = newList(NULL, NULL, NULL);
+  List** funcs = malloc(sizeof(List*) * n);
+  int f = -1;
+  for (ListNode* node = ir->head; node; node = node->next) {
+    IRCode* code = node->value;
+    if (code->kind == IR_FUNCTION) funcs[++f] = newList(NULL, NULL, NULL);
+    listAddNodeTail(f >= 0 ? funcs[f] : head, code);
+  }
+  freeList(ir);
+
+  // calls[a * n + b], the times a called b
+  long* calls = calloc((size_t)n * n, sizeof(long));
+  for (f = 0; f < n; f++) {
+    for (ListNode* node = funcs[f]->head; node; node = node->next) {
+      IRCode* code = node->value;
+      if (code->kind != IR_CALL || code->count <= 0) continue;
+      int callee = functionIndex(code->right->func_name, funcs, n);
+      if (callee >= 0) calls[f * n + callee] += code->count;
+    }
+  }
+
+  int* order = malloc(sizeof(int) * n);
+  char* placed = calloc(n, 1);
+  int norder = 0;
+  int first = functionIndex("main", funcs, n);
+  if (first >= 0) {
+    order[norder++] = first;
+    placed[first] = 1;
+  }
+  while (norder < n) {
+    int best = -1;
+    long weight = 0;
+    for (int i = 0; i < norder; i++) {
+      for (int g = 0; g < n; g++) {
+        if (!placed[g] && calls[order[i] * n + g] > weight) {
+          best = g;
+          weight = calls[order[i] * n + g];
+        }
+      }
+    }
+    // no call left from the placed ones, the most run of the others
+    for (int g = 0; g < n && weight == 0; g++) {
+      if (placed[g]) continue;
+      if (best < 0 || ((IRCode*)funcs[g]->head->value)->count >
+                          ((IRCode*)funcs[best]->head->value)->count) {
+        best = g;
+      }
+    }
+    order[norder++] = best;
+    placed[best] = 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    listJoin(head, funcs[order[i]]);
+    freeList(funcs[order[i]]);
+  }
+  free(placed);
+  free(order);
+  free(calls);
+  free(funcs);
+  return head;
+}
+
+// every number in text, a '-' right before the digits is its sign
+static long* scanNumbers(char* text, int* n) {
+  int capacity = 64;
+  long* numbers = malloc(sizeof(long) * capacity);
+  *n = 0;
+  for (char* p = text; *p;) {
+    int negative = *p == '-' && p[1] >= '0' && p[1] <= '9';
+    if (!negative && (*p < '0' || *p > '9')) {
+      p++;
+      continue;
+    }
+    if (*n == capacity) {
+      capacity *= 2;
+      numbers = realloc(numbers, sizeof(long) * capacity);
+    }
+    numbers[(*n)++] = strtol(p, &p, 10);
+  }
+  return numbers;
+}
+
+// the function of funcs named name, -1 if none is
+static int functionIndex(char* name, List** funcs, int n) {
+  for (int f = 0; f < n; f++) {
+    IRCode* code = funcs[f]->head->value;
+    if (strcmp(code->op->func_name, name) == 0) return f;
+  }
+  return -1;
+}
@@ -2,7 +2,6 @@
 
 #include "data.h"
 #include "hash.h"
-#include "mbtree.h"
 
 #define BASIC_TYPE_INT 0
 #define BASIC_TYPE_FLOAT 1
@@ -10,100 +9,169 @@
 #define IS_LVALUE 1
 #define NOT_LVALUE 0
 
+#define FUNC_PTR_CAST(f) ((unsigned int (*)(const void*))f)
+
 extern HashTable* ht;
 extern int translateEnabled;
+extern int keyCompare(void* privDataPtr, const void* a, const void* b);
+extern void keyDestructor(void* privDataPtr, void* key);
+extern void* keyDup(void* privDataPtr, const void* key);
 
 static Type* retType = NULL;
 static int structDep = 0;
+// the names of the parameters, see NodeInfo
+static HtType paramType = {.hashFunction = FUNC_PTR_CAST(htGenHashFunction),
+                           .keyDup = keyDup,
+                           .valDup = NULL,
+                           .keyCompare = keyCompare,
+                           .keyDestructor = keyDestructor,
+                           .valDestructor = NULL};
+static HashTable* params = NULL;
+static int errors = 0;
+// called on each part of an ExtDef once it is checked, see
+// semanticAnalysisEmit
+static void (*emit)(NodeId part) = NULL;
+// only the names are entered, see declareExtDef
+static int declaring = 0;
+
+void beginSemanticAnalysis();
 
 // High-level Definitions
-static void saExtDefList(MBTreeNode* node);
-static void saExtDef(MBTreeNode* node);
-static void saExtDecList(MBTreeNode* node, Type* type);
+static void saExtDefList(NodeId node);
+static void saExtDef(NodeId node);
+static void saExtDecList(NodeId node, Type* type);
+static void saBody(NodeId node);
+static void emitPart(NodeId node);
 // Specifiers
-static Type* saSpecifier(MBTreeNode* node);
-static Type* saStructSpecifier(MBTreeNode* node);
-static char* saTag(MBTreeNode* node);
-static char* saOptTag(MBTreeNode* node);
+static Type* saSpecifier(NodeId node);
+static Type* saStructSpecifier(NodeId node);
+static char* saTag(NodeId node);
+static char* saOptTag(NodeId node);
 // Local Definitions
-static FieldList* saDefList(MBTreeNode* node);
-static FieldList* saDef(MBTreeNode* node);
-static FieldList* saDecList(MBTreeNode* node, Type* type);
-static FieldList* saDec(MBTreeNode* node, Type* type);
+static FieldList* saDefList(NodeId node);
+static FieldList* saDef(NodeId node);
+static FieldList* saDecList(NodeId node, Type* type);
+static FieldList* saDec(NodeId node, Type* type);
 // Declarators
-static FieldList* saVarDec(MBTreeNode* node, Type* type);
-static void saFunDec(MBTreeNode* node, Type* type);
-static FieldList* saVarList(MBTreeNode* node);
-static FieldList* saParamDec(MBTreeNode* node);
+static FieldList* saVarDec(NodeId node, Type* type);
+static void saFunDec(NodeId node, Type* type);
+static FieldList* saVarList(NodeId node);
+static FieldList* saParamDec(NodeId node);
 // Statements
-static void saCompSt(MBTreeNode* node);
-static void saStmtList(MBTreeNode* node);
-static void saStmt(MBTreeNode* node);
+static void saCompSt(NodeId node);
+static void saStmtList(NodeId node);
+static void saStmt(NodeId node);
+static void declareStmt(NodeId node);
 // Expressions
-static Type* saExp(MBTreeNode* node, int isLvalue);
-static FieldList* saArgs(MBTreeNode* node);
+static Type* saExp(NodeId node, int isLvalue);
+static FieldList* saArgs(NodeId node);
 // Tokens
-static Type* saTYPE(MBTreeNode* node);
-static char* saID(MBTreeNode* node);
-static int saINT(MBTreeNode* node);
+static Type* saTYPE(NodeId node);
+static char* saID(NodeId node);
+static int saINT(NodeId node);
 
+static void resolve(NodeId node, char* name);
+static int define(char* name, Type* type);
 static void print_error_massage(int code, int line);
 
-// semantic analysis entry
-void semanticAnalysis(MBTreeNode* node) {
+// semantic analysis entry, return the number of errors found
+int semanticAnalysis(NodeId node) {
+  beginSemanticAnalysis();
+
+  if (node == 0) return 0;
+
+  assert(getNodeType(node) == _Program);
+
+  // Program -> ExtDefList
+  saExtDefList(getNodeKid(node, 0));
+  return errors;
+}
+
+// set up the symbol table to analyse the ExtDefs one at a time
+void beginSemanticAnalysis() {
   // add the built-in functions read and write to the symbol table
   FieldList* fl = newFieldList("", newTypeBasic(BASIC_TYPE_INT), NULL);
   htAdd(ht, "write", newTypeFunction(newTypeBasic(BASIC_TYPE_INT), fl));
   htAdd(ht, "read", newTypeFunction(newTypeBasic(BASIC_TYPE_INT), NULL));
   freeFieldList(fl);
 
-  if (node == NULL) return;
+  // with room for the nodes still to be parsed, see allocNode
+  uint32_t n = ast.capacity > ast.nnodes ? ast.capacity : ast.nnodes;
+  ast.info = calloc(n, sizeof(NodeInfo));
+  params = htCreate(&paramType, NULL);
+}
+
+// analyse one ExtDef, return the number of errors found in it
+int semanticAnalysisExtDef(NodeId node) {
+  int before = errors;
+  saExtDef(node);
+  return errors - before;
+}
 
-  assert(getMBTreeNodeType(node) == _Program && node->nextSibling == NULL);
+// analyse one ExtDef like semanticAnalysisExtDef, passing each part of it to
+// emit as soon as the part is checked, while no error has been found: for a
+// function its FunDec, the DefList of its body and each statement of the
+// body in turn, else the whole ExtDef
+int semanticAnalysisEmit(NodeId node, void (*emitFn)(NodeId part)) {
+  emit = emitFn;
+  int found = semanticAnalysisExtDef(node);
+  emit = NULL;
+  return found;
+}
 
-  // Program -> ExtDefList
-  saExtDefList(node->firstChild);
+// enter the names one ExtDef declares, its structures, global variables,
+// function, parameters and locals, as semanticAnalysisExtDef would without
+// checking the statements and initial values; return the number of errors
+// found in the declarations
+int declareExtDef(NodeId node) {
+  declaring = 1;
+  int found = semanticAnalysisExtDef(node);
+  declaring = 0;
+  return found;
 }
 
+// return 1 if name was declared as a parameter
+int isParam(char* name) { return htFind(params, name) != NULL; }
+
 // analyse the ExtDefList node
-static void saExtDefList(MBTreeNode* node) {
-  if (node == NULL) return;
+static void saExtDefList(NodeId node) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _ExtDefList);
+  assert(getNodeType(node) == _ExtDefList);
 
-  MBTreeNode* child = node->firstChild;
-  if (getMBTreeNodeType(child) == _Empty) {
-    // ExtDefList -> empty
-    return;
+  // ExtDefList -> ExtDef ExtDefList | empty
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    saExtDef(getNodeKid(node, i));
   }
-
-  // ExtDefList -> ExtDef ExtDefList
-  saExtDef(child);
-  saExtDefList(child->nextSibling);
 }
 
 // analyse the ExtDef node
-static void saExtDef(MBTreeNode* node) {
-  if (node == NULL) return;
+static void saExtDef(NodeId node) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _ExtDef);
+  assert(getNodeType(node) == _ExtDef);
 
-  MBTreeNode* specifier = node->firstChild;  // Specifier
+  NodeId specifier = getNodeKid(node, 0);  // Specifier
   Type* type = saSpecifier(specifier);
 
-  MBTreeNode* next = specifier->nextSibling;
-  switch (getMBTreeNodeType(next)) {
-    case _SEMI:
-      // ExtDef -> Specifier SEMI
-      break;
+  if (getNodeKidCount(node) == 1) {
+    // ExtDef -> Specifier SEMI
+    freeType(type);
+    return;
+  }
+
+  NodeId next = getNodeKid(node, 1);
+  switch (getNodeType(next)) {
     case _FunDec:
       // ExtDef -> Specifier FunDec CompSt
       saFunDec(next, type);
-      saCompSt(next->nextSibling);
+      emitPart(next);
+      saBody(getNodeKid(node, 2));
       break;
     case _ExtDecList:
       // ExtDef -> Specifier ExtDecList SEMI
       saExtDecList(next, type);
+      emitPart(node);
       break;
     default:
       // error
@@ -114,18 +182,18 @@ static void saExtDef(MBTreeNode* node) {
 }
 
 // analyse the Specifier node
-static Type* saSpecifier(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static Type* saSpecifier(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _Specifier);
+  assert(getNodeType(node) == _Specifier);
 
-  MBTreeNode* child = node->firstChild;
+  NodeId child = getNodeKid(node, 0);
   Type* type = NULL;
 
-  if (getMBTreeNodeType(child) == _TYPE) {
+  if (getNodeType(child) == _TYPE) {
     // Specifier -> TYPE
     type = saTYPE(child);
-  } else if (getMBTreeNodeType(child) == _StructSpecifier) {
+  } else if (getNodeType(child) == _StructSpecifier) {
     // Specifier -> StructSpecifier
     type = saStructSpecifier(child);
   } else {
@@ -137,17 +205,17 @@ static Type* saSpecifier(MBTreeNode* node) {
 }
 
 // analyse the TYPE node
-static Type* saTYPE(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static Type* saTYPE(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _TYPE);
+  assert(getNodeType(node) == _TYPE);
 
   Type* type = NULL;
 
   // TYPE -> int | float
-  if (!strcmp(getMBTreeNodeValue(node).val_str, "int")) {
+  if (tokenIs(node, "int")) {
     type = newTypeBasic(BASIC_TYPE_INT);
-  } else if (!strcmp(getMBTreeNodeValue(node).val_str, "float")) {
+  } else if (tokenIs(node, "float")) {
     type = newTypeBasic(BASIC_TYPE_FLOAT);
   } else {
     // error
@@ -158,47 +226,37 @@ static Type* saTYPE(MBTreeNode* node) {
 }
 
 // analyse the StructSpecifier node
-static Type* saStructSpecifier(MBTreeNode* node) {
-  if (node == NULL) return NULL;
-
-  assert(getMBTreeNodeType(node) == _StructSpecifier);
+static Type* saStructSpecifier(NodeId node) {
+  if (node == 0) return NULL;
 
-  MBTreeNode* child = node->firstChild;
-  assert(getMBTreeNodeType(child) == _STRUCT);
+  assert(getNodeType(node) == _StructSpecifier);
 
   Type* type = NULL;
 
-  child = child->nextSibling;
-  if (getMBTreeNodeType(child) == _OptTag) {
+  NodeId child = getNodeKid(node, 0);
+  if (getNodeType(child) == _OptTag) {
     // StructSpecifier -> STRUCT OptTag LC DefList RC
     char* tag = saOptTag(child);
 
-    MBTreeNode* next = child->nextSibling;  // LC
-    assert(getMBTreeNodeType(next) == _LC);
     structDep++;
-
-    next = next->nextSibling;  // DefList
-    FieldList* fl = saDefList(next);
-
-    next = next->nextSibling;  // RC
-    assert(getMBTreeNodeType(next) == _RC);
+    FieldList* fl = saDefList(getNodeKid(node, 1));
     structDep--;
 
     type = newTypeStructure(tag, fl);
     // if the tag is not empty, insert the structure type into the symbol table
     if (tag[0] != '\0') {
-      if (htReplace(ht, tag, type) == 0) {
-        print_error_massage(STR_NAME_CON, getMBTreeNodeLineNo(node));
+      if (define(tag, type) == 0) {
+        print_error_massage(STR_NAME_CON, getNodeLineNo(node));
       }
     }
 
     freeFieldList(fl);
-  } else if (getMBTreeNodeType(child) == _Tag) {
+  } else if (getNodeType(child) == _Tag) {
     // StructSpecifier -> STRUCT Tag
     char* tag = saTag(child);
     HashEntry* he = htFind(ht, tag);
     if (he == NULL) {
-      print_error_massage(UND_STR, getMBTreeNodeLineNo(node));
+      print_error_massage(UND_STR, getNodeLineNo(node));
     } else {
       type = htGetEntryVal(he);
       type = copyType[type->kind](type);
@@ -212,81 +270,69 @@ static Type* saStructSpecifier(MBTreeNode* node) {
 }
 
 // analyse the OptTag node
-static char* saTag(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static char* saTag(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _Tag);
+  assert(getNodeType(node) == _Tag);
 
   // Tag -> ID
-  return saID(node->firstChild);
+  return saID(getNodeKid(node, 0));
 }
 
 // analyse the OptTag node
-static char* saOptTag(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static char* saOptTag(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _OptTag);
+  assert(getNodeType(node) == _OptTag);
 
-  MBTreeNode* child = node->firstChild;
-  if (getMBTreeNodeType(child) == _Empty) {
+  if (getNodeKidCount(node) == 0) {
     // OptTag -> empty
     return "";
   }
 
   // OptTag -> ID
-  return saID(child);
+  return saID(getNodeKid(node, 0));
 }
 
 // analyse the ID node
-static char* saID(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static char* saID(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _ID);
+  assert(getNodeType(node) == _ID);
 
-  return getMBTreeNodeValue(node).val_str;
+  return tokenText(node);
 }
 
 // analyse the DefList node
-static FieldList* saDefList(MBTreeNode* node) {
-  if (node == NULL) return NULL;
-
-  assert(getMBTreeNodeType(node) == _DefList);
-
-  MBTreeNode* child = node->firstChild;
-  if (getMBTreeNodeType(child) == _Empty) {
-    // DefList -> empty
-    return NULL;
-  }
-
-  // DefList -> Def DefList
-  FieldList* def = saDef(child);
-  FieldList* defList = saDefList(child->nextSibling);
-
-  // concatenate the two linked lists
-  FieldList* p = def;
-  while (p->next != NULL) {
-    p = p->next;
+static FieldList* saDefList(NodeId node) {
+  if (node == 0) return NULL;
+
+  assert(getNodeType(node) == _DefList);
+
+  // DefList -> Def DefList | empty, the fields of the definitions are
+  // concatenated
+  FieldList* defList = NULL;
+  FieldList** tail = &defList;
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    *tail = saDef(getNodeKid(node, i));
+    while (*tail != NULL) {
+      tail = &(*tail)->next;
+    }
   }
-  p->next = defList;
 
-  return def;
+  return defList;
 }
 
 // analyse the Def node
-static FieldList* saDef(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static FieldList* saDef(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _Def);
+  assert(getNodeType(node) == _Def);
 
   // Def -> Specifier DecList SEMI
-  MBTreeNode* specifier = node->firstChild;
-  Type* type = saSpecifier(specifier);
-
-  MBTreeNode* decList = specifier->nextSibling;
+  Type* type = saSpecifier(getNodeKid(node, 0));
 
-  assert(getMBTreeNodeType(decList->nextSibling) == _SEMI);
-
-  FieldList* fl = saDecList(decList, type);
+  FieldList* fl = saDecList(getNodeKid(node, 1), type);
 
   freeType(type);
 
@@ -294,81 +340,67 @@ static FieldList* saDef(MBTreeNode* node) {
 }
 
 // analyse the DecList node
-static FieldList* saDecList(MBTreeNode* node, Type* type) {
-  if (node == NULL) return NULL;
-
-  assert(getMBTreeNodeType(node) == _DecList);
-
-  MBTreeNode* child = node->firstChild;  // Dec
-  FieldList* dec = saDec(child, type);
-
-  MBTreeNode* next = child->nextSibling;
-  if (next == NULL) {
-    // DecList -> Dec
-    return dec;
+static FieldList* saDecList(NodeId node, Type* type) {
+  if (node == 0) return NULL;
+
+  assert(getNodeType(node) == _DecList);
+
+  // DecList -> Dec | Dec COMMA DecList
+  FieldList* decList = NULL;
+  FieldList** tail = &decList;
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    *tail = saDec(getNodeKid(node, i), type);
+    assert((*tail)->next == NULL);
+    tail = &(*tail)->next;
   }
 
-  assert(getMBTreeNodeType(next) == _COMMA);
-
-  // DecList -> Dec COMMA DecList
-  FieldList* decList = saDecList(next->nextSibling, type);
-  assert(dec->next == NULL);
-  dec->next = decList;
-
-  return dec;
+  return decList;
 }
 
 // analyse the Dec node
-static FieldList* saDec(MBTreeNode* node, Type* type) {
-  if (node == NULL) return NULL;
+static FieldList* saDec(NodeId node, Type* type) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _Dec);
+  assert(getNodeType(node) == _Dec);
 
-  MBTreeNode* child = node->firstChild;  // VarDec
-  FieldList* varDec = saVarDec(child, type);
+  FieldList* varDec = saVarDec(getNodeKid(node, 0), type);  // VarDec
 
-  child = child->nextSibling;
-  if (child == NULL) {
-    // Dec -> VarDec
-  } else if (getMBTreeNodeType(child) == _ASSIGNOP) {
+  if (getNodeKidCount(node) == 2 && !declaring) {
     // Dec -> VarDec ASSIGNOP Exp
     if (structDep > 0) {
-      print_error_massage(RED_STR_MEM_OR_INIT, getMBTreeNodeLineNo(node));
+      print_error_massage(RED_STR_MEM_OR_INIT, getNodeLineNo(node));
     }
 
-    Type* t = saExp(child->nextSibling, NOT_LVALUE);
+    Type* t = saExp(getNodeKid(node, 1), NOT_LVALUE);
     if (!typeEqual(varDec->type, t)) {
-      print_error_massage(TYP_MIS_ASS, getMBTreeNodeLineNo(node));
+      print_error_massage(TYP_MIS_ASS, getNodeLineNo(node));
     }
-
-  } else {
-    // error
-    assert(0);
   }
 
   // To prevent erroneous reports, such as ‘float a; int a = a + 0.1’, we defer
   // adding the symbol to the symbol table after the right expression has been
   // processed.
-  if (htReplace(ht, varDec->name, varDec->type) == 0) {
+  if (define(varDec->name, varDec->type) == 0) {
     if (structDep > 0) {
-      print_error_massage(RED_STR_MEM_OR_INIT, getMBTreeNodeLineNo(node));
+      print_error_massage(RED_STR_MEM_OR_INIT, getNodeLineNo(node));
     } else {
-      print_error_massage(RED_VAR, getMBTreeNodeLineNo(node));
+      print_error_massage(RED_VAR, getNodeLineNo(node));
     }
   }
+  resolve(getNodeKid(node, 0), varDec->name);
 
   return varDec;
 }
 
 // analyse the VarDec node
-static FieldList* saVarDec(MBTreeNode* node, Type* type) {
-  if (node == NULL) return NULL;
+static FieldList* saVarDec(NodeId node, Type* type) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _VarDec);
+  assert(getNodeType(node) == _VarDec);
 
-  MBTreeNode* child = node->firstChild;
+  NodeId child = getNodeKid(node, 0);
   FieldList* fl = NULL;
-  if (getMBTreeNodeType(child) == _ID) {
+  if (getNodeType(child) == _ID) {
     // VarDec -> ID
     char* name = saID(child);
     fl = newFieldList(name, type, NULL);
@@ -376,11 +408,7 @@ static FieldList* saVarDec(MBTreeNode* node, Type* type) {
     // VarDec -> VarDec LB INT RB
     fl = saVarDec(child, type);
 
-    MBTreeNode* next = child->nextSibling;
-    assert(getMBTreeNodeType(next) == _LB);
-
-    next = next->nextSibling;
-    int size = saINT(next);
+    int size = saINT(getNodeKid(node, 1));
 
     // Create a new array type and insert it into the type hierarchy. The new
     // array type is positioned as the second-to-last type before the basic
@@ -402,99 +430,80 @@ static FieldList* saVarDec(MBTreeNode* node, Type* type) {
       array->array.element = p->array.element;
       p->array.element = array;
     }
-
-    next = next->nextSibling;
-    assert(getMBTreeNodeType(next) == _RB);
   }
   return fl;
 }
 
 // get the int value of the INT node
-static int saINT(MBTreeNode* node) {
-  if (node == NULL) return 0;
+static int saINT(NodeId node) {
+  if (node == 0) return 0;
 
-  assert(getMBTreeNodeType(node) == _INT);
+  assert(getNodeType(node) == _INT);
 
-  return getMBTreeNodeValue(node).val_int;
+  return getNodeValue(node).val_int;
 }
 
 // analyse the FunDec node
-static void saFunDec(MBTreeNode* node, Type* type) {
-  if (node == NULL) return;
+static void saFunDec(NodeId node, Type* type) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _FunDec);
+  assert(getNodeType(node) == _FunDec);
 
   // record the return type of the function
   retType = type;
 
-  MBTreeNode* child = node->firstChild;  // ID
-  char* name = saID(child);
-
-  child = child->nextSibling;  // LP
-  assert(getMBTreeNodeType(child) == _LP);
+  char* name = saID(getNodeKid(node, 0));  // ID
 
   Type* function = newTypeFunction(type, NULL);
 
-  child = child->nextSibling;
-  if (getMBTreeNodeType(child) == _VarList) {
+  if (getNodeKidCount(node) == 2) {
     // FunDec -> ID LP VarList RP
-    function->function.params = saVarList(child);
-
-    assert(getMBTreeNodeType(child->nextSibling) == _RP);
-  } else if (getMBTreeNodeType(child) == _RP) {
-    // FunDec -> ID LP RP
+    function->function.params = saVarList(getNodeKid(node, 1));
   } else {
-    // error
-    assert(0);
+    // FunDec -> ID LP RP
   }
 
-  if (htReplace(ht, name, function) == 0) {
-    print_error_massage(RED_FUNC, getMBTreeNodeLineNo(node));
+  if (define(name, function) == 0) {
+    print_error_massage(RED_FUNC, getNodeLineNo(node));
   }
+  resolve(node, name);
 
   freeType(function);
 }
 
 // analyse the VarList node
-static FieldList* saVarList(MBTreeNode* node) {
-  if (node == NULL) return NULL;
-
-  assert(getMBTreeNodeType(node) == _VarList);
-
-  MBTreeNode* child = node->firstChild;  // ParamDec
-  FieldList* fl = saParamDec(child);
-
-  MBTreeNode* next = child->nextSibling;
-  if (next == NULL) {
-    // VarList -> ParamDec
-    return fl;
+static FieldList* saVarList(NodeId node) {
+  if (node == 0) return NULL;
+
+  assert(getNodeType(node) == _VarList);
+
+  // VarList -> ParamDec | ParamDec COMMA VarList
+  FieldList* varList = NULL;
+  FieldList** tail = &varList;
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    *tail = saParamDec(getNodeKid(node, i));
+    assert((*tail)->next == NULL);
+    tail = &(*tail)->next;
   }
 
-  assert(getMBTreeNodeType(next) == _COMMA);
-
-  // VarList -> ParamDec COMMA VarList
-  assert(fl->next == NULL);
-  fl->next = saVarList(next->nextSibling);
-
-  return fl;
+  return varList;
 }
 
 // analyse the ParamDec node
-static FieldList* saParamDec(MBTreeNode* node) {
-  if (node == NULL) return NULL;
+static FieldList* saParamDec(NodeId node) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _ParamDec);
+  assert(getNodeType(node) == _ParamDec);
 
   // ParamDec -> Specifier VarDec
-  MBTreeNode* child = node->firstChild;
-  Type* type = saSpecifier(child);
+  Type* type = saSpecifier(getNodeKid(node, 0));
 
-  child = child->nextSibling;
-  FieldList* fl = saVarDec(child, type);
+  FieldList* fl = saVarDec(getNodeKid(node, 1), type);
 
-  if (htReplace(ht, fl->name, fl->type) == 0) {
-    print_error_massage(RED_VAR, getMBTreeNodeLineNo(node));
+  if (define(fl->name, fl->type) == 0) {
+    print_error_massage(RED_VAR, getNodeLineNo(node));
   }
+  htAdd(params, fl->name, NULL);
 
   if (fl->type->kind == ARRAY) {
     translateEnabled = 0;
@@ -506,112 +515,100 @@ static FieldList* saParamDec(MBTreeNode* node) {
 }
 
 // analyse the CompSt node
-static void saCompSt(MBTreeNode* node) {
-  if (node == NULL) return;
+static void saCompSt(NodeId node) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _CompSt);
-
-  MBTreeNode* child = node->firstChild;  // LC
-  assert(getMBTreeNodeType(child) == _LC);
+  assert(getNodeType(node) == _CompSt);
 
   // CompSt -> LC DefList StmtList RC
-  child = child->nextSibling;  // DefList
-  freeFieldList(saDefList(child));
+  freeFieldList(saDefList(getNodeKid(node, 0)));
+
+  saStmtList(getNodeKid(node, 1));
+}
 
-  child = child->nextSibling;  // StmtList
-  saStmtList(child);
+// analyse the CompSt of a function like saCompSt, emitting its DefList and
+// then each of its statements
+static void saBody(NodeId node) {
+  if (node == 0) return;
 
-  child = child->nextSibling;  // RC
-  assert(getMBTreeNodeType(child) == _RC);
+  assert(getNodeType(node) == _CompSt);
+
+  // CompSt -> LC DefList StmtList RC
+  NodeId defList = getNodeKid(node, 0);
+  freeFieldList(saDefList(defList));
+  emitPart(defList);
+
+  NodeId stmtList = getNodeKid(node, 1);
+  for (uint32_t i = 0; i < getNodeKidCount(stmtList); i++) {
+    NodeId stmt = getNodeKid(stmtList, i);
+    saStmt(stmt);
+    emitPart(stmt);
+  }
 }
 
 // analyse the StmtList node
-static void saStmtList(MBTreeNode* node) {
-  if (node == NULL) return;
+static void saStmtList(NodeId node) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _StmtList);
+  assert(getNodeType(node) == _StmtList);
 
-  MBTreeNode* child = node->firstChild;
-  if (getMBTreeNodeType(child) == _Empty) {
-    // StmtList -> empty
-    return;
+  // StmtList -> Stmt StmtList | empty
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    saStmt(getNodeKid(node, i));
   }
-
-  // StmtList -> Stmt StmtList
-  saStmt(child);
-  saStmtList(child->nextSibling);
 }
 
 // analyse the Stmt node
-static void saStmt(MBTreeNode* node) {
-  if (node == NULL) return;
+static void saStmt(NodeId node) {
+  if (node == 0) return;
 
-  assert(getMBTreeNodeType(node) == _Stmt);
+  assert(getNodeType(node) == _Stmt);
 
-  MBTreeNode* child = node->firstChild;
-  switch (getMBTreeNodeType(child)) {
+  if (declaring) {
+    declareStmt(node);
+    return;
+  }
+
+  switch (getNodeOp(node)) {
     case _Exp:
       // Stmt -> Exp SEMI
-      saExp(child, NOT_LVALUE);
-      assert(getMBTreeNodeType(child->nextSibling) == _SEMI);
+      saExp(getNodeKid(node, 0), NOT_LVALUE);
       break;
     case _CompSt:
       // Stmt -> CompSt
-      saCompSt(child);
+      saCompSt(getNodeKid(node, 0));
       break;
     case _RETURN: {
       // Stmt -> RETURN Exp SEMI
-      child = child->nextSibling;
-      Type* t = saExp(child, NOT_LVALUE);
+      Type* t = saExp(getNodeKid(node, 0), NOT_LVALUE);
       if (!typeEqual(retType, t)) {
-        print_error_massage(RET_TYP_MIS, getMBTreeNodeLineNo(node));
+        print_error_massage(RET_TYP_MIS, getNodeLineNo(node));
       }
-
-      assert(getMBTreeNodeType(child->nextSibling) == _SEMI);
       break;
     }
     case _IF: {
       // Stmt -> IF LP Exp RP Stmt
-      child = child->nextSibling;  // LP
-      assert(getMBTreeNodeType(child) == _LP);
-
-      child = child->nextSibling;  // Exp
-      Type* t = saExp(child, NOT_LVALUE);
+      Type* t = saExp(getNodeKid(node, 0), NOT_LVALUE);
       if (t != NULL && (t->kind != BASIC || t->basic != BASIC_TYPE_INT)) {
-        print_error_massage(OP_MIS, getMBTreeNodeLineNo(node));
+        print_error_massage(OP_MIS, getNodeLineNo(node));
       }
 
-      child = child->nextSibling;  // RP
-      assert(getMBTreeNodeType(child) == _RP);
+      saStmt(getNodeKid(node, 1));
 
-      child = child->nextSibling;  // Stmt
-      saStmt(child);
-
-      child = child->nextSibling;
-      if (child != NULL) {
+      if (getNodeKidCount(node) == 3) {
         // Stmt -> IF LP Exp RP Stmt ELSE Stmt
-        assert(getMBTreeNodeType(child) == _ELSE);
-        child = child->nextSibling;
-        saStmt(child);
+        saStmt(getNodeKid(node, 2));
       }
       break;
     }
     case _WHILE: {
       // Stmt -> WHILE LP Exp RP Stmt
-      child = child->nextSibling;  // LP
-      assert(getMBTreeNodeType(child) == _LP);
-
-      child = child->nextSibling;  // Exp
-      Type* t = saExp(child, NOT_LVALUE);
+      Type* t = saExp(getNodeKid(node, 0), NOT_LVALUE);
       if (t != NULL && (t->kind != BASIC || t->basic != BASIC_TYPE_INT)) {
-        print_error_massage(OP_MIS, getMBTreeNodeLineNo(node));
+        print_error_massage(OP_MIS, getNodeLineNo(node));
       }
 
-      child = child->nextSibling;  // RP
-      assert(getMBTreeNodeType(child) == _RP);
-
-      child = child->nextSibling;  // Stmt
-      saStmt(child);
+      saStmt(getNodeKid(node, 1));
       break;
     }
     default:
@@ -620,172 +617,193 @@ static void saStmt(MBTreeNode* node) {
   }
 }
 
+// enter the locals of the CompSts in a Stmt node, see declareExtDef
+static void declareStmt(NodeId node) {
+  switch (getNodeOp(node)) {
+    case _CompSt:
+      // Stmt -> CompSt
+      saCompSt(getNodeKid(node, 0));
+      break;
+    case _IF:
+      // Stmt -> IF LP Exp RP Stmt | IF LP Exp RP Stmt ELSE Stmt
+      declareStmt(getNodeKid(node, 1));
+      if (getNodeKidCount(node) == 3) declareStmt(getNodeKid(node, 2));
+      break;
+    case _WHILE:
+      // Stmt -> WHILE LP Exp RP Stmt
+      declareStmt(getNodeKid(node, 1));
+      break;
+    default:
+      // Stmt -> Exp SEMI | RETURN Exp SEMI
+      break;
+  }
+}
+
 // analyse the Exp node
-static Type* saExp(MBTreeNode* node, int isLvalue) {
-  if (node == NULL) return NULL;
+static Type* saExp(NodeId node, int isLvalue) {
+  if (node == 0) return NULL;
 
-  assert(getMBTreeNodeType(node) == _Exp);
+  assert(getNodeType(node) == _Exp);
 
   Type* type = NULL;
 
-  MBTreeNode* child = node->firstChild;
-  switch (getMBTreeNodeType(child)) {
-    case _Exp: {
-      Type* t1 = saExp(child, NOT_LVALUE);
-      child = child->nextSibling;
-      if (getMBTreeNodeType(child) == _DOT) {
-        // Exp -> Exp DOT ID
-        if (t1 == NULL) {
-          break;
-        }
+  switch (getNodeOp(node)) {
+    case _DOT: {
+      // Exp -> Exp DOT ID
+      Type* t1 = saExp(getNodeKid(node, 0), NOT_LVALUE);
+      if (t1 == NULL) {
+        break;
+      }
 
-        if (t1->kind != STRUCTURE) {
-          print_error_massage(NON_STR_MEM, getMBTreeNodeLineNo(node));
-          break;
-        }
+      if (t1->kind != STRUCTURE) {
+        print_error_massage(NON_STR_MEM, getNodeLineNo(node));
+        break;
+      }
 
-        char* name = saID(child->nextSibling);
-        FieldList* fl = t1->structure.structure;
-        while (fl != NULL) {
-          if (!strcmp(fl->name, name)) {
-            type = fl->type;
-            break;
-          }
-          fl = fl->next;
-        }
+      char* name = saID(getNodeKid(node, 1));
+      FieldLayout* field = findField(t1, name);
+      if (field) {
+        type = field->field->type;
+      }
+      getNodeInfo(node).field = field;
 
-        if (type == NULL) {
-          print_error_massage(UND_STR_MEM, getMBTreeNodeLineNo(node));
-        }
+      if (type == NULL) {
+        print_error_massage(UND_STR_MEM, getNodeLineNo(node));
+      }
 
-        goto ret;
-      } else if (getMBTreeNodeType(child) == _LB) {
-        // Exp -> Exp LB Exp RB
-        Type* t2 = saExp(child->nextSibling, NOT_LVALUE);
-        if (t1 == NULL || t1->kind != ARRAY) {
-          print_error_massage(NON_ARR_SUB, getMBTreeNodeLineNo(node));
-          break;
-        }
-        if (t2 == NULL || t2->kind != BASIC || t2->basic != BASIC_TYPE_INT) {
-          print_error_massage(NON_INT_SUB, getMBTreeNodeLineNo(node));
-          break;
-        }
-        type = t1->array.element;
+      goto ret;
+    }
+    case _LB: {
+      // Exp -> Exp LB Exp RB
+      Type* t1 = saExp(getNodeKid(node, 0), NOT_LVALUE);
+      Type* t2 = saExp(getNodeKid(node, 1), NOT_LVALUE);
+      if (t1 == NULL || t1->kind != ARRAY) {
+        print_error_massage(NON_ARR_SUB, getNodeLineNo(node));
+        break;
+      }
+      if (t2 == NULL || t2->kind != BASIC || t2->basic != BASIC_TYPE_INT) {
+        print_error_massage(NON_INT_SUB, getNodeLineNo(node));
+        break;
+      }
+      type = t1->array.element;
 
-        if (t1->array.element->kind == ARRAY) {
-          translateEnabled = 0;
-        }
+      if (t1->array.element->kind == ARRAY) {
+        translateEnabled = 0;
+      }
 
-        goto ret;
-      } else {
-        // Exp -> Exp ASSIGNOP Exp
-        // Exp -> Exp AND Exp
-        // Exp -> Exp OR Exp
-        // Exp -> Exp RELOP Exp
-        // Exp -> Exp PLUS Exp
-        // Exp -> Exp MINUS Exp
-        // Exp -> Exp STAR Exp
-        // Exp -> Exp DIV Exp
-        Type* t2 = saExp(child->nextSibling, NOT_LVALUE);
-        if (getMBTreeNodeType(child) == _ASSIGNOP) {
-          t1 = saExp(node->firstChild, IS_LVALUE);
-
-          if (!typeEqual(t1, t2)) {
-            print_error_massage(TYP_MIS_ASS, getMBTreeNodeLineNo(node));
-          }
-        } else {
-          if (!typeEqual(t1, t2)) {
-            print_error_massage(OP_MIS, getMBTreeNodeLineNo(node));
-          }
+      goto ret;
+    }
+    case _MINUS:
+      if (getNodeKidCount(node) == 1) {
+        // Exp -> MINUS Exp
+        type = saExp(getNodeKid(node, 0), NOT_LVALUE);
+        if (type == NULL || type->kind != BASIC) {
+          print_error_massage(OP_MIS, getNodeLineNo(node));
+        }
+        break;
+      }
+      // fall through
+    case _ASSIGNOP:
+    case _AND:
+    case _OR:
+    case _RELOP:
+    case _PLUS:
+    case _STAR:
+    case _DIV: {
+      // Exp -> Exp ASSIGNOP Exp
+      // Exp -> Exp AND Exp
+      // Exp -> Exp OR Exp
+      // Exp -> Exp RELOP Exp
+      // Exp -> Exp PLUS Exp
+      // Exp -> Exp MINUS Exp
+      // Exp -> Exp STAR Exp
+      // Exp -> Exp DIV Exp
+      Type* t1 = saExp(getNodeKid(node, 0), NOT_LVALUE);
+      Type* t2 = saExp(getNodeKid(node, 1), NOT_LVALUE);
+      if (getNodeOp(node) == _ASSIGNOP) {
+        t1 = saExp(getNodeKid(node, 0), IS_LVALUE);
+
+        if (!typeEqual(t1, t2)) {
+          print_error_massage(TYP_MIS_ASS, getNodeLineNo(node));
         }
-        if (getMBTreeNodeType(child) == _RELOP) {
-          type = newTypeBasic(BASIC_TYPE_INT);
-        } else {
-          type = t1;
+      } else {
+        if (!typeEqual(t1, t2)) {
+          print_error_massage(OP_MIS, getNodeLineNo(node));
         }
       }
-
+      if (getNodeOp(node) == _RELOP) {
+        type = newTypeBasic(BASIC_TYPE_INT);
+        getNodeInfo(node).relop = tokenText(node);
+      } else {
+        type = t1;
+      }
       break;
     }
     case _LP:
       // Exp -> LP Exp RP
-      child = child->nextSibling;
-      type = saExp(child, NOT_LVALUE);
-
-      assert(getMBTreeNodeType(child->nextSibling) == _RP);
-      break;
-    case _MINUS:
-      // Exp -> MINUS Exp
-      type = saExp(child->nextSibling, NOT_LVALUE);
-      if (type == NULL || type->kind != BASIC) {
-        print_error_massage(OP_MIS, getMBTreeNodeLineNo(node));
-      }
+      type = saExp(getNodeKid(node, 0), NOT_LVALUE);
       break;
     case _NOT:
       // Exp -> NOT Exp
-      type = saExp(child->nextSibling, NOT_LVALUE);
+      type = saExp(getNodeKid(node, 0), NOT_LVALUE);
       if (type == NULL || type->kind != BASIC ||
           type->basic != BASIC_TYPE_INT) {
-        print_error_massage(OP_MIS, getMBTreeNodeLineNo(node));
+        print_error_massage(OP_MIS, getNodeLineNo(node));
       }
       break;
-    case _ID: {
+    case _Args: {
       // Exp -> ID LP Args RP
       // Exp -> ID LP RP
-      // Exp -> ID
-      char* name = saID(child);
-
-      child = child->nextSibling;
-      if (child != NULL) {
-        HashEntry* he = htFind(ht, name);
-        if (he == NULL) {
-          print_error_massage(UND_FUNC, getMBTreeNodeLineNo(node));
-          break;
-        }
+      char* name = saID(getNodeKid(node, 0));
+
+      HashEntry* he = htFind(ht, name);
+      if (he == NULL) {
+        print_error_massage(UND_FUNC, getNodeLineNo(node));
+        break;
+      }
+      getNodeInfo(node).symbol = he;
 
-        Type* t = htGetEntryVal(he);
+      Type* t = htGetEntryVal(he);
 
-        if (t == NULL || t->kind != FUNCTION) {
-          print_error_massage(NON_FUNC_CALL, getMBTreeNodeLineNo(node));
-          break;
-        }
+      if (t == NULL || t->kind != FUNCTION) {
+        print_error_massage(NON_FUNC_CALL, getNodeLineNo(node));
+        break;
+      }
+
+      if (getNodeKidCount(node) == 2) {
+        // Exp -> ID LP Args RP
+        FieldList* fl = saArgs(getNodeKid(node, 1));
 
-        assert(getMBTreeNodeType(child) == _LP);
-        child = child->nextSibling;
-        if (getMBTreeNodeType(child) == _Args) {
-          // Exp -> ID LP Args RP
-          FieldList* fl = saArgs(child);
-
-          if (!fieldListEqual(t->function.params, fl)) {
-            print_error_massage(PAR_MIS, getMBTreeNodeLineNo(node));
-          }
-
-          freeFieldList(fl);
-
-          assert(getMBTreeNodeType(child->nextSibling) == _RP);
-        } else if (getMBTreeNodeType(child) == _RP) {
-          // Exp -> ID LP RP
-          if (t->function.params != NULL) {
-            print_error_massage(PAR_MIS, getMBTreeNodeLineNo(node));
-          }
-        } else {
-          // error
-          assert(0);
+        if (!fieldListEqual(t->function.params, fl)) {
+          print_error_massage(PAR_MIS, getNodeLineNo(node));
         }
 
-        type = t->function.returnType;
+        freeFieldList(fl);
       } else {
-        HashEntry* he = htFind(ht, name);
-        if (he == NULL) {
-          print_error_massage(UND_VAR, getMBTreeNodeLineNo(node));
-        } else {
-          type = htGetEntryVal(he);
+        // Exp -> ID LP RP
+        if (t->function.params != NULL) {
+          print_error_massage(PAR_MIS, getNodeLineNo(node));
         }
-
-        goto ret;
       }
+
+      type = t->function.returnType;
       break;
     }
+    case _ID: {
+      // Exp -> ID
+      char* name = saID(getNodeKid(node, 0));
+
+      HashEntry* he = htFind(ht, name);
+      if (he == NULL) {
+        print_error_massage(UND_VAR, getNodeLineNo(node));
+      } else {
+        type = htGetEntryVal(he);
+      }
+      getNodeInfo(node).symbol = he;
+      getNodeInfo(node).param = htFind(params, name) != NULL;
+
+      goto ret;
+    }
     case _INT:
       // Exp -> INT
       type = newTypeBasic(BASIC_TYPE_INT);
@@ -800,64 +818,75 @@ static Type* saExp(MBTreeNode* node, int isLvalue) {
   }
 
   if (isLvalue) {
-    print_error_massage(LVAL_REQ, getMBTreeNodeLineNo(node));
+    print_error_massage(LVAL_REQ, getNodeLineNo(node));
   }
 
 ret:
+  getNodeInfo(node).type = type;
   return type;
 }
 
 // analyse the Args node
-static FieldList* saArgs(MBTreeNode* node) {
-  if (node == NULL) return NULL;
-
-  assert(getMBTreeNodeType(node) == _Args);
+static FieldList* saArgs(NodeId node) {
+  if (node == 0) return NULL;
 
-  MBTreeNode* child = node->firstChild;
-  FieldList* fl = newFieldList("", saExp(child, NOT_LVALUE), NULL);
+  assert(getNodeType(node) == _Args);
 
-  MBTreeNode* next = child->nextSibling;
-  if (next == NULL) {
-    // Args -> Exp
-    return fl;
+  // Args -> Exp | Exp COMMA Args
+  FieldList* args = NULL;
+  FieldList** tail = &args;
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    *tail = newFieldList("", saExp(getNodeKid(node, i), NOT_LVALUE), NULL);
+    tail = &(*tail)->next;
   }
 
-  assert(getMBTreeNodeType(next) == _COMMA);
-
-  // Args -> Exp COMMA Args
-  assert(fl->next == NULL);
-  fl->next = saArgs(next->nextSibling);
-
-  return fl;
+  return args;
 }
 
 // analyse the ExtDecList node
-static void saExtDecList(MBTreeNode* node, Type* type) {
-  if (node == NULL) return;
+static void saExtDecList(NodeId node, Type* type) {
+  if (node == 0) return;
+
+  assert(getNodeType(node) == _ExtDecList);
 
-  assert(getMBTreeNodeType(node) == _ExtDecList);
+  // ExtDecList -> VarDec | VarDec COMMA ExtDecList
+  for (uint32_t i = 0; i < getNodeKidCount(node); i++) {
+    NodeId varDec = getNodeKid(node, i);
+    FieldList* fl = saVarDec(varDec, type);
 
-  MBTreeNode* child = node->firstChild;  // VarDec
-  FieldList* fl = saVarDec(child, type);
+    if (define(fl->name, fl->type) == 0) {
+      print_error_massage(RED_VAR, getNodeLineNo(varDec));
+    }
+    resolve(varDec, fl->name);
 
-  if (htReplace(ht, fl->name, fl->type) == 0) {
-    print_error_massage(RED_VAR, getMBTreeNodeLineNo(node));
+    freeFieldList(fl);
   }
+}
 
-  MBTreeNode* next = child->nextSibling;
-  if (next == NULL) {
-    // ExtDecList -> VarDec
-  } else if (getMBTreeNodeType(next) == _COMMA) {
-    // ExtDecList -> VarDec COMMA ExtDecList
-    saExtDecList(next->nextSibling, type);
-  } else {
-    // error
-    assert(0);
+// bind name to a copy of type, return 0 if it was bound already; unlike
+// htReplace the type it was bound to is kept, the nodes resolved so far
+// point into it
+static int define(char* name, Type* type) {
+  HashEntry* he = htFind(ht, name);
+  if (he == NULL) {
+    htAdd(ht, name, type);
+    return 1;
   }
+  htGetEntryVal(he) = copyType[type->kind](type);
+  return 0;
+}
 
-  freeFieldList(fl);
+// record the symbol table entry the name declared at node is in
+static void resolve(NodeId node, char* name) {
+  getNodeInfo(node).symbol = htFind(ht, name);
+}
+
+// pass a part that was just checked on, unless an error was found
+static void emitPart(NodeId node) {
+  if (emit && node != 0 && errors == 0) emit(node);
 }
 
 static void print_error_massage(int code, int line) {
+  errors++;
   printf("Error type %d at Line %d: %s\n", code, line, error_msg[code]);
 }
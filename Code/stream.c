@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include "data.h"
+#include "list.h"
+
+extern int has_error;
+extern int translateEnabled;
+extern void beginSemanticAnalysis();
+extern int semanticAnalysisExtDef(NodeId node);
+extern List* IRGenerateExtDef(NodeId node);
+
+// set by beginStream, streamExtDef passes the ExtDefs through until then
+static int streaming = 0;
+static FILE* out = NULL;
+static FILE* irOut = NULL;
+// the end of the tree before the ExtDef being parsed
+static AstMark mark;
+
+static void compile(NodeId extDef);
+
+// compile each ExtDef as soon as it is parsed, into fout and irout if not
+// NULL, so only the nodes of one ExtDef are kept at a time
+void beginStream(FILE* fout, FILE* irout) {
+  streaming = 1;
+  out = fout;
+  irOut = irout;
+  beginSemanticAnalysis();
+  MIPS32Prelude(out);
+  mark = markAst();
+}
+
+// called by the parser for every ExtDef it makes; when streaming, check,
+// translate and write it, then drop its nodes and return 0 for the tree.
+// The lookahead token, if the parser has read one, may be a leaf made after
+// the ExtDef, it is kept
+NodeId streamExtDef(NodeId extDef, NodeId* lookahead) {
+  // after a syntax error the nodes on the stack may be anywhere, the tree is
+  // dropped anyway
+  if (!streaming || has_error) return extDef;
+
+  semanticAnalysisExtDef(extDef);
+  if (translateEnabled) compile(extDef);
+
+  if (lookahead && *lookahead > extDef && *lookahead < ast.nnodes) {
+    *lookahead = releaseAst(mark, *lookahead);
+  } else {
+    releaseAst(mark, 0);
+  }
+  return 0;
+}
+
+// return 1 if what was written is the whole program, it is not after a
+// syntax error or once a construct that cannot be translated is met
+int endStream() {
+  streaming = 0;
+  if (has_error || !translateEnabled) return 0;
+  MIPS32Counters(out);
+  return 1;
+}
+
+static void compile(NodeId extDef) {
+  List* ir = IRGenerateExtDef(extDef);
+  if (ir->head == NULL) {
+    freeList(ir);
+    return;
+  }
+
+  ir = IROptimize(ir);
+  if (irOut) displayIRCodeList(ir, irOut);
+  MIPS32GenerateCodes(ir, out);
+
+  freeList(ir);
+  arenaReset(&irArena);
+}
@@ -1,5 +1,5 @@
 %{
-#define YYSTYPE MBTreeNode*
+#define YYSTYPE NodeId
 #define YYDEBUG 1
 
 #include <stdio.h>
@@ -7,8 +7,12 @@
 #include "lex.yy.c"
 
 extern int error_line;
-extern MBTreeNode* root;
+extern NodeId root;
 void yyerror(const char* msg);
+
+// an ExtDef is compiled and dropped as soon as it is made when streaming
+#define STREAM(node) \
+    streamExtDef(node, yychar == YYEMPTY ? NULL : &yylval)
 %}
 
 %locations
@@ -55,59 +59,59 @@ void yyerror(const char* msg);
 
 %%
 
-Program : ExtDefList                            {$$ = newMBTreeNodeData(VAL_EMPTY, _Program, @$.first_line); addMBTreeNode($$, $1, NULL); root = $$;}
+Program : ExtDefList                            {$$ = newAstNode(_Program, _Empty, @$.first_line, 1, $1); root = $$;}
     ;
-ExtDefList : ExtDef ExtDefList                  {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDefList, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    |                                           {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDefList, @$.first_line); addMBTreeNode($$, newMBTreeNodeData(VAL_EMPTY, _Empty, -1), NULL);}
+ExtDefList : ExtDef ExtDefList                  {$$ = prependAstNode($2, $1, @$.first_line);}
+    |                                           {$$ = newAstList(_ExtDefList, @$.first_line);}
     ;
-ExtDef : Specifier ExtDecList SEMI              {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDef, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Specifier SEMI                            {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDef, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    | Specifier FunDec CompSt                   {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDef, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
+ExtDef : Specifier ExtDecList SEMI              {$$ = STREAM(newAstNode(_ExtDef, _Empty, @$.first_line, 2, $1, $2));}
+    | Specifier SEMI                            {$$ = STREAM(newAstNode(_ExtDef, _Empty, @$.first_line, 1, $1));}
+    | Specifier FunDec CompSt                   {$$ = STREAM(newAstNode(_ExtDef, _Empty, @$.first_line, 3, $1, $2, $3));}
     | error SEMI
     | Specifier error SEMI
     | error Specifier SEMI
     ;
-ExtDecList : VarDec                             {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDecList, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | VarDec COMMA ExtDecList                   {$$ = newMBTreeNodeData(VAL_EMPTY, _ExtDecList, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);};
+ExtDecList : VarDec                             {$$ = prependAstNode(newAstList(_ExtDecList, @$.first_line), $1, @$.first_line);}
+    | VarDec COMMA ExtDecList                   {$$ = prependAstNode($3, $1, @$.first_line);};
     | VarDec error ExtDefList
     ;
-Specifier : TYPE                                {$$ = newMBTreeNodeData(VAL_EMPTY, _Specifier, @$.first_line); addMBTreeNode($$, $1,NULL);}
-    | StructSpecifier                           {$$ = newMBTreeNodeData(VAL_EMPTY, _Specifier, @$.first_line); addMBTreeNode($$, $1, NULL);}
+Specifier : TYPE                                {$$ = newAstNode(_Specifier, _Empty, @$.first_line, 1, $1);}
+    | StructSpecifier                           {$$ = newAstNode(_Specifier, _Empty, @$.first_line, 1, $1);}
     ;                 
-StructSpecifier : STRUCT OptTag LC DefList RC   {$$ = newMBTreeNodeData(VAL_EMPTY, _StructSpecifier, @$.first_line); addMBTreeNode($$, $5, $4, $3, $2, $1, NULL);}
-    | STRUCT Tag                                {$$ = newMBTreeNodeData(VAL_EMPTY, _StructSpecifier, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
+StructSpecifier : STRUCT OptTag LC DefList RC   {$$ = newAstNode(_StructSpecifier, _Empty, @$.first_line, 2, $2, $4);}
+    | STRUCT Tag                                {$$ = newAstNode(_StructSpecifier, _Empty, @$.first_line, 1, $2);}
     | STRUCT OptTag LC DefList error RC
     ;             
-OptTag : ID                                     {$$ = newMBTreeNodeData(VAL_EMPTY, _OptTag, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    |                                           {$$ = newMBTreeNodeData(VAL_EMPTY, _OptTag, @$.first_line); addMBTreeNode($$, newMBTreeNodeData(VAL_EMPTY, _Empty, -1), NULL);}
+OptTag : ID                                     {$$ = newAstNode(_OptTag, _Empty, @$.first_line, 1, $1);}
+    |                                           {$$ = newAstNode(_OptTag, _Empty, @$.first_line, 0);}
     ;               
-Tag : ID                                        {$$ = newMBTreeNodeData(VAL_EMPTY, _Tag, @$.first_line); addMBTreeNode($$, $1, NULL);}
+Tag : ID                                        {$$ = newAstNode(_Tag, _Empty, @$.first_line, 1, $1);}
     ;
-VarDec : ID                                     {$$ = newMBTreeNodeData(VAL_EMPTY, _VarDec, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | VarDec LB INT RB                          {$$ = newMBTreeNodeData(VAL_EMPTY, _VarDec, @$.first_line); addMBTreeNode($$,$4,$3,$2,$1, NULL); }
+VarDec : ID                                     {$$ = newAstNode(_VarDec, _Empty, @$.first_line, 1, $1);}
+    | VarDec LB INT RB                          {$$ = newAstNode(_VarDec, _Empty, @$.first_line, 2, $1, $3);}
     | VarDec LB error RB
     ;               
-FunDec : ID LP VarList RP                       {$$ = newMBTreeNodeData(VAL_EMPTY, _FunDec, @$.first_line); addMBTreeNode($$, $4,$3,$2,$1, NULL);}
-    | ID LP RP                                  {$$ = newMBTreeNodeData(VAL_EMPTY, _FunDec, @$.first_line); addMBTreeNode($$, $3,$2,$1, NULL);}
+FunDec : ID LP VarList RP                       {$$ = newAstNode(_FunDec, _Empty, @$.first_line, 2, $1, $3);}
+    | ID LP RP                                  {$$ = newAstNode(_FunDec, _Empty, @$.first_line, 1, $1);}
     | ID LP error RP
     | error LP VarList RP
     ;    
-VarList : ParamDec COMMA VarList                {$$ = newMBTreeNodeData(VAL_EMPTY, _VarList, @$.first_line); addMBTreeNode($$, $3,$2, $1, NULL);}
-    | ParamDec                                  {$$ = newMBTreeNodeData(VAL_EMPTY, _VarList, @$.first_line); addMBTreeNode($$, $1, NULL);}
+VarList : ParamDec COMMA VarList                {$$ = prependAstNode($3, $1, @$.first_line);}
+    | ParamDec                                  {$$ = prependAstNode(newAstList(_VarList, @$.first_line), $1, @$.first_line);}
     ;            
-ParamDec : Specifier VarDec                     {$$ = newMBTreeNodeData(VAL_EMPTY, _ParamDec, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
+ParamDec : Specifier VarDec                     {$$ = newAstNode(_ParamDec, _Empty, @$.first_line, 2, $1, $2);}
     ; 
-CompSt : LC DefList StmtList RC                 {$$ = newMBTreeNodeData(VAL_EMPTY, _CompSt, @$.first_line); addMBTreeNode($$, $4, $3, $2, $1, NULL);}
+CompSt : LC DefList StmtList RC                 {$$ = newAstNode(_CompSt, _Empty, @$.first_line, 2, $2, $3);}
     ;               
-StmtList : Stmt StmtList                        {$$ = newMBTreeNodeData(VAL_EMPTY, _StmtList, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    |                                           {$$ = newMBTreeNodeData(VAL_EMPTY, _StmtList, @$.first_line); addMBTreeNode($$, newMBTreeNodeData(VAL_EMPTY, _Empty, -1), NULL);}
+StmtList : Stmt StmtList                        {$$ = prependAstNode($2, $1, @$.first_line);}
+    |                                           {$$ = newAstList(_StmtList, @$.first_line);}
     ;               
-Stmt : Exp SEMI                                 {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    | CompSt                                    {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | RETURN Exp SEMI                           {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $3, $2,$1, NULL);}
-    | IF LP Exp RP Stmt %prec LOWER_THAN_ELSE   {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $5, $4, $3, $2, $1, NULL);}
-    | IF LP Exp RP Stmt ELSE Stmt               {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $7, $6, $5, $4, $3, $2, $1, NULL);}
-    | WHILE LP Exp RP Stmt                      {$$ = newMBTreeNodeData(VAL_EMPTY, _Stmt, @$.first_line); addMBTreeNode($$, $5, $4, $3, $2, $1, NULL);}
+Stmt : Exp SEMI                                 {$$ = newAstNode(_Stmt, _Exp, @$.first_line, 1, $1);}
+    | CompSt                                    {$$ = newAstNode(_Stmt, _CompSt, @$.first_line, 1, $1);}
+    | RETURN Exp SEMI                           {$$ = newAstNode(_Stmt, _RETURN, @$.first_line, 1, $2);}
+    | IF LP Exp RP Stmt %prec LOWER_THAN_ELSE   {$$ = newAstNode(_Stmt, _IF, @$.first_line, 2, $3, $5);}
+    | IF LP Exp RP Stmt ELSE Stmt               {$$ = newAstNode(_Stmt, _IF, @$.first_line, 3, $3, $5, $7);}
+    | WHILE LP Exp RP Stmt                      {$$ = newAstNode(_Stmt, _WHILE, @$.first_line, 2, $3, $5);}
     | error SEMI
     | error Stmt
     | WHILE LP error RP Stmt
@@ -115,37 +119,37 @@ Stmt : Exp SEMI                                 {$$ = newMBTreeNodeData(VAL_EMPT
     | IF LP error RP Stmt ELSE Stmt
     | Exp error
     ;               
-DefList : Def DefList                           {$$ = newMBTreeNodeData(VAL_EMPTY, _DefList, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    |                                           {$$ = newMBTreeNodeData(VAL_EMPTY, _DefList, @$.first_line); addMBTreeNode($$, newMBTreeNodeData(VAL_EMPTY, _Empty, -1), NULL);}
+DefList : Def DefList                           {$$ = prependAstNode($2, $1, @$.first_line);}
+    |                                           {$$ = newAstList(_DefList, @$.first_line);}
     ;               
-Def : Specifier DecList SEMI                    {$$ = newMBTreeNodeData(VAL_EMPTY, _Def, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
+Def : Specifier DecList SEMI                    {$$ = newAstNode(_Def, _Empty, @$.first_line, 2, $1, $2);}
     | Specifier error SEMI
     | Specifier DecList error
     ;             
-DecList : Dec                                   {$$ = newMBTreeNodeData(VAL_EMPTY, _DecList, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | Dec COMMA DecList                         {$$ = newMBTreeNodeData(VAL_EMPTY, _DecList, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
+DecList : Dec                                   {$$ = prependAstNode(newAstList(_DecList, @$.first_line), $1, @$.first_line);}
+    | Dec COMMA DecList                         {$$ = prependAstNode($3, $1, @$.first_line);}
     ;          
-Dec : VarDec                                    {$$ = newMBTreeNodeData(VAL_EMPTY, _Dec, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | VarDec ASSIGNOP Exp                       {$$ = newMBTreeNodeData(VAL_EMPTY, _Dec, @$.first_line); addMBTreeNode($$, $3,$2, $1, NULL);}
+Dec : VarDec                                    {$$ = newAstNode(_Dec, _Empty, @$.first_line, 1, $1);}
+    | VarDec ASSIGNOP Exp                       {$$ = newAstNode(_Dec, _Empty, @$.first_line, 2, $1, $3);}
     ;
-Exp : Exp ASSIGNOP Exp                          {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp AND Exp                               {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp OR Exp                                {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp RELOP Exp                             {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp PLUS Exp                              {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp MINUS Exp                             {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp STAR Exp                              {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp DIV Exp                               {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | LP Exp RP                                 {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | MINUS Exp                                 {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    | NOT Exp                                   {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $2, $1, NULL);}
-    | ID LP Args RP                             {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $4, $3, $2, $1, NULL);}
-    | ID LP RP                                  {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp LB Exp RB                             {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $4, $3, $2, $1, NULL);}
-    | Exp DOT ID                                {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | ID                                        {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | INT                                       {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $1, NULL);}
-    | FLOAT                                     {$$ = newMBTreeNodeData(VAL_EMPTY, _Exp, @$.first_line); addMBTreeNode($$, $1, NULL);}
+Exp : Exp ASSIGNOP Exp                          {$$ = newAstNode(_Exp, _ASSIGNOP, @$.first_line, 2, $1, $3);}
+    | Exp AND Exp                               {$$ = newAstNode(_Exp, _AND, @$.first_line, 2, $1, $3);}
+    | Exp OR Exp                                {$$ = newAstNode(_Exp, _OR, @$.first_line, 2, $1, $3);}
+    | Exp RELOP Exp                             {$$ = newAstNode(_Exp, _RELOP, @$.first_line, 2, $1, $3); getNodeValue($$) = getNodeValue($2);}
+    | Exp PLUS Exp                              {$$ = newAstNode(_Exp, _PLUS, @$.first_line, 2, $1, $3);}
+    | Exp MINUS Exp                             {$$ = newAstNode(_Exp, _MINUS, @$.first_line, 2, $1, $3);}
+    | Exp STAR Exp                              {$$ = newAstNode(_Exp, _STAR, @$.first_line, 2, $1, $3);}
+    | Exp DIV Exp                               {$$ = newAstNode(_Exp, _DIV, @$.first_line, 2, $1, $3);}
+    | LP Exp RP                                 {$$ = newAstNode(_Exp, _LP, @$.first_line, 1, $2);}
+    | MINUS Exp                                 {$$ = newAstNode(_Exp, _MINUS, @$.first_line, 1, $2);}
+    | NOT Exp                                   {$$ = newAstNode(_Exp, _NOT, @$.first_line, 1, $2);}
+    | ID LP Args RP                             {$$ = newAstNode(_Exp, _Args, @$.first_line, 2, $1, $3);}
+    | ID LP RP                                  {$$ = newAstNode(_Exp, _Args, @$.first_line, 1, $1);}
+    | Exp LB Exp RB                             {$$ = newAstNode(_Exp, _LB, @$.first_line, 2, $1, $3);}
+    | Exp DOT ID                                {$$ = newAstNode(_Exp, _DOT, @$.first_line, 2, $1, $3);}
+    | ID                                        {$$ = newAstNode(_Exp, _ID, @$.first_line, 1, $1);}
+    | INT                                       {$$ = newAstNode(_Exp, _INT, @$.first_line, 1, $1);}
+    | FLOAT                                     {$$ = newAstNode(_Exp, _FLOAT, @$.first_line, 1, $1);}
     | Exp ASSIGNOP error
     | Exp PLUS error
     | Exp MINUS error
@@ -159,8 +163,8 @@ Exp : Exp ASSIGNOP Exp                          {$$ = newMBTreeNodeData(VAL_EMPT
     | LP error RP
     | ID LP error RP
     ;               
-Args : Exp COMMA Args                           {$$ = newMBTreeNodeData(VAL_EMPTY, _Args, @$.first_line); addMBTreeNode($$, $3, $2, $1, NULL);}
-    | Exp                                       {$$ = newMBTreeNodeData(VAL_EMPTY, _Args, @$.first_line); addMBTreeNode($$, $1, NULL);}
+Args : Exp COMMA Args                           {$$ = prependAstNode($3, $1, @$.first_line);}
+    | Exp                                       {$$ = prependAstNode(newAstList(_Args, @$.first_line), $1, @$.first_line);}
     | error COMMA Args
     ;               
 
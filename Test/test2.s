@@ -0,0 +1,41 @@
+.data
+_prompt: .asciiz "Enter an integer:"
+_ret: .asciiz "\n"
+.globl main
+.text
+
+read:
+	li $v0, 4
+	la $a0, _prompt
+	syscall
+	li $v0, 5
+	syscall
+	jr $ra
+
+write:
+	li $v0, 1
+	syscall
+	li $v0, 4
+	la $a0, _ret
+	syscall
+	move $v0, $0
+	jr $ra
+
+func_g:
+	addiu $sp, $sp, -8
+	sw $ra, 4($sp)
+	sw $s0, 0($sp)
+	move $s0, $a0
+	move $a0, $s0
+	jal write
+	lw $ra, 4($sp)
+	move $v0, $s0
+	lw $s0, 0($sp)
+	addiu $sp, $sp, 8
+	jr $ra
+
+main:
+	addiu $sp, $sp, -4
+	sw $ra, 0($sp)
+	li $a0, 5
+	jal func_g
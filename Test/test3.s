@@ -0,0 +1,93 @@
+.data
+_prompt: .asciiz "Enter an integer:"
+_ret: .asciiz "\n"
+.globl main
+.text
+
+read:
+	li $v0, 4
+	la $a0, _prompt
+	syscall
+	li $v0, 5
+	syscall
+	jr $ra
+
+write:
+	li $v0, 1
+	syscall
+	li $v0, 4
+	la $a0, _ret
+	syscall
+	move $v0, $0
+	jr $ra
+
+func_alias:
+	move $t5, $zero
+	move $t4, $zero
+	blez $a2, l3
+	li $t0, -2147483645
+	slt $t0, $a2, $t0
+	addiu $t6, $a2, -3
+	bne $t0, $zero, l5
+	blez $t6, l5
+l6:
+	lw $t0, 0($a0)
+	addiu $t4, $t4, 1
+	addu $t5, $t5, $t0
+	lw $t0, 0($a1)
+	addiu $t4, $t4, 1
+	addiu $t0, $t0, 1
+	sw $t0, 0($a1)
+	lw $t0, 0($a0)
+	addiu $t4, $t4, 1
+	addu $t5, $t5, $t0
+	lw $t0, 0($a1)
+	addiu $t4, $t4, 1
+	addiu $t0, $t0, 1
+	sw $t0, 0($a1)
+	lw $t0, 0($a0)
+	addu $t5, $t5, $t0
+	lw $t0, 0($a1)
+	addiu $t0, $t0, 1
+	sw $t0, 0($a1)
+	lw $t0, 0($a0)
+	addu $t5, $t5, $t0
+	lw $t0, 0($a1)
+	addiu $t0, $t0, 1
+	sw $t0, 0($a1)
+	slt $t0, $t4, $t6
+	bne $t0, $zero, l6
+	slt $t0, $t4, $a2
+	beq $t0, $zero, l3
+l5:
+	lw $t0, 0($a0)
+	addiu $t4, $t4, 1
+	addu $t5, $t5, $t0
+	lw $t0, 0($a1)
+	addiu $t0, $t0, 1
+	sw $t0, 0($a1)
+	slt $t0, $t4, $a2
+	bne $t0, $zero, l5
+l3:
+	move $v0, $t5
+	jr $ra
+
+main:
+	addiu $sp, $sp, -16
+	sw $s0, 8($sp)
+	addiu $s0, $sp, 0
+	li $t0, 1
+	sw $ra, 12($sp)
+	sw $t0, 0($s0)
+	li $a2, 5
+	move $a1, $s0
+	move $a0, $s0
+	jal func_alias
+	sw $v0, 4($sp) # t2
+	lw $a0, 4($sp) # t2
+	jal write
+	lw $ra, 12($sp)
+	lw $s0, 8($sp)
+	move $v0, $zero
+	addiu $sp, $sp, 16
+	jr $ra
@@ -0,0 +1,34 @@
+.data
+_prompt: .asciiz "Enter an integer:"
+_ret: .asciiz "\n"
+.globl main
+.text
+
+read:
+	li $v0, 4
+	la $a0, _prompt
+	syscall
+	li $v0, 5
+	syscall
+	jr $ra
+
+write:
+	li $v0, 1
+	syscall
+	li $v0, 4
+	la $a0, _ret
+	syscall
+	move $v0, $0
+	jr $ra
+
+func_nothing:
+
+main:
+	addiu $sp, $sp, -4
+	sw $ra, 0($sp)
+	li $a0, 1
+	jal write
+	lw $ra, 0($sp)
+	move $v0, $zero
+	addiu $sp, $sp, 4
+	jr $ra